@@ -41,6 +41,7 @@
 
 #include <dev/flash.h>
 #include <lib/ptable.h>
+#include <lib/bootparam.h>
 #include <dev/keys.h>
 #include <dev/fbcon.h>
 #include <baseband.h>
@@ -51,6 +52,10 @@
 #include <crypto_hash.h>
 #include <malloc.h>
 #include <boot_stats.h>
+#if WITH_LIB_MEMTEST
+#include <err.h>
+#include <lib/memtest.h>
+#endif
 
 #if DEVICE_TREE
 #include <libfdt.h>
@@ -73,8 +78,7 @@ extern void dsb();
 extern void isb();
 extern void platform_uninit(void);
 
-void write_device_info_mmc(device_info *dev);
-void write_device_info_flash(device_info *dev);
+void write_device_info(device_info *dev);
 
 #define EXPAND(NAME) #NAME
 #define TARGET(NAME) EXPAND(NAME)
@@ -85,6 +89,9 @@ void write_device_info_flash(device_info *dev);
 #define EMMC_BOOT_IMG_HEADER_ADDR 0xFF000
 #endif
 
+/* Room for the boot image command line and what is appended to it */
+#define ATAG_CMDLINE_MAX	(BOOT_ARGS_SIZE + 512)
+
 #define RECOVERY_MODE   0x77665502
 #define FASTBOOT_MODE   0x77665500
 
@@ -181,190 +188,88 @@ static void ptentry_to_tag(unsigned **ptr, struct ptentry *ptn)
 	*ptr += sizeof(struct atag_ptbl_entry) / sizeof(unsigned);
 }
 
-unsigned char *update_cmdline(const char * cmdline)
+/*
+ * Build the kernel command line into buf: the boot image's own, then what
+ * the bootloader adds. Used as a dt_cmdline_fill, so arg is the boot image
+ * command line. Returns the bytes used including the nul.
+ */
+static unsigned build_cmdline(char *buf, unsigned size, void *arg)
 {
-	int cmdline_len = 0;
-	int have_cmdline = 0;
-	unsigned char *cmdline_final = NULL;
-	int pause_at_bootup = 0;
+	const char *cmdline = arg;
+	struct bootparam bp;
+	unsigned len;
 	char ffbm[10];
 	bool boot_into_ffbm = get_ffbm(ffbm, sizeof(ffbm));
 
-	if (cmdline && cmdline[0]) {
-		cmdline_len = strlen(cmdline);
-		have_cmdline = 1;
-	}
-	if (target_is_emmc_boot()) {
-		cmdline_len += strlen(emmc_cmdline);
-	}
+	bootparam_init(&bp, buf, size);
+
+	if (cmdline && cmdline[0])
+		bootparam_add(&bp, cmdline);
+
+	if (target_is_emmc_boot())
+		bootparam_add(&bp, emmc_cmdline);
 
-	cmdline_len += strlen(usb_sn_cmdline);
-	cmdline_len += strlen(sn_buf);
+	bootparam_add(&bp, usb_sn_cmdline);
+	bootparam_add(&bp, sn_buf);
 
 	if (boot_into_ffbm) {
-		cmdline_len += strlen(androidboot_mode);
-		cmdline_len += strlen(ffbm);
+		bootparam_add(&bp, androidboot_mode);
+		bootparam_add(&bp, ffbm);
 		/* reduce kernel console messages to speed-up boot */
-		cmdline_len += strlen(loglevel);
+		bootparam_add(&bp, loglevel);
 	} else if (target_pause_for_battery_charge()) {
-		pause_at_bootup = 1;
-		cmdline_len += strlen(battchg_pause);
+		bootparam_add(&bp, battchg_pause);
 	}
 
 	if(target_use_signed_kernel() && auth_kernel_img) {
-		cmdline_len += strlen(auth_kernel);
+		bootparam_add(&bp, auth_kernel);
 	}
 
 	/* Determine correct androidboot.baseband to use */
 	switch(target_baseband())
 	{
 		case BASEBAND_APQ:
-			cmdline_len += strlen(baseband_apq);
+			bootparam_add(&bp, baseband_apq);
 			break;
 
 		case BASEBAND_MSM:
-			cmdline_len += strlen(baseband_msm);
+			bootparam_add(&bp, baseband_msm);
 			break;
 
 		case BASEBAND_CSFB:
-			cmdline_len += strlen(baseband_csfb);
+			bootparam_add(&bp, baseband_csfb);
 			break;
 
 		case BASEBAND_SVLTE2A:
-			cmdline_len += strlen(baseband_svlte2a);
+			bootparam_add(&bp, baseband_svlte2a);
 			break;
 
 		case BASEBAND_MDM:
-			cmdline_len += strlen(baseband_mdm);
+			bootparam_add(&bp, baseband_mdm);
 			break;
 
 		case BASEBAND_SGLTE:
-			cmdline_len += strlen(baseband_sglte);
+			bootparam_add(&bp, baseband_sglte);
 			break;
 
 		case BASEBAND_SGLTE2:
-			cmdline_len += strlen(baseband_sglte2);
+			bootparam_add(&bp, baseband_sglte2);
 			break;
 
 		case BASEBAND_DSDA:
-			cmdline_len += strlen(baseband_dsda);
+			bootparam_add(&bp, baseband_dsda);
 			break;
 
 		case BASEBAND_DSDA2:
-			cmdline_len += strlen(baseband_dsda2);
+			bootparam_add(&bp, baseband_dsda2);
 			break;
 	}
 
-	if (cmdline_len > 0) {
-		const char *src;
-		unsigned char *dst = (unsigned char*) malloc((cmdline_len + 4) & (~3));
-		ASSERT(dst != NULL);
-
-		/* Save start ptr for debug print */
-		cmdline_final = dst;
-		if (have_cmdline) {
-			src = cmdline;
-			while ((*dst++ = *src++));
-		}
-		if (target_is_emmc_boot()) {
-			src = emmc_cmdline;
-			if (have_cmdline) --dst;
-			have_cmdline = 1;
-			while ((*dst++ = *src++));
-		}
-
-		src = usb_sn_cmdline;
-		if (have_cmdline) --dst;
-		have_cmdline = 1;
-		while ((*dst++ = *src++));
-		src = sn_buf;
-		if (have_cmdline) --dst;
-		have_cmdline = 1;
-		while ((*dst++ = *src++));
-
-		if (boot_into_ffbm) {
-			src = androidboot_mode;
-			if (have_cmdline) --dst;
-			while ((*dst++ = *src++));
-			src = ffbm;
-			if (have_cmdline) --dst;
-			while ((*dst++ = *src++));
-			src = loglevel;
-			if (have_cmdline) --dst;
-			while ((*dst++ = *src++));
-		} else if (pause_at_bootup) {
-			src = battchg_pause;
-			if (have_cmdline) --dst;
-			while ((*dst++ = *src++));
-		}
-
-		if(target_use_signed_kernel() && auth_kernel_img) {
-			src = auth_kernel;
-			if (have_cmdline) --dst;
-			while ((*dst++ = *src++));
-		}
-
-		switch(target_baseband())
-		{
-			case BASEBAND_APQ:
-				src = baseband_apq;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_MSM:
-				src = baseband_msm;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_CSFB:
-				src = baseband_csfb;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_SVLTE2A:
-				src = baseband_svlte2a;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_MDM:
-				src = baseband_mdm;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_SGLTE:
-				src = baseband_sglte;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_SGLTE2:
-				src = baseband_sglte2;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_DSDA:
-				src = baseband_dsda;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-
-			case BASEBAND_DSDA2:
-				src = baseband_dsda2;
-				if (have_cmdline) --dst;
-				while ((*dst++ = *src++));
-				break;
-		}
-	}
+	len = bootparam_finish(&bp);
 
-	dprintf(INFO, "cmdline: %s\n", cmdline_final);
+	dprintf(INFO, "cmdline: %s\n", buf);
 
-	return cmdline_final;
+	return len;
 }
 
 unsigned *atag_core(unsigned *ptr)
@@ -406,19 +311,16 @@ unsigned *atag_ptable(unsigned **ptr_addr)
 	return (*ptr_addr);
 }
 
+/* The command line is built straight into the tag */
 unsigned *atag_cmdline(unsigned *ptr, const char *cmdline)
 {
-	int cmdline_length = 0;
 	int n;
-	char *dest;
 
-	cmdline_length = strlen((const char*)cmdline);
-	n = (cmdline_length + 4) & (~3);
+	n = build_cmdline((char *)(ptr + 2), ATAG_CMDLINE_MAX, (void *)cmdline);
+	n = (n + 3) & (~3);
 
 	*ptr++ = (n / 4) + 2;
 	*ptr++ = 0x54410009;
-	dest = (char *) ptr;
-	while ((*dest++ = *cmdline++));
 	ptr += (n / 4);
 
 	return ptr;
@@ -455,7 +357,6 @@ void boot_linux(void *kernel, unsigned *tags,
 		const char *cmdline, unsigned machtype,
 		void *ramdisk, unsigned ramdisk_size)
 {
-	unsigned char *final_cmdline;
 #if DEVICE_TREE
 	int ret = 0;
 #endif
@@ -465,13 +366,12 @@ void boot_linux(void *kernel, unsigned *tags,
 
 	ramdisk = PA(ramdisk);
 
-	final_cmdline = update_cmdline((const char*)cmdline);
-
 #if DEVICE_TREE
 	dprintf(INFO, "Updating device tree: start\n");
 
 	/* Update the Device Tree */
-	ret = update_device_tree((void *)tags, final_cmdline, ramdisk, ramdisk_size);
+	ret = update_device_tree((void *)tags, build_cmdline, (void *)cmdline,
+				 ramdisk, ramdisk_size);
 	if(ret)
 	{
 		dprintf(CRITICAL, "ERROR: Updating Device Tree Failed \n");
@@ -480,7 +380,7 @@ void boot_linux(void *kernel, unsigned *tags,
 	dprintf(INFO, "Updating device tree: done\n");
 #else
 	/* Generating the Atags */
-	generate_atags(tags, final_cmdline, ramdisk, ramdisk_size);
+	generate_atags(tags, cmdline, ramdisk, ramdisk_size);
 #endif
 
 	dprintf(INFO, "booting linux @ %p, ramdisk @ %p (%d), tags/device tree @ %p\n",
@@ -684,7 +584,7 @@ int boot_linux_from_mmc(void)
 		/* Make sure everything from scratch address is read before next step!*/
 		if(device.is_tampered)
 		{
-			write_device_info_mmc(&device);
+			write_device_info(&device);
 		#ifdef TZ_TAMPER_FUSE
 			set_tamper_fuse_cmd();
 		#endif
@@ -933,7 +833,7 @@ int boot_linux_from_flash(void)
 		/* Make sure everything from scratch address is read before next step!*/
 		if(device.is_tampered)
 		{
-			write_device_info_flash(&device);
+			write_device_info(&device);
 		}
 #if USE_PCOM_SECBOOT
 		set_tamper_flag(device.is_tampered);
@@ -1020,152 +920,122 @@ continue_boot:
 	return 0;
 }
 
+/*
+ * Device state lives in the device_info block every bootloader uses: the
+ * last block of aboot on eMMC, the first page of devinfo on NAND. It is
+ * read once into devinfo_state and written through on every change, and a
+ * write that would not change the state is dropped.
+ */
 BUF_DMA_ALIGN(info_buf, 4096);
-void write_device_info_mmc(device_info *dev)
-{
-	struct device_info *info = (void*) info_buf;
-	unsigned long long ptn = 0;
-	unsigned long long size;
-	int index = INVALID_PTN;
+static device_info devinfo_state;
+static unsigned long long devinfo_offset;
+static struct ptentry *devinfo_ptn;
+static bool devinfo_loaded;
 
-	index = partition_get_index("aboot");
-	ptn = partition_get_offset(index);
-	if(ptn == 0)
-	{
-		return;
-	}
+static int read_device_info_block(void)
+{
+	if (target_is_emmc_boot())
+		return mmc_read(devinfo_offset, (void *)info_buf, 512);
+	else
+		return flash_read(devinfo_ptn, 0, (void *)info_buf, page_size);
+}
 
-	size = partition_get_size(index);
+static int write_device_info_block(device_info *dev)
+{
+	struct device_info *info = (void*) info_buf;
 
+	memset(info_buf, 0, sizeof(info_buf));
 	memcpy(info, dev, sizeof(device_info));
 
-	if(mmc_write((ptn + size - 512), 512, (void *)info_buf))
-	{
-		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
-		return;
-	}
+	if (target_is_emmc_boot())
+		return mmc_write(devinfo_offset, 512, (void *)info_buf);
+	else
+		return flash_write(devinfo_ptn, 0, (void *)info_buf, page_size);
 }
 
-void read_device_info_mmc(device_info *dev)
+static bool open_device_info(void)
 {
 	struct device_info *info = (void*) info_buf;
+	struct ptable *ptable;
 	unsigned long long ptn = 0;
-	unsigned long long size;
 	int index = INVALID_PTN;
 
-	index = partition_get_index("aboot");
-	ptn = partition_get_offset(index);
-	if(ptn == 0)
-	{
-		return;
-	}
+	if (devinfo_loaded)
+		return true;
 
-	size = partition_get_size(index);
-
-	if(mmc_read((ptn + size - 512), (void *)info_buf, 512))
+	if (target_is_emmc_boot())
 	{
-		dprintf(CRITICAL, "ERROR: Cannot read device info\n");
-		return;
-	}
+		index = partition_get_index("aboot");
+		ptn = partition_get_offset(index);
+		if(ptn == 0)
+		{
+			dprintf(CRITICAL, "ERROR: No aboot partition found\n");
+			return false;
+		}
 
-	if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
+		devinfo_offset = ptn + partition_get_size(index) - 512;
+	}
+	else
 	{
-		memcpy(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
-		info->is_unlocked = 0;
-		info->is_tampered = 0;
+		ptable = flash_get_ptable();
+		if (ptable == NULL)
+		{
+			dprintf(CRITICAL, "ERROR: Partition table not found\n");
+			return false;
+		}
 
-		write_device_info_mmc(info);
+		devinfo_ptn = ptable_find(ptable, "devinfo");
+		if (devinfo_ptn == NULL)
+		{
+			dprintf(CRITICAL, "ERROR: No devinfo partition found\n");
+			return false;
+		}
 	}
-	memcpy(dev, info, sizeof(device_info));
-}
-
-void write_device_info_flash(device_info *dev)
-{
-	struct device_info *info = (void *) info_buf;
-	struct ptentry *ptn;
-	struct ptable *ptable;
 
-	ptable = flash_get_ptable();
-	if (ptable == NULL)
+	if (read_device_info_block())
 	{
-		dprintf(CRITICAL, "ERROR: Partition table not found\n");
-		return;
+		dprintf(CRITICAL, "ERROR: Cannot read device info\n");
+		return false;
 	}
 
-	ptn = ptable_find(ptable, "devinfo");
-	if (ptn == NULL)
+	if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
 	{
-		dprintf(CRITICAL, "ERROR: No boot partition found\n");
-			return;
-	}
-
-	memcpy(info, dev, sizeof(device_info));
+		memcpy(devinfo_state.magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
+		devinfo_state.is_unlocked = 0;
+		devinfo_state.is_tampered = 0;
 
-	if (flash_write(ptn, 0, (void *)info_buf, page_size))
-	{
-		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
-			return;
+		if (write_device_info_block(&devinfo_state))
+			dprintf(CRITICAL, "ERROR: Cannot write device info\n");
 	}
+	else
+		memcpy(&devinfo_state, info, sizeof(device_info));
+
+	devinfo_loaded = true;
+	return true;
 }
 
-void read_device_info_flash(device_info *dev)
+void write_device_info(device_info *dev)
 {
-	struct device_info *info = (void*) info_buf;
-	struct ptentry *ptn;
-	struct ptable *ptable;
+	if (!open_device_info())
+		return;
 
-	ptable = flash_get_ptable();
-	if (ptable == NULL)
-	{
-		dprintf(CRITICAL, "ERROR: Partition table not found\n");
+	if (dev->is_unlocked == devinfo_state.is_unlocked &&
+	    dev->is_tampered == devinfo_state.is_tampered)
 		return;
-	}
 
-	ptn = ptable_find(ptable, "devinfo");
-	if (ptn == NULL)
-	{
-		dprintf(CRITICAL, "ERROR: No boot partition found\n");
-			return;
-	}
+	devinfo_state.is_unlocked = dev->is_unlocked;
+	devinfo_state.is_tampered = dev->is_tampered;
 
-	if (flash_read(ptn, 0, (void *)info_buf, page_size))
-	{
+	if (write_device_info_block(&devinfo_state))
 		dprintf(CRITICAL, "ERROR: Cannot write device info\n");
-			return;
-	}
-
-	if (memcmp(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE))
-	{
-		memcpy(info->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
-		info->is_unlocked = 0;
-		info->is_tampered = 0;
-		write_device_info_flash(info);
-	}
-	memcpy(dev, info, sizeof(device_info));
-}
-
-void write_device_info(device_info *dev)
-{
-	if(target_is_emmc_boot())
-	{
-		write_device_info_mmc(dev);
-	}
-	else
-	{
-		write_device_info_flash(dev);
-	}
 }
 
 void read_device_info(device_info *dev)
 {
-	if(target_is_emmc_boot())
-	{
-		read_device_info_mmc(dev);
-	}
-	else
-	{
-		read_device_info_flash(dev);
-	}
+	if (!open_device_info())
+		return;
+
+	memcpy(dev, &devinfo_state, sizeof(device_info));
 }
 
 void reset_device_info()
@@ -1399,6 +1269,7 @@ void cmd_flash_mmc_img(const char *arg, void *data, unsigned sz)
 		}
 
 		size = partition_get_size(index);
+
 		if (ROUND_TO_PAGE(sz,511) > size) {
 			fastboot_fail("size too large");
 			return;
@@ -1710,6 +1581,63 @@ void cmd_oem_devinfo(const char *arg, void *data, unsigned sz)
 	fastboot_okay("");
 }
 
+#if WITH_LIB_MEMTEST
+static void memtest_info_line(const char *str)
+{
+	fastboot_info(str);
+}
+
+/* oem memtest <base> <len> [pattern mask] [cpu|burst|dma] [seed] */
+void cmd_oem_memtest(const char *arg, void *data, unsigned sz)
+{
+	struct memtest_result res;
+	enum memtest_engine engine = MEMTEST_ENGINE_BURST;
+	uint patterns = MEMTEST_PAT_ALL;
+	unsigned long argv[5] = { 0 };
+	char buf[64];
+	char *tok;
+	int argc = 0;
+	status_t err;
+
+	/* it overwrites whatever ram it is pointed at */
+	if (!device.is_unlocked) {
+		fastboot_fail("device is locked");
+		return;
+	}
+
+	strlcpy(buf, arg, sizeof(buf));
+	for (tok = strtok(buf, " "); tok && argc < 5; tok = strtok(NULL, " "), argc++) {
+		if (argc == 3) {
+			if (!strcmp(tok, "cpu"))
+				engine = MEMTEST_ENGINE_CPU;
+			else if (!strcmp(tok, "dma"))
+				engine = MEMTEST_ENGINE_DMA;
+			continue;
+		}
+		argv[argc] = atoul(tok);
+	}
+
+	if (argc < 2) {
+		fastboot_fail("usage: oem memtest <base> <len> [mask] [engine] [seed]");
+		return;
+	}
+	if (argc > 2)
+		patterns = argv[2];
+
+	err = memtest_run(argv[0], argv[1], patterns, engine, argv[4], &res);
+	if (err == ERR_INVALID_ARGS) {
+		fastboot_fail("nothing to test in range");
+		return;
+	}
+
+	memtest_summarize(&res, memtest_info_line);
+	if (err)
+		fastboot_fail("memory errors found");
+	else
+		fastboot_okay("");
+}
+#endif
+
 void cmd_preflash(const char *arg, void *data, unsigned sz)
 {
 	fastboot_okay("");
@@ -1926,6 +1854,11 @@ void aboot_init(const struct app_descriptor *app)
 	fastboot_register("reboot-bootloader", cmd_reboot_bootloader);
 	fastboot_register("oem unlock", cmd_oem_unlock);
 	fastboot_register("oem device-info", cmd_oem_devinfo);
+#if WITH_LIB_MEMTEST
+	/* memtest skips our own image and heap, keep the download buffer out too */
+	memtest_exclude((addr_t)target_get_scratch_address(), sz);
+	fastboot_register("oem memtest", cmd_oem_memtest);
+#endif
 	fastboot_register("preflash", cmd_preflash);
 	fastboot_publish("product", TARGET(BOARD));
 	fastboot_publish("kernel", "lk");
@@ -71,10 +71,10 @@ static void bench_memcpy(void)
 			libc = bench_memcpy_routine(&memcpy, srcalign, dstalign);
 			mine = bench_memcpy_routine(&mymemcpy, srcalign, dstalign);
 
-			printf("srcalign %lu, dstalign %lu\n", srcalign, dstalign);
-			printf("   null memcpy %u msecs\n", null);
-			printf("   libc memcpy %u msecs, %llu bytes/sec\n", libc, BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
-			printf("   my   memcpy %u msecs, %llu bytes/sec\n", mine, BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
+			printf("srcalign %zu, dstalign %zu\n", srcalign, dstalign);
+			printf("   null memcpy %lu msecs\n", null);
+			printf("   libc memcpy %lu msecs, %llu bytes/sec\n", libc, BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
+			printf("   my   memcpy %lu msecs, %llu bytes/sec\n", mine, BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
 
 			if (dstalign == 0)
 				dstalign = 1;
@@ -192,9 +192,9 @@ static void bench_memset(void)
 		libc = bench_memset_routine(&memset, dstalign);
 		mine = bench_memset_routine(&mymemset, dstalign);
 
-		printf("dstalign %lu\n", dstalign);
-		printf("   libc memset %u msecs, %llu bytes/sec\n", libc, BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
-		printf("   my   memset %u msecs, %llu bytes/sec\n", mine, BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
+		printf("dstalign %zu\n", dstalign);
+		printf("   libc memset %lu msecs, %llu bytes/sec\n", libc, BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
+		printf("   my   memset %lu msecs, %llu bytes/sec\n", mine, BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
 	}
 }
 
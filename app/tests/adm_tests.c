@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <compiler.h>
+#include <platform.h>
+#include <arch/ops.h>
+#include <arch/defines.h>
+#include <kernel/thread.h>
+#include <lib/console.h>
+
+#if PERIPH_BLK_ADM
+#include <adm.h>
+#include <platform/adm.h>
+
+#define ADM_BENCH_CHUNK     (16 * 1024)
+#define ADM_BENCH_CHUNKS    16
+#define ADM_BENCH_ROUNDS    64
+
+struct adm_bench_state {
+	volatile unsigned remaining;	/* transfers still to submit */
+	volatile unsigned inflight;
+	volatile unsigned failed;
+	uint64_t bytes;
+};
+
+static void adm_bench_done(struct adm_xfer *xfer, void *arg)
+{
+	struct adm_bench_state *state = arg;
+
+	if (xfer->result != ADM_RESULT_SUCCESS)
+		state->failed++;
+	else
+		state->bytes += xfer->len;
+
+	/* a resubmitted transfer stays in flight, so the waiter can't see 0 */
+	if (state->remaining && !state->failed) {
+		state->remaining--;
+		if (adm_xfer_submit(xfer, adm_bench_done, state) == NO_ERROR)
+			return;
+		state->failed++;
+	}
+
+	state->inflight--;
+}
+
+static int adm_bench_depth(uint8_t *src, uint8_t *dst, unsigned depth)
+{
+	struct adm_xfer xfer[ADM_MAX_CMDS];
+	struct adm_bench_state state;
+	bigtime_t start, elapsed;
+	uint32_t work = 0;
+	unsigned i, n = 0;
+	int ret = 0;
+
+	memset(dst, 0, ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS);
+	arch_clean_invalidate_cache_range((addr_t) dst, ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS);
+
+	for (n = 0; n < depth; n++) {
+		if (adm_xfer_init(&xfer[n], ADM_CHN)) {
+			dprintf(CRITICAL, "adm_bench: out of descriptors at %u\n", n);
+			ret = 1;
+			goto out;
+		}
+		/* each transfer owns every depth'th chunk, one per submit */
+		for (i = n; i < ADM_BENCH_CHUNKS && xfer[n].ncmds < ADM_MAX_CMDS; i += depth)
+			adm_xfer_add(&xfer[n], (addr_t) src + i * ADM_BENCH_CHUNK,
+				     (addr_t) dst + i * ADM_BENCH_CHUNK,
+				     ADM_BENCH_CHUNK, 0);
+	}
+
+	state.remaining = ADM_BENCH_ROUNDS - depth;
+	state.inflight = 0;
+	state.failed = 0;
+	state.bytes = 0;
+
+	start = current_time_hires();
+
+	enter_critical_section();
+	for (i = 0; i < depth; i++) {
+		if (adm_xfer_submit(&xfer[i], adm_bench_done, &state) == NO_ERROR)
+			state.inflight++;
+	}
+	exit_critical_section();
+
+	/* the cpu keeps working while the copies run */
+	while (state.inflight) {
+		for (i = 0; i < 1000; i++)
+			work += i ^ work;
+		adm_poll();
+	}
+
+	elapsed = current_time_hires() - start;
+
+	if (state.failed) {
+		dprintf(CRITICAL, "adm_bench: depth %u: %u transfers failed\n",
+			depth, state.failed);
+		ret = 1;
+		goto out;
+	}
+
+	arch_invalidate_cache_range((addr_t) dst, ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS);
+	for (i = 0; i < depth; i++) {
+		unsigned c;
+
+		for (c = i; c < ADM_BENCH_CHUNKS && c / depth < ADM_MAX_CMDS; c += depth) {
+			if (memcmp(src + c * ADM_BENCH_CHUNK, dst + c * ADM_BENCH_CHUNK,
+				   ADM_BENCH_CHUNK)) {
+				dprintf(CRITICAL, "adm_bench: depth %u: chunk %u mismatch\n",
+					depth, c);
+				ret = 1;
+				goto out;
+			}
+		}
+	}
+
+	dprintf(INFO, "adm_bench: depth %u: %llu bytes in %llu us (%llu KB/s), cpu work %u\n",
+		depth, state.bytes, elapsed,
+		elapsed ? (state.bytes * 1000000 / elapsed) / 1024 : 0, work);
+
+out:
+	while (n--)
+		adm_xfer_release(&xfer[n]);
+	return ret;
+}
+
+int adm_bench(int argc, const cmd_args *argv)
+{
+	static const unsigned depths[] = { 1, 2, 4, 8 };
+	uint8_t *src, *dst;
+	unsigned i;
+	int ret = 0;
+
+	src = memalign(CACHE_LINE, ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS);
+	dst = memalign(CACHE_LINE, ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS);
+	if (!src || !dst) {
+		dprintf(CRITICAL, "adm_bench: no memory for buffers\n");
+		ret = 1;
+		goto out;
+	}
+
+	for (i = 0; i < ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS; i++)
+		src[i] = i ^ (i >> 8);
+	arch_clean_cache_range((addr_t) src, ADM_BENCH_CHUNK * ADM_BENCH_CHUNKS);
+
+	adm_reset_stats();
+
+	for (i = 0; i < countof(depths) && !ret; i++)
+		ret = adm_bench_depth(src, dst, depths[i]);
+
+	adm_dump_stats();
+
+out:
+	free(src);
+	free(dst);
+	return ret;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <debug.h>
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <app/tests.h>
+#include <lib/bio.h>
+#include <lib/bcache.h>
+
+#if defined(WITH_LIB_BCACHE)
+
+#define TEST_BLOCKS 1024
+#define TEST_BLOCK_SIZE 512
+
+static uint8_t pattern_byte(uint pos)
+{
+	return (pos * 7) + (pos >> 9);
+}
+
+int bcache_tests(void)
+{
+	uint8_t *mem;
+	uint8_t *big = NULL;
+	uint8_t buf[TEST_BLOCK_SIZE];
+	struct bcache_stats stats;
+	bdev_t *dev;
+	bdev_t *cdev = NULL;
+	bcache_t cache = NULL;
+	uint i;
+	int err = -1;
+
+	printf("bcache tests\n");
+
+	mem = malloc(TEST_BLOCKS * TEST_BLOCK_SIZE);
+	if (!mem)
+		return ERR_NO_MEMORY;
+	for (i = 0; i < TEST_BLOCKS * TEST_BLOCK_SIZE; i++)
+		mem[i] = pattern_byte(i);
+
+	create_membdev("bctest", mem, TEST_BLOCKS * TEST_BLOCK_SIZE);
+	dev = bio_open("bctest");
+	if (!dev) {
+		free(mem);
+		return ERR_NOT_FOUND;
+	}
+
+	cache = bcache_create(dev, TEST_BLOCK_SIZE, 64);
+	if (!cache) {
+		printf("bcache_create failed\n");
+		goto out;
+	}
+
+	/* sequential pass, read-ahead should absorb most of the misses */
+	for (i = 0; i < TEST_BLOCKS; i++) {
+		if (bcache_read_block(cache, buf, i) < 0 ||
+		    memcmp(buf, mem + i * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE)) {
+			printf("sequential read of block %u failed\n", i);
+			goto out;
+		}
+	}
+	bcache_get_stats(cache, &stats);
+	bcache_dump(cache, "sequential");
+	if (stats.reads >= TEST_BLOCKS / 8) {
+		printf("read-ahead not effective, %u device reads\n", stats.reads);
+		goto out;
+	}
+
+	/* write back, nothing should reach the device until the flush */
+	memset(buf, 0xa5, sizeof(buf));
+	for (i = 100; i < 110; i++)
+		bcache_write_block(cache, buf, i);
+	if (mem[100 * TEST_BLOCK_SIZE] == 0xa5) {
+		printf("write reached the device before flush\n");
+		goto out;
+	}
+	bcache_reset_stats(cache);
+	bcache_flush(cache);
+	bcache_get_stats(cache, &stats);
+	for (i = 100; i < 110; i++) {
+		if (memcmp(mem + i * TEST_BLOCK_SIZE, buf, TEST_BLOCK_SIZE)) {
+			printf("flush of block %u failed\n", i);
+			goto out;
+		}
+	}
+	if (stats.writes != 1) {
+		printf("flush was not coalesced, %u device writes\n", stats.writes);
+		goto out;
+	}
+
+	/* the cached bio device should be indistinguishable from the parent */
+	if (bcache_publish_device("bctest", "bctest.cache", 32) < 0) {
+		printf("bcache_publish_device failed\n");
+		goto out;
+	}
+	cdev = bio_open("bctest.cache");
+	big = malloc(64 * 1024);
+	if (!cdev || !big)
+		goto out;
+	bio_read(cdev, big, 1000, 64 * 1024 - 7);
+	if (memcmp(big, mem + 1000, 64 * 1024 - 7)) {
+		printf("cached device read mismatch\n");
+		goto out;
+	}
+	memset(big, 0x5a, 1000);
+	bio_write(cdev, big, 3000, 1000);
+	bcache_flush_device("bctest.cache");
+	if (memcmp(mem + 3000, big, 1000)) {
+		printf("cached device write mismatch\n");
+		goto out;
+	}
+
+	printf("bcache tests passed\n");
+	err = 0;
+
+out:
+	free(big);
+	if (cdev) {
+		/* dropping the last reference closes the cache and its parent ref */
+		bio_unregister_device(cdev);
+		bio_close(cdev);
+	}
+	if (cache)
+		bcache_destroy(cache);
+	bio_unregister_device(dev);
+	bio_close(dev);
+	free(mem);
+	return err;
+}
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <string.h>
+#include <malloc.h>
+#include <app/tests.h>
+
+#if defined(WITH_LIB_BOOTPARAM)
+#include <lib/bootparam.h>
+
+/* The fragments aboot appends, as aboot defines them */
+static const char *emmc_cmdline = " androidboot.emmc=true";
+static const char *usb_sn_cmdline = " androidboot.serialno=";
+static const char *androidboot_mode = " androidboot.mode=";
+static const char *loglevel         = " quiet";
+static const char *battchg_pause = " androidboot.mode=charger";
+static const char *auth_kernel = " androidboot.authorized_kernel=true";
+static const char *sn_buf = "0123456789ab";
+
+static const char *basebands[] = {
+	NULL,
+	" androidboot.baseband=apq",
+	" androidboot.baseband=msm",
+	" androidboot.baseband=csfb",
+	" androidboot.baseband=svlte2a",
+	" androidboot.baseband=mdm",
+	" androidboot.baseband=sglte",
+	" androidboot.baseband=sglte2",
+	" androidboot.baseband=dsda",
+	" androidboot.baseband=dsda2",
+};
+
+static const char *image_cmdlines[] = {
+	NULL,
+	"",
+	"console=ttyHSL0,115200,n8 androidboot.hardware=qcom user_debug=31",
+};
+
+/* What aboot's target and boot state queries answer for one boot */
+struct bootparam_boot {
+	const char *cmdline;
+	bool emmc;
+	const char *ffbm;	/* NULL unless booting into ffbm */
+	bool pause;
+	bool auth;
+	const char *baseband;	/* NULL for an unknown baseband */
+};
+
+/*
+ * update_cmdline() as aboot had it before the command line was built in
+ * place, with the target queries replaced by the fields of boot. This is
+ * the reference the new builder must match byte for byte.
+ */
+static unsigned char *bootparam_old_cmdline(const struct bootparam_boot *boot)
+{
+	const char *cmdline = boot->cmdline;
+	const char *ffbm = boot->ffbm;
+	int cmdline_len = 0;
+	int have_cmdline = 0;
+	unsigned char *cmdline_final = NULL;
+	int pause_at_bootup = 0;
+	bool boot_into_ffbm = ffbm != NULL;
+
+	if (cmdline && cmdline[0]) {
+		cmdline_len = strlen(cmdline);
+		have_cmdline = 1;
+	}
+	if (boot->emmc) {
+		cmdline_len += strlen(emmc_cmdline);
+	}
+
+	cmdline_len += strlen(usb_sn_cmdline);
+	cmdline_len += strlen(sn_buf);
+
+	if (boot_into_ffbm) {
+		cmdline_len += strlen(androidboot_mode);
+		cmdline_len += strlen(ffbm);
+		/* reduce kernel console messages to speed-up boot */
+		cmdline_len += strlen(loglevel);
+	} else if (boot->pause) {
+		pause_at_bootup = 1;
+		cmdline_len += strlen(battchg_pause);
+	}
+
+	if (boot->auth) {
+		cmdline_len += strlen(auth_kernel);
+	}
+
+	if (boot->baseband)
+		cmdline_len += strlen(boot->baseband);
+
+	if (cmdline_len > 0) {
+		const char *src;
+		unsigned char *dst = (unsigned char*) malloc((cmdline_len + 4) & (~3));
+		ASSERT(dst != NULL);
+
+		/* Save start ptr for debug print */
+		cmdline_final = dst;
+		if (have_cmdline) {
+			src = cmdline;
+			while ((*dst++ = *src++));
+		}
+		if (boot->emmc) {
+			src = emmc_cmdline;
+			if (have_cmdline) --dst;
+			have_cmdline = 1;
+			while ((*dst++ = *src++));
+		}
+
+		src = usb_sn_cmdline;
+		if (have_cmdline) --dst;
+		have_cmdline = 1;
+		while ((*dst++ = *src++));
+		src = sn_buf;
+		if (have_cmdline) --dst;
+		have_cmdline = 1;
+		while ((*dst++ = *src++));
+
+		if (boot_into_ffbm) {
+			src = androidboot_mode;
+			if (have_cmdline) --dst;
+			while ((*dst++ = *src++));
+			src = ffbm;
+			if (have_cmdline) --dst;
+			while ((*dst++ = *src++));
+			src = loglevel;
+			if (have_cmdline) --dst;
+			while ((*dst++ = *src++));
+		} else if (pause_at_bootup) {
+			src = battchg_pause;
+			if (have_cmdline) --dst;
+			while ((*dst++ = *src++));
+		}
+
+		if (boot->auth) {
+			src = auth_kernel;
+			if (have_cmdline) --dst;
+			while ((*dst++ = *src++));
+		}
+
+		if (boot->baseband) {
+			src = boot->baseband;
+			if (have_cmdline) --dst;
+			while ((*dst++ = *src++));
+		}
+	}
+
+	return cmdline_final;
+}
+
+/* The same boot through bootparam, in the order build_cmdline() adds */
+static unsigned bootparam_new_cmdline(const struct bootparam_boot *boot,
+				      char *buf, unsigned size)
+{
+	struct bootparam bp;
+
+	bootparam_init(&bp, buf, size);
+
+	if (boot->cmdline && boot->cmdline[0])
+		bootparam_add(&bp, boot->cmdline);
+	if (boot->emmc)
+		bootparam_add(&bp, emmc_cmdline);
+
+	bootparam_add(&bp, usb_sn_cmdline);
+	bootparam_add(&bp, sn_buf);
+
+	if (boot->ffbm) {
+		bootparam_add(&bp, androidboot_mode);
+		bootparam_add(&bp, boot->ffbm);
+		bootparam_add(&bp, loglevel);
+	} else if (boot->pause) {
+		bootparam_add(&bp, battchg_pause);
+	}
+
+	if (boot->auth)
+		bootparam_add(&bp, auth_kernel);
+	if (boot->baseband)
+		bootparam_add(&bp, boot->baseband);
+
+	return bootparam_finish(&bp);
+}
+
+/*
+ * Repeated parameters, which the old code passed through and bootparam
+ * now drops, so these have no reference to compare with.
+ */
+struct bootparam_case {
+	const char *frags[4];
+	const char *out;
+};
+
+static const struct bootparam_case bootparam_cases[] = {
+	/* ffbm adds quiet, which the image already asked for */
+	{ { "console=ttyHSL0 quiet", " quiet" }, "console=ttyHSL0 quiet" },
+	/* the bootloader's androidboot.mode wins over the image's */
+	{ { "androidboot.mode=normal foo", " androidboot.mode=charger" },
+	  "foo androidboot.mode=charger" },
+	/* only androidboot.* keys are overridden, other repeats are kept */
+	{ { "console=a console=b", " androidboot.x=1 androidboot.xy=2" },
+	  "console=a console=b androidboot.x=1 androidboot.xy=2" },
+	/* quoted values are one parameter */
+	{ { "k=\"a b\" k=\"a b\" z" }, "k=\"a b\" z" },
+};
+
+int bootparam_tests(void)
+{
+	struct bootparam_boot boot;
+	char buf[512];
+	char small[8];
+	struct bootparam bp;
+	unsigned char *old;
+	unsigned c, e, m, a, b, i, j, len;
+	int errors = 0;
+
+	printf("bootparam tests\n");
+
+	/* every combination aboot can produce, against the old builder */
+	for (c = 0; c < countof(image_cmdlines); c++)
+	for (e = 0; e < 2; e++)
+	for (m = 0; m < 3; m++)
+	for (a = 0; a < 2; a++)
+	for (b = 0; b < countof(basebands); b++) {
+		boot.cmdline = image_cmdlines[c];
+		boot.emmc = e;
+		boot.ffbm = m == 1 ? "ffbm-01" : NULL;
+		boot.pause = m == 2;
+		boot.auth = a;
+		boot.baseband = basebands[b];
+
+		old = bootparam_old_cmdline(&boot);
+		len = bootparam_new_cmdline(&boot, buf, sizeof(buf));
+
+		if (strcmp(buf, (char *)old) || len != strlen(buf) + 1) {
+			printf("cmdline %u emmc %u mode %u auth %u baseband %u:\n"
+			       " old '%s'\n new '%s' (%u)\n",
+			       c, e, m, a, b, old, buf, len);
+			errors++;
+		}
+		free(old);
+	}
+
+	for (i = 0; i < countof(bootparam_cases); i++) {
+		bootparam_init(&bp, buf, sizeof(buf));
+		for (j = 0; j < countof(bootparam_cases[i].frags) && bootparam_cases[i].frags[j]; j++)
+			bootparam_add(&bp, bootparam_cases[i].frags[j]);
+		len = bootparam_finish(&bp);
+
+		if (strcmp(buf, bootparam_cases[i].out) || len != strlen(buf) + 1 || bp.truncated) {
+			printf("case %u: got '%s' (%u)\n", i, buf, len);
+			errors++;
+		}
+	}
+
+	/* a line that does not fit is cut, not overrun */
+	memset(small, 0x55, sizeof(small));
+	bootparam_init(&bp, small, sizeof(small));
+	bootparam_add(&bp, "abcdefghij");
+	len = bootparam_finish(&bp);
+	if (len != sizeof(small) || strcmp(small, "abcdefg") || !bp.truncated) {
+		printf("truncation: got '%s' (%u)\n", small, len);
+		errors++;
+	}
+
+	printf("bootparam tests: %d errors\n", errors);
+
+	return errors;
+}
+
+#endif
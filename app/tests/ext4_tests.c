@@ -0,0 +1,608 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <debug.h>
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <app/tests.h>
+#include <lib/bio.h>
+#include <lib/fs/ext4.h>
+
+#if defined(WITH_LIB_FS_EXT4)
+
+/*
+ * A 512K ext4 volume in two block groups, stored as runs of data and
+ * fills. Made with
+ *   mke2fs -t ext4 -b 1024 -I 128 -N 48 -g 256 -G 4 -O ^has_journal,
+ *     ^resize_inode,^metadata_csum,^64bit,^huge_file,^dir_nlink,
+ *     ^extra_isize -d root img 512
+ *   debugfs -w -R "ea_set /fastxattr user.test abcdefgh" img
+ *   e2fsck -fyD img
+ * where root holds hello.txt, dir/nested.txt, a fast symlink "fast", a
+ * fast symlink "fastxattr" that also owns an xattr block, and a symlink
+ * "slow" whose target is too long for i_block. "big" holds 40 links to
+ * hello.txt, which e2fsck -D turns into an htree directory spread over
+ * three extents. more/f0-f7 push the last inodes into group 1, whose
+ * inode table flex_bg places in group 0. "sparse" has a 1K block of 'A'
+ * to 'F' at every other block and a text tail, six extents behind an
+ * index block.
+ */
+#define EXT4_TEST_SIZE	(512 * 1024)
+
+static const struct {
+	uint32_t off;
+	uint16_t len;
+	uint8_t fill;
+	const char *data;	/* NULL for a run of fill */
+} ext4_test_image[] = {
+	{ 0x00400, 1, 0, "\x30" },
+	{ 0x00405, 16, 0,
+	  "\x02\x00\x00\x19\x00\x00\x00\xcb\x01\x00\x00\x14\x00\x00\x00\x01" },
+	{ 0x00421, 8, 0, "\x01\x00\x00\x00\x01\x00\x00\x18" },
+	{ 0x00430, 20, 0,
+	  "\xa2\xfd\xd3\x6a\x00\x00\xff\xff\x53\xef\x01\x00\x01\x00\x00\x00"
+	  "\xa2\xfd\xd3\x6a" },
+	{ 0x0044c, 1, 0, "\x01" },
+	{ 0x00454, 36, 0,
+	  "\x0b\x00\x00\x00\x80\x00\x00\x00\x28\x00\x00\x00\x42\x02\x00\x00"
+	  "\x03\x00\x00\x00\x1d\xac\xdd\xb3\x42\x47\x44\x72\xaf\xf0\xc4\x86"
+	  "\x85\x83\xf3\x13" },
+	{ 0x004ec, 21, 0,
+	  "\x9b\x41\x02\x0b\xe8\xf7\x46\x24\x8a\x48\x7e\x08\x4d\xa9\x90\xf4"
+	  "\x01\x00\x00\x00\x0c" },
+	{ 0x00509, 3, 0, "\xf1\x53\x65" },
+	{ 0x00560, 1, 0, "\x01" },
+	{ 0x00574, 5, 0, "\x02\x00\x00\x00\x4a" },
+	{ 0x00648, 1, 0, "\x0f" },
+	{ 0x00800, 17, 0,
+	  "\x03\x00\x00\x00\x05\x00\x00\x00\x07\x00\x00\x00\xce\x00\x00\x00"
+	  "\x05" },
+	{ 0x00820, 15, 0,
+	  "\x04\x00\x00\x00\x06\x00\x00\x00\x0a\x00\x00\x00\xfd\x00\x14" },
+	{ 0x00c00, 7, 0, "\xff\xff\xff\xff\xff\xff\x03" },
+	{ 0x00c20, 992, 0xff, NULL },
+	{ 0x01000, 1, 0, "\x03" },
+	{ 0x0101f, 1, 0, "\x80" },
+	{ 0x01020, 2016, 0xff, NULL },
+	{ 0x01800, 3, 0, "\x0f\x00\x00" },
+	{ 0x01803, 1021, 0xff, NULL },
+	{ 0x01c09, 11, 0, "\xf1\x53\x65\x00\xf1\x53\x65\x00\xf1\x53\x65" },
+	{ 0x01c80, 20, 0,
+	  "\xed\x41\x00\x00\x00\x04\x00\x00\x00\xf1\x53\x65\x00\xf1\x53\x65"
+	  "\x00\xf1\x53\x65" },
+	{ 0x01c9a, 3, 0, "\x06\x00\x02" },
+	{ 0x01ca2, 1, 0, "\x08" },
+	{ 0x01ca8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x01cb8, 5, 0, "\x01\x00\x00\x00\x0d" },
+	{ 0x02100, 20, 0,
+	  "\xc0\x41\x00\x00\x00\x30\x00\x00\x00\xf1\x53\x65\x00\xf1\x53\x65"
+	  "\x00\xf1\x53\x65" },
+	{ 0x0211a, 3, 0, "\x02\x00\x18" },
+	{ 0x02122, 1, 0, "\x08" },
+	{ 0x02128, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02138, 5, 0, "\x0c\x00\x00\x00\x0e" },
+	{ 0x02180, 20, 0,
+	  "\xed\x41\x00\x00\x00\x0c\x00\x00\x7d\xfd\xd3\x6a\xa2\xfd\xd3\x6a"
+	  "\xa2\xfd\xd3\x6a" },
+	{ 0x0219a, 3, 0, "\x02\x00\x06" },
+	{ 0x021a1, 2, 0, "\x10\x08" },
+	{ 0x021a8, 5, 0, "\x0a\xf3\x03\x00\x04" },
+	{ 0x021b8, 29, 0,
+	  "\x01\x00\x00\x00\x1a\x00\x00\x00\x01\x00\x00\x00\x01\x00\x00\x00"
+	  "\x1c\x00\x00\x00\x02\x00\x00\x00\x01\x00\x00\x00\x32" },
+	{ 0x02200, 20, 0,
+	  "\xa4\x81\x00\x00\x10\x00\x00\x00\x7d\xfd\xd3\x6a\xa2\xfd\xd3\x6a"
+	  "\x19\xf7\xd3\x6a" },
+	{ 0x0221a, 3, 0, "\x29\x00\x02" },
+	{ 0x02222, 1, 0, "\x08" },
+	{ 0x02228, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02238, 5, 0, "\x01\x00\x00\x00\x1b" },
+	{ 0x02280, 20, 0,
+	  "\xed\x41\x00\x00\x00\x04\x00\x00\x7d\xfd\xd3\x6a\x7c\xfd\xd3\x6a"
+	  "\x19\xf7\xd3\x6a" },
+	{ 0x0229a, 3, 0, "\x02\x00\x02" },
+	{ 0x022a2, 1, 0, "\x08" },
+	{ 0x022a8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x022b8, 5, 0, "\x01\x00\x00\x00\x1d" },
+	{ 0x02300, 20, 0,
+	  "\xa4\x81\x00\x00\x0c\x00\x00\x00\x7d\xfd\xd3\x6a\x7c\xfd\xd3\x6a"
+	  "\x19\xf7\xd3\x6a" },
+	{ 0x0231a, 3, 0, "\x01\x00\x02" },
+	{ 0x02322, 1, 0, "\x08" },
+	{ 0x02328, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02338, 5, 0, "\x01\x00\x00\x00\x1e" },
+	{ 0x02380, 20, 0,
+	  "\xff\xa1\x00\x00\x09\x00\x00\x00\x7d\xfd\xd3\x6a\x7c\xfd\xd3\x6a"
+	  "\x19\xf7\xd3\x6a" },
+	{ 0x0239a, 1, 0, "\x01" },
+	{ 0x023a8, 9, 0, "\x68\x65\x6c\x6c\x6f\x2e\x74\x78\x74" },
+	{ 0x02400, 20, 0,
+	  "\xff\xa1\x00\x00\x0e\x00\x00\x00\x7d\xfd\xd3\x6a\x7c\xfd\xd3\x6a"
+	  "\x19\xf7\xd3\x6a" },
+	{ 0x0241a, 3, 0, "\x01\x00\x02" },
+	{ 0x02428, 14, 0, "\x64\x69\x72\x2f\x6e\x65\x73\x74\x65\x64\x2e\x74\x78\x74" },
+	{ 0x02468, 1, 0, "\x31" },
+	{ 0x02480, 20, 0,
+	  "\xed\x41\x00\x00\x00\x04\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0249a, 3, 0, "\x02\x00\x02" },
+	{ 0x024a2, 1, 0, "\x08" },
+	{ 0x024a8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x024b8, 5, 0, "\x01\x00\x00\x00\x1f" },
+	{ 0x02500, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0251a, 3, 0, "\x01\x00\x02" },
+	{ 0x02522, 1, 0, "\x08" },
+	{ 0x02528, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02538, 5, 0, "\x01\x00\x00\x00\x20" },
+	{ 0x02580, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0259a, 3, 0, "\x01\x00\x02" },
+	{ 0x025a2, 1, 0, "\x08" },
+	{ 0x025a8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x025b8, 5, 0, "\x01\x00\x00\x00\x21" },
+	{ 0x02600, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0261a, 3, 0, "\x01\x00\x02" },
+	{ 0x02622, 1, 0, "\x08" },
+	{ 0x02628, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02638, 5, 0, "\x01\x00\x00\x00\x22" },
+	{ 0x02680, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0269a, 3, 0, "\x01\x00\x02" },
+	{ 0x026a2, 1, 0, "\x08" },
+	{ 0x026a8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x026b8, 5, 0, "\x01\x00\x00\x00\x23" },
+	{ 0x02700, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0271a, 3, 0, "\x01\x00\x02" },
+	{ 0x02722, 1, 0, "\x08" },
+	{ 0x02728, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02738, 5, 0, "\x01\x00\x00\x00\x24" },
+	{ 0x02780, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0279a, 3, 0, "\x01\x00\x02" },
+	{ 0x027a2, 1, 0, "\x08" },
+	{ 0x027a8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x027b8, 5, 0, "\x01\x00\x00\x00\x25" },
+	{ 0x02800, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0281a, 3, 0, "\x01\x00\x02" },
+	{ 0x02822, 1, 0, "\x08" },
+	{ 0x02828, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02838, 5, 0, "\x01\x00\x00\x00\x26" },
+	{ 0x02880, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x00\x00\x00\x88\xfd\xd3\x6a\x87\xfd\xd3\x6a"
+	  "\x87\xfd\xd3\x6a" },
+	{ 0x0289a, 3, 0, "\x01\x00\x02" },
+	{ 0x028a2, 1, 0, "\x08" },
+	{ 0x028a8, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x028b8, 5, 0, "\x01\x00\x00\x00\x27" },
+	{ 0x02900, 20, 0,
+	  "\xff\xa1\x00\x00\x67\x00\x00\x00\x7d\xfd\xd3\x6a\x7c\xfd\xd3\x6a"
+	  "\x19\xf7\xd3\x6a" },
+	{ 0x0291a, 3, 0, "\x01\x00\x02" },
+	{ 0x02922, 1, 0, "\x08" },
+	{ 0x02928, 5, 0, "\x0a\xf3\x01\x00\x04" },
+	{ 0x02938, 5, 0, "\x01\x00\x00\x00\x28" },
+	{ 0x02980, 20, 0,
+	  "\xa4\x81\x00\x00\x18\x2c\x00\x00\xa2\xfd\xd3\x6a\xa2\xfd\xd3\x6a"
+	  "\xa2\xfd\xd3\x6a" },
+	{ 0x0299a, 3, 0, "\x01\x00\x10" },
+	{ 0x029a2, 1, 0, "\x08" },
+	{ 0x029a8, 7, 0, "\x0a\xf3\x01\x00\x04\x00\x01" },
+	{ 0x029b8, 1, 0, "\x2e" },
+	{ 0x029c0, 33, 0,
+	  "\x02\x00\x00\x00\x01\x00\x00\x00\x2a\x00\x00\x00\x04\x00\x00\x00"
+	  "\x01\x00\x00\x00\x2b\x00\x00\x00\x06\x00\x00\x00\x01\x00\x00\x00"
+	  "\x2c" },
+	{ 0x03400, 158, 0,
+	  "\x02\x00\x00\x00\x0c\x00\x01\x02\x2e\x00\x00\x00\x02\x00\x00\x00"
+	  "\x0c\x00\x02\x02\x2e\x2e\x00\x00\x0b\x00\x00\x00\x14\x00\x0a\x02"
+	  "\x6c\x6f\x73\x74\x2b\x66\x6f\x75\x6e\x64\x00\x00\x0c\x00\x00\x00"
+	  "\x0c\x00\x03\x02\x62\x69\x67\x00\x0d\x00\x00\x00\x14\x00\x09\x01"
+	  "\x68\x65\x6c\x6c\x6f\x2e\x74\x78\x74\x00\x00\x00\x0e\x00\x00\x00"
+	  "\x0c\x00\x03\x02\x64\x69\x72\x00\x10\x00\x00\x00\x0c\x00\x04\x07"
+	  "\x66\x61\x73\x74\x11\x00\x00\x00\x14\x00\x09\x07\x66\x61\x73\x74"
+	  "\x78\x61\x74\x74\x72\x00\x00\x00\x12\x00\x00\x00\x0c\x00\x04\x02"
+	  "\x6d\x6f\x72\x65\x1b\x00\x00\x00\x0c\x00\x04\x07\x73\x6c\x6f\x77"
+	  "\x1c\x00\x00\x00\x70\x03\x06\x01\x73\x70\x61\x72\x73\x65" },
+	{ 0x03800, 22, 0,
+	  "\x0b\x00\x00\x00\x0c\x00\x01\x02\x2e\x00\x00\x00\x02\x00\x00\x00"
+	  "\xf4\x03\x02\x02\x2e\x2e" },
+	{ 0x03c05, 1, 0, "\x04" },
+	{ 0x04005, 1, 0, "\x04" },
+	{ 0x04405, 1, 0, "\x04" },
+	{ 0x04805, 1, 0, "\x04" },
+	{ 0x04c05, 1, 0, "\x04" },
+	{ 0x05005, 1, 0, "\x04" },
+	{ 0x05405, 1, 0, "\x04" },
+	{ 0x05805, 1, 0, "\x04" },
+	{ 0x05c05, 1, 0, "\x04" },
+	{ 0x06005, 1, 0, "\x04" },
+	{ 0x06405, 1, 0, "\x04" },
+	{ 0x06800, 22, 0,
+	  "\x0c\x00\x00\x00\x0c\x00\x01\x02\x2e\x00\x00\x00\x02\x00\x00\x00"
+	  "\xf4\x03\x02\x02\x2e\x2e" },
+	{ 0x0681c, 17, 0,
+	  "\x01\x08\x00\x00\x7c\x00\x02\x00\x01\x00\x00\x00\x96\x08\x6c\x9b"
+	  "\x02" },
+	{ 0x06c00, 16, 0,
+	  "\x68\x65\x6c\x6c\x6f\x20\x66\x72\x6f\x6d\x20\x65\x78\x74\x34\x0a" },
+	{ 0x07000, 827, 0,
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x31\x39"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x33\x35\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x32\x34\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x31\x34\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x31\x31"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x31\x35\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x30\x36\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x31\x37\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x33\x39"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x33\x38\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x30\x35\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x33\x32\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x30\x38"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x32\x39\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x31\x33\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x30\x39\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x33\x36"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x33\x33\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x30\x34\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x33\x31\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x32\x31"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x30\x33\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\xe8\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x32\x35\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65" },
+	{ 0x07400, 42, 0,
+	  "\x0e\x00\x00\x00\x0c\x00\x01\x02\x2e\x00\x00\x00\x02\x00\x00\x00"
+	  "\x0c\x00\x02\x02\x2e\x2e\x00\x00\x0f\x00\x00\x00\xe8\x03\x0a\x01"
+	  "\x6e\x65\x73\x74\x65\x64\x2e\x74\x78\x74" },
+	{ 0x07800, 12, 0, "\x6e\x65\x73\x74\x65\x64\x20\x66\x69\x6c\x65\x0a" },
+	{ 0x07c00, 118, 0,
+	  "\x12\x00\x00\x00\x0c\x00\x01\x02\x2e\x00\x00\x00\x02\x00\x00\x00"
+	  "\x0c\x00\x02\x02\x2e\x2e\x00\x00\x13\x00\x00\x00\x0c\x00\x02\x01"
+	  "\x66\x30\x00\x00\x14\x00\x00\x00\x0c\x00\x02\x01\x66\x31\x00\x00"
+	  "\x15\x00\x00\x00\x0c\x00\x02\x01\x66\x32\x00\x00\x16\x00\x00\x00"
+	  "\x0c\x00\x02\x01\x66\x33\x00\x00\x17\x00\x00\x00\x0c\x00\x02\x01"
+	  "\x66\x34\x00\x00\x18\x00\x00\x00\x0c\x00\x02\x01\x66\x35\x00\x00"
+	  "\x19\x00\x00\x00\x0c\x00\x02\x01\x66\x36\x00\x00\x1a\x00\x00\x00"
+	  "\x94\x03\x02\x01\x66\x37" },
+	{ 0x08000, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x30\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x08400, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x31\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x08800, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x32\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x08c00, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x33\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x09000, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x34\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x09400, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x35\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x09800, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x36\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x09c00, 24, 0,
+	  "\x66\x69\x6c\x65\x20\x37\x20\x69\x6e\x20\x61\x20\x6c\x61\x74\x65"
+	  "\x72\x20\x67\x72\x6f\x75\x70\x0a" },
+	{ 0x0a000, 103, 0,
+	  "\x64\x69\x72\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f"
+	  "\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e"
+	  "\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e"
+	  "\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f"
+	  "\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e"
+	  "\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x2e\x2e\x2f\x68\x65"
+	  "\x6c\x6c\x6f\x2e\x74\x78\x74" },
+	{ 0x0a400, 1024, 0x41, NULL },
+	{ 0x0a800, 1024, 0x42, NULL },
+	{ 0x0ac00, 1024, 0x43, NULL },
+	{ 0x0b000, 1024, 0x44, NULL },
+	{ 0x0b400, 1024, 0x45, NULL },
+	{ 0x0b800, 5, 0, "\x0a\xf3\x06\x00\x54" },
+	{ 0x0b810, 65, 0,
+	  "\x01\x00\x00\x00\x29\x00\x00\x00\x02\x00\x00\x00\x01\x00\x00\x00"
+	  "\x2a\x00\x00\x00\x04\x00\x00\x00\x01\x00\x00\x00\x2b\x00\x00\x00"
+	  "\x06\x00\x00\x00\x01\x00\x00\x00\x2c\x00\x00\x00\x08\x00\x00\x00"
+	  "\x01\x00\x00\x00\x2d\x00\x00\x00\x0a\x00\x00\x00\x02\x00\x00\x00"
+	  "\x2f" },
+	{ 0x0bc00, 1024, 0x46, NULL },
+	{ 0x0c000, 24, 0,
+	  "\x74\x61\x69\x6c\x20\x6f\x66\x20\x74\x68\x65\x20\x73\x70\x61\x72"
+	  "\x73\x65\x20\x66\x69\x6c\x65\x0a" },
+	{ 0x0c402, 7, 0, "\x02\xea\x01\x00\x00\x00\x01" },
+	{ 0x0c420, 4, 0, "\x04\x01\xf8\x03" },
+	{ 0x0c428, 12, 0, "\x08\x00\x00\x00\x12\x98\x3d\x0a\x74\x65\x73\x74" },
+	{ 0x0c7f8, 619, 0,
+	  "\x61\x62\x63\x64\x65\x66\x67\x68\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x32\x36\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x32\x38\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x30\x37"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x33\x34\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x31\x36\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x32\x30\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x32\x37"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x33\x30\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x32\x33\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x31\x38\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x30\x31"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x30\x30\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x31\x30\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00"
+	  "\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x33\x37\x2d\x77\x69\x74"
+	  "\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65\x00"
+	  "\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72\x79\x2d\x30\x32"
+	  "\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67\x65\x72\x2d\x6e"
+	  "\x61\x6d\x65\x00\x0d\x00\x00\x00\x24\x00\x1b\x01\x65\x6e\x74\x72"
+	  "\x79\x2d\x32\x32\x2d\x77\x69\x74\x68\x2d\x61\x2d\x6c\x6f\x6e\x67"
+	  "\x65\x72\x2d\x6e\x61\x6d\x65\x00\x0d\x00\x00\x00\xc0\x01\x1b\x01"
+	  "\x65\x6e\x74\x72\x79\x2d\x31\x32\x2d\x77\x69\x74\x68\x2d\x61\x2d"
+	  "\x6c\x6f\x6e\x67\x65\x72\x2d\x6e\x61\x6d\x65" },
+	{ 0x40400, 1, 0, "\x30" },
+	{ 0x40405, 16, 0,
+	  "\x02\x00\x00\x19\x00\x00\x00\xcd\x01\x00\x00\x14\x00\x00\x00\x01" },
+	{ 0x40421, 8, 0, "\x01\x00\x00\x00\x01\x00\x00\x18" },
+	{ 0x40431, 12, 0, "\xf1\x53\x65\x00\x00\xff\xff\x53\xef\x00\x00\x01" },
+	{ 0x40441, 3, 0, "\xf1\x53\x65" },
+	{ 0x4044c, 1, 0, "\x01" },
+	{ 0x40454, 36, 0,
+	  "\x0b\x00\x00\x00\x80\x00\x01\x00\x28\x00\x00\x00\x42\x02\x00\x00"
+	  "\x03\x00\x00\x00\x1d\xac\xdd\xb3\x42\x47\x44\x72\xaf\xf0\xc4\x86"
+	  "\x85\x83\xf3\x13" },
+	{ 0x404ec, 21, 0,
+	  "\x9b\x41\x02\x0b\xe8\xf7\x46\x24\x8a\x48\x7e\x08\x4d\xa9\x90\xf4"
+	  "\x01\x00\x00\x00\x0c" },
+	{ 0x40509, 3, 0, "\xf1\x53\x65" },
+	{ 0x40560, 1, 0, "\x01" },
+	{ 0x40574, 5, 0, "\x02\x00\x00\x00\x2f" },
+	{ 0x40648, 1, 0, "\x0f" },
+	{ 0x40800, 17, 0,
+	  "\x03\x00\x00\x00\x05\x00\x00\x00\x07\x00\x00\x00\xd0\x00\x00\x00"
+	  "\x05" },
+	{ 0x40820, 15, 0,
+	  "\x04\x00\x00\x00\x06\x00\x00\x00\x0a\x00\x00\x00\xfd\x00\x14" },
+};
+
+static const struct {
+	const char *path;
+	const char *contents;
+} ext4_test_files[] = {
+	{ "/hello.txt", "hello from ext4\n" },
+	{ "/dir/nested.txt", "nested file\n" },
+	{ "/fast", "hello from ext4\n" },
+	{ "/fastxattr", "nested file\n" },
+	{ "/slow", "hello from ext4\n" },
+	{ "/big/entry-00-with-a-longer-name", "hello from ext4\n" },
+	{ "/big/entry-17-with-a-longer-name", "hello from ext4\n" },
+	{ "/big/entry-39-with-a-longer-name", "hello from ext4\n" },
+	{ "/more/f0", "file 0 in a later group\n" },
+	{ "/more/f7", "file 7 in a later group\n" },
+};
+
+#define EXT4_SPARSE_TAIL	"tail of the sparse file\n"
+#define EXT4_SPARSE_SIZE	(11 * 1024 + sizeof(EXT4_SPARSE_TAIL) - 1)
+
+static int ext4_check_file(fscookie fs, const char *path, const char *contents)
+{
+	filecookie file;
+	struct file_stat stat;
+	char buf[32];
+	size_t len = strlen(contents);
+	int err;
+
+	err = ext4_open_file(fs, path, &file);
+	if (err < 0) {
+		printf("open of %s failed: %d\n", path, err);
+		return err;
+	}
+
+	err = ext4_stat_file(file, &stat);
+	if (err >= 0 && (stat.is_dir || stat.size != (off_t)len)) {
+		printf("%s: bad stat, size %lld\n", path, stat.size);
+		err = ERR_NOT_VALID;
+	}
+
+	if (err >= 0) {
+		memset(buf, 0, sizeof(buf));
+		err = ext4_read_file(file, buf, 0, sizeof(buf) - 1);
+		if (err != (int)len || memcmp(buf, contents, len)) {
+			printf("%s: read back '%s' (%d)\n", path, buf, err);
+			err = ERR_NOT_VALID;
+		}
+	}
+
+	ext4_close_file(file);
+
+	return err < 0 ? err : 0;
+}
+
+/* every other block of /sparse is a hole, read back as zeroes */
+static int ext4_check_sparse(fscookie fs)
+{
+	filecookie file;
+	uint8_t *buf;
+	uint8_t expect;
+	uint i;
+	int err;
+
+	err = ext4_open_file(fs, "/sparse", &file);
+	if (err < 0) {
+		printf("open of /sparse failed: %d\n", err);
+		return err;
+	}
+
+	buf = malloc(EXT4_SPARSE_SIZE);
+	if (!buf) {
+		ext4_close_file(file);
+		return ERR_NO_MEMORY;
+	}
+
+	err = ext4_read_file(file, buf, 0, EXT4_SPARSE_SIZE);
+	if (err != (int)EXT4_SPARSE_SIZE) {
+		printf("/sparse: short read %d\n", err);
+		err = ERR_NOT_VALID;
+		goto out;
+	}
+
+	err = 0;
+	for (i = 0; i < 11 * 1024; i++) {
+		expect = ((i / 1024) & 1) ? 0 : 'A' + i / 2048;
+		if (buf[i] != expect) {
+			printf("/sparse: byte %u is 0x%x, not 0x%x\n", i, buf[i], expect);
+			err = ERR_NOT_VALID;
+			goto out;
+		}
+	}
+
+	if (memcmp(buf + 11 * 1024, EXT4_SPARSE_TAIL, sizeof(EXT4_SPARSE_TAIL) - 1)) {
+		printf("/sparse: bad tail\n");
+		err = ERR_NOT_VALID;
+	}
+
+out:
+	free(buf);
+	ext4_close_file(file);
+
+	return err;
+}
+
+int ext4_tests(void)
+{
+	filecookie file;
+	uint8_t *mem;
+	bdev_t *dev;
+	fscookie fs;
+	uint i;
+	int errors = 0;
+
+	printf("ext4 tests\n");
+
+	mem = calloc(1, EXT4_TEST_SIZE);
+	if (!mem)
+		return ERR_NO_MEMORY;
+
+	for (i = 0; i < countof(ext4_test_image); i++) {
+		if (ext4_test_image[i].data)
+			memcpy(mem + ext4_test_image[i].off, ext4_test_image[i].data,
+			       ext4_test_image[i].len);
+		else
+			memset(mem + ext4_test_image[i].off, ext4_test_image[i].fill,
+			       ext4_test_image[i].len);
+	}
+
+	create_membdev("ext4test", mem, EXT4_TEST_SIZE);
+	dev = bio_open("ext4test");
+	if (!dev) {
+		free(mem);
+		return ERR_NOT_FOUND;
+	}
+
+	if (ext4_mount(dev, &fs) < 0) {
+		printf("mount failed\n");
+		errors++;
+		goto out;
+	}
+
+	for (i = 0; i < countof(ext4_test_files); i++) {
+		if (ext4_check_file(fs, ext4_test_files[i].path, ext4_test_files[i].contents))
+			errors++;
+	}
+
+	if (ext4_check_sparse(fs))
+		errors++;
+
+	/* a name that hashes into the htree but is not there */
+	if (ext4_open_file(fs, "/big/entry-40-with-a-longer-name", &file) != ERR_NOT_FOUND) {
+		printf("lookup of a missing htree entry did not fail\n");
+		errors++;
+	}
+
+	ext4_unmount(fs);
+
+out:
+	bio_unregister_device(dev);
+	bio_close(dev);
+	free(mem);
+
+	printf("ext4 tests: %d errors\n", errors);
+
+	return errors;
+}
+
+#endif
@@ -27,6 +27,11 @@
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <debug.h>
+#include <stdlib.h>
+#include <lib/console.h>
+
+#if defined(I2C_TEST_BLSP_ID)
 #include <i2c_qup.h>
 #include <blsp_qup.h>
 
@@ -38,7 +43,7 @@ void eeprom_read_test()
 	struct qup_i2c_dev  *dev;
 	char ret[100] = {'\0'};
 
-	dev = qup_blsp_i2c_init(BLSP_ID_2, QUP_ID_4, 100000, 19200000);
+	dev = qup_blsp_i2c_init(I2C_TEST_BLSP_ID, I2C_TEST_QUP_ID, 100000, 19200000);
 
 	if (!dev) {
 		dprintf(CRITICAL, "Failed initializing I2c\n");
@@ -53,3 +58,72 @@ void eeprom_read_test()
 
 	qup_i2c_xfer(dev, msg_buf, 1);
 }
+
+/*
+ * Throughput and latency harness:
+ *   i2c_bench [slave addr] [read length] [iterations]
+ * Reads from the slave with a one byte register write and repeated
+ * START before each read, as panel/touch/charger drivers do, and
+ * reports what the controller statistics saw. The bus is the one the
+ * target names in I2C_TEST_BLSP_ID/I2C_TEST_QUP_ID.
+ */
+int i2c_bench(int argc, const cmd_args *argv)
+{
+	struct qup_i2c_dev *dev;
+	struct qup_i2c_stats stats;
+	uint8_t addr = EEPROM_HW_I2C_ADDRESS;
+	int len = 16;
+	int iterations = 100;
+	uint8_t reg = 0;
+	uint8_t *buf;
+	int i;
+	int ret;
+
+	if (argc > 1)
+		addr = argv[1].u;
+	if (argc > 2)
+		len = argv[2].u;
+	if (argc > 3)
+		iterations = argv[3].u;
+
+	if (len <= 0 || len > 256 || iterations <= 0) {
+		dprintf(CRITICAL, "usage: %s [addr] [len 1-256] [iterations]\n",
+			argv[0].str);
+		return -1;
+	}
+
+	dev = qup_blsp_i2c_init(I2C_TEST_BLSP_ID, I2C_TEST_QUP_ID, 100000, 19200000);
+	if (!dev) {
+		dprintf(CRITICAL, "Failed initializing I2c\n");
+		return -1;
+	}
+
+	buf = malloc(len);
+	if (!buf)
+		return -1;
+
+	qup_i2c_reset_stats(dev);
+
+	for (i = 0; i < iterations; i++) {
+		ret = qup_i2c_write_read(dev, addr, &reg, 1, buf, len);
+		if (ret) {
+			dprintf(CRITICAL, "i2c_bench: transfer %d failed: %d\n", i, ret);
+			break;
+		}
+	}
+
+	free(buf);
+
+	qup_i2c_get_stats(dev, &stats);
+	dprintf(INFO, "i2c_bench: %u xfers, %u bytes, %u errors, %u irqs, "
+		"%u timeouts\n", stats.xfers, stats.bytes, stats.errors,
+		stats.irqs, stats.timeouts);
+	if (stats.xfers && stats.total_us)
+		dprintf(INFO, "i2c_bench: avg %llu us, max %llu us, %llu bytes/s\n",
+			stats.total_us / stats.xfers, stats.max_us,
+			(uint64_t)stats.bytes * 1000000 / stats.total_us);
+
+	return (i == iterations) ? 0 : -1;
+}
+
+#endif
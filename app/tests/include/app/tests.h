@@ -25,6 +25,22 @@
 
 int thread_tests(void);
 void printf_tests(void);
+int bcache_tests(void);
+int ext4_tests(void);
+int pmic_shadow_tests(void);
+int ssbi_tests(void);
+int keypad_tests(void);
+int bootparam_tests(void);
+int scm_tests(void);
+int memtest_tests(void);
+#if defined(I2C_TEST_BLSP_ID)
+#include <lib/console.h>
+int i2c_bench(int argc, const cmd_args *argv);
+#endif
+#if PERIPH_BLK_ADM
+#include <lib/console.h>
+int adm_bench(int argc, const cmd_args *argv);
+#endif
 
 #endif
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <app/tests.h>
+
+#if defined(KEYS_USE_GPIO_KEYPAD)
+
+#include <dev/gpio.h>
+#include <dev/gpio_keypad.h>
+#include <dev/keys.h>
+#include <kernel/thread.h>
+
+/*
+ * A simulated 3x3 matrix behind gpio_ops. Outputs are gpios 0-2 and inputs
+ * 8-10; an input reads low while a pressed key connects it to an output
+ * that is being driven low.
+ */
+#define SIM_OUTPUTS	3
+#define SIM_INPUTS	3
+#define SIM_IN_BASE	8
+
+static unsigned sim_output_gpios[SIM_OUTPUTS] = { 0, 1, 2 };
+static unsigned sim_input_gpios[SIM_INPUTS] = { 8, 9, 10 };
+static const uint16_t sim_keymap[SIM_OUTPUTS * SIM_INPUTS] = {
+	KEY_1, KEY_2, KEY_3,
+	KEY_4, KEY_5, KEY_6,
+	KEY_7, KEY_8, KEY_9,
+};
+
+static volatile int sim_out[SIM_OUTPUTS];
+static volatile int sim_pressed[SIM_OUTPUTS * SIM_INPUTS];
+static volatile int sim_irq_enabled;
+static volatile int sim_irq_ok;
+
+static int sim_get(unsigned nr)
+{
+	int in = nr - SIM_IN_BASE;
+	int out;
+
+	for (out = 0; out < SIM_OUTPUTS; out++) {
+		if (sim_out[out] == 0 && sim_pressed[out * SIM_INPUTS + in])
+			return 0;
+	}
+
+	return 1;
+}
+
+static void sim_set(unsigned nr, unsigned on)
+{
+	if (nr < SIM_OUTPUTS)
+		sim_out[nr] = on;
+}
+
+static int sim_config(unsigned nr, unsigned flags)
+{
+	return 0;
+}
+
+static const struct gpio_keypad_gpio_ops sim_gpio_ops = {
+	.get	= sim_get,
+	.set	= sim_set,
+	.config	= sim_config,
+};
+
+static int sim_irq_enable(struct gpio_keypad_info *kpinfo, int enable)
+{
+	if (!sim_irq_ok)
+		return -1;
+
+	sim_irq_enabled = enable;
+	return 0;
+}
+
+static struct gpio_keypad_info sim_keypad_info = {
+	.keymap		= sim_keymap,
+	.output_gpios	= sim_output_gpios,
+	.input_gpios	= sim_input_gpios,
+	.noutputs	= SIM_OUTPUTS,
+	.ninputs	= SIM_INPUTS,
+	.settle_time	= 1 /* msec */,
+	.poll_time	= 10 /* msec */,
+	.flags		= GPIOKPF_DRIVE_INACTIVE,
+	.irq_enable	= sim_irq_enable,
+	.gpio_ops	= &sim_gpio_ops,
+};
+
+static void drain_events(void)
+{
+	struct key_event ev;
+
+	while (keys_get_event(&ev, 0) == 0)
+		;
+}
+
+static int expect_event(uint16_t code, int16_t value)
+{
+	struct key_event ev;
+
+	if (keys_get_event(&ev, 200)) {
+		printf("no event for key 0x%x\n", code);
+		return -1;
+	}
+	if (ev.code != code || ev.value != value) {
+		printf("got key 0x%x/%d, expected 0x%x/%d\n",
+		       ev.code, ev.value, code, value);
+		return -1;
+	}
+
+	return 0;
+}
+
+int keypad_tests(void)
+{
+	struct gpio_keypad_stats stats, before;
+	struct key_event ev;
+	int err = -1;
+
+	printf("keypad tests\n");
+
+	memset((void *)sim_pressed, 0, sizeof(sim_pressed));
+	sim_irq_ok = 0;
+	sim_irq_enabled = 0;
+	gpio_keypad_init(&sim_keypad_info);
+	drain_events();
+
+	/* idle and polled: cheap input reads, no matrix scans */
+	thread_sleep(200);
+	gpio_keypad_get_stats(&sim_keypad_info, &stats);
+	printf("idle: %u scans, %u idle checks\n", stats.scans, stats.idle_checks);
+	if (stats.scans > 1 || stats.idle_checks < 10) {
+		printf("keypad kept scanning while idle\n");
+		goto out;
+	}
+
+	/* a 5ms bounce is shorter than poll_time and never reported */
+	sim_pressed[4] = 1;
+	thread_sleep(5);
+	sim_pressed[4] = 0;
+	if (keys_get_event(&ev, 100) == 0) {
+		printf("bounce reported as key 0x%x/%d\n", ev.code, ev.value);
+		goto out;
+	}
+
+	/* a held key is reported once, and its release once, with no bounces */
+	gpio_keypad_get_stats(&sim_keypad_info, &before);
+	sim_pressed[4] = 1;
+	if (expect_event(KEY_5, 1))
+		goto out;
+	thread_sleep(50);
+	sim_pressed[4] = 0;
+	if (expect_event(KEY_5, 0))
+		goto out;
+	if (keys_get_event(&ev, 50) == 0) {
+		printf("spurious key 0x%x/%d\n", ev.code, ev.value);
+		goto out;
+	}
+
+	gpio_keypad_get_stats(&sim_keypad_info, &stats);
+	printf("press: %u scans, %u wakeups, %u events, %u bounces\n",
+	       stats.scans, stats.wakeups, stats.events, stats.bounces);
+	if (stats.events - before.events != 2 ||
+	    stats.bounces != before.bounces) {
+		printf("clean press counted %u events, %u bounces\n",
+		       stats.events - before.events,
+		       stats.bounces - before.bounces);
+		goto out_uninit;
+	}
+	gpio_keypad_uninit(&sim_keypad_info);
+
+	/* with an interrupt, the timer stops until notified */
+	sim_irq_ok = 1;
+	gpio_keypad_init(&sim_keypad_info);
+	drain_events();
+	thread_sleep(100);
+	gpio_keypad_get_stats(&sim_keypad_info, &stats);
+	if (!sim_irq_enabled || stats.idle_checks) {
+		printf("keypad polled with an interrupt available\n");
+		goto out_uninit;
+	}
+
+	sim_pressed[8] = 1;
+	gpio_keypad_notify(&sim_keypad_info);
+	if (expect_event(KEY_9, 1))
+		goto out_uninit;
+	/* keys held down are scanned until released, then it re-arms */
+	sim_pressed[8] = 0;
+	if (expect_event(KEY_9, 0))
+		goto out_uninit;
+	thread_sleep(50);
+	if (!sim_irq_enabled) {
+		printf("keypad did not re-arm after release\n");
+		goto out_uninit;
+	}
+
+	gpio_keypad_get_stats(&sim_keypad_info, &stats);
+	printf("irq: %u scans, %u irqs, %u idle checks\n",
+	       stats.scans, stats.irqs, stats.idle_checks);
+	err = 0;
+
+out_uninit:
+	gpio_keypad_uninit(&sim_keypad_info);
+out:
+	drain_events();
+	printf("keypad tests %s\n", err ? "FAILED" : "passed");
+	return err;
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <malloc.h>
+#include <string.h>
+#include <app/tests.h>
+
+#if defined(WITH_LIB_MEMTEST)
+#include <lib/memtest.h>
+#include <target.h>
+
+/*
+ * Runs lib/memtest over a slice of the target's scratch area, which is
+ * outside LK's own image and heap, and over a heap buffer, which memtest
+ * must refuse to touch. A dma engine that flips one bit at a known address
+ * stands in for bad memory.
+ */
+#define MEMTEST_TEST_LEN	(128 * 1024)
+#define MEMTEST_TEST_HOLE	(64 * 1024)
+#define MEMTEST_FAULT_OFF	(96 * 1024 + 0x40)
+#define MEMTEST_FAULT_BIT	(1 << 3)
+
+static addr_t memtest_fault_addr;
+
+static int memtest_faulty_copy(addr_t dst, addr_t src, size_t len)
+{
+	memcpy((void *)dst, (const void *)src, len);
+	if (memtest_fault_addr >= dst && memtest_fault_addr < dst + len)
+		*(volatile uint32_t *)memtest_fault_addr ^= MEMTEST_FAULT_BIT;
+
+	return 0;
+}
+
+static const struct memtest_dma_ops memtest_faulty_dma = {
+	.copy = memtest_faulty_copy,
+};
+
+int memtest_tests(void)
+{
+	static bool hole_excluded;
+	struct memtest_result res;
+	addr_t scratch = (addr_t)target_get_scratch_address();
+	void *buf;
+	status_t err;
+	int errors = 0;
+
+	printf("memtest tests\n");
+
+	/* LK's own heap is never tested */
+	buf = memalign(64, 4096);
+	err = memtest_run((addr_t)buf, 4096, MEMTEST_PAT_ALL,
+			  MEMTEST_ENGINE_CPU, 0, &res);
+	if (err != ERR_INVALID_ARGS || res.tested || res.excluded != 4096) {
+		printf("heap buffer: err %d, %u bytes tested\n", err,
+		       (uint)res.tested);
+		errors++;
+	}
+	free(buf);
+
+	/* every pattern passes on good memory */
+	err = memtest_run(scratch, MEMTEST_TEST_LEN, MEMTEST_PAT_ALL,
+			  MEMTEST_ENGINE_BURST, 0x1234, &res);
+	if (err || res.errors || res.tested != MEMTEST_TEST_LEN ||
+	    res.npatterns != MEMTEST_NUM_PATTERNS) {
+		printf("clean run: err %d, %u errors, %u bytes, %u patterns\n",
+		       err, res.errors, (uint)res.tested, res.npatterns);
+		errors++;
+	}
+
+	/* a registered range is stepped over */
+	if (!hole_excluded) {
+		memtest_exclude(scratch + MEMTEST_TEST_LEN, MEMTEST_TEST_HOLE);
+		hole_excluded = true;
+	}
+	err = memtest_run(scratch, 2 * MEMTEST_TEST_LEN, MEMTEST_PAT_SOLID,
+			  MEMTEST_ENGINE_CPU, 0, &res);
+	if (err || res.excluded != MEMTEST_TEST_HOLE ||
+	    res.tested != 2 * MEMTEST_TEST_LEN - MEMTEST_TEST_HOLE) {
+		printf("excluded hole: err %d, %u bytes tested, %u excluded\n",
+		       err, (uint)res.tested, (uint)res.excluded);
+		errors++;
+	}
+
+	/* a flipped bit is found and located */
+	memtest_fault_addr = scratch + MEMTEST_FAULT_OFF;
+	memtest_set_dma_ops(&memtest_faulty_dma);
+	err = memtest_run(scratch, MEMTEST_TEST_LEN, MEMTEST_PAT_SOLID,
+			  MEMTEST_ENGINE_DMA, 0, &res);
+	memtest_set_dma_ops(NULL);
+	if (err != ERR_IO || !res.errors ||
+	    res.bad_bits != MEMTEST_FAULT_BIT ||
+	    res.first_error != memtest_fault_addr ||
+	    res.last_error != memtest_fault_addr) {
+		printf("injected fault: err %d, %u errors, bits 0x%x, "
+		       "first 0x%lx last 0x%lx\n", err, res.errors,
+		       res.bad_bits, res.first_error, res.last_error);
+		errors++;
+	}
+
+	printf("memtest tests: %d errors\n", errors);
+	return errors ? -1 : 0;
+}
+
+#endif
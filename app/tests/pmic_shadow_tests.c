@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <bits.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <app/tests.h>
+
+#if defined(WITH_DEV_PMIC_PM8X41)
+
+#include <pm8x41.h>
+#include <pm8x41_hw.h>
+
+/* Fake SPMI backend: a handful of peripherals backed by memory, with
+ * every bus command counted.
+ */
+static const uint32_t fake_periphs[] = { 0x800, 0xC000, 0xC100, 0x14100 };
+static uint8_t fake_regs[ARRAY_SIZE(fake_periphs)][256];
+static uint32_t fake_reads;
+static uint32_t fake_writes;
+
+static uint8_t *fake_reg(uint32_t addr)
+{
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(fake_periphs); i++)
+		if (fake_periphs[i] == (addr & ~0xFF))
+			return &fake_regs[i][addr & 0xFF];
+
+	return NULL;
+}
+
+static int fake_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	uint8_t *reg = fake_reg(addr);
+
+	if (!reg)
+		return 1;
+
+	fake_reads++;
+	memcpy(buf, reg, len);
+	return 0;
+}
+
+static int fake_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	uint8_t *reg = fake_reg(addr);
+
+	if (!reg)
+		return 1;
+
+	fake_writes++;
+	memcpy(reg, buf, len);
+	return 0;
+}
+
+static int fake_sync(void)
+{
+	return 0;
+}
+
+static const struct pm8x41_bus_ops fake_bus_ops = {
+	.read  = fake_read,
+	.write = fake_write,
+	.sync  = fake_sync,
+};
+
+#define EXPECT_BUS(what, r, w) \
+	do { \
+		if (fake_reads != (r) || fake_writes != (w)) { \
+			printf("%s: %u reads, %u writes, expected %u/%u\n", \
+			       what, fake_reads, fake_writes, (r), (w)); \
+			goto out; \
+		} \
+		fake_reads = fake_writes = 0; \
+	} while (0)
+
+int pmic_shadow_tests(void)
+{
+	const struct pm8x41_bus_ops *old;
+	struct pm8x41_gpio cfg;
+	struct pm8x41_shadow_stats stats;
+	uint8_t status;
+	int err = -1;
+
+	printf("pm8x41 shadow tests\n");
+
+	memset(fake_regs, 0, sizeof(fake_regs));
+	fake_reads = fake_writes = 0;
+	old = pm8x41_set_bus_ops(&fake_bus_ops);
+	pm8x41_shadow_reset_stats();
+
+	/* read-modify-write of the mode register only reads once */
+	pm8x41_gpio_set(1, 1);
+	EXPECT_BUS("first gpio_set", 1u, 1u);
+	pm8x41_gpio_set(1, 1);
+	EXPECT_BUS("repeated gpio_set", 0u, 0u);
+
+	/* status registers are never cached */
+	pm8x41_gpio_get(1, &status);
+	pm8x41_gpio_get(1, &status);
+	EXPECT_BUS("gpio_get", 2u, 0u);
+	pm8x41_get_pon_reason();
+	pm8x41_get_pon_reason();
+	EXPECT_BUS("pon reason", 2u, 0u);
+
+	/* the gpio is already disabled, so only the two bursts go out */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.direction = PM_GPIO_DIR_OUT;
+	cfg.vin_sel = 2;
+	cfg.pull = 5;
+	cfg.out_strength = PM_GPIO_OUT_DRIVE_HIGH;
+	pm8x41_gpio_config(2, &cfg);
+	EXPECT_BUS("gpio_config", 1u, 2u);
+	if (*fake_reg(GPIO_N_PERIPHERAL_BASE(2) + GPIO_DIG_PULL_CTL) != 5 ||
+	    !(*fake_reg(GPIO_N_PERIPHERAL_BASE(2) + GPIO_EN_CTL) & BIT(PERPH_EN_BIT))) {
+		printf("gpio_config did not reach the hardware\n");
+		goto out;
+	}
+	pm8x41_gpio_config(2, &cfg);
+	EXPECT_BUS("repeated gpio_config", 0u, 2u);
+
+	/* unchanged voltage settings are not rewritten, the power mode always is */
+	pm8x41_ldo_set_voltage("LDO2", 1200000);
+	EXPECT_BUS("ldo_set_voltage", 0u, 2u);
+	pm8x41_ldo_set_voltage("LDO2", 1200000);
+	EXPECT_BUS("repeated ldo_set_voltage", 0u, 1u);
+
+	/* RPM can change the ldo enable, so it is never cached */
+	pm8x41_ldo_control("LDO2", 1);
+	pm8x41_ldo_control("LDO2", 1);
+	EXPECT_BUS("ldo_control", 0u, 2u);
+
+	/* verify mode catches the hardware changing behind our back */
+	*fake_reg(GPIO_N_PERIPHERAL_BASE(1) + GPIO_MODE_CTL) = 0x10;
+	if (pm8x41_shadow_check() != 1 || pm8x41_shadow_check() != 0) {
+		printf("shadow_check missed a stale register\n");
+		goto out;
+	}
+	*fake_reg(GPIO_N_PERIPHERAL_BASE(1) + GPIO_MODE_CTL) = 0x11;
+	pm8x41_shadow_set_verify(1);
+	if (pm8x41_reg_read(GPIO_N_PERIPHERAL_BASE(1) + GPIO_MODE_CTL) != 0x11) {
+		printf("verify mode returned a stale value\n");
+		goto out;
+	}
+	pm8x41_shadow_set_verify(0);
+
+	pm8x41_shadow_get_stats(&stats);
+	printf("hits %u misses %u dropped %u mismatches %u\n", stats.hits,
+	       stats.misses, stats.writes_dropped, stats.mismatches);
+	if (stats.mismatches != 2) {
+		printf("expected 2 mismatches\n");
+		goto out;
+	}
+
+	printf("pm8x41 shadow tests passed\n");
+	err = 0;
+
+out:
+	pm8x41_shadow_set_verify(0);
+	pm8x41_set_bus_ops(old);
+	return err;
+}
+
+#endif
@@ -22,6 +22,23 @@
  */
 #include <app/tests.h>
 #include <debug.h>
+#include <stdarg.h>
+#include <printf.h>
+
+/* %D and %U are LK extensions that gcc's format checking doesn't know,
+ * so they go through vsnprintf, which isn't checked.
+ */
+static void printf_unchecked(const char *fmt, ...)
+{
+	char buf[64];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	printf("%s", buf);
+}
 
 void printf_tests(void)
 {
@@ -34,10 +51,10 @@ void printf_tests(void)
 	printf("uint16:%hu %hu %hu\n", -1234, 0, 1234);
 	printf("int:   %d %d %d\n", -12345678, 0, 12345678);
 	printf("uint:  %u %u %u\n", -12345678, 0, 12345678);
-	printf("long:  %ld %ld %ld\n", -12345678, 0, 12345678);
-	printf("ulong: %lu %lu %lu\n", -12345678, 0, 12345678);
-	printf("long:  %D %D %D\n", -12345678, 0, 12345678);
-	printf("ulong: %U %U %U\n", -12345678, 0, 12345678);
+	printf("long:  %ld %ld %ld\n", -12345678L, 0L, 12345678L);
+	printf("ulong: %lu %lu %lu\n", -12345678UL, 0UL, 12345678UL);
+	printf_unchecked("long:  %D %D %D\n", -12345678L, 0L, 12345678L);
+	printf_unchecked("ulong: %U %U %U\n", -12345678UL, 0UL, 12345678UL);
 	printf("longlong: %lli %lli %lli\n", -12345678LL, 0LL, 12345678LL);
 	printf("ulonglong: %llu %llu %llu\n", -12345678LL, 0LL, 12345678LL);
 	printf("size_t: %zd %zd %zd\n", -12345678, 0, 12345678);
@@ -47,7 +64,7 @@ void printf_tests(void)
 	printf("uint8: %hhx %hhx %hhx\n", -12, 0, 254);
 	printf("uint16:%hx %hx %hx\n", -1234, 0, 1234);
 	printf("uint:  %x %x %x\n", -12345678, 0, 12345678);
-	printf("ulong: %lx %lx %lx\n", -12345678, 0, 12345678);
+	printf("ulong: %lx %lx %lx\n", -12345678UL, 0UL, 12345678UL);
 	printf("ulong: %X %X %X\n", -12345678, 0, 12345678);
 	printf("ulonglong: %llx %llx %llx\n", -12345678LL, 0LL, 12345678LL);
 	printf("usize_t: %zx %zx %zx\n", -12345678, 0, 12345678);
@@ -66,6 +83,13 @@ void printf_tests(void)
 	printf("int: a%010da\n", 12345678);
 	printf("int: a%6da\n", 12345678);
 
+	printf("int: a%05da a%+06da\n", -12, 34);
+	printf("ulonglong: %llu %llu %llx\n", 4294967296ULL, 18446744073709551615ULL, 0x123456789abcdefULL);
+
+	char buf[8];
+	int len = snprintf(buf, sizeof(buf), "%s", "truncated");
+	printf("snprintf: '%s' returned %d\n", buf, len);
+
 	printf("a%1sa\n", "b");
 	printf("a%9sa\n", "b");
 	printf("a%-9sa\n", "b");
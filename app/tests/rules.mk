@@ -6,5 +6,14 @@ OBJS += \
 	$(LOCAL_DIR)/tests.o \
 	$(LOCAL_DIR)/thread_tests.o \
 	$(LOCAL_DIR)/printf_tests.o \
-	$(LOCAL_DIR)/i2c_tests.o \
-	$(LOCAL_DIR)/adc_tests.o
+	$(LOCAL_DIR)/bcache_tests.o \
+	$(LOCAL_DIR)/ext4_tests.o \
+	$(LOCAL_DIR)/pmic_shadow_tests.o \
+	$(LOCAL_DIR)/ssbi_tests.o \
+	$(LOCAL_DIR)/keypad_tests.o \
+	$(LOCAL_DIR)/i2c_test.o \
+	$(LOCAL_DIR)/adc_tests.o \
+	$(LOCAL_DIR)/adm_tests.o \
+	$(LOCAL_DIR)/bootparam_tests.o \
+	$(LOCAL_DIR)/scm_tests.o \
+	$(LOCAL_DIR)/memtest_tests.o
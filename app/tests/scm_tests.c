@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <string.h>
+#include <arch/ops.h>
+#include <app/tests.h>
+
+#if defined(SSD_ENABLE)
+#include <scm.h>
+
+/*
+ * Runs SCM batches against the stub secure monitor, wrapped so the test
+ * sees the order commands reach "TZ" in and can fail one of them. Each
+ * response carries the first word of its command plus one.
+ */
+static uint32_t scm_test_ids[SCM_BATCH_MAX_CMDS];
+static unsigned scm_test_calls;
+static unsigned scm_test_fail_at;	/* 1-based call to fail, 0 for none */
+
+static uint32_t scm_test_monitor(uint32_t cmd_addr)
+{
+	struct scm_command *cmd = (struct scm_command *) cmd_addr;
+	struct scm_response *rsp;
+	uint32_t *out;
+	uint32_t ret;
+
+	if (scm_test_calls < countof(scm_test_ids))
+		scm_test_ids[scm_test_calls] = cmd->id;
+	if (++scm_test_calls == scm_test_fail_at)
+		return 1;
+
+	ret = scm_stub_monitor(cmd_addr);
+
+	rsp = (struct scm_response *) ((uint8_t *) cmd + cmd->resp_hdr_offset);
+	if (rsp->len - rsp->buf_offset >= sizeof(uint32_t)) {
+		out = (uint32_t *) ((uint8_t *) rsp + rsp->buf_offset);
+		*out = cmd->buf[0] + 1;
+		arch_clean_invalidate_cache_range((addr_t) out, sizeof(*out));
+	}
+
+	return ret;
+}
+
+static void scm_test_reset(unsigned fail_at)
+{
+	memset(scm_test_ids, 0, sizeof(scm_test_ids));
+	scm_test_calls = 0;
+	scm_test_fail_at = fail_at;
+	scm_reset_stats();
+}
+
+int scm_tests(void)
+{
+	struct scm_batch batch;
+	struct scm_stats stats;
+	uint32_t in[SCM_BATCH_MAX_CMDS][32];
+	uint32_t out[SCM_BATCH_MAX_CMDS];
+	uint32_t word;
+	unsigned i;
+	int ret;
+	int errors = 0;
+
+	printf("scm tests\n");
+
+	/* the bare stub completes a call with a zeroed response */
+	scm_set_monitor(scm_stub_monitor);
+	word = 0xffffffff;
+	ret = scm_call(SCM_SVC_FUSE, SCM_IS_SW_FUSE_BLOWN_ID, &in[0][0],
+		       sizeof(in[0][0]), &word, sizeof(word));
+	if (ret || word) {
+		printf("stub call: ret %d, response 0x%x\n", ret, word);
+		errors++;
+	}
+
+	/* three commands: one cache pass, run and answered in order */
+	scm_set_monitor(scm_test_monitor);
+	scm_test_reset(0);
+	scm_batch_init(&batch);
+	for (i = 0; i < 3; i++) {
+		in[i][0] = 100 * i;
+		out[i] = 0;
+		scm_batch_add(&batch, SCM_SVC_SSD, i + 1, in[i], sizeof(in[i][0]),
+			      &out[i], sizeof(out[i]));
+	}
+	scm_batch_add_range(&batch, in, sizeof(in));
+
+	ret = scm_batch_submit(&batch);
+	scm_get_stats(&stats);
+	if (ret || batch.completed != 3 || scm_test_calls != 3 ||
+	    stats.calls != 3 || stats.batches != 1 || stats.cache_passes != 1) {
+		printf("batch: ret %d, %u completed, %u monitor calls, "
+		       "%u calls/%u batches/%u passes\n", ret, batch.completed,
+		       scm_test_calls, stats.calls, stats.batches,
+		       stats.cache_passes);
+		errors++;
+	}
+	for (i = 0; i < 3; i++) {
+		if (scm_test_ids[i] != ((SCM_SVC_SSD << 10) | (i + 1)) ||
+		    out[i] != 100 * i + 1) {
+			printf("batch: command %u id 0x%x, response %u\n", i,
+			       scm_test_ids[i], out[i]);
+			errors++;
+		}
+	}
+
+	/* a failing command stops the batch, earlier responses are kept */
+	scm_test_reset(2);
+	scm_batch_init(&batch);
+	for (i = 0; i < 3; i++) {
+		out[i] = 0xdead;
+		scm_batch_add(&batch, SCM_SVC_SSD, i + 1, in[i], sizeof(in[i][0]),
+			      &out[i], sizeof(out[i]));
+	}
+
+	ret = scm_batch_submit(&batch);
+	scm_get_stats(&stats);
+	if (!ret || batch.completed != 1 || scm_test_calls != 2 ||
+	    stats.errors != 1 || out[0] != 1 || out[1] != 0xdead ||
+	    out[2] != 0xdead) {
+		printf("failing batch: ret %d, %u completed, %u monitor calls, "
+		       "%u errors\n", ret, batch.completed, scm_test_calls,
+		       stats.errors);
+		errors++;
+	}
+
+	/* a batch too big for the static command area is allocated */
+	scm_test_reset(0);
+	scm_batch_init(&batch);
+	for (i = 0; i < SCM_BATCH_MAX_CMDS; i++) {
+		in[i][0] = i;
+		out[i] = 0;
+		scm_batch_add(&batch, SCM_SVC_SSD, i + 1, in[i], sizeof(in[i]),
+			      &out[i], sizeof(out[i]));
+	}
+
+	ret = scm_batch_submit(&batch);
+	if (ret || batch.completed != SCM_BATCH_MAX_CMDS) {
+		printf("large batch: ret %d, %u completed\n", ret, batch.completed);
+		errors++;
+	}
+	for (i = 0; i < SCM_BATCH_MAX_CMDS; i++) {
+		if (out[i] != i + 1) {
+			printf("large batch: command %u response %u\n", i, out[i]);
+			errors++;
+		}
+	}
+
+	scm_dump_stats();
+	scm_set_monitor(NULL);
+
+	printf("scm tests: %d errors\n", errors);
+
+	return errors;
+}
+
+#endif
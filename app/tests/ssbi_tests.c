@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <app/tests.h>
+#include <kernel/event.h>
+
+#if defined(WITH_DEV_SSBI)
+
+#include <dev/ssbi.h>
+
+/* Simulated SSBI register model: the SSBI 2.0 controller and both PMIC
+ * arbiters in front of one 1K PMIC register space. Each command keeps the
+ * bus busy for a couple of status reads, and the bus can be wedged to
+ * exercise the timeout path.
+ */
+#define SIM_REGS	0x400
+#define SIM_BUSY_READS	2
+
+static uint8_t sim_pmic[SIM_REGS];
+static uint32_t sim_mode2;
+static uint32_t sim_rd;
+static uint32_t sim_pa_status;
+static int sim_busy;
+static int sim_wedged;
+static uint32_t sim_cmds;
+
+static void sim_cmd(uint16_t addr, int read, uint8_t data)
+{
+	addr %= SIM_REGS;
+	sim_cmds++;
+	sim_busy = SIM_BUSY_READS;
+	if (read)
+		sim_rd = sim_pmic[addr];
+	else
+		sim_pmic[addr] = data;
+}
+
+static uint32_t sim_read(addr_t addr)
+{
+	int busy = sim_wedged || sim_busy > 0;
+
+	if (sim_busy > 0)
+		sim_busy--;
+
+	switch (addr) {
+	case MSM_SSBI_BASE + SSBI2_STATUS:
+		return busy ? SSBI_STATUS_MCHN_BUSY :
+			(SSBI_STATUS_READY | SSBI_STATUS_RD_READY);
+	case MSM_SSBI_BASE + SSBI2_RD:
+		return sim_rd;
+	case MSM_SSBI_BASE + SSBI2_MODE2:
+		return sim_mode2;
+	case PA1_SSBI2_RD_STATUS:
+	case PA2_SSBI2_RD_STATUS:
+		return busy ? 0 : sim_pa_status;
+	}
+
+	return 0;
+}
+
+static void sim_write(uint32_t val, addr_t addr)
+{
+	switch (addr) {
+	case MSM_SSBI_BASE + SSBI2_CMD:
+		sim_cmd(((sim_mode2 & SSBI_MODE2_REG_ADDR_15_8_MASK) >>
+			 SSBI_MODE2_REG_ADDR_15_8_SHFT) << 8 |
+			((val & SSBI_CMD_REG_ADDR_MASK) >> SSBI_CMD_REG_ADDR_SHFT),
+			!!(val & SSBI_CMD_RDWRN), val & 0xFF);
+		break;
+	case MSM_SSBI_BASE + SSBI2_MODE2:
+		sim_mode2 = val;
+		break;
+	case PA1_SSBI2_CMD:
+	case PA2_SSBI2_CMD:
+		sim_cmd((val >> PA1_SSBI2_REG_ADDR_SHIFT) & 0xFFFF,
+			(val >> PA1_SSBI2_CMD_RDWRN_SHIFT) & 1, val & 0xFF);
+		sim_pa_status = (1 << PA1_SSBI2_TRANS_DONE_SHIFT) | sim_rd;
+		break;
+	}
+}
+
+static const struct ssbi_reg_ops sim_ops = {
+	.read  = sim_read,
+	.write = sim_write,
+};
+
+static int sim_completions;
+static event_t sim_done;
+
+/* the batch belongs to the callback, which is told instead of the event */
+static void sim_complete(struct ssbi_batch *b)
+{
+	sim_completions++;
+	event_signal((event_t *) b->arg, false);
+}
+
+int ssbi_tests(void)
+{
+	const struct ssbi_reg_ops *old;
+	struct ssbi_stats stats;
+	struct ssbi_batch b;
+	uint8_t wr[5] = { 0x11, 0x22, 0x33, 0x44, 0x55 };
+	uint8_t rd[5];
+	uint8_t val;
+	struct ssbi_xfer xfers[5] = {
+		{ .addr = 0x148, .len = 1, .flags = SSBI_XFER_WRITE },
+		{ .addr = 0x149, .len = 1, .flags = SSBI_XFER_WRITE },
+		{ .addr = 0x14A, .len = 1, .flags = SSBI_XFER_WRITE },
+		{ .addr = 0x0A0, .len = 1, .flags = SSBI_XFER_WRITE },
+		{ .addr = 0x0A1, .len = 1, .flags = SSBI_XFER_WRITE },
+	};
+	int i;
+	int err = -1;
+
+	printf("ssbi tests\n");
+
+	memset(sim_pmic, 0, sizeof(sim_pmic));
+	sim_mode2 = SSBI_MODE2_SSBI2_MODE;
+	sim_busy = sim_wedged = 0;
+	sim_cmds = 0;
+	sim_completions = 0;
+	old = ssbi_set_reg_ops(&sim_ops);
+	ssbi_reset_stats();
+
+	/* one batch across two pages only rewrites MODE2 twice */
+	for (i = 0; i < 5; i++)
+		xfers[i].buf = &wr[i];
+	ssbi_batch_init(&b, SSBI_BUS_SSBI2, xfers, 5);
+	if (ssbi_batch_run(&b) || b.done != 5) {
+		printf("write batch failed, %u done\n", b.done);
+		goto out;
+	}
+	ssbi_get_stats(&stats);
+	if (stats.page_writes != 2 || stats.writes != 5 || sim_cmds != 5) {
+		printf("write batch: %u page writes, %u writes, %u commands\n",
+		       stats.page_writes, stats.writes, sim_cmds);
+		goto out;
+	}
+	if (sim_pmic[0x149] != 0x22 || sim_pmic[0x0A1] != 0x55) {
+		printf("write batch did not reach the registers\n");
+		goto out;
+	}
+
+	/* read it all back through a queued batch with a callback... */
+	for (i = 0; i < 5; i++) {
+		xfers[i].flags = SSBI_XFER_READ;
+		xfers[i].buf = &rd[i];
+	}
+	memset(rd, 0, sizeof(rd));
+	event_init(&sim_done, false, 0);
+	ssbi_batch_init(&b, SSBI_BUS_SSBI2, xfers, 5);
+	b.complete = sim_complete;
+	b.arg = &sim_done;
+	ssbi_batch_queue(&b);
+	event_wait(&sim_done);
+	event_destroy(&sim_done);
+	if (b.status || b.done != 5 || sim_completions != 1 ||
+	    memcmp(rd, wr, 5)) {
+		printf("queued read batch with callback failed\n");
+		goto out;
+	}
+
+	/* ...and again waiting on the batch event */
+	memset(rd, 0, sizeof(rd));
+	ssbi_batch_init(&b, SSBI_BUS_SSBI2, xfers, 5);
+	ssbi_batch_queue(&b);
+	if (ssbi_batch_wait(&b) || b.done != 5 || sim_completions != 1 ||
+	    memcmp(rd, wr, 5)) {
+		printf("queued read batch failed\n");
+		goto out;
+	}
+
+	/* the byte level calls still work, through both arbiters */
+	val = 0x5a;
+	if (pa1_ssbi2_write_bytes(&val, 1, 0x200) || sim_pmic[0x200] != 0x5a) {
+		printf("pa1 write failed\n");
+		goto out;
+	}
+	val = 0;
+	if (pa2_ssbi2_read_bytes(&val, 1, 0x200) || val != 0x5a) {
+		printf("pa2 read failed\n");
+		goto out;
+	}
+
+	/* a wedged bus times out and reports how far the batch got */
+	sim_wedged = 1;
+	ssbi_batch_init(&b, SSBI_BUS_PA1, xfers, 5);
+	if (ssbi_batch_run(&b) != 1 || b.done != 0) {
+		printf("wedged bus did not time out\n");
+		goto out;
+	}
+	sim_wedged = 0;
+
+	ssbi_get_stats(&stats);
+	if (stats.timeouts != 1 || stats.polls == 0) {
+		printf("expected one timeout and some polls\n");
+		goto out;
+	}
+	ssbi_dump_stats();
+
+	printf("ssbi tests passed\n");
+	err = 0;
+
+out:
+	ssbi_set_reg_ops(old);
+	return err;
+}
+
+#endif
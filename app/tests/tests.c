@@ -31,6 +31,36 @@
 STATIC_COMMAND_START
 STATIC_COMMAND("printf_tests", NULL, (console_cmd)&printf_tests)
 STATIC_COMMAND("thread_tests", NULL, (console_cmd)&thread_tests)
+#if defined(WITH_LIB_BCACHE)
+STATIC_COMMAND("bcache_tests", NULL, (console_cmd)&bcache_tests)
+#endif
+#if defined(WITH_LIB_FS_EXT4)
+STATIC_COMMAND("ext4_tests", NULL, (console_cmd)&ext4_tests)
+#endif
+#if defined(WITH_DEV_PMIC_PM8X41)
+STATIC_COMMAND("pmic_shadow_tests", NULL, (console_cmd)&pmic_shadow_tests)
+#endif
+#if defined(WITH_DEV_SSBI)
+STATIC_COMMAND("ssbi_tests", NULL, (console_cmd)&ssbi_tests)
+#endif
+#if defined(KEYS_USE_GPIO_KEYPAD)
+STATIC_COMMAND("keypad_tests", NULL, (console_cmd)&keypad_tests)
+#endif
+#if defined(I2C_TEST_BLSP_ID)
+STATIC_COMMAND("i2c_bench", "i2c throughput/latency", &i2c_bench)
+#endif
+#if defined(SSD_ENABLE)
+STATIC_COMMAND("scm_tests", NULL, (console_cmd)&scm_tests)
+#endif
+#if defined(WITH_LIB_MEMTEST)
+STATIC_COMMAND("memtest_tests", NULL, (console_cmd)&memtest_tests)
+#endif
+#if defined(WITH_LIB_BOOTPARAM)
+STATIC_COMMAND("bootparam_tests", NULL, (console_cmd)&bootparam_tests)
+#endif
+#if PERIPH_BLK_ADM
+STATIC_COMMAND("adm_bench", "adm queue depth/throughput", &adm_bench)
+#endif
 STATIC_COMMAND_END(tests);
 
 #endif
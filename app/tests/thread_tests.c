@@ -21,11 +21,15 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <debug.h>
+#include <err.h>
 #include <rand.h>
 #include <app/tests.h>
 #include <kernel/thread.h>
 #include <kernel/mutex.h>
 #include <kernel/event.h>
+#include <kernel/dpc.h>
+#include <kernel/timer.h>
+#include <platform.h>
 
 static int sleep_thread(void *arg)
 {
@@ -136,6 +140,93 @@ int mutex_test(void)
 	return 0;
 }
 
+static mutex_t pi_mutex;
+static event_t pi_held;
+static volatile int pi_threads;
+static volatile int pi_low_priority;
+static volatile time_t pi_high_wait;
+
+static void pi_busy(time_t ms)
+{
+	time_t start = current_time();
+
+	while (current_time() - start < ms)
+		;
+}
+
+static int pi_low_thread(void *arg)
+{
+	mutex_acquire(&pi_mutex);
+	event_signal(&pi_held, true);
+
+	/* hold the mutex for a while, long enough for the high thread to queue up behind us */
+	pi_busy(50);
+	pi_low_priority = current_thread->priority;
+
+	mutex_release(&pi_mutex);
+	atomic_add(&pi_threads, -1);
+	return 0;
+}
+
+static int pi_medium_thread(void *arg)
+{
+	/* hog the cpu, starving anything below us that has not inherited a priority */
+	pi_busy(200);
+	atomic_add(&pi_threads, -1);
+	return 0;
+}
+
+static int pi_high_thread(void *arg)
+{
+	time_t start = current_time();
+
+	mutex_acquire(&pi_mutex);
+	pi_high_wait = current_time() - start;
+	mutex_release(&pi_mutex);
+
+	atomic_add(&pi_threads, -1);
+	return 0;
+}
+
+/*
+ * classic priority inversion: a low priority thread holds a mutex that a
+ * high priority thread wants while a medium priority thread hogs the cpu.
+ * with priority inheritance the low thread runs at the high thread's
+ * priority until it releases, so the high thread waits ~50ms, not ~250ms.
+ */
+static void mutex_inherit_test(void)
+{
+	struct mutex_stats stats;
+
+	printf("testing mutex priority inheritance\n");
+
+	mutex_init(&pi_mutex);
+	event_init(&pi_held, false, EVENT_FLAG_AUTOUNSIGNAL);
+	pi_threads = 3;
+	pi_low_priority = 0;
+	pi_high_wait = 0;
+
+	thread_resume(thread_create("pi low", &pi_low_thread, NULL, LOW_PRIORITY, DEFAULT_STACK_SIZE));
+	event_wait(&pi_held);
+
+	thread_resume(thread_create("pi high", &pi_high_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE));
+	thread_resume(thread_create("pi medium", &pi_medium_thread, NULL, HIGH_PRIORITY - 2, DEFAULT_STACK_SIZE));
+
+	while (pi_threads > 0)
+		thread_sleep(10);
+
+	mutex_get_stats(&pi_mutex, &stats);
+	printf("pi low ran at priority %d while holding (should be %d)\n", pi_low_priority, HIGH_PRIORITY);
+	printf("pi high waited %lu ms (should be near 50, not 250)\n", pi_high_wait);
+	printf("pi stats: %u acquires, %u contended, %u boosts, max hold %llu us, max wait %llu us\n",
+			stats.acquires, stats.contended, stats.boosts, stats.max_hold, stats.max_wait);
+
+	mutex_dump_stats(&pi_mutex);
+
+	event_destroy(&pi_held);
+	mutex_destroy(&pi_mutex);
+}
+
 static event_t e;
 
 static int event_signaller(void *arg)
@@ -308,15 +399,341 @@ static void atomic_test(void)
 	printf("atomic count == %d (should be zero)\n", atomic);
 }
 
+#define DPC_TEST_ITEMS 8
+#define DPC_TEST_ROUNDS 1000
+#define DPC_TEST_ORDERED 4
+
+static dpc_t dpc_test_items[DPC_TEST_ITEMS];
+static volatile int dpc_test_runs[DPC_TEST_ITEMS];
+static volatile int dpc_one_off_runs;
+static volatile int dpc_producers;
+static int dpc_order[DPC_TEST_ORDERED];
+static volatile int dpc_order_count;
+static event_t dpc_gate_started;
+static event_t dpc_gate;
+static event_t dpc_fast_done;
+
+static void dpc_test_cb(void *arg)
+{
+	atomic_add(&dpc_test_runs[(int)arg], 1);
+}
+
+static void dpc_one_off_cb(void *arg)
+{
+	atomic_add(&dpc_one_off_runs, 1);
+}
+
+static void dpc_order_cb(void *arg)
+{
+	if (dpc_order_count < DPC_TEST_ORDERED)
+		dpc_order[dpc_order_count] = (int)arg;
+	dpc_order_count++;
+}
+
+/* holds up the normal level worker until dpc_gate is signalled */
+static void dpc_gate_cb(void *arg)
+{
+	event_signal(&dpc_gate_started, false);
+	event_wait(&dpc_gate);
+}
+
+static void dpc_slow_cb(void *arg)
+{
+	thread_sleep(200);
+}
+
+static void dpc_fast_cb(void *arg)
+{
+	event_signal(&dpc_fast_done, true);
+}
+
+static int dpc_producer(void *arg)
+{
+	int i, j;
+
+	for (i = 0; i < DPC_TEST_ROUNDS; i++) {
+		for (j = 0; j < DPC_TEST_ITEMS; j++)
+			dpc_queue_item(&dpc_test_items[j], DPC_FLAG_NORESCHED);
+		if ((i % 64) == 0)
+			thread_yield();
+	}
+
+	atomic_add(&dpc_producers, -1);
+	return 0;
+}
+
+static void dpc_close_gate(dpc_t *gate)
+{
+	event_unsignal(&dpc_gate);
+	event_unsignal(&dpc_gate_started);
+	dpc_queue_item(gate, 0);
+	event_wait(&dpc_gate_started);
+}
+
+static void dpc_test(void)
+{
+	struct dpc_stats before[DPC_NUM_LEVELS], after;
+	dpc_t gate, ordered[DPC_TEST_ORDERED], slow, fast;
+	bigtime_t start, latency;
+	uint queued = 0, coalesced = 0, run = 0;
+	status_t err;
+	int i;
+	int errors = 0;
+
+	printf("dpc test: %d items, 4 producers, %d rounds\n",
+		DPC_TEST_ITEMS, DPC_TEST_ROUNDS);
+
+	for (i = 0; i < DPC_NUM_LEVELS; i++)
+		dpc_get_stats(i, &before[i]);
+
+	for (i = 0; i < DPC_TEST_ITEMS; i++) {
+		dpc_test_runs[i] = 0;
+		dpc_initialize(&dpc_test_items[i], dpc_test_cb, (void *)i,
+			i % DPC_NUM_LEVELS);
+	}
+
+	dpc_producers = 4;
+	for (i = 0; i < 4; i++)
+		thread_resume(thread_create("dpc producer", &dpc_producer, NULL,
+			LOW_PRIORITY, DEFAULT_STACK_SIZE));
+
+	while (dpc_producers > 0)
+		thread_sleep(10);
+	thread_sleep(100);
+
+	for (i = 0; i < DPC_NUM_LEVELS; i++) {
+		dpc_get_stats(i, &after);
+		queued += after.queued - before[i].queued;
+		coalesced += after.coalesced - before[i].coalesced;
+		run += after.run - before[i].run;
+	}
+
+	for (i = 0; i < DPC_TEST_ITEMS; i++) {
+		if (dpc_test_runs[i] == 0) {
+			printf("dpc test: item %d never ran\n", i);
+			errors++;
+		}
+	}
+	/* the producers' own exit cleanup is queued too, so allow for extra */
+	if (queued != run ||
+	    queued + coalesced < 4 * DPC_TEST_ROUNDS * DPC_TEST_ITEMS) {
+		printf("dpc test: %u requests, %u queued, %u coalesced, %u run\n",
+			4 * DPC_TEST_ROUNDS * DPC_TEST_ITEMS, queued, coalesced, run);
+		errors++;
+	}
+
+	event_init(&dpc_gate_started, false, 0);
+	event_init(&dpc_gate, false, 0);
+	dpc_initialize(&gate, dpc_gate_cb, NULL, DPC_LEVEL_NORMAL);
+
+	/* with the worker held up, items queue in order and a repeat coalesces */
+	dpc_close_gate(&gate);
+	dpc_get_stats(DPC_LEVEL_NORMAL, &before[DPC_LEVEL_NORMAL]);
+	dpc_order_count = 0;
+	for (i = 0; i < DPC_TEST_ORDERED; i++) {
+		dpc_initialize(&ordered[i], dpc_order_cb, (void *)i,
+			DPC_LEVEL_NORMAL);
+		dpc_queue_item(&ordered[i], 0);
+	}
+	dpc_queue_item(&ordered[1], 0);
+	dpc_queue_item(&ordered[1], 0);
+	dpc_get_stats(DPC_LEVEL_NORMAL, &after);
+	if (after.queued - before[DPC_LEVEL_NORMAL].queued != DPC_TEST_ORDERED ||
+	    after.coalesced - before[DPC_LEVEL_NORMAL].coalesced != 2 ||
+	    dpc_order_count != 0) {
+		printf("dpc test: %u queued, %u coalesced, %d ran behind the gate\n",
+			after.queued - before[DPC_LEVEL_NORMAL].queued,
+			after.coalesced - before[DPC_LEVEL_NORMAL].coalesced,
+			dpc_order_count);
+		errors++;
+	}
+	event_signal(&dpc_gate, true);
+	thread_sleep(50);
+	if (dpc_order_count != DPC_TEST_ORDERED) {
+		printf("dpc test: %d of %d ordered items ran\n", dpc_order_count,
+			DPC_TEST_ORDERED);
+		errors++;
+	}
+	for (i = 0; i < DPC_TEST_ORDERED && i < dpc_order_count; i++) {
+		if (dpc_order[i] != i) {
+			printf("dpc test: item %d ran in position %d\n",
+				dpc_order[i], i);
+			errors++;
+		}
+	}
+
+	/* the one-off pool runs dry without falling back to the heap... */
+	dpc_close_gate(&gate);
+	dpc_one_off_runs = 0;
+	for (i = 0; i < DPC_POOL_SIZE; i++) {
+		err = dpc_queue(dpc_one_off_cb, NULL, DPC_FLAG_NORESCHED);
+		if (err != NO_ERROR) {
+			printf("dpc test: one-off %d of the pool refused, %d\n",
+				i, err);
+			errors++;
+			break;
+		}
+	}
+	err = dpc_queue(dpc_one_off_cb, NULL, DPC_FLAG_NORESCHED);
+	if (err != ERR_NO_MEMORY) {
+		printf("dpc test: one-off past the pool returned %d\n", err);
+		errors++;
+	}
+	event_signal(&dpc_gate, true);
+	thread_sleep(50);
+
+	/* ...and every item is back for reuse once the callbacks have run */
+	for (i = 0; i < DPC_POOL_SIZE; i++) {
+		err = dpc_queue(dpc_one_off_cb, NULL, DPC_FLAG_NORESCHED);
+		if (err != NO_ERROR) {
+			printf("dpc test: one-off %d refused after the pool drained, %d\n",
+				i, err);
+			errors++;
+			break;
+		}
+	}
+	thread_sleep(50);
+	if (dpc_one_off_runs != 2 * DPC_POOL_SIZE) {
+		printf("dpc test: %d of %d one-off callbacks ran\n",
+			dpc_one_off_runs, 2 * DPC_POOL_SIZE);
+		errors++;
+	}
+	event_destroy(&dpc_gate);
+	event_destroy(&dpc_gate_started);
+
+	/* a slow low level callback must not hold up the high level */
+	event_init(&dpc_fast_done, false, 0);
+	dpc_initialize(&slow, dpc_slow_cb, NULL, DPC_LEVEL_LOW);
+	dpc_initialize(&fast, dpc_fast_cb, NULL, DPC_LEVEL_HIGH);
+	dpc_queue_item(&slow, 0);
+	start = current_time_hires();
+	dpc_queue_item(&fast, 0);
+	event_wait(&dpc_fast_done);
+	latency = current_time_hires() - start;
+	if (latency >= 100000) {
+		printf("dpc test: high level ran %llu us after queueing behind a slow low level callback\n",
+			latency);
+		errors++;
+	}
+	thread_sleep(250);
+	event_destroy(&dpc_fast_done);
+
+	dpc_dump_stats();
+	printf("dpc test: %d errors\n", errors);
+}
+
+#if THREAD_STATS
+static volatile int latency_threads;
+
+static int latency_sleeper(void *arg)
+{
+	int i;
+
+	for (i = 0; i < 50; i++)
+		thread_sleep(1 + (rand() % 5));
+
+	atomic_add(&latency_threads, -1);
+	return 0;
+}
+
+static int latency_hog(void *arg)
+{
+	time_t start = current_time();
+
+	/* keep the cpu busy so the low priority sleepers queue up behind us */
+	while (current_time() - start < 200)
+		;
+
+	atomic_add(&latency_threads, -1);
+	return 0;
+}
+
+static void latency_test(void)
+{
+	printf("testing wake-up latency accounting\n");
+
+	thread_reset_latency();
+
+	latency_threads = 4;
+	thread_resume(thread_create("lat low", &latency_sleeper, NULL, LOW_PRIORITY, DEFAULT_STACK_SIZE));
+	thread_resume(thread_create("lat default", &latency_sleeper, NULL, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
+	thread_resume(thread_create("lat high", &latency_sleeper, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE));
+	thread_resume(thread_create("lat hog", &latency_hog, NULL, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
+
+	while (latency_threads > 0)
+		thread_sleep(10);
+
+	/* the sleepers have exited, expect priority LOW_PRIORITY to show the worst latency */
+	thread_dump_latency();
+}
+#endif
+
+#define TIMER_TEST_COUNT 500
+
+static timer_t timer_test_timers[TIMER_TEST_COUNT];
+static volatile int timer_test_fired;
+static volatile int timer_test_early;
+
+static enum handler_return timer_test_cb(struct timer *t, time_t now, void *arg)
+{
+	if (TIME_LT(now, t->scheduled_time))
+		timer_test_early++;
+	timer_test_fired++;
+	return INT_NO_RESCHEDULE;
+}
+
+static void timer_test(void)
+{
+	bigtime_t start, elapsed;
+	int i, cancelled = 0;
+
+	printf("timer test: arming %d oneshot timers\n", TIMER_TEST_COUNT);
+
+	timer_test_fired = 0;
+	timer_test_early = 0;
+
+	start = current_time_hires();
+	for (i = 0; i < TIMER_TEST_COUNT; i++) {
+		timer_initialize(&timer_test_timers[i]);
+		timer_set_slack(&timer_test_timers[i], rand() % 20);
+		timer_set_oneshot(&timer_test_timers[i], 1 + (rand() % 1000),
+			timer_test_cb, NULL);
+	}
+	elapsed = current_time_hires() - start;
+	printf("timer test: %llu us to arm, %llu ns per timer\n",
+		elapsed, elapsed * 1000 / TIMER_TEST_COUNT);
+
+	/* cancel every fourth timer, most of them still queued */
+	for (i = 0; i < TIMER_TEST_COUNT; i += 4) {
+		timer_cancel(&timer_test_timers[i]);
+		cancelled++;
+	}
+
+	thread_sleep(1200);
+
+	printf("timer test: %d of %d timers fired, %d early (should be zero)\n",
+		timer_test_fired, TIMER_TEST_COUNT - cancelled, timer_test_early);
+	timer_dump_stats();
+}
+
 int thread_tests(void) 
 {
 	mutex_test();
+	mutex_inherit_test();
 	event_test();
 
 	thread_sleep(200);
 	context_switch_test();
 
 	atomic_test();
+
+	dpc_test();
+
+	timer_test();
+
+#if THREAD_STATS
+	latency_test();
+#endif
 	
 	return 0;
 }
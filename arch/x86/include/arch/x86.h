@@ -125,6 +125,27 @@ static inline uint32_t x86_get_cr2(void) {
 #define rdtscll(val) \
      __asm__ __volatile__("rdtsc" : "=A" (val))
 
+/* cpuid leaf 1 feature bits */
+#define X86_CPUID1_EDX_TSC	(1 << 4)
+#define X86_CPUID1_EDX_MSR	(1 << 5)
+#define X86_CPUID1_EDX_APIC	(1 << 9)
+
+static inline void x86_cpuid(uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+	__asm__ __volatile__ ("cpuid"
+		: "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+		: "a" (leaf), "c" (0));
+}
+
+static inline uint64_t read_msr(uint32_t msr) {
+	uint64_t val;
+	__asm__ __volatile__ ("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static inline void write_msr(uint32_t msr, uint64_t val) {
+	__asm__ __volatile__ ("wrmsr" : : "c" (msr), "A" (val));
+}
+
 static inline uint8_t inp(uint16_t _port) {
     uint8_t rv;
     __asm__ __volatile__ ("inb %1, %0"
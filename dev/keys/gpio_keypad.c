@@ -40,7 +40,9 @@
 #include <dev/gpio_keypad.h>
 #include <dev/ssbi.h>
 #include <kernel/event.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
+#include <list.h>
 #include <reg.h>
 #include <platform/iomap.h>
 #include <platform/timer.h>
@@ -48,26 +50,85 @@
 
 #define LINUX_MACHTYPE_8660_QT      3298
 
+enum gpio_kp_state {
+	GPIO_KP_SCANNING,	/* walking the outputs, one settle_time apart */
+	GPIO_KP_ARMED,		/* all outputs driven, waiting for any input */
+};
+
 struct gpio_kp {
 	struct gpio_keypad_info *keypad_info;
+	struct list_node node;
 	struct timer timer;
 	event_t full_scan;
+	enum gpio_kp_state state;
 	int current_output;
-	unsigned int some_keys_pressed:2;
-	unsigned long keys_pressed[0];
+	bool initial_scan;
+	unsigned long *keys_sample;	/* raw state seen by the current scan */
+	unsigned long *keys_last;	/* raw state seen by the previous scan */
+	struct gpio_keypad_stats stats;
+	unsigned long keys_pressed[0];	/* debounced state, followed by the two above */
 };
 
+/* give up on a key that is still bouncing after this many scans */
+#define QWERTY_KP_MAX_SCANS	8
+
 struct gpio_qwerty_kp {
 	struct qwerty_keypad_info *keypad_info;
 	struct timer timer;
 	event_t full_scan;
+	int pending_key;	/* seen by the last scan, not yet confirmed */
+	int scans;		/* scans since the last settled one */
+	struct gpio_keypad_stats stats;
 	unsigned int some_keys_pressed:2;
 	unsigned long keys_pressed[0];
 };
 
 static struct gpio_qwerty_kp *qwerty_keypad;
-/* TODO: Support multiple keypads? */
-static struct gpio_kp *keypad;
+static struct list_node gpio_keypads = LIST_INITIAL_VALUE(gpio_keypads);
+
+static enum handler_return
+gpio_keypad_timer_func(struct timer *timer, time_t now, void *arg);
+
+static int kp_gpio_get(struct gpio_kp *kp, unsigned nr)
+{
+	const struct gpio_keypad_gpio_ops *ops = kp->keypad_info->gpio_ops;
+
+	return ops ? ops->get(nr) : gpio_get(nr);
+}
+
+static void kp_gpio_set(struct gpio_kp *kp, unsigned nr, unsigned on)
+{
+	const struct gpio_keypad_gpio_ops *ops = kp->keypad_info->gpio_ops;
+
+	if (ops)
+		ops->set(nr, on);
+	else
+		gpio_set(nr, on);
+}
+
+static void kp_gpio_config(struct gpio_kp *kp, unsigned nr, unsigned flags)
+{
+	const struct gpio_keypad_gpio_ops *ops = kp->keypad_info->gpio_ops;
+
+	if (ops)
+		ops->config(nr, flags);
+	else
+		gpio_config(nr, flags);
+}
+
+static void drive_output(struct gpio_kp *kp, int out, int active)
+{
+	struct gpio_keypad_info *kpinfo = kp->keypad_info;
+	int polarity = !!(kpinfo->flags & GPIOKPF_ACTIVE_HIGH);
+	int gpio = kpinfo->output_gpios[out];
+
+	if (kpinfo->flags & GPIOKPF_DRIVE_INACTIVE)
+		kp_gpio_set(kp, gpio, active ? polarity : !polarity);
+	else if (active)
+		kp_gpio_config(kp, gpio, polarity ? GPIO_OUTPUT : 0);
+	else
+		kp_gpio_config(kp, gpio, GPIO_INPUT);
+}
 
 static void check_output(struct gpio_kp *kp, int out, int polarity)
 {
@@ -75,46 +136,142 @@ static void check_output(struct gpio_kp *kp, int out, int polarity)
 	int key_index;
 	int in;
 	int gpio;
-	int changed = 0;
 
 	key_index = out * kpinfo->ninputs;
 	for (in = 0; in < kpinfo->ninputs; in++, key_index++) {
 		gpio = kpinfo->input_gpios[in];
-		changed = 0;
-		if (gpio_get(gpio) ^ !polarity) {
-			if (kp->some_keys_pressed < 3)
-				kp->some_keys_pressed++;
-			changed = !bitmap_set(kp->keys_pressed, key_index);
-		} else {
-			changed = bitmap_clear(kp->keys_pressed, key_index);
-		}
-		if (changed) {
-			int state = bitmap_test(kp->keys_pressed, key_index);
-			keys_post_event(kpinfo->keymap[key_index], state);
-		}
+		if (kp_gpio_get(kp, gpio) ^ !polarity)
+			bitmap_set(kp->keys_sample, key_index);
+		else
+			bitmap_clear(kp->keys_sample, key_index);
 	}
 
 	/* sets up the right state for the next poll cycle */
-	gpio = kpinfo->output_gpios[out];
-	if (kpinfo->flags & GPIOKPF_DRIVE_INACTIVE)
-		gpio_set(gpio, !polarity);
-	else
-		gpio_config(gpio, GPIO_INPUT);
+	drive_output(kp, out, 0);
+}
+
+/*
+ * A key change is only reported once two scans in a row agree on it, so
+ * contact bounce shorter than poll_time never reaches keys_post_event().
+ * A change that the next scan does not see again is counted as a bounce.
+ * The first scan after init is taken as is, so keys held at boot show up
+ * straight away.
+ *
+ * Returns true if any key is down or still settling.
+ */
+static bool debounce_scan(struct gpio_kp *kp)
+{
+	struct gpio_keypad_info *kpinfo = kp->keypad_info;
+	int key_count = kpinfo->ninputs * kpinfo->noutputs;
+	bool busy = false;
+	int i;
+
+	for (i = 0; i < key_count; i++) {
+		int sample = bitmap_test(kp->keys_sample, i);
+		int last = bitmap_test(kp->keys_last, i);
+		int pressed = bitmap_test(kp->keys_pressed, i);
+
+		if (sample != pressed) {
+			if (kp->initial_scan || sample == last) {
+				if (sample)
+					bitmap_set(kp->keys_pressed, i);
+				else
+					bitmap_clear(kp->keys_pressed, i);
+				keys_post_event(kpinfo->keymap[i], sample);
+				kp->stats.events++;
+				pressed = sample;
+			} else {
+				/* first sighting, confirm it next scan */
+				busy = true;
+			}
+		} else if (!kp->initial_scan && last != pressed) {
+			/* the change seen last scan has gone again */
+			kp->stats.bounces++;
+		}
+
+		if (sample)
+			bitmap_set(kp->keys_last, i);
+		else
+			bitmap_clear(kp->keys_last, i);
+		if (pressed)
+			busy = true;
+	}
+
+	kp->initial_scan = false;
+	return busy;
+}
+
+/* any input active with every output driven? */
+static bool any_input_active(struct gpio_kp *kp)
+{
+	struct gpio_keypad_info *kpinfo = kp->keypad_info;
+	int polarity = !!(kpinfo->flags & GPIOKPF_ACTIVE_HIGH);
+	int in;
+
+	for (in = 0; in < kpinfo->ninputs; in++) {
+		if (kp_gpio_get(kp, kpinfo->input_gpios[in]) ^ !polarity)
+			return true;
+	}
+
+	return false;
+}
+
+static void start_scan(struct gpio_kp *kp)
+{
+	int out;
+
+	for (out = 0; out < kp->keypad_info->noutputs; out++)
+		drive_output(kp, out, 0);
+
+	kp->stats.wakeups++;
+	kp->state = GPIO_KP_SCANNING;
+	kp->current_output = kp->keypad_info->noutputs;
+	timer_set_oneshot(&kp->timer, 0, gpio_keypad_timer_func, kp);
+}
+
+/*
+ * Nothing is pressed: drive every output at once so that any key press
+ * shows up on an input, and wait for it. With a key-change interrupt the
+ * timer stops until gpio_keypad_notify(); without one, a single read of
+ * the inputs every poll_time stands in for the full matrix scan.
+ */
+static void arm_keypad(struct gpio_kp *kp)
+{
+	struct gpio_keypad_info *kpinfo = kp->keypad_info;
+	int out;
+
+	for (out = 0; out < kpinfo->noutputs; out++)
+		drive_output(kp, out, 1);
+
+	kp->state = GPIO_KP_ARMED;
+	if (kpinfo->irq_enable && kpinfo->irq_enable(kpinfo, 1) == 0)
+		return;
+
+	timer_set_oneshot(&kp->timer, kpinfo->poll_time,
+			  gpio_keypad_timer_func, kp);
 }
 
 static enum handler_return
 gpio_keypad_timer_func(struct timer *timer, time_t now, void *arg)
 {
-	struct gpio_kp *kp = keypad;
+	struct gpio_kp *kp = arg;
 	struct gpio_keypad_info *kpinfo = kp->keypad_info;
 	int polarity = !!(kpinfo->flags & GPIOKPF_ACTIVE_HIGH);
 	int out;
-	int gpio;
+
+	if (kp->state == GPIO_KP_ARMED) {
+		kp->stats.idle_checks++;
+		if (any_input_active(kp))
+			start_scan(kp);
+		else
+			timer_set_oneshot(timer, kpinfo->poll_time,
+					  gpio_keypad_timer_func, kp);
+		goto done;
+	}
 
 	out = kp->current_output;
 	if (out == kpinfo->noutputs) {
 		out = 0;
-		kp->some_keys_pressed = 0;
 	} else {
 		check_output(kp, out, polarity);
 		out++;
@@ -122,30 +279,65 @@ gpio_keypad_timer_func(struct timer *timer, time_t now, void *arg)
 
 	kp->current_output = out;
 	if (out < kpinfo->noutputs) {
-		gpio = kpinfo->output_gpios[out];
-		if (kpinfo->flags & GPIOKPF_DRIVE_INACTIVE)
-			gpio_set(gpio, polarity);
-		else
-			gpio_config(gpio, polarity ? GPIO_OUTPUT : 0);
+		drive_output(kp, out, 1);
 		timer_set_oneshot(timer, kpinfo->settle_time,
-				  gpio_keypad_timer_func, NULL);
+				  gpio_keypad_timer_func, kp);
 		goto done;
 	}
 
-	if (/*!kp->use_irq*/ 1 || kp->some_keys_pressed) {
-		event_signal(&kp->full_scan, false);
+	/* full scan done */
+	kp->stats.scans++;
+	event_signal(&kp->full_scan, false);
+	if (debounce_scan(kp))
 		timer_set_oneshot(timer, kpinfo->poll_time,
-				  gpio_keypad_timer_func, NULL);
-		goto done;
-	}
+				  gpio_keypad_timer_func, kp);
+	else
+		arm_keypad(kp);
 
 done:
 	return INT_RESCHEDULE;
 }
 
+static struct gpio_kp *find_keypad(struct gpio_keypad_info *kpinfo)
+{
+	struct gpio_kp *kp;
+
+	list_for_every_entry(&gpio_keypads, kp, struct gpio_kp, node) {
+		if (kp->keypad_info == kpinfo)
+			return kp;
+	}
+
+	return NULL;
+}
+
+/*
+ * Called from the platform's key-change interrupt handler once it has been
+ * enabled through kpinfo->irq_enable. Disarms the interrupt and starts a
+ * scan.
+ */
+void gpio_keypad_notify(struct gpio_keypad_info *kpinfo)
+{
+	struct gpio_kp *kp;
+
+	enter_critical_section();
+
+	kp = find_keypad(kpinfo);
+	if (kp && kp->state == GPIO_KP_ARMED) {
+		kp->stats.irqs++;
+		if (kpinfo->irq_enable)
+			kpinfo->irq_enable(kpinfo, 0);
+		timer_cancel(&kp->timer);
+		start_scan(kp);
+	}
+
+	exit_critical_section();
+}
+
 void gpio_keypad_init(struct gpio_keypad_info *kpinfo)
 {
+	struct gpio_kp *keypad;
 	int key_count;
+	int words;
 	int output_val;
 	int output_cfg;
 	int i;
@@ -153,35 +345,100 @@ void gpio_keypad_init(struct gpio_keypad_info *kpinfo)
 
 	ASSERT(kpinfo->keymap && kpinfo->input_gpios && kpinfo->output_gpios);
 	key_count = kpinfo->ninputs * kpinfo->noutputs;
+	words = BITMAP_NUM_WORDS(key_count);
 
-	len = sizeof(struct gpio_kp) + (sizeof(unsigned long) *
-					BITMAP_NUM_WORDS(key_count));
+	len = sizeof(struct gpio_kp) + (sizeof(unsigned long) * words * 3);
 	keypad = malloc(len);
 	ASSERT(keypad);
 
 	memset(keypad, 0, len);
 	keypad->keypad_info = kpinfo;
+	keypad->keys_sample = keypad->keys_pressed + words;
+	keypad->keys_last = keypad->keys_sample + words;
+	keypad->initial_scan = true;
+	keypad->state = GPIO_KP_SCANNING;
 
 	output_val = (!!(kpinfo->flags & GPIOKPF_ACTIVE_HIGH)) ^
 		     (!!(kpinfo->flags & GPIOKPF_DRIVE_INACTIVE));
 	output_cfg = kpinfo->flags & GPIOKPF_DRIVE_INACTIVE ? GPIO_OUTPUT : 0;
 	for (i = 0; i < kpinfo->noutputs; i++) {
-		gpio_set(kpinfo->output_gpios[i], output_val);
-		gpio_config(kpinfo->output_gpios[i], output_cfg);
+		kp_gpio_set(keypad, kpinfo->output_gpios[i], output_val);
+		kp_gpio_config(keypad, kpinfo->output_gpios[i], output_cfg);
 	}
 	for (i = 0; i < kpinfo->ninputs; i++)
-		gpio_config(kpinfo->input_gpios[i], GPIO_INPUT);
+		kp_gpio_config(keypad, kpinfo->input_gpios[i], GPIO_INPUT);
 
 	keypad->current_output = kpinfo->noutputs;
 
 	event_init(&keypad->full_scan, false, EVENT_FLAG_AUTOUNSIGNAL);
 	timer_initialize(&keypad->timer);
-	timer_set_oneshot(&keypad->timer, 0, gpio_keypad_timer_func, NULL);
+
+	enter_critical_section();
+	list_add_tail(&gpio_keypads, &keypad->node);
+	exit_critical_section();
+
+	timer_set_oneshot(&keypad->timer, 0, gpio_keypad_timer_func, keypad);
 
 	/* wait for the keypad to complete one full scan */
 	event_wait(&keypad->full_scan);
 }
 
+/*
+ * Stop scanning a keypad and free it. Keys still down are reported released.
+ */
+void gpio_keypad_uninit(struct gpio_keypad_info *kpinfo)
+{
+	struct gpio_kp *kp;
+	int i;
+
+	enter_critical_section();
+
+	kp = find_keypad(kpinfo);
+	if (!kp) {
+		exit_critical_section();
+		return;
+	}
+
+	timer_cancel(&kp->timer);
+	if (kp->state == GPIO_KP_ARMED && kpinfo->irq_enable)
+		kpinfo->irq_enable(kpinfo, 0);
+	list_delete(&kp->node);
+
+	for (i = 0; i < kpinfo->ninputs * kpinfo->noutputs; i++) {
+		if (bitmap_test(kp->keys_pressed, i))
+			keys_post_event(kpinfo->keymap[i], 0);
+	}
+
+	exit_critical_section();
+
+	event_destroy(&kp->full_scan);
+	free(kp);
+}
+
+void gpio_keypad_get_stats(struct gpio_keypad_info *kpinfo,
+			   struct gpio_keypad_stats *stats)
+{
+	struct gpio_kp *kp;
+
+	enter_critical_section();
+	kp = find_keypad(kpinfo);
+	if (kp)
+		*stats = kp->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+	exit_critical_section();
+}
+
+void ssbi_keypad_get_stats(struct gpio_keypad_stats *stats)
+{
+	enter_critical_section();
+	if (qwerty_keypad)
+		*stats = qwerty_keypad->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+	exit_critical_section();
+}
+
 int pm8058_gpio_config(int gpio, struct pm8058_gpio *param)
 {
 	int	rc;
@@ -311,6 +568,11 @@ static void ssbi_gpio_init(unsigned int mach_id)
     }
 }
 
+/*
+ * As with the gpio matrix, a key is only reported once two scans in a row
+ * see it, poll_time apart. The scan after a key has settled (or given up
+ * bouncing) completes full_scan.
+ */
 static enum handler_return
 scan_qwerty_keypad(struct timer *timer, time_t now, void *arg)
 {
@@ -321,6 +583,7 @@ scan_qwerty_keypad(struct timer *timer, time_t now, void *arg)
     unsigned char column_new_keys = 0x00;
     unsigned char column_old_keys = 0x00;
     int shift = 0;
+    int found = -1;
     static int key_detected = -1;
 
     if ((*rd_function)((qwerty_keypad->keypad_info)->rec_keys, num_of_ssbi_reads,
@@ -331,7 +594,9 @@ scan_qwerty_keypad(struct timer *timer, time_t now, void *arg)
                                                  SSBI_REG_KYPD_OLD_DATA_ADDR))
       dprintf (CRITICAL, "Error in initializing SSBI_REG_KYPD_CNTL register\n");
 
-    while (rows--) {
+    qwerty_keypad->stats.scans++;
+
+    while (rows-- && found < 0) {
          columns = qwerty_keypad->keypad_info->columns;
          if (((qwerty_keypad->keypad_info)->rec_keys[rows]
 	      != (qwerty_keypad->keypad_info)->old_keys[rows])
@@ -344,16 +609,34 @@ scan_qwerty_keypad(struct timer *timer, time_t now, void *arg)
 		    && !((0x01 << columns) & (~column_old_keys))) {
 	            shift = (rows * 8) + columns;
 	            if ((qwerty_keypad->keypad_info)->keymap[shift]) {
-		      if (shift != key_detected) {
-			    key_detected = shift;
-			    keys_post_event((qwerty_keypad->keypad_info)->keymap[shift], 1);
-		        }
+		        found = shift;
+		        break;
 	            }
 		}
 	    }
 	}
     }
 
+    if (found >= 0 && found == qwerty_keypad->pending_key) {
+        /* seen twice in a row */
+        if (found != key_detected) {
+            key_detected = found;
+            keys_post_event((qwerty_keypad->keypad_info)->keymap[found], 1);
+            qwerty_keypad->stats.events++;
+        }
+    } else {
+        if (qwerty_keypad->pending_key >= 0)
+            qwerty_keypad->stats.bounces++;
+        if (found >= 0 && ++qwerty_keypad->scans < QWERTY_KP_MAX_SCANS) {
+            qwerty_keypad->pending_key = found;
+            timer_set_oneshot(timer, (qwerty_keypad->keypad_info)->poll_time,
+                              scan_qwerty_keypad, NULL);
+            return INT_RESCHEDULE;
+        }
+    }
+
+    qwerty_keypad->pending_key = -1;
+    qwerty_keypad->scans = 0;
     event_signal(&qwerty_keypad->full_scan, false);
     return INT_RESCHEDULE;
 }
@@ -414,6 +697,7 @@ void ssbi_keypad_init(struct qwerty_keypad_info  *qwerty_kp)
 
     memset(qwerty_keypad, 0, len);
     qwerty_keypad->keypad_info = qwerty_kp;
+    qwerty_keypad->pending_key = -1;
 
     event_init(&qwerty_keypad->full_scan, false, EVENT_FLAG_AUTOUNSIGNAL);
     timer_initialize(&qwerty_keypad->timer);
@@ -31,29 +31,80 @@
 
 #include <bits.h>
 #include <debug.h>
+#include <err.h>
 #include <string.h>
 #include <dev/keys.h>
+#include <kernel/thread.h>
+#include <kernel/event.h>
+#include <platform.h>
 
 static unsigned long key_bitmap[BITMAP_NUM_WORDS(MAX_KEYS)];
 
+/* key events, oldest first. when full the oldest event is dropped */
+static struct key_event key_queue[KEYS_EVENT_QUEUE_LEN];
+static unsigned key_queue_head;
+static unsigned key_queue_count;
+static event_t key_queue_event;
+static bool key_queue_ready;
+static struct keys_stats key_stats;
+
+static void keys_queue_init(void)
+{
+	if (key_queue_ready)
+		return;
+
+	key_queue_head = 0;
+	key_queue_count = 0;
+	event_init(&key_queue_event, false, 0);
+	key_queue_ready = true;
+}
+
 void keys_init(void)
 {
 	memset(key_bitmap, 0, sizeof(key_bitmap));
+
+	enter_critical_section();
+	keys_queue_init();
+	key_queue_head = 0;
+	key_queue_count = 0;
+	event_unsignal(&key_queue_event);
+	exit_critical_section();
 }
 
 void keys_post_event(uint16_t code, int16_t value)
 {
+	struct key_event *ev;
+
 	if (code >= MAX_KEYS) {
 		dprintf(INFO, "Invalid keycode posted: %d\n", code);
 		return;
 	}
 
-	/* TODO: Implement an actual event queue if it becomes necessary */
 	if (value)
 		bitmap_set(key_bitmap, code);
 	else
 		bitmap_clear(key_bitmap, code);
 
+	/* may be called from interrupt context, e.g. a keypad scan timer */
+	enter_critical_section();
+	keys_queue_init();
+
+	if (key_queue_count == KEYS_EVENT_QUEUE_LEN) {
+		key_queue_head = (key_queue_head + 1) % KEYS_EVENT_QUEUE_LEN;
+		key_queue_count--;
+		key_stats.dropped++;
+	}
+
+	ev = &key_queue[(key_queue_head + key_queue_count) % KEYS_EVENT_QUEUE_LEN];
+	ev->code = code;
+	ev->value = value;
+	ev->time = current_time();
+	key_queue_count++;
+	key_stats.posted++;
+
+	event_signal(&key_queue_event, false);
+	exit_critical_section();
+
 //	dprintf(INFO, "key state change: %d %d\n", code, value);
 }
 
@@ -65,3 +116,39 @@ int keys_get_state(uint16_t code)
 	}
 	return bitmap_test(key_bitmap, code);
 }
+
+/*
+ * Take the oldest key event off the queue, waiting up to timeout ms for
+ * one to arrive. Returns NO_ERROR or ERR_TIMED_OUT.
+ */
+int keys_get_event(struct key_event *ev, time_t timeout)
+{
+	int ret = NO_ERROR;
+
+	enter_critical_section();
+	keys_queue_init();
+
+	while (key_queue_count == 0) {
+		ret = event_wait_timeout(&key_queue_event, timeout);
+		if (ret < 0)
+			goto out;
+	}
+
+	*ev = key_queue[key_queue_head];
+	key_queue_head = (key_queue_head + 1) % KEYS_EVENT_QUEUE_LEN;
+	key_queue_count--;
+	key_stats.delivered++;
+	if (key_queue_count == 0)
+		event_unsignal(&key_queue_event);
+
+out:
+	exit_critical_section();
+	return ret;
+}
+
+void keys_get_stats(struct keys_stats *stats)
+{
+	enter_critical_section();
+	*stats = key_stats;
+	exit_critical_section();
+}
@@ -256,6 +256,7 @@ static u32 mipi_d2l_read_reg(u16 reg)
 
 	mipi_cmd.size = sizeof(dsi_hdr);
 	mipi_cmd.payload = (char *) &dsi_hdr;
+	mipi_cmd.wait = 0;
 
 	dsi_hdr = 0;
 	dsi_hdr |= DSI_HDR_DTYPE(DTYPE_GEN_READ2);
@@ -294,6 +295,7 @@ static int mipi_d2l_write_reg(u16 reg, u32 data)
 
 	mipi_cmd.size = sizeof(payload);
 	mipi_cmd.payload = (char *) &payload;
+	mipi_cmd.wait = 0;
 
 	payload.addr = reg;
 	payload.dsi_hdr = 0;
@@ -83,6 +83,46 @@ struct pm8x41_gpio {
 	int disable_pin;
 };
 
+/* Queued register writes, see pm8x41_txn_commit() */
+#define PM8X41_TXN_MAX_OPS      16
+
+struct pm8x41_txn {
+	uint32_t count;
+	uint32_t addr[PM8X41_TXN_MAX_OPS];
+	uint8_t  val[PM8X41_TXN_MAX_OPS];
+};
+
+void pm8x41_txn_init(struct pm8x41_txn *txn);
+int pm8x41_txn_write(struct pm8x41_txn *txn, uint32_t addr, uint8_t val);
+int pm8x41_txn_commit(struct pm8x41_txn *txn);
+int pm8x41_reg_read_burst(uint32_t addr, uint8_t *buf, uint32_t len);
+int pm8x41_reg_write_burst(uint32_t addr, uint8_t *buf, uint32_t len);
+
+/* SPMI backend used for all register access. read is synchronous,
+ * write may be posted until the next sync. All return 0 on success.
+ */
+struct pm8x41_bus_ops {
+	int (*read)(uint32_t addr, uint8_t *buf, uint32_t len);
+	int (*write)(uint32_t addr, uint8_t *buf, uint32_t len);
+	int (*sync)(void);
+};
+
+const struct pm8x41_bus_ops *pm8x41_set_bus_ops(const struct pm8x41_bus_ops *ops);
+
+/* Shadow register cache */
+struct pm8x41_shadow_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t writes_dropped;
+	uint32_t mismatches;
+};
+
+void pm8x41_shadow_invalidate();
+void pm8x41_shadow_set_verify(int enable);
+int pm8x41_shadow_check();
+void pm8x41_shadow_get_stats(struct pm8x41_shadow_stats *stats);
+void pm8x41_shadow_reset_stats();
+
 int pm8x41_gpio_get(uint8_t gpio, uint8_t *status);
 int pm8x41_gpio_set(uint8_t gpio, uint8_t value);
 int pm8x41_gpio_config(uint8_t gpio, struct pm8x41_gpio *config);
@@ -39,6 +39,7 @@
 
 /* GPIO Registers */
 #define GPIO_PERIPHERAL_BASE                  0xC000
+#define PM8X41_MAX_GPIOS                      36
 /* Peripheral base address for GPIO_X */
 #define GPIO_N_PERIPHERAL_BASE(x)            (GPIO_PERIPHERAL_BASE + ((x) - 1) * 0x100)
 
@@ -56,6 +57,7 @@
 
 
 /* PON Peripheral registers */
+#define PON_PERIPHERAL_BASE                   0x800
 #define PON_PON_REASON1                       0x808
 #define PON_INT_RT_STS                        0x810
 #define PON_INT_SET_TYPE                      0x811
@@ -112,6 +114,13 @@ uint8_t pm8x41_reg_read(uint32_t addr);
 #define LDO_VREG_ENABLE_BIT                   7
 #define LDO_NORMAL_PWR_BIT                    7
 
+/* LDO1..LDO24 peripherals, 0x100 apart */
+#define LDO_PERIPHERAL_FIRST                  0x14000
+#define LDO_PERIPHERAL_LAST                   0x15F00
+
+/* WLED peripheral, see pm8x41_wled.h */
+#define WLED_PERIPHERAL_BASE                  0x1D800
+
 #define LDO_RANGE_CTRL                        0x40
 #define LDO_STEP_CTRL                         0x41
 #define LDO_POWER_MODE                        0x45
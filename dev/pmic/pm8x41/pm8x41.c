@@ -31,6 +31,7 @@
 #include <reg.h>
 #include <spmi.h>
 #include <string.h>
+#include <stdlib.h>
 #include <pm8x41_hw.h>
 #include <pm8x41.h>
 #include <platform/timer.h>
@@ -41,10 +42,13 @@ struct pm8x41_ldo ldo_data[] = {
 	LDO("LDO22", PLDO_TYPE, 0x15500, LDO_RANGE_CTRL, LDO_STEP_CTRL, LDO_EN_CTL_REG),
 };
 
-/* SPMI helper functions */
-uint8_t pm8x41_reg_read(uint32_t addr)
+/* SPMI bus access
+ *
+ * Everything below goes through bus_ops so a fake backend can stand in
+ * for the arbiter, see pm8x41_set_bus_ops().
+ */
+static int pmic_arb_bus_read(uint32_t addr, uint8_t *buf, uint32_t len)
 {
-	uint8_t val = 0;
 	struct pmic_arb_cmd cmd;
 	struct pmic_arb_param param;
 
@@ -53,15 +57,13 @@ uint8_t pm8x41_reg_read(uint32_t addr)
 	cmd.slave_id = SLAVE_ID(addr);
 	cmd.priority = 0;
 
-	param.buffer = &val;
-	param.size   = 1;
-
-	pmic_arb_read_cmd(&cmd, &param);
+	param.buffer = buf;
+	param.size   = len;
 
-	return val;
+	return pmic_arb_read_cmd(&cmd, &param) ? 1 : 0;
 }
 
-void pm8x41_reg_write(uint32_t addr, uint8_t val)
+static int pmic_arb_bus_write(uint32_t addr, uint8_t *buf, uint32_t len)
 {
 	struct pmic_arb_cmd cmd;
 	struct pmic_arb_param param;
@@ -71,10 +73,412 @@ void pm8x41_reg_write(uint32_t addr, uint8_t val)
 	cmd.slave_id = SLAVE_ID(addr);
 	cmd.priority = 0;
 
-	param.buffer = &val;
-	param.size   = 1;
+	param.buffer = buf;
+	param.size   = len;
+
+	return pmic_arb_write_cmd_posted(&cmd, &param) ? 1 : 0;
+}
+
+static int pmic_arb_bus_sync()
+{
+	return pmic_arb_sync() ? 1 : 0;
+}
+
+static const struct pm8x41_bus_ops pmic_arb_bus_ops = {
+	.read  = pmic_arb_bus_read,
+	.write = pmic_arb_bus_write,
+	.sync  = pmic_arb_bus_sync,
+};
+
+static const struct pm8x41_bus_ops *bus_ops = &pmic_arb_bus_ops;
+
+/* Shadow register cache
+ *
+ * LK is the only master programming these peripherals while it runs, so
+ * the last value read from or written to a control register can be kept
+ * and reused. Only peripherals listed in shadow_periphs are cached, and
+ * only their control window (offsets 0x40-0x7F). Status and interrupt
+ * registers live below 0x40 and always go to the bus, as does anything
+ * in a peripheral's volatile mask.
+ */
+#define SHADOW_FIRST_REG                      0x40
+#define SHADOW_NUM_REGS                       64
+#define SHADOW_SLOTS                          8
+
+struct shadow_periph_desc {
+	uint32_t first;
+	uint32_t last;
+	uint64_t volatile_mask; /* bit n: SHADOW_FIRST_REG + n is never cached */
+};
+
+#define SHADOW_VOLATILE(reg)                  (1ULL << ((reg) - SHADOW_FIRST_REG))
+
+/* RPM also votes on LDO enable and power mode, so those are not ours to cache */
+#define LDO_VOLATILE_MASK \
+	(SHADOW_VOLATILE(LDO_POWER_MODE) | SHADOW_VOLATILE(LDO_EN_CTL_REG))
+
+static const struct shadow_periph_desc shadow_periphs[] = {
+	{ PON_PERIPHERAL_BASE, PON_PERIPHERAL_BASE, 0 },
+	{ GPIO_N_PERIPHERAL_BASE(1), GPIO_N_PERIPHERAL_BASE(PM8X41_MAX_GPIOS), 0 },
+	{ LDO_PERIPHERAL_FIRST, LDO_PERIPHERAL_LAST, LDO_VOLATILE_MASK },
+	{ WLED_PERIPHERAL_BASE, WLED_PERIPHERAL_BASE, 0 },
+};
+
+struct shadow_periph {
+	uint32_t base;          /* peripheral address, 0 if the slot is free */
+	uint64_t valid;
+	uint8_t  val[SHADOW_NUM_REGS];
+};
+
+static struct shadow_periph shadow[SHADOW_SLOTS];
+static uint32_t shadow_victim;
+static int shadow_verify;
+static struct pm8x41_shadow_stats shadow_stats;
+
+static int shadow_cacheable(uint32_t addr)
+{
+	uint32_t base = addr & ~0xFF;
+	uint32_t reg = REG_OFFSET(addr);
+	uint32_t i;
+
+	if (reg < SHADOW_FIRST_REG || reg >= SHADOW_FIRST_REG + SHADOW_NUM_REGS)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(shadow_periphs); i++) {
+		if (base >= shadow_periphs[i].first && base <= shadow_periphs[i].last)
+			return !(shadow_periphs[i].volatile_mask &
+				 (1ULL << (reg - SHADOW_FIRST_REG)));
+	}
+
+	return 0;
+}
+
+static struct shadow_periph *shadow_find(uint32_t addr, int alloc)
+{
+	uint32_t base = addr & ~0xFF;
+	struct shadow_periph *free_slot = NULL;
+	struct shadow_periph *slot;
+	uint32_t i;
+
+	for (i = 0; i < SHADOW_SLOTS; i++) {
+		if (shadow[i].base == base)
+			return &shadow[i];
+		if (!shadow[i].base && !free_slot)
+			free_slot = &shadow[i];
+	}
+
+	if (!alloc)
+		return NULL;
+
+	slot = free_slot;
+	if (!slot) {
+		slot = &shadow[shadow_victim];
+		shadow_victim = (shadow_victim + 1) % SHADOW_SLOTS;
+	}
+
+	slot->base  = base;
+	slot->valid = 0;
+
+	return slot;
+}
+
+/* Returns 1 and the cached value if addr is in the shadow */
+static int shadow_get(uint32_t addr, uint8_t *val)
+{
+	struct shadow_periph *slot;
+	uint32_t n = REG_OFFSET(addr) - SHADOW_FIRST_REG;
+
+	if (!shadow_cacheable(addr))
+		return 0;
+
+	slot = shadow_find(addr, 0);
+	if (!slot || !(slot->valid & (1ULL << n)))
+		return 0;
+
+	*val = slot->val[n];
+	return 1;
+}
+
+static void shadow_set(uint32_t addr, uint8_t val)
+{
+	struct shadow_periph *slot;
+	uint32_t n = REG_OFFSET(addr) - SHADOW_FIRST_REG;
+
+	if (!shadow_cacheable(addr))
+		return;
+
+	slot = shadow_find(addr, 1);
+	slot->val[n] = val;
+	slot->valid |= 1ULL << n;
+}
+
+static void shadow_drop(uint32_t addr)
+{
+	struct shadow_periph *slot;
+
+	if (!shadow_cacheable(addr))
+		return;
+
+	slot = shadow_find(addr, 0);
+	if (slot)
+		slot->valid &= ~(1ULL << (REG_OFFSET(addr) - SHADOW_FIRST_REG));
+}
+
+/* In verify mode, check a cached value against the hardware and fix the
+ * shadow up on mismatch. Returns 1 if the cached value was right.
+ */
+static int shadow_check_reg(uint32_t addr, uint8_t cached)
+{
+	uint8_t hw = 0;
+
+	if (bus_ops->read(addr, &hw, 1))
+		return 0;
+
+	if (hw == cached)
+		return 1;
+
+	shadow_stats.mismatches++;
+	dprintf(CRITICAL, "pm8x41 shadow mismatch at 0x%x: cached 0x%x, hw 0x%x\n",
+		addr, cached, hw);
+	shadow_set(addr, hw);
+
+	return 0;
+}
+
+/* Returns 1 if writing val to addr would not change the register */
+static int shadow_write_redundant(uint32_t addr, uint8_t val)
+{
+	uint8_t cur;
+
+	if (!shadow_get(addr, &cur) || cur != val)
+		return 0;
+
+	if (shadow_verify && !shadow_check_reg(addr, cur))
+		return 0;
+
+	shadow_stats.writes_dropped++;
+	return 1;
+}
+
+void pm8x41_shadow_invalidate()
+{
+	memset(shadow, 0, sizeof(shadow));
+	shadow_victim = 0;
+}
+
+void pm8x41_shadow_set_verify(int enable)
+{
+	shadow_verify = enable;
+}
+
+/* Compare every cached register with the hardware.
+ * Returns the number of mismatches found, which are also corrected.
+ */
+int pm8x41_shadow_check()
+{
+	uint32_t i;
+	uint32_t n;
+	int mismatches = 0;
+
+	for (i = 0; i < SHADOW_SLOTS; i++) {
+		if (!shadow[i].base)
+			continue;
+
+		for (n = 0; n < SHADOW_NUM_REGS; n++) {
+			if (!(shadow[i].valid & (1ULL << n)))
+				continue;
+
+			if (!shadow_check_reg(shadow[i].base + SHADOW_FIRST_REG + n,
+					      shadow[i].val[n]))
+				mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+void pm8x41_shadow_get_stats(struct pm8x41_shadow_stats *stats)
+{
+	*stats = shadow_stats;
+}
+
+void pm8x41_shadow_reset_stats()
+{
+	memset(&shadow_stats, 0, sizeof(shadow_stats));
+}
+
+/* Swap the SPMI backend, NULL restores the arbiter. The shadow is
+ * dropped since it described the old backend.
+ * Returns the previous backend.
+ */
+const struct pm8x41_bus_ops *pm8x41_set_bus_ops(const struct pm8x41_bus_ops *ops)
+{
+	const struct pm8x41_bus_ops *old = bus_ops;
+
+	bus_ops = ops ? ops : &pmic_arb_bus_ops;
+	pm8x41_shadow_invalidate();
+
+	return old;
+}
+
+/* SPMI helper functions */
+uint8_t pm8x41_reg_read(uint32_t addr)
+{
+	uint8_t val = 0;
+
+	if (shadow_get(addr, &val)) {
+		shadow_stats.hits++;
+
+		if (shadow_verify && !shadow_check_reg(addr, val))
+			shadow_get(addr, &val);
+
+		return val;
+	}
+
+	if (shadow_cacheable(addr))
+		shadow_stats.misses++;
+
+	if (bus_ops->read(addr, &val, 1))
+		return 0;
+
+	shadow_set(addr, val);
+
+	return val;
+}
+
+void pm8x41_reg_write(uint32_t addr, uint8_t val)
+{
+	if (shadow_write_redundant(addr, val))
+		return;
+
+	bus_ops->write(addr, &val, 1);
+
+	if (bus_ops->sync())
+		shadow_drop(addr);
+	else
+		shadow_set(addr, val);
+}
+
+/* Read len consecutive registers starting at addr, in bursts of up to
+ * PMIC_ARB_MAX_BURST bytes. The range must stay within one peripheral.
+ */
+int pm8x41_reg_read_burst(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	uint32_t chunk;
+	uint32_t i;
+
+	if (REG_OFFSET(addr) + len > 0x100)
+		return 1;
+
+	while (len) {
+		chunk = MIN(len, PMIC_ARB_MAX_BURST);
+
+		if (bus_ops->read(addr, buf, chunk))
+			return 1;
+
+		for (i = 0; i < chunk; i++)
+			shadow_set(addr + i, buf[i]);
+
+		addr += chunk;
+		buf  += chunk;
+		len  -= chunk;
+	}
+
+	return 0;
+}
+
+/* Write len consecutive registers starting at addr, in bursts of up to
+ * PMIC_ARB_MAX_BURST bytes. The range must stay within one peripheral.
+ */
+int pm8x41_reg_write_burst(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	uint32_t chunk;
+	uint32_t i;
+
+	if (REG_OFFSET(addr) + len > 0x100)
+		return 1;
+
+	for (i = 0; i < len; i++)
+		shadow_set(addr + i, buf[i]);
+
+	for (i = 0; i < len; i += chunk) {
+		chunk = MIN(len - i, PMIC_ARB_MAX_BURST);
+		bus_ops->write(addr + i, buf + i, chunk);
+	}
+
+	if (bus_ops->sync()) {
+		for (i = 0; i < len; i++)
+			shadow_drop(addr + i);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Register write transactions
+ *
+ * Writes are queued in order and only hit the bus on commit, where runs
+ * of consecutive registers are merged into bursts and issued back to
+ * back without waiting for each one to complete. Writes that would not
+ * change a shadowed register are dropped when queued.
+ */
+void pm8x41_txn_init(struct pm8x41_txn *txn)
+{
+	txn->count = 0;
+}
+
+int pm8x41_txn_write(struct pm8x41_txn *txn, uint32_t addr, uint8_t val)
+{
+	int ret = 0;
+
+	if (shadow_write_redundant(addr, val))
+		return 0;
+
+	/* Full, push out what we have so ordering is kept */
+	if (txn->count == PM8X41_TXN_MAX_OPS)
+		ret = pm8x41_txn_commit(txn);
 
-	pmic_arb_write_cmd(&cmd, &param);
+	txn->addr[txn->count] = addr;
+	txn->val[txn->count]  = val;
+	txn->count++;
+
+	/* later writes in this transaction compare against the queued value */
+	shadow_set(addr, val);
+
+	return ret;
+}
+
+int pm8x41_txn_commit(struct pm8x41_txn *txn)
+{
+	uint32_t i = 0;
+	uint32_t run;
+
+	while (i < txn->count) {
+		/* extend the run while the next write is the following register
+		 * of the same peripheral
+		 */
+		for (run = 1; (i + run < txn->count) && (run < PMIC_ARB_MAX_BURST); run++) {
+			if (txn->addr[i + run] != txn->addr[i] + run ||
+			    REG_OFFSET(txn->addr[i + run]) == 0)
+				break;
+		}
+
+		bus_ops->write(txn->addr[i], &txn->val[i], run);
+
+		i += run;
+	}
+
+	if (bus_ops->sync()) {
+		/* we can't tell which burst failed, forget them all */
+		for (i = 0; i < txn->count; i++)
+			shadow_drop(txn->addr[i]);
+		txn->count = 0;
+		return 1;
+	}
+
+	txn->count = 0;
+
+	return 0;
 }
 
 /* Exported functions */
@@ -94,36 +498,32 @@ int pm8x41_gpio_config(uint8_t gpio, struct pm8x41_gpio *config)
 {
 	uint8_t  val;
 	uint32_t gpio_base = GPIO_N_PERIPHERAL_BASE(gpio);
+	struct pm8x41_txn txn;
+
+	pm8x41_txn_init(&txn);
 
 	/* Disable the GPIO */
 	val  = REG_READ(gpio_base + GPIO_EN_CTL);
 	val &= ~BIT(PERPH_EN_BIT);
-	REG_WRITE(gpio_base + GPIO_EN_CTL, val);
-
-	/* Select the mode */
-	val = config->function | (config->direction << 4);
-	REG_WRITE(gpio_base + GPIO_MODE_CTL, val);
+	pm8x41_txn_write(&txn, gpio_base + GPIO_EN_CTL, val);
 
-	/* Set the right pull */
-	val = config->pull;
-	REG_WRITE(gpio_base + GPIO_DIG_PULL_CTL, val);
-
-	/* Select the VIN */
-	val = config->vin_sel;
-	REG_WRITE(gpio_base + GPIO_DIG_VIN_CTL, val);
+	/* Select the mode, VIN and pull: one burst */
+	pm8x41_txn_write(&txn, gpio_base + GPIO_MODE_CTL,
+			 config->function | (config->direction << 4));
+	pm8x41_txn_write(&txn, gpio_base + GPIO_DIG_VIN_CTL, config->vin_sel);
+	pm8x41_txn_write(&txn, gpio_base + GPIO_DIG_PULL_CTL, config->pull);
 
 	if (config->direction == PM_GPIO_DIR_OUT) {
 		/* Set the right dig out control */
-		val = config->out_strength | (config->output_buffer << 4);
-		REG_WRITE(gpio_base + GPIO_DIG_OUT_CTL, val);
+		pm8x41_txn_write(&txn, gpio_base + GPIO_DIG_OUT_CTL,
+				 config->out_strength | (config->output_buffer << 4));
 	}
 
 	/* Enable the GPIO */
-	val  = REG_READ(gpio_base + GPIO_EN_CTL);
 	val |= BIT(PERPH_EN_BIT);
-	REG_WRITE(gpio_base + GPIO_EN_CTL, val);
+	pm8x41_txn_write(&txn, gpio_base + GPIO_EN_CTL, val);
 
-	return 0;
+	return pm8x41_txn_commit(&txn);
 }
 
 /* Reads the status of requested gpio */
@@ -284,6 +684,7 @@ int pm8x41_ldo_set_voltage(const char *name, uint32_t voltage)
 	uint32_t val = 0;
 	uint32_t vmin = 0;
 	struct pm8x41_ldo *ldo;
+	struct pm8x41_txn txn;
 
 	ldo = ldo_get(name);
 	if (!ldo) {
@@ -322,17 +723,14 @@ int pm8x41_ldo_set_voltage(const char *name, uint32_t voltage)
 
 	mult = (voltage - vmin) / step;
 
-	/* Set Range in voltage ctrl register */
-	val = 0x0;
-	val = range << LDO_RANGE_SEL_BIT;
-	REG_WRITE((ldo->base + ldo->range_reg), val);
-
-	/* Set multiplier in voltage ctrl register */
-	val = 0x0;
-	val = mult << LDO_VSET_SEL_BIT;
-	REG_WRITE((ldo->base + ldo->step_reg), val);
+	/* Set Range and multiplier in voltage ctrl registers, adjacent
+	 * registers go out as a single burst
+	 */
+	pm8x41_txn_init(&txn);
+	pm8x41_txn_write(&txn, ldo->base + ldo->range_reg, range << LDO_RANGE_SEL_BIT);
+	pm8x41_txn_write(&txn, ldo->base + ldo->step_reg, mult << LDO_VSET_SEL_BIT);
 
-	return 0;
+	return pm8x41_txn_commit(&txn);
 }
 
 /*
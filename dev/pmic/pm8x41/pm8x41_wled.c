@@ -29,25 +29,36 @@
 #include <bits.h>
 #include <reg.h>
 #include <pm8x41_hw.h>
+#include <pm8x41.h>
 #include <pm8x41_wled.h>
 
 void pm8x41_wled_config(struct pm8x41_wled_data *wled_ctrl) {
 
+	struct pm8x41_txn txn;
+
 	if (!wled_ctrl) {
 		dprintf(CRITICAL, "Error: Invalid WLED data.\n");
 		return;
 	}
 
-	REG_WRITE(PM_WLED_MODULATION_SCHEME, wled_ctrl->mod_scheme);
+	pm8x41_txn_init(&txn);
+
+	/* LED1..3 brightness are six consecutive registers: one burst */
+	pm8x41_txn_write(&txn, PM_WLED_LED1_BRIGHTNESS_LSB, (wled_ctrl->led1_brightness & 0xFF));
+	pm8x41_txn_write(&txn, PM_WLED_LED1_BRIGHTNESS_MSB, ((wled_ctrl->led1_brightness >> 8) & 0xFF));
+	pm8x41_txn_write(&txn, PM_WLED_LED2_BRIGHTNESS_LSB, (wled_ctrl->led2_brightness & 0xFF));
+	pm8x41_txn_write(&txn, PM_WLED_LED2_BRIGHTNESS_MSB, ((wled_ctrl->led2_brightness >> 8) & 0xFF));
+	pm8x41_txn_write(&txn, PM_WLED_LED3_BRIGHTNESS_LSB, (wled_ctrl->led3_brightness & 0xFF));
+	pm8x41_txn_write(&txn, PM_WLED_LED3_BRIGHTNESS_MSB, ((wled_ctrl->led3_brightness >> 8) & 0xFF));
 
-	REG_WRITE(PM_WLED_LED1_BRIGHTNESS_LSB, (wled_ctrl->led1_brightness & 0xFF));
-	REG_WRITE(PM_WLED_LED1_BRIGHTNESS_MSB, ((wled_ctrl->led1_brightness >> 8) & 0xFF));
-	REG_WRITE(PM_WLED_LED2_BRIGHTNESS_LSB, (wled_ctrl->led2_brightness & 0xFF));
-	REG_WRITE(PM_WLED_LED2_BRIGHTNESS_MSB, ((wled_ctrl->led2_brightness >> 8) & 0xFF));
-	REG_WRITE(PM_WLED_LED3_BRIGHTNESS_LSB, (wled_ctrl->led3_brightness & 0xFF));
-	REG_WRITE(PM_WLED_LED3_BRIGHTNESS_MSB, ((wled_ctrl->led3_brightness >> 8) & 0xFF));
+	/* Modulation scheme and max duty cycle are adjacent too */
+	pm8x41_txn_write(&txn, PM_WLED_MODULATION_SCHEME, wled_ctrl->mod_scheme);
+	pm8x41_txn_write(&txn, PM_WLED_MAX_DUTY_CYCLE, wled_ctrl->max_duty_cycle);
 
-	REG_WRITE(PM_WLED_MAX_DUTY_CYCLE, wled_ctrl->max_duty_cycle);
+	if (pm8x41_txn_commit(&txn)) {
+		dprintf(CRITICAL, "Error: WLED configuration failed.\n");
+		return;
+	}
 
 	dprintf(SPEW, "WLED Configuration Success.\n");
 
@@ -33,6 +33,10 @@
 #ifndef __DEV_SSBI_H
 #define __DEV_SSBI_H
 
+#include <sys/types.h>
+#include <list.h>
+#include <kernel/event.h>
+
 //Macros for SSBI Qwerty keypad for 7x30
 
 /* SSBI 2.0 controller registers */
@@ -127,6 +131,67 @@
 	(((MD) & 0x0F) | ((((AD) >> 8) << SSBI_MODE2_REG_ADDR_15_8_SHFT) & \
 	SSBI_MODE2_REG_ADDR_15_8_MASK))
 
+/* SSBI transaction engine */
+enum ssbi_bus {
+	SSBI_BUS_SSBI2,		/* SSBI 2.0 controller at MSM_SSBI_BASE */
+	SSBI_BUS_PA1,		/* PMIC arbiter 1 */
+	SSBI_BUS_PA2,		/* PMIC arbiter 2 */
+};
+
+#define SSBI_XFER_READ			0x00
+#define SSBI_XFER_WRITE			0x01
+
+/* len bytes moved through the single register at addr */
+struct ssbi_xfer {
+	uint16_t addr;
+	uint16_t len;
+	uint8_t *buf;
+	uint8_t flags;
+};
+
+struct ssbi_batch {
+	enum ssbi_bus bus;
+	struct ssbi_xfer *xfers;
+	unsigned count;
+
+	unsigned done;		/* transfers completed */
+	int status;		/* 0, or 1 on timeout */
+
+	/* completion of queued batches: complete if set, else the event */
+	void (*complete)(struct ssbi_batch *);
+	void *arg;
+	event_t event;
+	struct list_node node;
+};
+
+struct ssbi_stats {
+	uint32_t batches;
+	uint32_t queued;
+	uint32_t transactions;	/* bytes moved */
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t page_writes;	/* SSBI2 MODE2 upper address updates */
+	uint32_t polls;		/* status reads that found the bus busy */
+	uint32_t timeouts;
+};
+
+/* register access hooks for a simulated controller */
+struct ssbi_reg_ops {
+	uint32_t (*read)(addr_t addr);
+	void (*write)(uint32_t val, addr_t addr);
+};
+
+void ssbi_batch_init(struct ssbi_batch *b, enum ssbi_bus bus,
+		     struct ssbi_xfer *xfers, unsigned count);
+int ssbi_batch_run(struct ssbi_batch *b);
+void ssbi_batch_queue(struct ssbi_batch *b);
+int ssbi_batch_wait(struct ssbi_batch *b);
+
+const struct ssbi_reg_ops *ssbi_set_reg_ops(const struct ssbi_reg_ops *ops);
+void ssbi_get_stats(struct ssbi_stats *stats);
+void ssbi_reset_stats(void);
+void ssbi_dump_stats(void);
+
 int i2c_ssbi_read_bytes(unsigned char  *buffer, unsigned short length,
 			unsigned short slave_addr);
 int i2c_ssbi_write_bytes(unsigned char  *buffer, unsigned short length,
@@ -135,5 +200,9 @@ int pa1_ssbi2_read_bytes(unsigned char  *buffer, unsigned short length,
 			 unsigned short slave_addr);
 int pa1_ssbi2_write_bytes(unsigned char  *buffer, unsigned short length,
 			  unsigned short slave_addr);
+int pa2_ssbi2_read_bytes(unsigned char  *buffer, unsigned short length,
+			 unsigned short slave_addr);
+int pa2_ssbi2_write_bytes(unsigned char  *buffer, unsigned short length,
+			  unsigned short slave_addr);
 
 #endif
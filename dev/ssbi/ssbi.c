@@ -32,249 +32,363 @@
  */
 #include <debug.h>
 #include <reg.h>
+#include <list.h>
+#include <string.h>
 #include <sys/types.h>
+#include <kernel/thread.h>
+#include <kernel/event.h>
+#include <kernel/dpc.h>
 #include <dev/ssbi.h>
 #ifdef TARGET_USES_RSPIN_LOCK
 #include <platform/remote_spinlock.h>
 #endif
 
-int i2c_ssbi_poll_for_device_ready(void)
-{
-	unsigned long timeout = SSBI_TIMEOUT_US;
+/*
+ * SSBI transaction engine.
+ *
+ * Every access goes through a batch: a list of transfers, each moving one
+ * or more bytes through a single PMIC register. The bus is locked for one
+ * transfer at a time (interrupts off, plus the remote spin lock where the
+ * controller is shared), so a long batch does not hold off interrupts.
+ * The SSBI2 MODE2 page is only rewritten when the upper address bits
+ * change and the per-byte status polls are bounded.
+ * The controllers have no completion interrupt wired up, so the polls stay,
+ * but callers that cannot afford to wait (timer callbacks, for instance)
+ * can queue a batch and be told through an event or callback when it is done.
+ */
 
-	while (!(readl(MSM_SSBI_BASE + SSBI2_STATUS) & SSBI_STATUS_READY)) {
-		if (--timeout == 0) {
-		        dprintf(INFO, "In Device ready function:Timeout, status %x\n", readl(MSM_SSBI_BASE + SSBI2_STATUS));
-			return 1;
-		}
-	}
+/* PMIC arbiter register pairs, the PA1 and PA2 field layouts are identical */
+static const struct {
+	addr_t cmd;
+	addr_t status;
+} ssbi_arbiter[] = {
+	[SSBI_BUS_PA1] = { PA1_SSBI2_CMD, PA1_SSBI2_RD_STATUS },
+	[SSBI_BUS_PA2] = { PA2_SSBI2_CMD, PA2_SSBI2_RD_STATUS },
+};
 
-	return 0;
+static const struct ssbi_reg_ops *reg_ops;
+static struct ssbi_stats ssbi_stats;
+
+static struct list_node ssbi_queue = LIST_INITIAL_VALUE(ssbi_queue);
+static dpc_t ssbi_dpc;
+static bool ssbi_dpc_ready;
+
+static inline uint32_t ssbi_readl(addr_t addr)
+{
+	if (reg_ops)
+		return reg_ops->read(addr);
+	return readl(addr);
 }
 
-int i2c_ssbi_poll_for_read_completed(void)
+static inline void ssbi_writel(uint32_t val, addr_t addr)
+{
+	if (reg_ops)
+		reg_ops->write(val, addr);
+	else
+		writel(val, addr);
+}
+
+/* spin until (status & mask) == want, bounded by SSBI_TIMEOUT_US polls */
+static int ssbi_poll(addr_t reg, uint32_t mask, uint32_t want, uint32_t *status)
 {
 	unsigned long timeout = SSBI_TIMEOUT_US;
+	uint32_t val;
 
-	while (!(readl(MSM_SSBI_BASE + SSBI2_STATUS) & SSBI_STATUS_RD_READY)) {
+	while (((val = ssbi_readl(reg)) & mask) != want) {
+		ssbi_stats.polls++;
 		if (--timeout == 0) {
-		        dprintf(INFO, "In read completed function:Timeout, status %x\n", readl(MSM_SSBI_BASE + SSBI2_STATUS));
+			dprintf(INFO, "ssbi: timeout at 0x%lx, status %x\n", reg, val);
+			ssbi_stats.timeouts++;
 			return 1;
 		}
 	}
 
+	if (status)
+		*status = val;
 	return 0;
 }
 
-int i2c_ssbi_read_bytes(unsigned char  *buffer, unsigned short length,
-                                                unsigned short slave_addr)
+static int ssbi2_xfer(struct ssbi_xfer *x)
 {
-	int ret = 0;
-	unsigned char *buf = buffer;
-	unsigned short len = length;
-	unsigned short addr = slave_addr;
-	unsigned long read_cmd = 0;
-	unsigned long mode2 = 0;
-
-	/*
-	 * Use remote spin locks since SSBI2 controller is shared with nonHLOS proc
-	 */
-#if TARGET_USES_RSPIN_LOCK
-	remote_spin_lock(rlock);
-#endif
-	read_cmd = SSBI_CMD_READ(addr);
-	mode2 = readl(MSM_SSBI_BASE + SSBI2_MODE2);
+	uint32_t mode2;
+	unsigned i;
+	int ret;
 
-	//buf = alloc(len * sizeof(8));
-	if (mode2 & SSBI_MODE2_SSBI2_MODE)
-		writel(SSBI_MODE2_REG_ADDR_15_8(mode2, addr),
+	/* the page is left as the last user set it, which may not be us */
+	mode2 = ssbi_readl(MSM_SSBI_BASE + SSBI2_MODE2);
+	if ((mode2 & SSBI_MODE2_SSBI2_MODE) &&
+		SSBI_MODE2_REG_ADDR_15_8(mode2, x->addr) != mode2) {
+		ssbi_writel(SSBI_MODE2_REG_ADDR_15_8(mode2, x->addr),
 				MSM_SSBI_BASE + SSBI2_MODE2);
+		ssbi_stats.page_writes++;
+	}
 
-	while (len) {
-		ret = i2c_ssbi_poll_for_device_ready();
+	for (i = 0; i < x->len; i++) {
+		ret = ssbi_poll(MSM_SSBI_BASE + SSBI2_STATUS, SSBI_STATUS_READY,
+				SSBI_STATUS_READY, NULL);
 		if (ret) {
-		        dprintf (CRITICAL, "Error: device not ready\n");
-			goto end;
+			dprintf(CRITICAL, "Error: device not ready\n");
+			return ret;
 		}
 
-		writel(read_cmd, MSM_SSBI_BASE + SSBI2_CMD);
-
-		ret = i2c_ssbi_poll_for_read_completed();
+		if (x->flags & SSBI_XFER_WRITE) {
+			ssbi_writel(SSBI_CMD_WRITE(x->addr, x->buf[i]),
+					MSM_SSBI_BASE + SSBI2_CMD);
+			ret = ssbi_poll(MSM_SSBI_BASE + SSBI2_STATUS,
+					SSBI_STATUS_MCHN_BUSY, 0, NULL);
+		} else {
+			ssbi_writel(SSBI_CMD_READ(x->addr), MSM_SSBI_BASE + SSBI2_CMD);
+			ret = ssbi_poll(MSM_SSBI_BASE + SSBI2_STATUS,
+					SSBI_STATUS_RD_READY, SSBI_STATUS_RD_READY, NULL);
+			if (!ret)
+				x->buf[i] = ssbi_readl(MSM_SSBI_BASE + SSBI2_RD) &
+					SSBI_RD_REG_DATA_MASK;
+		}
 		if (ret) {
-		        dprintf (CRITICAL, "Error: read not completed\n");
-			goto end;
+			dprintf(CRITICAL, "Error: %s not completed\n",
+				(x->flags & SSBI_XFER_WRITE) ? "write" : "read");
+			return ret;
 		}
+	}
+
+	return 0;
+}
+
+static int pa_ssbi2_xfer(enum ssbi_bus bus, struct ssbi_xfer *x)
+{
+	uint32_t cmd;
+	uint32_t status;
+	unsigned i;
+
+	for (i = 0; i < x->len; i++) {
+		cmd = x->addr << PA1_SSBI2_REG_ADDR_SHIFT;
+		if (x->flags & SSBI_XFER_WRITE)
+			cmd |= (PA1_SSBI2_CMD_WRITE << PA1_SSBI2_CMD_RDWRN_SHIFT) |
+				x->buf[i];
+		else
+			cmd |= PA1_SSBI2_CMD_READ << PA1_SSBI2_CMD_RDWRN_SHIFT;
 
-		*buf++ = readl(MSM_SSBI_BASE + SSBI2_RD) & SSBI_RD_REG_DATA_MASK;
-		len--;
+		ssbi_writel(cmd, ssbi_arbiter[bus].cmd);
+		if (ssbi_poll(ssbi_arbiter[bus].status,
+				1 << PA1_SSBI2_TRANS_DONE_SHIFT,
+				1 << PA1_SSBI2_TRANS_DONE_SHIFT, &status))
+			return 1;
+
+		if (!(x->flags & SSBI_XFER_WRITE))
+			x->buf[i] = (status >> PA1_SSBI2_REG_DATA_SHIFT) &
+				PA1_SSBI2_REG_DATA_MASK;
 	}
-end:
-#if TARGET_USES_RSPIN_LOCK
-	remote_spin_unlock(rlock);
-#endif
-	return ret;
+
+	return 0;
 }
 
-int i2c_ssbi_write_bytes(unsigned char  *buffer, unsigned short length,
-                                                unsigned short slave_addr)
+/**
+ * Set up a batch of transfers on one bus. The transfers are run in order.
+ */
+void ssbi_batch_init(struct ssbi_batch *b, enum ssbi_bus bus,
+		     struct ssbi_xfer *xfers, unsigned count)
+{
+	b->bus = bus;
+	b->xfers = xfers;
+	b->count = count;
+	b->done = 0;
+	b->status = 0;
+	b->complete = NULL;
+	b->arg = NULL;
+	list_clear_node(&b->node);
+	event_init(&b->event, false, 0);
+}
+
+/**
+ * Run a batch now, spinning on the bus. Safe from interrupt context.
+ * Stops at the first transfer that times out.
+ *
+ * Returns 0 on success, 1 on timeout like the byte level calls. b->done
+ * holds the number of transfers completed.
+ */
+int ssbi_batch_run(struct ssbi_batch *b)
 {
 	int ret = 0;
-	unsigned long timeout = SSBI_TIMEOUT_US;
-	unsigned char *buf = buffer;
-	unsigned short len = length;
-	unsigned short addr = slave_addr;
-	unsigned long mode2 = 0;
-
-	/*
-	 * Use remote spin locks since SSBI2 controller is shared with nonHLOS proc
-	 */
+	unsigned i;
+
+	enter_critical_section();
+	ssbi_stats.batches++;
+	exit_critical_section();
+
+	for (i = 0; i < b->count; i++) {
+		struct ssbi_xfer *x = &b->xfers[i];
+
+		/*
+		 * Use remote spin locks since SSBI2 controller is shared with nonHLOS proc
+		 */
+		enter_critical_section();
 #if TARGET_USES_RSPIN_LOCK
-	remote_spin_lock(rlock);
+		remote_spin_lock(rlock);
 #endif
-	mode2 = readl(MSM_SSBI_BASE + SSBI2_MODE2);
 
-	if (mode2 & SSBI_MODE2_SSBI2_MODE)
-		writel(SSBI_MODE2_REG_ADDR_15_8(mode2, addr),
-				MSM_SSBI_BASE + SSBI2_MODE2);
+		if (b->bus == SSBI_BUS_SSBI2)
+			ret = ssbi2_xfer(x);
+		else
+			ret = pa_ssbi2_xfer(b->bus, x);
 
-	while (len) {
-		ret = i2c_ssbi_poll_for_device_ready();
-		if (ret) {
-		        dprintf (CRITICAL, "Error: device not ready\n");
-			goto end;
+		if (!ret) {
+			ssbi_stats.transactions += x->len;
+			if (x->flags & SSBI_XFER_WRITE)
+				ssbi_stats.writes += x->len;
+			else
+				ssbi_stats.reads += x->len;
 		}
 
-		writel(SSBI_CMD_WRITE(addr, *buf++), MSM_SSBI_BASE + SSBI2_CMD);
-
-		while (readl(MSM_SSBI_BASE + SSBI2_STATUS) & SSBI_STATUS_MCHN_BUSY) {
-		  if (--timeout == 0) {
-			dprintf(INFO, "In Device ready function:Timeout, status %x\n", readl(MSM_SSBI_BASE + SSBI2_STATUS));
-			ret = 1;
-			goto end;
-		  }
-		}
-		len--;
-	}
-end:
 #if TARGET_USES_RSPIN_LOCK
-	remote_spin_unlock(rlock);
+		remote_spin_unlock(rlock);
 #endif
+		exit_critical_section();
+
+		if (ret)
+			break;
+	}
+
+	b->done = i;
+	b->status = ret;
 	return ret;
 }
 
+static void ssbi_dpc_func(void *arg)
+{
+	struct ssbi_batch *b;
+
+	for (;;) {
+		enter_critical_section();
+		b = list_remove_head_type(&ssbi_queue, struct ssbi_batch, node);
+		exit_critical_section();
+		if (!b)
+			break;
+
+		ssbi_batch_run(b);
+
+		/* either may free the batch, so b is not touched after */
+		if (b->complete)
+			b->complete(b);
+		else
+			event_signal(&b->event, true);
+	}
+}
+
+/**
+ * Queue a batch to be run from the SSBI dpc. The caller is told it has
+ * finished through b->complete if set, otherwise through the batch event
+ * (see ssbi_batch_wait()). May be called from interrupt context. The batch
+ * must stay valid until it completes.
+ */
+void ssbi_batch_queue(struct ssbi_batch *b)
+{
+	enter_critical_section();
+
+	if (!ssbi_dpc_ready) {
+		dpc_initialize(&ssbi_dpc, ssbi_dpc_func, NULL, DPC_LEVEL_NORMAL);
+		ssbi_dpc_ready = true;
+	}
+
+	event_unsignal(&b->event);
+	list_add_tail(&ssbi_queue, &b->node);
+	ssbi_stats.queued++;
+	dpc_queue_item(&ssbi_dpc, DPC_FLAG_NORESCHED);
+
+	exit_critical_section();
+}
+
+/**
+ * Wait for a queued batch to finish. Returns the batch status.
+ */
+int ssbi_batch_wait(struct ssbi_batch *b)
+{
+	event_wait(&b->event);
+	return b->status;
+}
+
+static int ssbi_single(enum ssbi_bus bus, unsigned char *buffer,
+		       unsigned short length, unsigned short slave_addr,
+		       uint8_t flags)
+{
+	struct ssbi_xfer x = {
+		.addr = slave_addr,
+		.len = length,
+		.buf = buffer,
+		.flags = flags,
+	};
+	struct ssbi_batch b;
+
+	ssbi_batch_init(&b, bus, &x, 1);
+	return ssbi_batch_run(&b);
+}
+
+int i2c_ssbi_read_bytes(unsigned char  *buffer, unsigned short length,
+                                                unsigned short slave_addr)
+{
+	return ssbi_single(SSBI_BUS_SSBI2, buffer, length, slave_addr, SSBI_XFER_READ);
+}
+
+int i2c_ssbi_write_bytes(unsigned char  *buffer, unsigned short length,
+                                                unsigned short slave_addr)
+{
+	return ssbi_single(SSBI_BUS_SSBI2, buffer, length, slave_addr, SSBI_XFER_WRITE);
+}
+
 int pa1_ssbi2_read_bytes(unsigned char  *buffer, unsigned short length,
                                                 unsigned short slave_addr)
 {
-    unsigned val = 0x0;
-    unsigned temp = 0x0000;
-    unsigned char *buf = buffer;
-    unsigned short len = length;
-    unsigned short addr = slave_addr;
-    unsigned long timeout = SSBI_TIMEOUT_US;
-
-    while(len)
-    {
-        val |= ((addr << PA1_SSBI2_REG_ADDR_SHIFT) |
-		(PA1_SSBI2_CMD_READ << PA1_SSBI2_CMD_RDWRN_SHIFT));
-        writel(val, PA1_SSBI2_CMD);
-        while(!((temp = readl(PA1_SSBI2_RD_STATUS)) & (1 << PA1_SSBI2_TRANS_DONE_SHIFT))) {
-            if (--timeout == 0) {
-	        dprintf(INFO, "In Device ready function:Timeout\n");
-	        return 1;
-	    }
-	}
-        len--;
-        *buf++ = (temp & (PA1_SSBI2_REG_DATA_MASK << PA1_SSBI2_REG_DATA_SHIFT));
-    }
-    return 0;
+	return ssbi_single(SSBI_BUS_PA1, buffer, length, slave_addr, SSBI_XFER_READ);
 }
 
 int pa1_ssbi2_write_bytes(unsigned char  *buffer, unsigned short length,
                                                 unsigned short slave_addr)
 {
-    unsigned val;
-    unsigned char *buf = buffer;
-    unsigned short len = length;
-    unsigned short addr = slave_addr;
-    unsigned temp = 0x00;
-    unsigned char written_data1 = 0x00;
-    unsigned long timeout = SSBI_TIMEOUT_US;
-    //unsigned char written_data2 = 0x00;
-
-    while(len)
-    {
-        temp = 0x00;
-        written_data1 = 0x00;
-        val = (addr << PA1_SSBI2_REG_ADDR_SHIFT) |
-	  (PA1_SSBI2_CMD_WRITE << PA1_SSBI2_CMD_RDWRN_SHIFT) |
- (*buf & 0xFF);
-        writel(val, PA1_SSBI2_CMD);
-        while(!((temp = readl(PA1_SSBI2_RD_STATUS)) & (1 << PA1_SSBI2_TRANS_DONE_SHIFT))) {
-            if (--timeout == 0) {
-	        dprintf(INFO, "In Device write function:Timeout\n");
-	        return 1;
-	    }
-	}
-        len--;
-        buf++;
-    }
-    return 0;
+	return ssbi_single(SSBI_BUS_PA1, buffer, length, slave_addr, SSBI_XFER_WRITE);
 }
 
 int pa2_ssbi2_read_bytes(unsigned char  *buffer, unsigned short length,
         unsigned short slave_addr)
 {
-    unsigned val = 0x0;
-    unsigned temp = 0x0000;
-    unsigned char *buf = buffer;
-    unsigned short len = length;
-    unsigned short addr = slave_addr;
-    unsigned long timeout = SSBI_TIMEOUT_US;
-
-    while(len)
-    {
-        val |= ((addr << PA2_SSBI2_REG_ADDR_SHIFT) |
-                (PA2_SSBI2_CMD_READ << PA2_SSBI2_CMD_RDWRN_SHIFT));
-        writel(val, PA2_SSBI2_CMD);
-        while(!((temp = readl(PA2_SSBI2_RD_STATUS)) & (1 << PA2_SSBI2_TRANS_DONE_SHIFT))) {
-            if (--timeout == 0) {
-                dprintf(INFO, "In Device ready function:Timeout\n");
-                return 1;
-            }
-        }
-        len--;
-        *buf++ = (temp & (PA2_SSBI2_REG_DATA_MASK << PA2_SSBI2_REG_DATA_SHIFT));
-    }
-    return 0;
+	return ssbi_single(SSBI_BUS_PA2, buffer, length, slave_addr, SSBI_XFER_READ);
 }
 
 int pa2_ssbi2_write_bytes(unsigned char  *buffer, unsigned short length,
         unsigned short slave_addr)
 {
-    unsigned val;
-    unsigned char *buf = buffer;
-    unsigned short len = length;
-    unsigned short addr = slave_addr;
-    unsigned temp = 0x00;
-    unsigned char written_data1 = 0x00;
-    unsigned long timeout = SSBI_TIMEOUT_US;
-
-    while(len)
-    {
-        temp = 0x00;
-        written_data1 = 0x00;
-        val = (addr << PA2_SSBI2_REG_ADDR_SHIFT) |
-            (PA2_SSBI2_CMD_WRITE << PA2_SSBI2_CMD_RDWRN_SHIFT) |
-            (*buf & 0xFF);
-        writel(val, PA2_SSBI2_CMD);
-        while(!((temp = readl(PA2_SSBI2_RD_STATUS)) & (1 << PA2_SSBI2_TRANS_DONE_SHIFT))) {
-            if (--timeout == 0) {
-                dprintf(INFO, "In Device write function:Timeout\n");
-                return 1;
-            }
-        }
-        len--;
-        buf++;
-    }
-    return 0;
+	return ssbi_single(SSBI_BUS_PA2, buffer, length, slave_addr, SSBI_XFER_WRITE);
+}
+
+/**
+ * Redirect register accesses, for running against a simulated controller.
+ * Pass NULL to go back to the hardware. Returns the previous ops.
+ */
+const struct ssbi_reg_ops *ssbi_set_reg_ops(const struct ssbi_reg_ops *ops)
+{
+	const struct ssbi_reg_ops *old = reg_ops;
+
+	reg_ops = ops;
+	return old;
+}
+
+void ssbi_get_stats(struct ssbi_stats *stats)
+{
+	enter_critical_section();
+	*stats = ssbi_stats;
+	exit_critical_section();
+}
+
+void ssbi_reset_stats(void)
+{
+	enter_critical_section();
+	memset(&ssbi_stats, 0, sizeof(ssbi_stats));
+	exit_critical_section();
+}
+
+void ssbi_dump_stats(void)
+{
+	dprintf(INFO, "ssbi: %u batches (%u queued), %u transactions (%u reads, %u writes)\n",
+		ssbi_stats.batches, ssbi_stats.queued, ssbi_stats.transactions,
+		ssbi_stats.reads, ssbi_stats.writes);
+	dprintf(INFO, "ssbi: %u page writes, %u status polls, %u timeouts\n",
+		ssbi_stats.page_writes, ssbi_stats.polls, ssbi_stats.timeouts);
 }
@@ -47,14 +47,22 @@ extern "C" {
 
 /* output */
 void _dputc(char c); // XXX for now, platform implements
+void _dwrite(const char *str, size_t len); // platform may override, defaults to _dputc
 int _dputs(const char *str);
 int _dprintf(const char *fmt, ...) __PRINTFLIKE(1, 2);
 int _dvprintf(const char *fmt, va_list ap);
 
-#define dputc(level, str) do { if ((level) <= DEBUGLEVEL) { _dputc(str); } } while (0)
-#define dputs(level, str) do { if ((level) <= DEBUGLEVEL) { _dputs(str); } } while (0)
-#define dprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dprintf(x); } } while (0)
-#define dvprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dvprintf(x); } } while (0)
+/*
+ * level is a compile time constant, so output above DEBUGLEVEL is compiled
+ * out along with its arguments, while the format is still type checked.
+ * DPRINTF_ENABLED() guards any expensive work done only to feed a dprintf.
+ */
+#define DPRINTF_ENABLED(level) ((level) <= DEBUGLEVEL)
+
+#define dputc(level, str) do { if (DPRINTF_ENABLED(level)) { _dputc(str); } } while (0)
+#define dputs(level, str) do { if (DPRINTF_ENABLED(level)) { _dputs(str); } } while (0)
+#define dprintf(level, x...) do { if (DPRINTF_ENABLED(level)) { _dprintf(x); } } while (0)
+#define dvprintf(level, x...) do { if (DPRINTF_ENABLED(level)) { _dvprintf(x); } } while (0)
 
 /* input */
 int dgetc(char *c, bool wait);
@@ -40,6 +40,13 @@
 #define GPIOKPF_ACTIVE_HIGH		(1U << 0)
 #define GPIOKPF_DRIVE_INACTIVE		(1U << 1)
 
+/* gpio accessors for keypads behind an expander, or a simulated model */
+struct gpio_keypad_gpio_ops {
+	int (*get)(unsigned nr);
+	void (*set)(unsigned nr, unsigned on);
+	int (*config)(unsigned nr, unsigned flags);
+};
+
 struct gpio_keypad_info {
 	/* size must be ninputs * noutputs */
 	const uint16_t *keymap;
@@ -49,11 +56,33 @@ struct gpio_keypad_info {
 	int noutputs;
 	/* time to wait before reading inputs after driving each output */
 	time_t settle_time;
+	/* time between scans while keys are down, and idle checks without an irq */
 	time_t poll_time;
 	unsigned flags;
+
+	/*
+	 * optional: enable or disable an interrupt on any input changing, whose
+	 * handler calls gpio_keypad_notify(). return non zero if unavailable.
+	 */
+	int (*irq_enable)(struct gpio_keypad_info *kpinfo, int enable);
+	/* optional: defaults to gpio_get/gpio_set/gpio_config */
+	const struct gpio_keypad_gpio_ops *gpio_ops;
+};
+
+struct gpio_keypad_stats {
+	uint32_t scans;		/* full matrix scans */
+	uint32_t idle_checks;	/* single reads of the inputs while armed */
+	uint32_t wakeups;	/* armed to scanning transitions */
+	uint32_t irqs;		/* wakeups from gpio_keypad_notify() */
+	uint32_t events;	/* key changes posted */
+	uint32_t bounces;	/* changes seen once and gone by the next scan */
 };
 
 void gpio_keypad_init(struct gpio_keypad_info *kpinfo);
+void gpio_keypad_uninit(struct gpio_keypad_info *kpinfo);
+void gpio_keypad_notify(struct gpio_keypad_info *kpinfo);
+void gpio_keypad_get_stats(struct gpio_keypad_info *kpinfo,
+			   struct gpio_keypad_stats *stats);
 
 // GPIO configurations
 
@@ -153,5 +182,6 @@ struct qwerty_keypad_info {
 };
 
 void ssbi_keypad_init (struct qwerty_keypad_info *);
+void ssbi_keypad_get_stats(struct gpio_keypad_stats *stats);
 
 #endif /* __DEV_GPIO_KEYPAD_H */
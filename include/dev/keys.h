@@ -84,8 +84,24 @@
 
 #define MAX_KEYS	0x1ff
 
+#define KEYS_EVENT_QUEUE_LEN	32
+
+struct key_event {
+	uint16_t code;
+	int16_t value;		/* 1 pressed, 0 released */
+	time_t time;		/* current_time() when posted */
+};
+
+struct keys_stats {
+	uint32_t posted;
+	uint32_t delivered;
+	uint32_t dropped;	/* overwritten while the queue was full */
+};
+
 void keys_init(void);
 void keys_post_event(uint16_t code, int16_t value);
 int keys_get_state(uint16_t code);
+int keys_get_event(struct key_event *ev, time_t timeout);
+void keys_get_stats(struct keys_stats *stats);
 
 #endif /* __DEV_KEYS_H */
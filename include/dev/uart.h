@@ -29,6 +29,7 @@ void uart_init(void);
 void uart_init_early(void);
 
 int uart_putc(int port, char c);
+int uart_write(int port, const char *buf, size_t len);
 int uart_getc(int port, bool wait);
 void uart_flush_tx(int port);
 void uart_flush_rx(int port);
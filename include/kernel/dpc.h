@@ -32,7 +32,54 @@ typedef void (*dpc_callback)(void *arg);
 
 #define DPC_FLAG_NORESCHED 0x1
 
+/* Each level is drained by its own worker thread, so a slow callback only
+ * holds up work queued at the same level. */
+enum {
+	DPC_LEVEL_HIGH = 0,
+	DPC_LEVEL_NORMAL,
+	DPC_LEVEL_LOW,
+	DPC_NUM_LEVELS
+};
+
+#define DPC_MAGIC 'dpcw'
+
+/* A work item, usually embedded in the structure it works on. An item is
+ * queued at most once: queueing it again before it runs is a no-op. It may
+ * be queued again from its own callback. */
+typedef struct dpc {
+	int magic;
+	struct list_node node;
+
+	dpc_callback cb;
+	void *arg;
+	uint level;
+	uint flags;
+	bigtime_t queue_time;
+} dpc_t;
+
+void dpc_initialize(dpc_t *dpc, dpc_callback cb, void *arg, uint level);
+status_t dpc_queue_item(dpc_t *dpc, uint flags);
+bool dpc_cancel(dpc_t *dpc);
+
+/* Queue a one-off callback at DPC_LEVEL_NORMAL, using an item from a
+ * preallocated pool. Returns ERR_NO_MEMORY if the pool is empty. */
+#define DPC_POOL_SIZE 32
 status_t dpc_queue(dpc_callback, void *arg, uint flags);
 
+struct dpc_stats {
+	uint queued;		/* items queued */
+	uint coalesced;		/* queue requests for items already queued */
+	uint cancelled;
+	uint run;		/* callbacks run */
+	uint depth;		/* items waiting right now */
+	uint max_depth;
+	bigtime_t total_latency;	/* queue to start of callback, usecs */
+	bigtime_t max_latency;
+	bigtime_t max_runtime;		/* longest callback, usecs */
+};
+
+void dpc_get_stats(uint level, struct dpc_stats *stats);
+void dpc_dump_stats(void);
+
 #endif
 
@@ -23,20 +23,54 @@
 #ifndef __KERNEL_MUTEX_H
 #define __KERNEL_MUTEX_H
 
+#include <debug.h>
+#include <list.h>
 #include <kernel/thread.h>
 
 #define MUTEX_MAGIC 'mutx'
 
+/* mutex contention statistics */
+#if DEBUGLEVEL > 1
+#define MUTEX_STATS 1
+#else
+#define MUTEX_STATS 0
+#endif
+
+struct mutex_stats {
+	uint acquires;		/* successful acquisitions */
+	uint contended;		/* acquisitions that found the mutex held */
+	uint spin_acquires;	/* contended acquisitions satisfied without blocking */
+	uint boosts;		/* times the holder inherited a waiter's priority */
+	uint timeouts;		/* mutex_acquire_timeout() calls that gave up */
+	bigtime_t max_hold;	/* longest hold time, in microseconds */
+	bigtime_t max_wait;	/* longest wait to acquire, in microseconds */
+};
+
 typedef struct mutex {
 	int magic;
 	int count;
 	thread_t *holder;
 	wait_queue_t wait;
+
+	/* node in the holder's list of held mutexes */
+	struct list_node held_node;
+
+	/* number of yields to try before blocking, adapted on each contended acquire */
+	int spin_limit;
+
+#if MUTEX_STATS
+	bigtime_t acquire_time;
+	struct mutex_stats stats;
+#endif
 } mutex_t;
 
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - Mutexes use priority inheritance: while a thread waits on a mutex, the
+ *   holder runs at no less than the waiter's priority. On release the mutex
+ *   is handed to the highest priority waiter.
+ * - A mutex must be destroyed with mutex_destroy() before its storage is reused.
 */
 
 void mutex_init(mutex_t *);
@@ -45,5 +79,9 @@ status_t mutex_acquire(mutex_t *);
 status_t mutex_acquire_timeout(mutex_t *, time_t); /* try to acquire the mutex with a timeout value */
 status_t mutex_release(mutex_t *);
 
-#endif
+/* contention statistics, empty unless MUTEX_STATS */
+void mutex_get_stats(mutex_t *, struct mutex_stats *);
+void mutex_reset_stats(mutex_t *);
+void mutex_dump_stats(mutex_t *);
 
+#endif
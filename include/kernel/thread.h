@@ -28,6 +28,7 @@
 #include <compiler.h>
 #include <arch/ops.h>
 #include <arch/thread.h>
+#include <kernel/dpc.h>
 
 enum thread_state {
 	THREAD_SUSPENDED = 0,
@@ -47,13 +48,26 @@ enum thread_tls_list {
 
 #define THREAD_MAGIC 'thrd'
 
+struct mutex;
+
+/* wake-up to run latency, log2 buckets of microseconds */
+#define THREAD_LATENCY_BUCKETS 16
+
+struct thread_latency {
+	uint count;
+	bigtime_t total;
+	bigtime_t max;
+	uint hist[THREAD_LATENCY_BUCKETS]; /* bucket n counts [2^(n-1), 2^n) us, the last is open ended */
+};
+
 typedef struct thread {
 	int magic;
 	struct list_node thread_list_node;
 
 	/* active bits */
 	struct list_node queue_node;
-	int priority;
+	int priority;		/* effective priority, may be raised by priority inheritance */
+	int base_priority;	/* priority set by thread_create() or thread_set_priority() */
 	enum thread_state state;	
 	int saved_critical_section_count;
 	int remaining_quantum;
@@ -62,6 +76,14 @@ typedef struct thread {
 	struct wait_queue *blocking_wait_queue;
 	status_t wait_queue_block_ret;
 
+	/* priority inheritance: mutexes held and the mutex being waited on */
+	struct list_node held_mutexes;
+	struct mutex *blocking_mutex;
+
+	/* when the thread was last made runnable, 0 if not waiting to run after a wakeup */
+	bigtime_t ready_time;
+	struct thread_latency latency;
+
 	/* architecture stuff */
 	struct arch_thread arch;
 
@@ -76,6 +98,9 @@ typedef struct thread {
 	/* return code */
 	int retcode;
 
+	/* frees the thread once it has exited */
+	dpc_t cleanup_dpc;
+
 	/* thread local storage */
 	uint32_t tls[MAX_TLS_ENTRY];
 
@@ -114,6 +139,9 @@ void thread_yield(void); /* give up the cpu voluntarily */
 void thread_preempt(void); /* get preempted (inserted into head of run queue) */
 void thread_block(void); /* block on something and reschedule */
 
+/* change the effective priority of any thread, requeueing it if it is ready to run. used by mutexes. */
+void thread_set_effective_priority(thread_t *t, int priority);
+
 /* called on every timer tick for the scheduler to do quantum expiration */
 enum handler_return thread_timer_tick(void);
 
@@ -198,6 +226,12 @@ status_t wait_queue_block(wait_queue_t *, time_t timeout);
 int wait_queue_wake_one(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 int wait_queue_wake_all(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 
+/*
+ * release a specific thread blocked on the wait queue, same semantics as wait_queue_wake_one().
+ * returns ERR_NOT_BLOCKED if the thread is not blocked on this wait queue.
+ */
+status_t wait_queue_wake_thread(wait_queue_t *, thread_t *t, bool reschedule, status_t wait_queue_error);
+
 /* 
  * remove the thread from whatever wait queue it's in.
  * return an error if the thread is not currently blocked (or is the current thread) 
@@ -221,10 +255,22 @@ struct thread_stats {
 	int interrupts; /* platform code increment this */
 	int timer_ints; /* timer code increment this */
 	int timers; /* timer code increment this */
+
+	/* wake-up to run latency by the priority the thread ran at */
+	struct thread_latency prio_latency[NUM_PRIORITIES];
+
+	/* run queue length, sampled on every timer tick, not counting the idle thread */
+	uint rq_samples;
+	uint rq_total;
+	uint rq_max;
+	uint rq_hist[8]; /* lengths 0..6, the last bucket is 7 or more */
 };
 
 extern struct thread_stats thread_stats;
 
+void thread_dump_latency(void);
+void thread_reset_latency(void);
+
 #endif
 
 #endif
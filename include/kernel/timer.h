@@ -35,9 +35,15 @@ typedef enum handler_return (*timer_callback)(struct timer *, time_t now, void *
 
 typedef struct timer {
 	int magic;
-	struct list_node node;
+
+	/* pairing heap links; prev is the left sibling, or the parent for a
+	 * first child */
+	struct timer *child;
+	struct timer *next;
+	struct timer *prev;
 
 	time_t scheduled_time;
+	time_t slack;
 	time_t periodic_time;
 
 	timer_callback callback;
@@ -49,11 +55,26 @@ typedef struct timer {
  * - Timers may be programmed or canceled from interrupt or thread context
  * - Timers may be canceled or reprogrammed from within their callback
  * - Timers currently are dispatched from a 10ms periodic tick
+ * - A timer with slack may fire up to slack ms late, so that it can share
+ *   an interrupt with a later deadline
 */
 void timer_initialize(timer_t *);
+void timer_set_slack(timer_t *, time_t slack);
 void timer_set_oneshot(timer_t *, time_t delay, timer_callback, void *arg);
 void timer_set_periodic(timer_t *, time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
+struct timer_stats {
+	uint ints;		/* timer interrupts handled */
+	uint fired;		/* callbacks run */
+	uint batched;		/* callbacks that shared an interrupt with an earlier one */
+	uint reprograms;	/* oneshot hardware timer reprograms */
+	uint queued;		/* timers waiting right now */
+	uint max_queued;
+};
+
+void timer_get_stats(struct timer_stats *);
+void timer_dump_stats(void);
+
 #endif
 
@@ -27,14 +27,44 @@
 
 typedef void * bcache_t;
 
+struct bcache_stats {
+	uint32_t hits;
+	uint32_t depth;
+	uint32_t misses;
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t evictions;
+	uint32_t readahead_blocks;
+	uint32_t readahead_hits;
+	uint32_t flushes;
+};
+
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count);
 void bcache_destroy(bcache_t);
 
 int bcache_read_block(bcache_t, void *, uint block);
 
+// write back: the block is only marked dirty until the next flush or eviction
+int bcache_write_block(bcache_t, const void *, uint block);
+
 // get and put a pointer directly to the block
 int bcache_get_block(bcache_t, void **, uint block);
 int bcache_put_block(bcache_t, uint block);
 
+int bcache_mark_block_dirty(bcache_t, uint block);
+int bcache_zero_block(bcache_t, uint block);
+int bcache_flush(bcache_t);
+
+// max number of blocks fetched ahead on sequential access, 1 disables it
+void bcache_set_readahead(bcache_t, uint blocks);
+
+void bcache_get_stats(bcache_t, struct bcache_stats *);
+void bcache_reset_stats(bcache_t);
+void bcache_dump(bcache_t, const char *name);
+
+// layer a cache of block_count blocks over parent_dev, registered as a new bio device
+status_t bcache_publish_device(const char *parent_dev, const char *name, int block_count);
+status_t bcache_flush_device(const char *name);
+
 #endif
 
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __LIB_FS_EXT4_H
+#define __LIB_FS_EXT4_H
+
+#include <lib/bio.h>
+#include <lib/fs.h>
+
+/* read-only ext4 (and ext2/3) driver, hooked into lib/fs */
+int ext4_mount(bdev_t *dev, fscookie *cookie);
+int ext4_unmount(fscookie cookie);
+int ext4_open_file(fscookie cookie, const char *path, filecookie *fcookie);
+int ext4_read_file(filecookie fcookie, void *buf, off_t offset, size_t len);
+int ext4_close_file(filecookie fcookie);
+int ext4_stat_file(filecookie fcookie, struct file_stat *);
+
+#endif
+
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __LIB_MEMTEST_H
+#define __LIB_MEMTEST_H
+
+#include <sys/types.h>
+
+/* patterns, as a mask */
+#define MEMTEST_PAT_SOLID	(1 << 0)	/* 0s, 1s, 0x55.., 0xaa.. */
+#define MEMTEST_PAT_WALKING	(1 << 1)	/* walking ones, then walking zeros */
+#define MEMTEST_PAT_ADDRESS	(1 << 2)	/* each word holds its own address */
+#define MEMTEST_PAT_MOVINV	(1 << 3)	/* moving inversions, up then down */
+#define MEMTEST_PAT_RANDOM	(1 << 4)	/* xorshift stream from a seed */
+#define MEMTEST_PAT_ALL		0x1f
+#define MEMTEST_NUM_PATTERNS	5
+
+/* how the solid and moving inversion fills are written and compared */
+enum memtest_engine {
+	MEMTEST_ENGINE_CPU,	/* 32 bit loads and stores */
+	MEMTEST_ENGINE_BURST,	/* 64 byte NEON bursts where available */
+	MEMTEST_ENGINE_DMA,	/* fill through memtest_dma_ops, compare in bursts */
+};
+
+/* a platform mem to mem dma engine, for filling */
+struct memtest_dma_ops {
+	/* copy len bytes, return 0 when done */
+	int (*copy)(addr_t dst, addr_t src, size_t len);
+};
+
+struct memtest_pattern_result {
+	const char *name;
+	uint64_t write_bytes;
+	uint64_t read_bytes;	/* read modify write passes count both ways */
+	bigtime_t write_us;
+	bigtime_t read_us;
+	uint32_t errors;
+};
+
+struct memtest_result {
+	uint64_t tested;	/* bytes */
+	uint64_t excluded;	/* bytes skipped as LK's own or excluded */
+	uint32_t errors;
+	uint32_t bad_bits;	/* every data bit seen flipped */
+	addr_t first_error;
+	addr_t last_error;
+	uint32_t first_expected;
+	uint32_t first_actual;
+	uint npatterns;
+	struct memtest_pattern_result pattern[MEMTEST_NUM_PATTERNS];
+};
+
+/*
+ * Test [base, base + len), skipping LK's image and heap and anything passed
+ * to memtest_exclude(). Returns NO_ERROR, ERR_IO if any word failed, or
+ * ERR_INVALID_ARGS if nothing was left to test.
+ */
+status_t memtest_run(addr_t base, size_t len, uint patterns,
+                     enum memtest_engine engine, uint32_t seed,
+                     struct memtest_result *res);
+
+/* keep a range (a download buffer, a framebuffer) out of later runs */
+status_t memtest_exclude(addr_t base, size_t len);
+
+void memtest_set_dma_ops(const struct memtest_dma_ops *ops);
+
+/* format a result as a few short lines, for the console or fastboot */
+void memtest_summarize(const struct memtest_result *res, void (*line)(const char *str));
+
+#endif
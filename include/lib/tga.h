@@ -4,7 +4,18 @@
 #include <lib/gfx.h>
 #include <sys/types.h>
 
+/* rectangle of a surface, in pixels */
+struct tga_rect {
+	uint x;
+	uint y;
+	uint width;
+	uint height;
+};
+
 gfx_surface *tga_decode(const void *ptr, size_t len, gfx_format format);
+status_t tga_get_size(const void *ptr, size_t len, uint *width, uint *height);
+status_t tga_decode_to_surface(const void *ptr, size_t len, gfx_surface *surface,
+                               int x, int y, const struct tga_rect *clip);
 
 #endif
 
@@ -31,12 +31,19 @@
 extern "C" {
 #endif
 
-int printf(const char *fmt, ...);
+int printf(const char *fmt, ...) __PRINTFLIKE(1, 2);
 int sprintf(char *str, const char *fmt, ...) __PRINTFLIKE(2, 3);
 int snprintf(char *str, size_t len, const char *fmt, ...) __PRINTFLIKE(3, 4);
 int vsprintf(char *str, const char *fmt, va_list ap);
 int vsnprintf(char *str, size_t len, const char *fmt, va_list ap);
 
+/*
+ * The formatter behind the calls above. out() is handed each run of output
+ * and returns a negative value to stop early.
+ */
+typedef int (*_printf_engine_output_func)(const char *str, size_t len, void *state);
+int _printf_engine(_printf_engine_output_func out, void *state, const char *fmt, va_list ap);
+
 #if defined(__cplusplus)
 }
 #endif
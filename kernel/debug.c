@@ -35,6 +35,7 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <platform.h>
+#include <string.h>
 
 #if WITH_LIB_CONSOLE
 #include <lib/console.h>
@@ -42,6 +43,7 @@
 static int cmd_threads(int argc, const cmd_args *argv);
 static int cmd_threadstats(int argc, const cmd_args *argv);
 static int cmd_threadload(int argc, const cmd_args *argv);
+static int cmd_threadlat(int argc, const cmd_args *argv);
 
 STATIC_COMMAND_START
 #if DEBUGLEVEL > 1
@@ -50,6 +52,7 @@ STATIC_COMMAND("threads", "list kernel threads", &cmd_threads)
 #if THREAD_STATS
 STATIC_COMMAND("threadstats", "thread level statistics", &cmd_threadstats)
 STATIC_COMMAND("threadload", "toggle thread load display", &cmd_threadload)
+STATIC_COMMAND("threadlat", "thread wake-up latency, 'threadlat reset' to clear", &cmd_threadlat)
 #endif
 STATIC_COMMAND_END(kernel);
 
@@ -128,6 +131,20 @@ static int cmd_threadload(int argc, const cmd_args *argv)
 	return 0;
 }
 
+static int cmd_threadlat(int argc, const cmd_args *argv)
+{
+	if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+		thread_reset_latency();
+		printf("thread latency stats cleared\n");
+		return 0;
+	}
+
+	printf("thread latency stats:\n");
+	thread_dump_latency();
+
+	return 0;
+}
+
 #endif
 
 #endif
@@ -22,67 +22,213 @@
  */
 #include <debug.h>
 #include <list.h>
-#include <malloc.h>
 #include <err.h>
+#include <platform.h>
 #include <kernel/dpc.h>
 #include <kernel/thread.h>
 #include <kernel/event.h>
 
-struct dpc {
-	struct list_node node;	
+/* dpc_t.flags */
+#define DPC_QUEUED	0x1
+#define DPC_POOLED	0x2	/* one-off item from dpc_pool, freed after it runs */
 
-	dpc_callback cb;
-	void *arg;
+struct dpc_level {
+	struct list_node list;
+	event_t event;
+	struct dpc_stats stats;
+};
+
+static struct dpc_level dpc_levels[DPC_NUM_LEVELS];
+
+static const struct {
+	const char *name;
+	int priority;
+} dpc_workers[DPC_NUM_LEVELS] = {
+	[DPC_LEVEL_HIGH] = { "dpc high", HIGHEST_PRIORITY },
+	[DPC_LEVEL_NORMAL] = { "dpc", DPC_PRIORITY },
+	[DPC_LEVEL_LOW] = { "dpc low", DEFAULT_PRIORITY },
 };
 
-static struct list_node dpc_list = LIST_INITIAL_VALUE(dpc_list);
-static event_t dpc_event;
+static dpc_t dpc_pool[DPC_POOL_SIZE];
+static struct list_node dpc_free_list = LIST_INITIAL_VALUE(dpc_free_list);
+static uint dpc_pool_misses;
 
 static int dpc_thread_routine(void *arg);
 
 void dpc_init(void)
 {
-	event_init(&dpc_event, false, 0);
+	uint i;
 
-	thread_resume(thread_create("dpc", &dpc_thread_routine, NULL, DPC_PRIORITY, DEFAULT_STACK_SIZE));
+	for (i = 0; i < DPC_POOL_SIZE; i++)
+		list_add_tail(&dpc_free_list, &dpc_pool[i].node);
+
+	for (i = 0; i < DPC_NUM_LEVELS; i++) {
+		list_initialize(&dpc_levels[i].list);
+		event_init(&dpc_levels[i].event, false, 0);
+
+		thread_resume(thread_create(dpc_workers[i].name, &dpc_thread_routine,
+			&dpc_levels[i], dpc_workers[i].priority, DEFAULT_STACK_SIZE));
+	}
 }
 
-status_t dpc_queue(dpc_callback cb, void *arg, uint flags)
+void dpc_initialize(dpc_t *dpc, dpc_callback cb, void *arg, uint level)
 {
-	struct dpc *dpc;
-
-	dpc = malloc(sizeof(struct dpc));
+	ASSERT(level < DPC_NUM_LEVELS);
 
+	dpc->magic = DPC_MAGIC;
+	list_clear_node(&dpc->node);
 	dpc->cb = cb;
 	dpc->arg = arg;
+	dpc->level = level;
+	dpc->flags = 0;
+	dpc->queue_time = 0;
+}
+
+status_t dpc_queue_item(dpc_t *dpc, uint flags)
+{
+	struct dpc_level *level;
+
+	ASSERT(dpc->magic == DPC_MAGIC);
+
+	level = &dpc_levels[dpc->level];
+
 	enter_critical_section();
-	list_add_tail(&dpc_list, &dpc->node);
-	event_signal(&dpc_event, (flags & DPC_FLAG_NORESCHED) ? false : true);
+
+	if (dpc->flags & DPC_QUEUED) {
+		/* already waiting to run, it'll pick up whatever prompted this */
+		level->stats.coalesced++;
+		exit_critical_section();
+		return NO_ERROR;
+	}
+
+	dpc->flags |= DPC_QUEUED;
+	dpc->queue_time = current_time_hires();
+	list_add_tail(&level->list, &dpc->node);
+
+	level->stats.queued++;
+	if (++level->stats.depth > level->stats.max_depth)
+		level->stats.max_depth = level->stats.depth;
+
+	event_signal(&level->event, (flags & DPC_FLAG_NORESCHED) ? false : true);
 	exit_critical_section();
 
 	return NO_ERROR;
 }
 
+/* Returns true if the item was still waiting and won't run now. A callback
+ * that has already started is not waited for. */
+bool dpc_cancel(dpc_t *dpc)
+{
+	bool cancelled = false;
+
+	ASSERT(dpc->magic == DPC_MAGIC);
+
+	enter_critical_section();
+	if (dpc->flags & DPC_QUEUED) {
+		list_delete(&dpc->node);
+		dpc->flags &= ~DPC_QUEUED;
+		dpc_levels[dpc->level].stats.depth--;
+		dpc_levels[dpc->level].stats.cancelled++;
+		cancelled = true;
+	}
+	exit_critical_section();
+
+	return cancelled;
+}
+
+status_t dpc_queue(dpc_callback cb, void *arg, uint flags)
+{
+	dpc_t *dpc;
+
+	enter_critical_section();
+	dpc = list_remove_head_type(&dpc_free_list, dpc_t, node);
+	if (!dpc)
+		dpc_pool_misses++;
+	exit_critical_section();
+
+	if (!dpc)
+		return ERR_NO_MEMORY;
+
+	dpc_initialize(dpc, cb, arg, DPC_LEVEL_NORMAL);
+	dpc->flags = DPC_POOLED;
+
+	return dpc_queue_item(dpc, flags);
+}
+
 static int dpc_thread_routine(void *arg)
 {
+	struct dpc_level *level = arg;
+	dpc_callback cb;
+	void *cb_arg;
+	uint flags;
+	bigtime_t start, latency, runtime;
+
 	for (;;) {
-		event_wait(&dpc_event);
+		event_wait(&level->event);
 
 		enter_critical_section();
-		struct dpc *dpc = list_remove_head_type(&dpc_list, struct dpc, node);
-		if (!dpc)
-			event_unsignal(&dpc_event);
+		dpc_t *dpc = list_remove_head_type(&level->list, dpc_t, node);
+		if (!dpc) {
+			event_unsignal(&level->event);
+			exit_critical_section();
+			continue;
+		}
+
+		/* from here on the item may be queued again, even by its own callback */
+		dpc->flags &= ~DPC_QUEUED;
+		cb = dpc->cb;
+		cb_arg = dpc->arg;
+		flags = dpc->flags;
+
+		start = current_time_hires();
+		latency = start - dpc->queue_time;
+		level->stats.depth--;
+		level->stats.total_latency += latency;
+		if (latency > level->stats.max_latency)
+			level->stats.max_latency = latency;
 		exit_critical_section();
 
-		if (dpc) {
-//			dprintf("dpc calling %p, arg %p\n", dpc->cb, dpc->arg);
-			dpc->cb(dpc->arg);
+//		dprintf("dpc calling %p, arg %p\n", cb, cb_arg);
+		cb(cb_arg);
 
-			free(dpc);
-		}
+		runtime = current_time_hires() - start;
+
+		enter_critical_section();
+		level->stats.run++;
+		if (runtime > level->stats.max_runtime)
+			level->stats.max_runtime = runtime;
+		if (flags & DPC_POOLED)
+			list_add_head(&dpc_free_list, &dpc->node);
+		exit_critical_section();
 	}
 
 	return 0;
 }
 
+void dpc_get_stats(uint level, struct dpc_stats *stats)
+{
+	ASSERT(level < DPC_NUM_LEVELS);
+
+	enter_critical_section();
+	*stats = dpc_levels[level].stats;
+	exit_critical_section();
+}
 
+void dpc_dump_stats(void)
+{
+	struct dpc_stats stats;
+	uint i;
+
+	for (i = 0; i < DPC_NUM_LEVELS; i++) {
+		dpc_get_stats(i, &stats);
+		dprintf(INFO, "%s: %u queued, %u coalesced, %u cancelled, %u run, "
+			"depth %u (max %u), latency avg %llu max %llu us, "
+			"max runtime %llu us\n", dpc_workers[i].name,
+			stats.queued, stats.coalesced, stats.cancelled, stats.run,
+			stats.depth, stats.max_depth,
+			stats.run ? stats.total_latency / stats.run : 0,
+			stats.max_latency, stats.max_runtime);
+	}
+	dprintf(INFO, "dpc: %u one-off items refused, pool empty\n",
+		dpc_pool_misses);
+}
@@ -31,13 +31,22 @@
 
 #include <debug.h>
 #include <err.h>
+#include <string.h>
 #include <kernel/mutex.h>
 #include <kernel/thread.h>
+#include <platform.h>
 
 #if DEBUGLEVEL > 1
 #define MUTEX_CHECK 1
 #endif
 
+/* bounds for the adaptive yield-before-block loop */
+#define MUTEX_SPIN_MIN 1
+#define MUTEX_SPIN_MAX 8
+
+/* how far to follow a chain of blocked holders when lending priority */
+#define MUTEX_MAX_CHAIN 8
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -51,6 +60,248 @@ void mutex_init(mutex_t *m)
 	m->count = 0;
 	m->holder = 0;
 	wait_queue_init(&m->wait);
+	list_clear_node(&m->held_node);
+	m->spin_limit = MUTEX_SPIN_MIN;
+
+#if MUTEX_STATS
+	m->acquire_time = 0;
+	memset(&m->stats, 0, sizeof(m->stats));
+#endif
+}
+
+/* highest priority of any thread waiting on the mutex, or -1 if none */
+static int mutex_waiter_priority(mutex_t *m)
+{
+	thread_t *t;
+	int priority = -1;
+
+	list_for_every_entry(&m->wait.list, t, thread_t, queue_node) {
+		if (t->priority > priority)
+			priority = t->priority;
+	}
+
+	return priority;
+}
+
+/* the first of the highest priority waiters, so equal priorities stay fifo */
+static thread_t *mutex_highest_waiter(mutex_t *m)
+{
+	thread_t *t;
+	thread_t *best = NULL;
+
+	list_for_every_entry(&m->wait.list, t, thread_t, queue_node) {
+		if (!best || t->priority > best->priority)
+			best = t;
+	}
+
+	return best;
+}
+
+/*
+ * Recompute a thread's effective priority from its base priority and the
+ * waiters on every mutex it still holds.
+ */
+static void mutex_restore_priority(thread_t *t)
+{
+	mutex_t *m;
+	int priority = t->base_priority;
+
+	list_for_every_entry(&t->held_mutexes, m, mutex_t, held_node) {
+		int waiter = mutex_waiter_priority(m);
+		if (waiter > priority)
+			priority = waiter;
+	}
+
+	thread_set_effective_priority(t, priority);
+}
+
+/*
+ * Lend the current thread's priority to the holder of the mutex it is about
+ * to block on, and on down the chain if that holder is itself blocked on a
+ * mutex.
+ */
+static void mutex_boost_holder(mutex_t *m)
+{
+	int priority = current_thread->priority;
+	int depth;
+
+	for (depth = 0; depth < MUTEX_MAX_CHAIN && m; depth++) {
+		thread_t *holder = m->holder;
+
+		if (!holder || holder->priority >= priority)
+			break;
+
+		thread_set_effective_priority(holder, priority);
+#if MUTEX_STATS
+		m->stats.boosts++;
+#endif
+
+		if (holder->state != THREAD_BLOCKED)
+			break;
+		m = holder->blocking_mutex;
+	}
+}
+
+/*
+ * Give the mutex a few chances to come free before blocking on it.  On a
+ * uniprocessor spinning only helps if the holder is runnable at our own
+ * priority, in which case yielding lets it run to its release.  The number
+ * of yields grows while this pays off and shrinks when it does not.
+ *
+ * Called and returns inside the caller's critical section, which is left
+ * around each yield. Returns true with the mutex free (count == 0).
+ */
+static bool mutex_spin(mutex_t *m)
+{
+	int spins;
+
+	for (spins = 0; spins < m->spin_limit; spins++) {
+		thread_t *holder = m->holder;
+
+		if (!holder || holder->state != THREAD_READY ||
+			holder->priority != current_thread->priority)
+			break;
+
+		exit_critical_section();
+		thread_yield();
+		enter_critical_section();
+
+		if (m->count == 0) {
+			if (m->spin_limit < MUTEX_SPIN_MAX)
+				m->spin_limit++;
+			return true;
+		}
+	}
+
+	if (spins > 0 && m->spin_limit > MUTEX_SPIN_MIN)
+		m->spin_limit--;
+
+	return false;
+}
+
+/* bookkeeping once the current thread owns the mutex */
+static void mutex_take(mutex_t *m, bigtime_t wait_start)
+{
+	m->holder = current_thread;
+	list_add_head(&current_thread->held_mutexes, &m->held_node);
+
+#if MUTEX_STATS
+	m->acquire_time = current_time_hires();
+	m->stats.acquires++;
+	if (wait_start && m->acquire_time - wait_start > m->stats.max_wait)
+		m->stats.max_wait = m->acquire_time - wait_start;
+#endif
+}
+
+/*
+ * Pass a free mutex straight to its highest priority waiter, which then
+ * inherits from whoever is still waiting.  The caller wakes the thread.
+ */
+static thread_t *mutex_handoff(mutex_t *m)
+{
+	thread_t *t;
+
+	t = mutex_highest_waiter(m);
+	if (!t)
+		return NULL;
+
+	m->holder = t;
+	list_add_head(&t->held_mutexes, &m->held_node);
+#if MUTEX_STATS
+	m->acquire_time = current_time_hires();
+#endif
+	mutex_restore_priority(t);
+
+	return t;
+}
+
+/*
+ * Common acquire path.  The mutex is handed over directly by mutex_release(),
+ * so a thread woken with NO_ERROR already owns it.
+ */
+static status_t mutex_acquire_internal(mutex_t *m, time_t timeout)
+{
+	status_t ret = NO_ERROR;
+	bigtime_t wait_start = 0;
+
+	enter_critical_section();
+
+#if MUTEX_CHECK
+	ASSERT(m->magic == MUTEX_MAGIC);
+#endif
+
+	if (unlikely(m->count > 0)) {
+#if MUTEX_STATS
+		m->stats.contended++;
+		wait_start = current_time_hires();
+#endif
+		if (timeout != 0 && mutex_spin(m)) {
+#if MUTEX_STATS
+			m->stats.spin_acquires++;
+#endif
+		}
+	}
+
+	m->count++;
+	if (likely(m->count == 1)) {
+		mutex_take(m, wait_start);
+		goto done;
+	}
+
+	/*
+	 * block on the wait queue. If it returns an error, it was likely destroyed
+	 * out from underneath us, so make sure we dont scribble thread ownership
+	 * on the mutex.
+	 */
+	current_thread->blocking_mutex = m;
+	if (timeout != 0)
+		mutex_boost_holder(m);
+
+	ret = wait_queue_block(&m->wait, timeout);
+
+	current_thread->blocking_mutex = NULL;
+
+	if (ret == ERR_TIMED_OUT) {
+		/*
+		 * XXX race: the mutex may have been destroyed after the timeout,
+		 * but before we got scheduled again which makes messing with the
+		 * count variable dangerous.
+		 */
+		m->count--;
+#if MUTEX_STATS
+		m->stats.timeouts++;
+#endif
+		if (m->holder) {
+			/* the holder no longer needs our priority */
+			mutex_restore_priority(m->holder);
+		} else if (m->count > 0) {
+			/*
+			 * the mutex was released while we were timing out and our
+			 * count kept it from looking free, pass it on ourselves.
+			 */
+			thread_t *t = mutex_handoff(m);
+			if (t)
+				wait_queue_wake_thread(&m->wait, t, false, NO_ERROR);
+		}
+		goto done;
+	}
+	if (ret < NO_ERROR)
+		goto done;
+
+	/* mutex_release() made us the holder before waking us */
+#if MUTEX_CHECK
+	ASSERT(m->holder == current_thread);
+#endif
+#if MUTEX_STATS
+	m->stats.acquires++;
+	if (m->acquire_time - wait_start > m->stats.max_wait)
+		m->stats.max_wait = m->acquire_time - wait_start;
+#endif
+
+done:
+	exit_critical_section();
+
+	return ret;
 }
 
 /**
@@ -71,6 +322,12 @@ void mutex_destroy(mutex_t *m)
 //		panic("mutex_destroy: thread %p (%s) tried to release mutex %p it doesn't own. owned by %p (%s)\n", 
 //				current_thread, current_thread->name, m, m->holder, m->holder ? m->holder->name : "none");
 
+	if (list_in_list(&m->held_node)) {
+		list_delete(&m->held_node);
+		mutex_restore_priority(m->holder);
+	}
+	m->holder = 0;
+
 	m->magic = 0;
 	m->count = 0;
 	wait_queue_destroy(&m->wait, true);
@@ -81,43 +338,20 @@ void mutex_destroy(mutex_t *m)
  * @brief  Acquire a mutex; wait if needed.
  *
  * This function waits for a mutex to become available.  It
- * may wait forever if the mutex never becomes free.
+ * may wait forever if the mutex never becomes free.  While it waits,
+ * the holder inherits the caller's priority.
  *
  * @return  NO_ERROR on success, other values on error
  */
 status_t mutex_acquire(mutex_t *m)
 {
-	status_t ret = NO_ERROR;
-
 	if (current_thread == m->holder)
 		panic("mutex_acquire: thread %p (%s) tried to acquire mutex %p it already owns.\n",
 				current_thread, current_thread->name, m);
 
-	enter_critical_section();
-
-#if MUTEX_CHECK
-	ASSERT(m->magic == MUTEX_MAGIC);
-#endif
-
 //	dprintf("mutex_acquire: m %p, count %d, curr %p\n", m, m->count, current_thread);
 
-	m->count++;
-	if (unlikely(m->count > 1)) {
-		/* 
-		 * block on the wait queue. If it returns an error, it was likely destroyed
-		 * out from underneath us, so make sure we dont scribble thread ownership 
-		 * on the mutex.
-		 */
-		ret = wait_queue_block(&m->wait, INFINITE_TIME);
-		if (ret < 0)
-			goto err;
-	}
-	m->holder = current_thread;	
-
-err:
-	exit_critical_section();
-
-	return ret;
+	return mutex_acquire_internal(m, INFINITE_TIME);
 }
 
 /**
@@ -132,55 +366,26 @@ err:
  */
 status_t mutex_acquire_timeout(mutex_t *m, time_t timeout)
 {
-	status_t ret = NO_ERROR;
-
 	if (current_thread == m->holder)
 		panic("mutex_acquire_timeout: thread %p (%s) tried to acquire mutex %p it already owns.\n",
 				current_thread, current_thread->name, m);
 
-	if (timeout == INFINITE_TIME)
-		return mutex_acquire(m);
-
-	enter_critical_section();
-
-#if MUTEX_CHECK
-	ASSERT(m->magic == MUTEX_MAGIC);
-#endif
-
 //	dprintf("mutex_acquire_timeout: m %p, count %d, curr %p, timeout %d\n", m, m->count, current_thread, timeout);
 
-	m->count++;
-	if (unlikely(m->count > 1)) {
-		ret = wait_queue_block(&m->wait, timeout);
-		if (ret < NO_ERROR) {
-			/* if the acquisition timed out, back out the acquire and exit */
-			if (ret == ERR_TIMED_OUT) {
-				/* 
-				 * XXX race: the mutex may have been destroyed after the timeout,
-				 * but before we got scheduled again which makes messing with the
-				 * count variable dangerous.
-				 */
-				m->count--;
-				goto err;
-			}
-			/* if there was a general error, it may have been destroyed out from 
-			 * underneath us, so just exit (which is really an invalid state anyway)
-			 */
-		}	
-	}
-	m->holder = current_thread;	
-
-err:
-	exit_critical_section();
-
-	return ret;
+	return mutex_acquire_internal(m, timeout);
 }
 
 /**
  * @brief  Release mutex
+ *
+ * If threads are waiting, ownership passes straight to the highest
+ * priority one and the caller drops any priority it inherited through
+ * this mutex.
  */
 status_t mutex_release(mutex_t *m)
 {
+	thread_t *t;
+
 	if (current_thread != m->holder)
 		panic("mutex_release: thread %p (%s) tried to release mutex %p it doesn't own. owned by %p (%s)\n", 
 				current_thread, current_thread->name, m, m->holder, m->holder ? m->holder->name : "none");
@@ -193,12 +398,28 @@ status_t mutex_release(mutex_t *m)
 
 //	dprintf("mutex_release: m %p, count %d, holder %p, curr %p\n", m, m->count, m->holder, current_thread);
 
+#if MUTEX_STATS
+	bigtime_t now = current_time_hires();
+	if (now - m->acquire_time > m->stats.max_hold)
+		m->stats.max_hold = now - m->acquire_time;
+#endif
+
+	list_delete(&m->held_node);
 	m->holder = 0;
 	m->count--;
+
+	t = NULL;
 	if (unlikely(m->count >= 1)) {
-		/* release a thread */
+		/* hand the mutex to the highest priority waiter */
+		t = mutex_handoff(m);
+	}
+
+	/* give back anything we inherited through this mutex before anyone else runs */
+	mutex_restore_priority(current_thread);
+
+	if (t) {
 //		dprintf("releasing thread\n");
-		wait_queue_wake_one(&m->wait, true, NO_ERROR);
+		wait_queue_wake_thread(&m->wait, t, true, NO_ERROR);
 	}
 
 	exit_critical_section();
@@ -206,3 +427,45 @@ status_t mutex_release(mutex_t *m)
 	return NO_ERROR;
 }
 
+/**
+ * @brief  Copy out a mutex's contention statistics
+ */
+void mutex_get_stats(mutex_t *m, struct mutex_stats *stats)
+{
+#if MUTEX_STATS
+	enter_critical_section();
+	*stats = m->stats;
+	exit_critical_section();
+#else
+	memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+/**
+ * @brief  Clear a mutex's contention statistics
+ */
+void mutex_reset_stats(mutex_t *m)
+{
+#if MUTEX_STATS
+	enter_critical_section();
+	memset(&m->stats, 0, sizeof(m->stats));
+	exit_critical_section();
+#endif
+}
+
+/**
+ * @brief  Print a mutex's contention statistics
+ */
+void mutex_dump_stats(mutex_t *m)
+{
+#if MUTEX_STATS
+	enter_critical_section();
+	dprintf(INFO, "mutex      acquires contended     spin   boosts timeouts max hold us max wait us holder\n");
+	dprintf(INFO, "%p %8u %9u %8u %8u %8u %11llu %11llu %s\n", m,
+			m->stats.acquires, m->stats.contended, m->stats.spin_acquires,
+			m->stats.boosts, m->stats.timeouts,
+			m->stats.max_hold, m->stats.max_wait,
+			m->holder ? m->holder->name : "-");
+	exit_critical_section();
+#endif
+}
@@ -33,6 +33,8 @@
 #include <debug.h>
 #include <list.h>
 #include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <err.h>
 #include <kernel/thread.h>
@@ -60,6 +62,7 @@ int critical_section_count = 1;
 /* the run queue */
 static struct list_node run_queue[NUM_PRIORITIES];
 static uint32_t run_queue_bitmap;
+static uint run_queue_len;
 
 /* the bootstrap thread (statically allocated) */
 static thread_t bootstrap_thread;
@@ -88,6 +91,7 @@ static void insert_in_run_queue_head(thread_t *t)
 
 	list_add_head(&run_queue[t->priority], &t->queue_node);
 	run_queue_bitmap |= (1<<t->priority);
+	run_queue_len++;
 }
 
 static void insert_in_run_queue_tail(thread_t *t)
@@ -101,6 +105,15 @@ static void insert_in_run_queue_tail(thread_t *t)
 
 	list_add_tail(&run_queue[t->priority], &t->queue_node);
 	run_queue_bitmap |= (1<<t->priority);
+	run_queue_len++;
+}
+
+/* note when a thread is made runnable, so the scheduler can measure how long it waits to run */
+static inline void thread_mark_wakeup(thread_t *t)
+{
+#if THREAD_STATS
+	t->ready_time = current_time_hires();
+#endif
 }
 
 static void init_thread_struct(thread_t *t, const char *name)
@@ -108,6 +121,7 @@ static void init_thread_struct(thread_t *t, const char *name)
 	memset(t, 0, sizeof(thread_t));
 	t->magic = THREAD_MAGIC;
 	strlcpy(t->name, name, sizeof(t->name));
+	list_initialize(&t->held_mutexes);
 }
 
 /**
@@ -150,6 +164,7 @@ thread_t *thread_create(const char *name, thread_start_routine entry, void *arg,
 	t->entry = entry;
 	t->arg = arg;
 	t->priority = priority;
+	t->base_priority = priority;
 	t->saved_critical_section_count = 1; /* we always start inside a critical section */
 	t->state = THREAD_SUSPENDED;
 	t->blocking_wait_queue = NULL;
@@ -202,6 +217,7 @@ status_t thread_resume(thread_t *t)
 
 	enter_critical_section();
 	t->state = THREAD_READY;
+	thread_mark_wakeup(t);
 	insert_in_run_queue_head(t);
 	thread_yield();
 	exit_critical_section();
@@ -255,8 +271,11 @@ void thread_exit(int retcode)
 	current_thread->state = THREAD_DEATH;
 	current_thread->retcode = retcode;
 
-	/* schedule a dpc to clean ourselves up */
-	dpc_queue(thread_cleanup_dpc, (void *)current_thread, DPC_FLAG_NORESCHED);
+	/* schedule a dpc to clean ourselves up. The item lives in the thread
+	 * itself, so this can't fail for lack of a free one. */
+	dpc_initialize(&current_thread->cleanup_dpc, thread_cleanup_dpc,
+		(void *)current_thread, DPC_LEVEL_NORMAL);
+	dpc_queue_item(&current_thread->cleanup_dpc, DPC_FLAG_NORESCHED);
 
 	/* reschedule */
 	thread_resched();
@@ -270,6 +289,47 @@ static void idle_thread_routine(void)
 		arch_idle();
 }
 
+#if THREAD_STATS
+static void latency_add(struct thread_latency *l, bigtime_t latency)
+{
+	uint bucket = 0;
+
+	if (latency > 0) {
+		uint32_t us = latency > 0xffffffffULL ? 0xffffffff : (uint32_t)latency;
+		bucket = 32 - __builtin_clz(us);
+		if (bucket >= THREAD_LATENCY_BUCKETS)
+			bucket = THREAD_LATENCY_BUCKETS - 1;
+	}
+
+	l->count++;
+	l->total += latency;
+	if (latency > l->max)
+		l->max = latency;
+	l->hist[bucket]++;
+}
+
+static void thread_account_latency(thread_t *t, bigtime_t latency)
+{
+	latency_add(&t->latency, latency);
+	latency_add(&thread_stats.prio_latency[t->priority], latency);
+}
+
+/* called from the timer tick, the idle thread does not count as waiting */
+static void thread_sample_run_queue(void)
+{
+	uint len = run_queue_len;
+
+	if (idle_thread && idle_thread->state == THREAD_READY && len > 0)
+		len--;
+
+	thread_stats.rq_samples++;
+	thread_stats.rq_total += len;
+	if (len > thread_stats.rq_max)
+		thread_stats.rq_max = len;
+	thread_stats.rq_hist[MIN(len, countof(thread_stats.rq_hist) - 1)]++;
+}
+#endif
+
 /**
  * @brief  Cause another thread to be executed.
  *
@@ -310,6 +370,7 @@ void thread_resched(void)
 	//dprintf(SPEW, "bitmap 0x%x, next %d\n", run_queue_bitmap, next_queue);
 
 	newthread = list_remove_head_type(&run_queue[next_queue], thread_t, queue_node);
+	run_queue_len--;
 
 #if THREAD_CHECKS
 	ASSERT(newthread);
@@ -333,6 +394,13 @@ void thread_resched(void)
 
 	newthread->state = THREAD_RUNNING;
 
+#if THREAD_STATS
+	if (newthread->ready_time) {
+		thread_account_latency(newthread, current_time_hires() - newthread->ready_time);
+		newthread->ready_time = 0;
+	}
+#endif
+
 	if (newthread == oldthread)
 		return;
 
@@ -474,6 +542,10 @@ void thread_block(void)
 
 enum handler_return thread_timer_tick(void)
 {
+#if THREAD_STATS
+	thread_sample_run_queue();
+#endif
+
 	if (current_thread == idle_thread)
 		return INT_NO_RESCHEDULE;
 
@@ -495,6 +567,7 @@ static enum handler_return thread_sleep_handler(timer_t *timer, time_t now, void
 #endif
 
 	t->state = THREAD_READY;
+	thread_mark_wakeup(t);
 	insert_in_run_queue_head(t);
 
 	return INT_RESCHEDULE;
@@ -550,6 +623,7 @@ void thread_init_early(void)
 
 	/* half construct this thread, since we're already running */
 	t->priority = HIGHEST_PRIORITY;
+	t->base_priority = HIGHEST_PRIORITY;
 	t->state = THREAD_RUNNING;
 	t->saved_critical_section_count = 1;
 	list_add_head(&thread_list, &t->thread_list_node);
@@ -580,6 +654,10 @@ void thread_set_name(const char *name)
  * @brief Change priority of current thread
  *
  * See thread_create() for a discussion of priority values.
+ *
+ * If the thread holds a mutex and has inherited a higher priority from
+ * one of its waiters, the inherited priority stays in effect until the
+ * mutex is released.
  */
 void thread_set_priority(int priority)
 {
@@ -587,7 +665,49 @@ void thread_set_priority(int priority)
 		priority = LOWEST_PRIORITY;
 	if (priority > HIGHEST_PRIORITY)
 		priority = HIGHEST_PRIORITY;
-	current_thread->priority = priority;
+
+	enter_critical_section();
+	current_thread->base_priority = priority;
+	if (list_is_empty(&current_thread->held_mutexes) || priority > current_thread->priority)
+		current_thread->priority = priority;
+	exit_critical_section();
+}
+
+/**
+ * @brief Change the effective priority of a thread
+ *
+ * Used by the mutex code to lend a waiter's priority to the holder and
+ * to take it back again.  A thread sitting in the run queue is moved to
+ * the head of the queue for its new priority; a blocked or sleeping
+ * thread picks up the new priority when it is next made ready.
+ *
+ * Must be called inside a critical section.
+ */
+void thread_set_effective_priority(thread_t *t, int priority)
+{
+#if THREAD_CHECKS
+	ASSERT(t->magic == THREAD_MAGIC);
+	ASSERT(in_critical_section());
+#endif
+
+	if (priority < LOWEST_PRIORITY)
+		priority = LOWEST_PRIORITY;
+	if (priority > HIGHEST_PRIORITY)
+		priority = HIGHEST_PRIORITY;
+
+	if (t->priority == priority)
+		return;
+
+	if (t->state == THREAD_READY && list_in_list(&t->queue_node)) {
+		list_delete(&t->queue_node);
+		run_queue_len--;
+		if (list_is_empty(&run_queue[t->priority]))
+			run_queue_bitmap &= ~(1<<t->priority);
+		t->priority = priority;
+		insert_in_run_queue_head(t);
+	} else {
+		t->priority = priority;
+	}
 }
 
 /**
@@ -611,7 +731,7 @@ void thread_become_idle(void)
 void dump_thread(thread_t *t)
 {
 	dprintf(INFO, "dump_thread: t %p (%s)\n", t, t->name);
-	dprintf(INFO, "\tstate %d, priority %d, remaining quantum %d, critical section %d\n", t->state, t->priority, t->remaining_quantum, t->saved_critical_section_count);
+	dprintf(INFO, "\tstate %d, priority %d (base %d), remaining quantum %d, critical section %d\n", t->state, t->priority, t->base_priority, t->remaining_quantum, t->saved_critical_section_count);
 	dprintf(INFO, "\tstack %p, stack_size %zd\n", t->stack, t->stack_size);
 	dprintf(INFO, "\tentry %p, arg %p\n", t->entry, t->arg);
 	dprintf(INFO, "\twait queue %p, wait queue ret %d\n", t->blocking_wait_queue, t->wait_queue_block_ret);
@@ -637,6 +757,86 @@ void dump_all_threads(void)
 	exit_critical_section();
 }
 
+#if THREAD_STATS
+static void dump_latency(const char *name, const struct thread_latency *l)
+{
+	int i, last;
+
+	for (last = THREAD_LATENCY_BUCKETS - 1; last > 0; last--) {
+		if (l->hist[last])
+			break;
+	}
+
+	dprintf(INFO, "%-16s %8u %8llu %8llu  ", name, l->count, l->total / l->count, l->max);
+	for (i = 0; i <= last; i++)
+		dprintf(INFO, " %u", l->hist[i]);
+	dprintf(INFO, "\n");
+}
+
+/**
+ * @brief  Dump wake-up to run latency and run queue length statistics
+ *
+ * Latency is measured from the moment a thread is made runnable (resumed,
+ * woken from a wait queue or a sleep) until the scheduler switches to it.
+ * Histogram bucket n counts latencies of [2^(n-1), 2^n) microseconds.
+ */
+void thread_dump_latency(void)
+{
+	thread_t *t;
+	char name[16];
+	int i;
+
+	enter_critical_section();
+
+	dprintf(INFO, "wake-up latency (us)      count      avg      max   histogram\n");
+	for (i = HIGHEST_PRIORITY; i >= LOWEST_PRIORITY; i--) {
+		if (thread_stats.prio_latency[i].count == 0)
+			continue;
+		snprintf(name, sizeof(name), "priority %d", i);
+		dump_latency(name, &thread_stats.prio_latency[i]);
+	}
+	list_for_every_entry(&thread_list, t, thread_t, thread_list_node) {
+		if (t->latency.count == 0)
+			continue;
+		dump_latency(t->name, &t->latency);
+	}
+
+	if (thread_stats.rq_samples) {
+		dprintf(INFO, "run queue: %u samples, avg %u.%02u, max %u, histogram",
+				thread_stats.rq_samples,
+				thread_stats.rq_total / thread_stats.rq_samples,
+				(thread_stats.rq_total * 100 / thread_stats.rq_samples) % 100,
+				thread_stats.rq_max);
+		for (i = 0; i < (int)countof(thread_stats.rq_hist); i++)
+			dprintf(INFO, " %u", thread_stats.rq_hist[i]);
+		dprintf(INFO, "\n");
+	}
+
+	exit_critical_section();
+}
+
+/**
+ * @brief  Clear wake-up latency and run queue statistics
+ */
+void thread_reset_latency(void)
+{
+	thread_t *t;
+
+	enter_critical_section();
+
+	memset(thread_stats.prio_latency, 0, sizeof(thread_stats.prio_latency));
+	thread_stats.rq_samples = 0;
+	thread_stats.rq_total = 0;
+	thread_stats.rq_max = 0;
+	memset(thread_stats.rq_hist, 0, sizeof(thread_stats.rq_hist));
+
+	list_for_every_entry(&thread_list, t, thread_t, thread_list_node)
+		memset(&t->latency, 0, sizeof(t->latency));
+
+	exit_critical_section();
+}
+#endif
+
 /** @} */
 
 
@@ -739,38 +939,65 @@ status_t wait_queue_block(wait_queue_t *wait, time_t timeout)
 int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue_error)
 {
 	thread_t *t;
-	int ret = 0;
 
 #if THREAD_CHECKS
 	ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
 	ASSERT(in_critical_section());
 #endif
 
-	t = list_remove_head_type(&wait->list, thread_t, queue_node);
-	if (t) {
-		wait->count--;
+	t = list_peek_head_type(&wait->list, thread_t, queue_node);
+	if (!t)
+		return 0;
+
+	wait_queue_wake_thread(wait, t, reschedule, wait_queue_error);
+	return 1;
+}
+
+/**
+ * @brief  Wake a specific thread sleeping on a wait queue
+ *
+ * Like wait_queue_wake_one(), but the caller picks the thread.  The mutex
+ * code uses this to hand a mutex to its highest priority waiter.
+ *
+ * @param wait  The wait queue the thread is blocked on
+ * @param t  The thread to wake
+ * @param reschedule  If true, the newly-woken thread will run immediately.
+ * @param wait_queue_error  The return value which the new thread will receive
+ * from wait_queue_block().
+ *
+ * @return  NO_ERROR, or ERR_NOT_BLOCKED if \a t is not blocked on \a wait
+ */
+status_t wait_queue_wake_thread(wait_queue_t *wait, thread_t *t, bool reschedule, status_t wait_queue_error)
+{
 #if THREAD_CHECKS
-		ASSERT(t->state == THREAD_BLOCKED);
+	ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
+	ASSERT(t->magic == THREAD_MAGIC);
+	ASSERT(in_critical_section());
 #endif
-		t->state = THREAD_READY;
-		t->wait_queue_block_ret = wait_queue_error;
-		t->blocking_wait_queue = NULL;
 
-		/* if we're instructed to reschedule, stick the current thread on the head
-		 * of the run queue first, so that the newly awakened thread gets a chance to run
-		 * before the current one, but the current one doesn't get unnecessarilly punished.
-		 */
-		if (reschedule) {
-			current_thread->state = THREAD_READY;
-			insert_in_run_queue_head(current_thread);
-		}
-		insert_in_run_queue_head(t);
-		if (reschedule)
-			thread_resched();
-		ret = 1;
+	if (t->state != THREAD_BLOCKED || t->blocking_wait_queue != wait)
+		return ERR_NOT_BLOCKED;
+
+	list_delete(&t->queue_node);
+	wait->count--;
+	t->state = THREAD_READY;
+	t->wait_queue_block_ret = wait_queue_error;
+	t->blocking_wait_queue = NULL;
+
+	/* if we're instructed to reschedule, stick the current thread on the head
+	 * of the run queue first, so that the newly awakened thread gets a chance to run
+	 * before the current one, but the current one doesn't get unnecessarilly punished.
+	 */
+	if (reschedule) {
+		current_thread->state = THREAD_READY;
+		insert_in_run_queue_head(current_thread);
 	}
+	thread_mark_wakeup(t);
+	insert_in_run_queue_head(t);
+	if (reschedule)
+		thread_resched();
 
-	return ret;
+	return NO_ERROR;
 }
 
 
@@ -817,6 +1044,7 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
 		t->wait_queue_block_ret = wait_queue_error;
 		t->blocking_wait_queue = NULL;
 
+		thread_mark_wakeup(t);
 		insert_in_run_queue_head(t);
 		ret++;
 	}
@@ -867,8 +1095,10 @@ status_t thread_unblock_from_wait_queue(thread_t *t, bool reschedule, status_t w
 	ASSERT(t->magic == THREAD_MAGIC);
 #endif
 
-	if (t->state != THREAD_BLOCKED)
+	if (t->state != THREAD_BLOCKED) {
+		exit_critical_section();
 		return ERR_NOT_BLOCKED;
+	}
 
 #if THREAD_CHECKS
 	ASSERT(t->blocking_wait_queue != NULL);
@@ -881,6 +1111,7 @@ status_t thread_unblock_from_wait_queue(thread_t *t, bool reschedule, status_t w
 	t->blocking_wait_queue = NULL;
 	t->state = THREAD_READY;
 	t->wait_queue_block_ret = wait_queue_error;
+	thread_mark_wakeup(t);
 	insert_in_run_queue_head(t);
 
 	if (reschedule)
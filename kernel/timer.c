@@ -41,7 +41,14 @@
 #include <platform/timer.h>
 #include <platform.h>
 
-static struct list_node timer_queue;
+/* Pending timers, kept in a pairing heap ordered by the latest time each
+ * may fire (scheduled time + slack). Insert is O(1), removing the head or
+ * any other timer O(log n) amortized, and nothing is allocated.
+ */
+static timer_t *timer_heap;
+static struct timer_stats timer_stats;
+
+#define TIMER_DEADLINE(t) ((t)->scheduled_time + (t)->slack)
 
 static enum handler_return timer_tick(void *arg, time_t now);
 
@@ -51,30 +58,146 @@ static enum handler_return timer_tick(void *arg, time_t now);
 void timer_initialize(timer_t *timer)
 {
 	timer->magic = TIMER_MAGIC;
-	list_clear_node(&timer->node);
+	timer->child = NULL;
+	timer->next = NULL;
+	timer->prev = NULL;
 	timer->scheduled_time = 0;
+	timer->slack = 0;
 	timer->periodic_time = 0;
 	timer->callback = 0;
 	timer->arg = 0;
 }
 
-static void insert_timer_in_queue(timer_t *timer)
+/**
+ * @brief  Allow a timer to fire late
+ *
+ * The timer may fire up to @a slack ms after its deadline, so that it can be
+ * run from the same interrupt as a later timer. Takes effect the next time
+ * the timer is set.
+ */
+void timer_set_slack(timer_t *timer, time_t slack)
 {
-	timer_t *entry;
+	DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-//	TRACEF("timer %p, scheduled %d, periodic %d\n", timer, timer->scheduled_time, timer->periodic_time);
+	timer->slack = slack;
+}
+
+static bool timer_in_queue(timer_t *timer)
+{
+	return timer == timer_heap || timer->prev != NULL;
+}
+
+/* Meld two heaps; the root with the later deadline becomes the first child
+ * of the other one. */
+static timer_t *timer_meld(timer_t *a, timer_t *b)
+{
+	timer_t *tmp;
+
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+
+	if (TIME_LT(TIMER_DEADLINE(b), TIMER_DEADLINE(a))) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	b->prev = a;
+	b->next = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+
+	return a;
+}
+
+/* Combine a list of siblings into one heap: meld them in pairs left to
+ * right, then meld the pairs right to left. */
+static timer_t *timer_merge_pairs(timer_t *first)
+{
+	timer_t *a, *b, *next;
+	timer_t *pairs = NULL, *root = NULL;
 
-	list_for_every_entry(&timer_queue, entry, timer_t, node) {
-		if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-			list_add_before(&entry->node, &timer->node);
-			return;
+	for (a = first; a; a = next) {
+		b = a->next;
+		next = b ? b->next : NULL;
+
+		a->next = a->prev = NULL;
+		if (b) {
+			b->next = b->prev = NULL;
+			a = timer_meld(a, b);
 		}
+
+		/* collect the pairs in reverse order */
+		a->next = pairs;
+		pairs = a;
+	}
+
+	for (a = pairs; a; a = next) {
+		next = a->next;
+		a->next = NULL;
+		root = timer_meld(root, a);
+	}
+
+	return root;
+}
+
+static void insert_timer_in_queue(timer_t *timer)
+{
+//	TRACEF("timer %p, scheduled %d, periodic %d\n", timer, timer->scheduled_time, timer->periodic_time);
+
+	timer->child = timer->next = timer->prev = NULL;
+	timer_heap = timer_meld(timer_heap, timer);
+
+	if (++timer_stats.queued > timer_stats.max_queued)
+		timer_stats.max_queued = timer_stats.queued;
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+	if (timer == timer_heap) {
+		timer_heap = timer_merge_pairs(timer->child);
+	} else {
+		/* unlink from the parent, or from the left sibling */
+		if (timer->prev->child == timer)
+			timer->prev->child = timer->next;
+		else
+			timer->prev->next = timer->next;
+		if (timer->next)
+			timer->next->prev = timer->prev;
+
+		timer_heap = timer_meld(timer_heap, timer_merge_pairs(timer->child));
 	}
 
-	/* walked off the end of the list */
-	list_add_tail(&timer_queue, &timer->node);
+	timer->child = timer->next = timer->prev = NULL;
+	timer_stats.queued--;
 }
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/* program the hardware for the head of the queue */
+static void timer_program(time_t now)
+{
+	time_t delay;
+
+	if (!timer_heap) {
+//		TRACEF("clearing old hw timer, nothing in the queue\n");
+		platform_stop_timer();
+		return;
+	}
+
+	if (TIME_LT(TIMER_DEADLINE(timer_heap), now))
+		delay = 0;
+	else
+		delay = TIMER_DEADLINE(timer_heap) - now;
+
+//	TRACEF("setting new timer for %u msecs\n", (uint)delay);
+	timer_stats.reprograms++;
+	platform_set_oneshot_timer(timer_tick, NULL, delay);
+}
+#endif
+
 static void timer_set(timer_t *timer, time_t delay, time_t period, timer_callback callback, void *arg)
 {
 	time_t now;
@@ -83,7 +206,9 @@ static void timer_set(timer_t *timer, time_t delay, time_t period, timer_callbac
 
 	DEBUG_ASSERT(timer->magic == TIMER_MAGIC);	
 
-	if (list_in_list(&timer->node)) {
+	enter_critical_section();
+
+	if (timer_in_queue(timer)) {
 		panic("timer %p already in list\n", timer);
 	}
 
@@ -95,15 +220,12 @@ static void timer_set(timer_t *timer, time_t delay, time_t period, timer_callbac
 
 //	TRACEF("scheduled time %u\n", timer->scheduled_time);
 
-	enter_critical_section();
-
 	insert_timer_in_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	if (list_peek_head_type(&timer_queue, timer_t, node) == timer) {
+	if (timer_heap == timer) {
 		/* we just modified the head of the timer queue */
-//		TRACEF("setting new timer for %u msecs\n", (uint)delay);
-		platform_set_oneshot_timer(timer_tick, NULL, delay);
+		timer_program(now);
 	}
 #endif
 
@@ -162,11 +284,11 @@ void timer_cancel(timer_t *timer)
 	enter_critical_section();
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	timer_t *oldhead = list_peek_head_type(&timer_queue, timer_t, node);
+	timer_t *oldhead = timer_heap;
 #endif
 
-	if (list_in_list(&timer->node))
-		list_delete(&timer->node);
+	if (timer_in_queue(timer))
+		remove_timer_from_queue(timer);
 
 	/* to keep it from being reinserted into the queue if called from 
 	 * periodic timer callback.
@@ -177,22 +299,8 @@ void timer_cancel(timer_t *timer)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
 	/* see if we've just modified the head of the timer queue */
-	timer_t *newhead = list_peek_head_type(&timer_queue, timer_t, node);
-	if (newhead == NULL) {
-//		TRACEF("clearing old hw timer, nothing in the queue\n");
-		platform_stop_timer();
-	} else if (newhead != oldhead) {
-		time_t delay;
-		time_t now = current_time();
-
-		if (TIME_LT(newhead->scheduled_time, now))
-			delay = 0;
-		else
-			delay = newhead->scheduled_time - now;
-
-//		TRACEF("setting new timer to %d\n", delay);
-		platform_set_oneshot_timer(timer_tick, NULL, delay);
-	}
+	if (timer_heap != oldhead)
+		timer_program(current_time());
 #endif
 
 	exit_critical_section();
@@ -203,30 +311,37 @@ static enum handler_return timer_tick(void *arg, time_t now)
 {
 	timer_t *timer;
 	enum handler_return ret = INT_NO_RESCHEDULE;
+	bool first = true;
 
 #if THREAD_STATS
 	thread_stats.timer_ints++;
 #endif
+	timer_stats.ints++;
 
 //	TRACEF("now %d\n", now);
 
 	for (;;) {
-		/* see if there's an event to process */
-		timer = list_peek_head_type(&timer_queue, timer_t, node);
+		/* see if there's an event to process. The queue is ordered by
+		 * deadline plus slack, so this also stops at a timer with slack
+		 * that isn't due yet; anything behind it that is will fire no
+		 * later than its own slack allows. */
+		timer = timer_heap;
 		if (likely(!timer || TIME_LT(now, timer->scheduled_time)))
 			break;
 
 		/* process it */
 		DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
-		list_delete(&timer->node);
-//		timer = list_remove_head_type(&timer_queue, timer_t, node);
-//		ASSERT(timer);
+		remove_timer_from_queue(timer);
 
 //		TRACEF("dequeued timer %p, scheduled %d periodic %d\n", timer, timer->scheduled_time, timer->periodic_time);
 
 #if THREAD_STATS
 		thread_stats.timers++;
 #endif
+		timer_stats.fired++;
+		if (!first)
+			timer_stats.batched++;
+		first = false;
 
 		bool periodic = timer->periodic_time > 0;
 
@@ -237,7 +352,7 @@ static enum handler_return timer_tick(void *arg, time_t now)
 		/* if it was a periodic timer and it hasn't been requeued
 		 * by the callback put it back in the list
 		 */
-		if (periodic && !list_in_list(&timer->node) && timer->periodic_time > 0) {
+		if (periodic && !timer_in_queue(timer) && timer->periodic_time > 0) {
 //			TRACEF("periodic timer, period %u\n", (uint)timer->periodic_time);
 			timer->scheduled_time = now + timer->periodic_time;
 			insert_timer_in_queue(timer);
@@ -246,15 +361,11 @@ static enum handler_return timer_tick(void *arg, time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
 	/* reset the timer to the next event */
-	timer = list_peek_head_type(&timer_queue, timer_t, node);
-	if (timer) {
+	if (timer_heap) {
 		/* has to be the case or it would have fired already */
-		ASSERT(TIME_GT(timer->scheduled_time, now));
-
-		time_t delay = timer->scheduled_time - now;
+		ASSERT(TIME_GT(timer_heap->scheduled_time, now));
 
-//		TRACEF("setting new timer for %u msecs for event %p\n", (uint)delay, timer);
-		platform_set_oneshot_timer(timer_tick, NULL, delay);
+		timer_program(now);
 	}
 #else
 	/* let the scheduler have a shot to do quantum expiration, etc */
@@ -267,12 +378,37 @@ static enum handler_return timer_tick(void *arg, time_t now)
 	return INT_RESCHEDULE;
 }
 
+void timer_get_stats(struct timer_stats *stats)
+{
+	enter_critical_section();
+	*stats = timer_stats;
+	exit_critical_section();
+}
+
+void timer_dump_stats(void)
+{
+	struct timer_stats stats;
+	time_t up = current_time();
+
+	timer_get_stats(&stats);
+
+	if (up == 0)
+		up = 1;
+
+	dprintf(INFO, "timers: %u interrupts (%u/s), %u fired, %u batched, "
+		"%u reprograms (%u/s), %u queued (max %u)\n",
+		stats.ints, (uint)((unsigned long long)stats.ints * 1000 / up),
+		stats.fired, stats.batched,
+		stats.reprograms, (uint)((unsigned long long)stats.reprograms * 1000 / up),
+		stats.queued, stats.max_queued);
+}
+
 void timer_init(void)
 {
-	list_initialize(&timer_queue);
+	timer_heap = NULL;
 
+#if !PLATFORM_HAS_DYNAMIC_TIMER
 	/* register for a periodic timer tick */
 	platform_set_periodic_timer(timer_tick, NULL, 10); /* 10ms */
+#endif
 }
-
-
@@ -25,27 +25,28 @@
 #include <string.h>
 #include <sys/types.h>
 #include <debug.h>
+#include <err.h>
+#include <pow2.h>
 #include <lib/bcache.h>
 #include <lib/bio.h>
+#include <kernel/mutex.h>
 
 #define LOCAL_TRACE 0
 
+/* read-ahead window and flush burst limits, in blocks */
+#define BCACHE_DEFAULT_READAHEAD 32
+#define BCACHE_MAX_READAHEAD 64
+
 struct bcache_block {
-	struct list_node node;
+	struct list_node node;		/* on the free or lru list */
+	struct list_node hash_node;	/* on a hash bucket while valid */
 	bnum_t blocknum;
 	int ref_count;
 	bool is_dirty;
+	bool is_readahead;		/* filled speculatively, not yet used */
 	void *ptr;
 };
 
-struct bcache_stats {
-	uint32_t hits;
-	uint32_t depth;
-	uint32_t misses;
-	uint32_t reads;
-	uint32_t writes;
-};
-
 struct bcache {
 	bdev_t *dev;
 	size_t block_size;
@@ -55,47 +56,162 @@ struct bcache {
 	struct list_node free_list;
 	struct list_node lru_list;
 
+	/* blocknum -> block index, power of 2 sized */
+	struct list_node *hash;
+	uint hash_mask;
+
+	/* sequential access detection */
+	bnum_t next_seq;
+	uint ra_window;
+	uint ra_max;
+
+	/* bounce buffer for multi block reads and writes, ra_max blocks long */
+	uint8_t *burst_buf;
+
 	struct bcache_block *blocks;
 };
 
+static inline struct list_node *hash_bucket(struct bcache *cache, bnum_t blocknum)
+{
+	/* sequential blocks land in consecutive buckets */
+	return &cache->hash[blocknum & cache->hash_mask];
+}
+
+static uint bcache_clamp_readahead(struct bcache *cache, uint blocks)
+{
+	/* never let a single read-ahead burst evict more than half the cache */
+	blocks = MIN(blocks, (uint)BCACHE_MAX_READAHEAD);
+	blocks = MIN(blocks, (uint)cache->count / 2);
+	return MAX(blocks, 1U);
+}
+
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count)
 {
 	struct bcache *cache;
+	uint hash_size;
+	uint i;
+
+	cache = calloc(1, sizeof(struct bcache));
+	if (!cache)
+		return NULL;
 
-	cache = malloc(sizeof(struct bcache));
-	
 	cache->dev = dev;
 	cache->block_size = block_size;
 	cache->count = block_count;
-	memset(&cache->stats, 0, sizeof(cache->stats));
 
 	list_initialize(&cache->free_list);
 	list_initialize(&cache->lru_list);
 
-	cache->blocks = malloc(sizeof(struct bcache_block) * block_count);
-	int i;
-	for (i=0; i < block_count; i++) {
-		cache->blocks[i].ref_count = 0;
-		cache->blocks[i].is_dirty = false;
+	/* one bucket per block, rounded up to a power of 2 */
+	hash_size = 1;
+	while (hash_size < (uint)block_count)
+		hash_size <<= 1;
+	cache->hash = malloc(sizeof(struct list_node) * hash_size);
+	if (!cache->hash)
+		goto err;
+	cache->hash_mask = hash_size - 1;
+	for (i = 0; i < hash_size; i++)
+		list_initialize(&cache->hash[i]);
+
+	cache->next_seq = 0;
+	cache->ra_window = 1;
+	cache->ra_max = bcache_clamp_readahead(cache, BCACHE_DEFAULT_READAHEAD);
+	cache->burst_buf = malloc(cache->ra_max * block_size);
+	if (!cache->burst_buf)
+		goto err;
+
+	cache->blocks = calloc(block_count, sizeof(struct bcache_block));
+	if (!cache->blocks)
+		goto err;
+	for (i=0; i < (uint)block_count; i++) {
 		cache->blocks[i].ptr = malloc(block_size);
+		if (!cache->blocks[i].ptr)
+			goto err;
+		list_clear_node(&cache->blocks[i].hash_node);
 		// add to the free list
 		list_add_head(&cache->free_list, &cache->blocks[i].node);	
 	}
 
 	return (bcache_t)cache;
+
+err:
+	if (cache->blocks) {
+		for (i = 0; i < (uint)block_count; i++)
+			free(cache->blocks[i].ptr);
+	}
+	free(cache->blocks);
+	free(cache->burst_buf);
+	free(cache->hash);
+	free(cache);
+	return NULL;
 }
 
-static int flush_block(struct bcache *cache, struct bcache_block *block)
+/* look a block up in the hash without touching the lru or the stats */
+static struct bcache_block *lookup_block(struct bcache *cache, bnum_t blocknum, uint32_t *depth)
 {
+	struct bcache_block *block;
+
+	list_for_every_entry(hash_bucket(cache, blocknum), block, struct bcache_block, hash_node) {
+		if (depth)
+			(*depth)++;
+		if (block->blocknum == blocknum)
+			return block;
+	}
+
+	return NULL;
+}
+
+/*
+ * write out the run of contiguous dirty blocks that contains block,
+ * up to ra_max blocks in a single device write.
+ */
+static int flush_run(struct bcache *cache, struct bcache_block *block)
+{
+	struct bcache_block *b;
+	bnum_t start, end;
 	int rc;
 
-	rc = bio_write(cache->dev, block->ptr,
-			(off_t)block->blocknum * cache->block_size,
-			cache->block_size);
+	DEBUG_ASSERT(block->is_dirty);
+
+	/* extend backwards and forwards over dirty neighbours */
+	start = block->blocknum;
+	while (start > 0 && (block->blocknum - start + 1) < cache->ra_max) {
+		b = lookup_block(cache, start - 1, NULL);
+		if (!b || !b->is_dirty)
+			break;
+		start--;
+	}
+	end = block->blocknum + 1;
+	while ((end - start) < cache->ra_max) {
+		b = lookup_block(cache, end, NULL);
+		if (!b || !b->is_dirty)
+			break;
+		end++;
+	}
+
+	if (end - start == 1) {
+		rc = bio_write(cache->dev, block->ptr,
+				(off_t)block->blocknum * cache->block_size,
+				cache->block_size);
+	} else {
+		bnum_t num;
+		for (num = start; num < end; num++) {
+			b = lookup_block(cache, num, NULL);
+			memcpy(cache->burst_buf + (num - start) * cache->block_size,
+					b->ptr, cache->block_size);
+		}
+		rc = bio_write(cache->dev, cache->burst_buf,
+				(off_t)start * cache->block_size,
+				(end - start) * cache->block_size);
+	}
 	if (rc < 0)
 		goto exit;
 
-	block->is_dirty = false;
+	for ( ; start < end; start++) {
+		b = lookup_block(cache, start, NULL);
+		b->is_dirty = false;
+	}
+
 	cache->stats.writes++;
 	rc = 0;
 exit:
@@ -117,6 +233,9 @@ void bcache_destroy(bcache_t _cache)
 		free(cache->blocks[i].ptr);
 	}
 
+	free(cache->blocks);
+	free(cache->burst_buf);
+	free(cache->hash);
 	free(cache);
 }
 
@@ -128,26 +247,27 @@ static struct bcache_block *find_block(struct bcache *cache, uint blocknum)
 
 	LTRACEF("num %u\n", blocknum);
 
-	block = NULL;
-	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
-		LTRACEF("looking at entry %p, num %u\n", block, block->blocknum);
-		depth++;
+	block = lookup_block(cache, blocknum, &depth);
+	if (block) {
+		LTRACEF("found entry %p, num %u\n", block, block->blocknum);
 
-		if (block->blocknum == blocknum) {
-			list_delete(&block->node);
-			list_add_tail(&cache->lru_list, &block->node);
-			cache->stats.hits++;
-			cache->stats.depth += depth;
-			return block;
+		list_delete(&block->node);
+		list_add_tail(&cache->lru_list, &block->node);
+		cache->stats.hits++;
+		cache->stats.depth += depth;
+		if (block->is_readahead) {
+			block->is_readahead = false;
+			cache->stats.readahead_hits++;
 		}
+		return block;
 	}
 
 	cache->stats.misses++;
 	return NULL;
 }
 
-/* allocate a new block */
-static struct bcache_block *alloc_block(struct bcache *cache)
+/* allocate a new block and enter it into the hash as blocknum */
+static struct bcache_block *alloc_block(struct bcache *cache, uint blocknum)
 {
 	int err;
 	struct bcache_block *block;
@@ -155,36 +275,123 @@ static struct bcache_block *alloc_block(struct bcache *cache)
 	/* pop one off the free list if it's present */
 	block = list_remove_head_type(&cache->free_list, struct bcache_block, node);
 	if (block) {
-		block->ref_count = 0;
-		list_add_tail(&cache->lru_list, &block->node);
 		LTRACEF("found block %p on free list\n", block);
-		return block;
+		goto found;
 	}
 
-	/* walk the lru, looking for a free block */
+	/* walk the lru from the oldest end, looking for an unreferenced block */
 	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
 		LTRACEF("looking at %p, num %u\n", block, block->blocknum);
 		if (block->ref_count == 0) {
 			if (block->is_dirty) {
-				err = flush_block(cache, block);
+				err = flush_run(cache, block);
 				if (err)
 					return NULL;
 			}
 
-			// add it to the tail of the lru
 			list_delete(&block->node);
-			list_add_tail(&cache->lru_list, &block->node);
-			return block;
+			list_delete(&block->hash_node);
+			cache->stats.evictions++;
+			goto found;
 		}
 	}
 
 	return NULL;
+
+found:
+	block->ref_count = 0;
+	block->is_dirty = false;
+	block->is_readahead = false;
+	block->blocknum = blocknum;
+	list_add_tail(&cache->lru_list, &block->node);
+	list_add_head(hash_bucket(cache, blocknum), &block->hash_node);
+	return block;
 }
 
-static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blocknum)
+/* give a block that failed to fill back to the free list */
+static void free_block(struct bcache *cache, struct bcache_block *block)
 {
-	int err;
+	list_delete(&block->node);
+	list_delete(&block->hash_node);
+	list_add_tail(&cache->free_list, &block->node);
+}
+
+/*
+ * fill blocknum from the device. if the access pattern is sequential the
+ * following blocks are read in the same device transfer, with the window
+ * doubling on each consecutive sequential miss.
+ */
+static struct bcache_block *fill_blocks(struct bcache *cache, uint blocknum)
+{
+	struct bcache_block *batch[BCACHE_MAX_READAHEAD];
+	uint count, i;
+	bnum_t dev_blocks;
+	ssize_t err;
+
+	if (blocknum == cache->next_seq)
+		cache->ra_window = MIN(cache->ra_window * 2, cache->ra_max);
+	else
+		cache->ra_window = 1;
+
+	/* clip to the end of the device and to blocks we don't already have */
+	dev_blocks = cache->dev->size / cache->block_size;
+	count = MIN(cache->ra_window, dev_blocks > blocknum ? dev_blocks - blocknum : 1);
+	count = MAX(count, 1U);
+	for (i = 1; i < count; i++) {
+		if (lookup_block(cache, blocknum + i, NULL))
+			break;
+	}
+	count = i;
+
+	/* pin the batch while allocating so it can't evict itself */
+	for (i = 0; i < count; i++) {
+		batch[i] = alloc_block(cache, blocknum + i);
+		if (!batch[i])
+			break;
+		batch[i]->ref_count++;
+	}
+	count = i;
+	if (count == 0)
+		return NULL;
+
+	LTRACEF("block %u, count %u\n", blocknum, count);
+
+	if (count == 1) {
+		err = bio_read(cache->dev, batch[0]->ptr,
+				(off_t)blocknum * cache->block_size, cache->block_size);
+	} else {
+		err = bio_read(cache->dev, cache->burst_buf,
+				(off_t)blocknum * cache->block_size, count * cache->block_size);
+		if (err >= 0) {
+			for (i = 0; i < count; i++)
+				memcpy(batch[i]->ptr, cache->burst_buf + i * cache->block_size,
+						cache->block_size);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		batch[i]->ref_count--;
+		if (err < 0) {
+			free_block(cache, batch[i]);
+		} else if (i > 0) {
+			batch[i]->is_readahead = true;
+		}
+	}
+	if (err < 0)
+		return NULL;
+
+	cache->stats.reads++;
+	cache->stats.readahead_blocks += count - 1;
+
+	/* keep the requested block as the most recently used */
+	list_delete(&batch[0]->node);
+	list_add_tail(&cache->lru_list, &batch[0]->node);
+
+	return batch[0];
+}
 
+static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blocknum)
+{
 	LTRACEF("block %u\n", blocknum);
 
 	/* see if it's already in the cache */
@@ -192,23 +399,13 @@ static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blockn
 	if (block == NULL) {
 		LTRACEF("wasn't allocated\n");
 
-		/* allocate a new block and fill it */
-		block = alloc_block(cache);
-		DEBUG_ASSERT(block);
-
-		LTRACEF("wasn't allocated, new block %p\n", block);
-
-		block->blocknum = blocknum;
-		err = bio_read(cache->dev, block->ptr, (off_t)blocknum * cache->block_size, cache->block_size);
-		if (err < 0) {
-			/* free the block, return an error */
-			list_add_tail(&cache->free_list, &block->node);
+		block = fill_blocks(cache, blocknum);
+		if (block == NULL)
 			return NULL;
-		}
-
-		cache->stats.reads++;
 	}
 
+	cache->next_seq = blocknum + 1;
+
 	DEBUG_ASSERT(block->blocknum == blocknum);
 
 	return block;
@@ -230,6 +427,26 @@ int bcache_read_block(bcache_t _cache, void *buf, uint blocknum)
 	return 0;
 }
 
+int bcache_write_block(bcache_t _cache, const void *buf, uint blocknum)
+{
+	struct bcache *cache = _cache;
+	struct bcache_block *block;
+
+	LTRACEF("buf %p, blocknum %u\n", buf, blocknum);
+
+	/* the whole block is replaced, so there's no need to fill it first */
+	block = find_block(cache, blocknum);
+	if (!block) {
+		block = alloc_block(cache, blocknum);
+		if (!block)
+			return -1;
+	}
+
+	memcpy(block->ptr, buf, cache->block_size);
+	block->is_dirty = true;
+	return 0;
+}
+
 int bcache_get_block(bcache_t _cache, void **ptr, uint blocknum)
 {
 	struct bcache *cache = _cache;
@@ -257,7 +474,7 @@ int bcache_put_block(bcache_t _cache, uint blocknum)
 
 	LTRACEF("blocknum %u\n", blocknum);
 
-	struct bcache_block *block = find_block(cache, blocknum);
+	struct bcache_block *block = lookup_block(cache, blocknum, NULL);
 
 	/* be pretty hard on the caller for now */
 	DEBUG_ASSERT(block);
@@ -274,7 +491,7 @@ int bcache_mark_block_dirty(bcache_t priv, uint blocknum)
 	struct bcache *cache = priv;
 	struct bcache_block *block;
 
-	block = find_block(cache, blocknum);
+	block = lookup_block(cache, blocknum, NULL);
 	if (!block) {
 		err = -1;
 		goto exit;
@@ -294,13 +511,11 @@ int bcache_zero_block(bcache_t priv, uint blocknum)
 
 	block = find_block(cache, blocknum);
 	if (!block) {
-		block = alloc_block(cache);
+		block = alloc_block(cache, blocknum);
 		if (!block) {
 			err = -1;
 			goto exit;
 		}
-
-		block->blocknum = blocknum;
 	}
 
 	memset(block->ptr, 0, cache->block_size);
@@ -310,15 +525,26 @@ exit:
 	return (err);
 }
 
+/* drop a cached block without writing it back, used when the device is written around the cache */
+static void invalidate_block(struct bcache *cache, uint blocknum)
+{
+	struct bcache_block *block = lookup_block(cache, blocknum, NULL);
+
+	if (block && block->ref_count == 0)
+		free_block(cache, block);
+}
+
 int bcache_flush(bcache_t priv)
 {
 	int err;
 	struct bcache *cache = priv;
 	struct bcache_block *block;
 
+	cache->stats.flushes++;
+
 	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
 		if (block->is_dirty) {
-			err = flush_block(cache, block);
+			err = flush_run(cache, block);
 			if (err)
 				goto exit;
 		}
@@ -329,6 +555,38 @@ exit:
 	return (err);
 }
 
+void bcache_set_readahead(bcache_t priv, uint blocks)
+{
+	struct bcache *cache = priv;
+	uint8_t *buf;
+
+	blocks = bcache_clamp_readahead(cache, blocks);
+	if (blocks > cache->ra_max) {
+		buf = malloc(blocks * cache->block_size);
+		if (!buf)
+			return;
+		free(cache->burst_buf);
+		cache->burst_buf = buf;
+	}
+
+	cache->ra_max = blocks;
+	cache->ra_window = 1;
+}
+
+void bcache_get_stats(bcache_t priv, struct bcache_stats *stats)
+{
+	struct bcache *cache = priv;
+
+	*stats = cache->stats;
+}
+
+void bcache_reset_stats(bcache_t priv)
+{
+	struct bcache *cache = priv;
+
+	memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
 void bcache_dump(bcache_t priv, const char *name)
 {
 	uint32_t finds;
@@ -345,4 +603,166 @@ void bcache_dump(bcache_t priv, const char *name)
 		finds ? (cache->stats.misses * 100) / finds : 0,
 		cache->stats.reads,
 		cache->stats.writes);
+	printf("%s: evictions=%u readahead=%u(%u used) flushes=%u window=%u/%u\n",
+		name,
+		cache->stats.evictions,
+		cache->stats.readahead_blocks,
+		cache->stats.readahead_hits,
+		cache->stats.flushes,
+		cache->ra_window,
+		cache->ra_max);
+}
+
+/*
+ * block device shim, so a cache can be layered transparently over any
+ * registered bio device.
+ */
+typedef struct {
+	bdev_t dev;
+
+	bdev_t *parent;
+	struct bcache *cache;
+	mutex_t lock;
+} bcache_bdev_t;
+
+static ssize_t bcache_bdev_read_block(struct bdev *_dev, void *_buf, bnum_t block, uint count)
+{
+	bcache_bdev_t *bdev = (bcache_bdev_t *)_dev;
+	struct bcache *cache = bdev->cache;
+	uint8_t *buf = _buf;
+	ssize_t err = 0;
+	uint i;
+
+	mutex_acquire(&bdev->lock);
+
+	if (count >= cache->ra_max) {
+		/* large transfer, go straight to the device and patch in dirty blocks */
+		err = bio_read_block(bdev->parent, buf, block, count);
+		if (err >= 0) {
+			for (i = 0; i < count; i++) {
+				struct bcache_block *b = lookup_block(cache, block + i, NULL);
+				if (b && b->is_dirty)
+					memcpy(buf + i * cache->block_size, b->ptr, cache->block_size);
+			}
+			cache->next_seq = block + count;
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			err = bcache_read_block(cache, buf + i * cache->block_size, block + i);
+			if (err < 0)
+				break;
+		}
+	}
+
+	mutex_release(&bdev->lock);
+
+	return (err < 0) ? err : (ssize_t)(count * cache->block_size);
+}
+
+static ssize_t bcache_bdev_write_block(struct bdev *_dev, const void *_buf, bnum_t block, uint count)
+{
+	bcache_bdev_t *bdev = (bcache_bdev_t *)_dev;
+	struct bcache *cache = bdev->cache;
+	const uint8_t *buf = _buf;
+	ssize_t err = 0;
+	uint i;
+
+	mutex_acquire(&bdev->lock);
+
+	if (count >= cache->ra_max) {
+		/* large transfer, write around the cache and drop stale copies */
+		err = bio_write_block(bdev->parent, buf, block, count);
+		if (err >= 0) {
+			for (i = 0; i < count; i++)
+				invalidate_block(cache, block + i);
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			err = bcache_write_block(cache, buf + i * cache->block_size, block + i);
+			if (err < 0)
+				break;
+		}
+	}
+
+	mutex_release(&bdev->lock);
+
+	return (err < 0) ? err : (ssize_t)(count * cache->block_size);
+}
+
+static int bcache_bdev_ioctl(struct bdev *_dev, int request, void *argp)
+{
+	bcache_bdev_t *bdev = (bcache_bdev_t *)_dev;
+
+	return bio_ioctl(bdev->parent, request, argp);
+}
+
+static void bcache_bdev_close(struct bdev *_dev)
+{
+	bcache_bdev_t *bdev = (bcache_bdev_t *)_dev;
+
+	bcache_flush(bdev->cache);
+	bcache_destroy(bdev->cache);
+	bio_close(bdev->parent);
+	bdev->parent = NULL;
+	/* unlink it from the mutex stats list before the bdev is freed */
+	mutex_destroy(&bdev->lock);
+}
+
+status_t bcache_publish_device(const char *parent_dev, const char *name, int block_count)
+{
+	LTRACEF("parent %s, name %s, blocks %d\n", parent_dev, name, block_count);
+
+	bdev_t *parent = bio_open(parent_dev);
+	if (!parent)
+		return ERR_NOT_FOUND;
+
+	bcache_bdev_t *bdev = malloc(sizeof(bcache_bdev_t));
+	if (!bdev) {
+		bio_close(parent);
+		return ERR_NO_MEMORY;
+	}
+
+	bio_initialize_bdev(&bdev->dev, name, parent->block_size, parent->block_count);
+
+	bdev->parent = parent;
+	bdev->cache = bcache_create(parent, parent->block_size, block_count);
+	if (!bdev->cache) {
+		free(bdev->dev.name);
+		free(bdev);
+		bio_close(parent);
+		return ERR_NO_MEMORY;
+	}
+	mutex_init(&bdev->lock);
+
+	bdev->dev.read_block = &bcache_bdev_read_block;
+	bdev->dev.write_block = &bcache_bdev_write_block;
+	bdev->dev.ioctl = &bcache_bdev_ioctl;
+	bdev->dev.close = &bcache_bdev_close;
+
+	bio_register_device(&bdev->dev);
+
+	return NO_ERROR;
+}
+
+status_t bcache_flush_device(const char *name)
+{
+	bdev_t *dev = bio_open(name);
+	int err;
+
+	if (!dev)
+		return ERR_NOT_FOUND;
+
+	if (dev->read_block != &bcache_bdev_read_block) {
+		bio_close(dev);
+		return ERR_NOT_VALID;
+	}
+
+	bcache_bdev_t *bdev = (bcache_bdev_t *)dev;
+	mutex_acquire(&bdev->lock);
+	err = bcache_flush(bdev->cache);
+	mutex_release(&bdev->lock);
+
+	bio_close(dev);
+
+	return err;
 }
@@ -394,6 +394,7 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 	dev->write = bio_default_write;
 	dev->write_block = bio_default_write_block;
 	dev->erase = bio_default_erase;
+	dev->ioctl = NULL;
 	dev->close = NULL;
 }
 
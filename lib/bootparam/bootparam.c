@@ -0,0 +1,143 @@
+/* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <string.h>
+#include <lib/bootparam.h>
+
+/* keys the bootloader owns; a later setting replaces an earlier one */
+static const char *override_prefix = "androidboot.";
+
+void bootparam_init(struct bootparam *bp, char *buf, unsigned size)
+{
+	bp->buf = buf;
+	bp->size = size;
+	bp->len = 0;
+	bp->truncated = false;
+	if (size)
+		buf[0] = '\0';
+}
+
+void bootparam_add(struct bootparam *bp, const char *str)
+{
+	char *dst = bp->buf + bp->len;
+	char *end = bp->buf + bp->size - 1;
+
+	while (*str && dst < end)
+		*dst++ = *str++;
+	*dst = '\0';
+
+	if (*str)
+		bp->truncated = true;
+	bp->len = dst - bp->buf;
+}
+
+/* Length of the parameter at p, honouring double quotes in the value */
+static unsigned param_len(const char *p)
+{
+	const char *s = p;
+	bool quoted = false;
+
+	while (*s && (quoted || *s != ' ')) {
+		if (*s == '"')
+			quoted = !quoted;
+		s++;
+	}
+
+	return s - p;
+}
+
+/* Length of the key of a key=value parameter, 0 for a bare flag */
+static unsigned key_len(const char *p, unsigned len)
+{
+	const char *eq = memchr(p, '=', len);
+
+	return eq ? (unsigned)(eq - p) : 0;
+}
+
+/* Is the parameter at p, len bytes long, set again after it? */
+static bool superseded(const char *p, unsigned len)
+{
+	unsigned klen = key_len(p, len);
+	bool owned = klen && !strncmp(p, override_prefix, strlen(override_prefix));
+	const char *q = p + len;
+	unsigned qlen;
+
+	while (*q) {
+		if (*q == ' ') {
+			q++;
+			continue;
+		}
+
+		qlen = param_len(q);
+		if (qlen == len && !memcmp(p, q, len))
+			return true;
+		if (owned && key_len(q, qlen) == klen && !memcmp(p, q, klen + 1))
+			return true;
+		q += qlen;
+	}
+
+	return false;
+}
+
+unsigned bootparam_finish(struct bootparam *bp)
+{
+	char *buf = bp->buf;
+	unsigned pos = 0;
+	unsigned len, start;
+
+	if (!bp->size)
+		return 0;
+
+	while (pos < bp->len) {
+		if (buf[pos] == ' ') {
+			pos++;
+			continue;
+		}
+
+		len = param_len(buf + pos);
+		if (!superseded(buf + pos, len)) {
+			pos += len;
+			continue;
+		}
+
+		/* remove it together with the space in front of it */
+		start = (pos && buf[pos - 1] == ' ') ? pos - 1 : pos;
+		if (start == pos && buf[pos + len] == ' ')
+			len++;
+		memmove(buf + start, buf + pos + len, bp->len - (pos + len) + 1);
+		bp->len -= pos + len - start;
+		pos = start;
+	}
+
+	if (bp->truncated)
+		dprintf(CRITICAL, "ERROR: kernel command line truncated to %u bytes\n",
+			bp->len);
+
+	return bp->len + 1;
+}
@@ -59,44 +59,47 @@ void _panic(void *caller, const char *fmt, ...)
 	halt();
 }
 
-int _dputs(const char *str)
+/* platforms with a buffered console override this to take a run at once */
+__WEAK void _dwrite(const char *str, size_t len)
 {
-	while(*str != 0) {
+	while (len--)
 		_dputc(*str++);
-	}
+}
+
+int _dputs(const char *str)
+{
+	_dwrite(str, strlen(str));
+
+	return 0;
+}
+
+static int _dprintf_output(const char *str, size_t len, void *state)
+{
+	_dwrite(str, len);
 
 	return 0;
 }
 
 int _dprintf(const char *fmt, ...)
 {
-	char buf[256];
 	char ts_buf[13];
 	int err;
 
-	snprintf(ts_buf, sizeof(ts_buf), "[%u] ", current_time());
+	snprintf(ts_buf, sizeof(ts_buf), "[%lu] ", current_time());
 	dputs(ALWAYS, ts_buf);
 
 	va_list ap;
 	va_start(ap, fmt);
-	err = vsnprintf(buf, sizeof(buf), fmt, ap);
+	err = _dvprintf(fmt, ap);
 	va_end(ap);
 
-	dputs(ALWAYS, buf);
-
 	return err;
 }
 
+/* formats straight to the console, so long lines are not truncated */
 int _dvprintf(const char *fmt, va_list ap)
 {
-	char buf[256];
-	int err;
-
-	err = vsnprintf(buf, sizeof(buf), fmt, ap);
-
-	dputs(ALWAYS, buf);
-
-	return err;
+	return _printf_engine(&_dprintf_output, NULL, fmt, ap);
 }
 
 void hexdump(const void *ptr, size_t len)
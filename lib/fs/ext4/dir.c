@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <debug.h>
+#include <err.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ext4_priv.h"
+
+#define LOCAL_TRACE 0
+
+#define EXT4_FAST_SYMLINK_SIZE	(EXT4_N_BLOCKS * sizeof(uint32_t))
+#define DX_MAX_LEVELS		3
+
+/* scan one directory block for name */
+static int ext4_search_dir_block(ext4_t *ext4, const uint8_t *block, const char *name,
+		size_t namelen, uint32_t *ino)
+{
+	uint32_t pos = 0;
+
+	while (pos + sizeof(struct ext4_dir_entry_2) <= ext4->block_size) {
+		const struct ext4_dir_entry_2 *ent = (const struct ext4_dir_entry_2 *)(block + pos);
+		uint16_t rec_len = LE16(ent->rec_len);
+
+		if (rec_len < sizeof(struct ext4_dir_entry_2) || (rec_len & 3) ||
+		    pos + rec_len > ext4->block_size || ent->name_len + sizeof(*ent) > rec_len)
+			return ERR_NOT_VALID;
+
+		if (ent->inode != 0 && ent->name_len == namelen &&
+		    !memcmp(ent->name, name, namelen)) {
+			*ino = LE32(ent->inode);
+			return 0;
+		}
+
+		pos += rec_len;
+	}
+
+	return ERR_NOT_FOUND;
+}
+
+static int ext4_search_dir_lblock(ext4_t *ext4, const struct ext4_inode *dir, uint32_t lblock,
+		const char *name, size_t namelen, uint32_t *ino)
+{
+	uint32_t pblock, count;
+	void *ptr;
+	int err;
+
+	err = ext4_map_block(ext4, dir, lblock, &pblock, &count);
+	if (err < 0)
+		return err;
+	if (pblock == 0)
+		return ERR_NOT_FOUND;
+
+	if (bcache_get_block(ext4->cache, &ptr, pblock) < 0)
+		return ERR_IO;
+	err = ext4_search_dir_block(ext4, ptr, name, namelen, ino);
+	bcache_put_block(ext4->cache, pblock);
+
+	return err;
+}
+
+static int ext4_linear_lookup(ext4_t *ext4, const struct ext4_inode *dir, const char *name,
+		size_t namelen, uint32_t *ino)
+{
+	uint32_t lblock;
+	uint32_t nblocks = (ext4_inode_size(dir) + ext4->block_size - 1) >> ext4->log_block_size;
+	int err;
+
+	for (lblock = 0; lblock < nblocks; lblock++) {
+		err = ext4_search_dir_lblock(ext4, dir, lblock, name, namelen, ino);
+		if (err != ERR_NOT_FOUND)
+			return err;
+	}
+
+	return ERR_NOT_FOUND;
+}
+
+struct dx_frame {
+	uint32_t pblock;
+	const struct dx_entry *entries;
+	uint count;
+	uint at;
+};
+
+/* read the index node at lblock of the directory, entries start at offset */
+static int dx_load_node(ext4_t *ext4, const struct ext4_inode *dir, uint32_t lblock,
+		uint32_t offset, struct dx_frame *frame)
+{
+	const struct dx_countlimit *cl;
+	uint32_t count;
+	void *ptr;
+	int err;
+
+	err = ext4_map_block(ext4, dir, lblock, &frame->pblock, &count);
+	if (err < 0)
+		return err;
+	if (frame->pblock == 0)
+		return ERR_NOT_VALID;
+
+	if (bcache_get_block(ext4->cache, &ptr, frame->pblock) < 0)
+		return ERR_IO;
+
+	cl = (const struct dx_countlimit *)((uint8_t *)ptr + offset);
+	frame->entries = (const struct dx_entry *)cl;
+	frame->count = LE16(cl->count);
+	frame->at = 0;
+
+	if (frame->count == 0 || frame->count > LE16(cl->limit) ||
+	    offset + LE16(cl->limit) * sizeof(struct dx_entry) > ext4->block_size) {
+		bcache_put_block(ext4->cache, frame->pblock);
+		return ERR_NOT_VALID;
+	}
+
+	return 0;
+}
+
+/* pick the last entry whose hash is <= hash, entry 0 covers everything below entry 1 */
+static void dx_search_node(struct dx_frame *frame, uint32_t hash)
+{
+	uint lo = 1, hi = frame->count - 1, mid;
+
+	while (lo <= hi && hi > 0) {
+		mid = (lo + hi) / 2;
+		if (LE32(frame->entries[mid].hash) > hash)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	frame->at = lo - 1;
+}
+
+static inline uint32_t dx_block(const struct dx_frame *frame)
+{
+	return LE32(frame->entries[frame->at].block) & 0x0fffffff;
+}
+
+/*
+ * hashed directory lookup. returns ERR_NOT_VALID if the index can't be
+ * used, in which case the caller falls back to a linear scan.
+ */
+static int ext4_dx_lookup(ext4_t *ext4, const struct ext4_inode *dir, const char *name,
+		size_t namelen, uint32_t *ino)
+{
+	struct dx_frame frames[DX_MAX_LEVELS];
+	const struct dx_root_info *info;
+	uint32_t pblock, count;
+	uint levels, level, nframes = 0;
+	uint32_t hash;
+	int version;
+	void *ptr;
+	int err;
+
+	/* the root info sits behind the fake '.' and '..' entries of block 0 */
+	err = ext4_map_block(ext4, dir, 0, &pblock, &count);
+	if (err < 0)
+		return err;
+	if (pblock == 0)
+		return ERR_NOT_VALID;
+	if (bcache_get_block(ext4->cache, &ptr, pblock) < 0)
+		return ERR_IO;
+	info = (const struct dx_root_info *)((uint8_t *)ptr + 24);
+	version = info->hash_version;
+	levels = info->indirect_levels + 1;
+	if (info->reserved_zero != 0 || info->info_length != sizeof(*info) ||
+	    version > DX_HASH_TEA || levels > DX_MAX_LEVELS) {
+		bcache_put_block(ext4->cache, pblock);
+		return ERR_NOT_VALID;
+	}
+	bcache_put_block(ext4->cache, pblock);
+
+	if (ext4->hash_unsigned)
+		version += DX_HASH_LEGACY_UNSIGNED;
+	hash = ext4_dx_hash(name, namelen, version, ext4->hash_seed);
+
+	LTRACEF("name '%.*s' hash 0x%x, levels %u\n", (int)namelen, name, hash, levels);
+
+	/* walk down the index */
+	for (level = 0; level < levels; level++) {
+		if (level == 0)
+			err = dx_load_node(ext4, dir, 0, 24 + sizeof(*info), &frames[0]);
+		else
+			err = dx_load_node(ext4, dir, dx_block(&frames[level - 1]), 8, &frames[level]);
+		if (err < 0)
+			goto out;
+		nframes++;
+		dx_search_node(&frames[level], hash);
+	}
+
+	for (;;) {
+		err = ext4_search_dir_lblock(ext4, dir, dx_block(&frames[nframes - 1]), name, namelen, ino);
+		if (err != ERR_NOT_FOUND)
+			goto out;
+
+		/* names with colliding hashes may continue in the next leaf */
+		for (level = nframes; level > 0; level--) {
+			if (++frames[level - 1].at < frames[level - 1].count)
+				break;
+		}
+		if (level == 0)
+			goto out;
+		if ((LE32(frames[level - 1].entries[frames[level - 1].at].hash) & ~1) != hash)
+			goto out;
+
+		/* reload everything below the level that advanced */
+		while (nframes > level)
+			bcache_put_block(ext4->cache, frames[--nframes].pblock);
+		while (nframes < levels) {
+			err = dx_load_node(ext4, dir, dx_block(&frames[nframes - 1]), 8, &frames[nframes]);
+			if (err < 0)
+				goto out;
+			nframes++;
+		}
+	}
+
+out:
+	while (nframes > 0)
+		bcache_put_block(ext4->cache, frames[--nframes].pblock);
+	return err;
+}
+
+static int ext4_dir_lookup(ext4_t *ext4, const struct ext4_inode *dir, const char *name,
+		size_t namelen, uint32_t *ino)
+{
+	int err;
+
+	if ((dir->i_flags & EXT4_INDEX_FL) &&
+	    (ext4->sb.s_feature_compat & EXT4_FEATURE_COMPAT_DIR_INDEX)) {
+		err = ext4_dx_lookup(ext4, dir, name, namelen, ino);
+		if (err != ERR_NOT_VALID)
+			return err;
+		LTRACEF("bad directory index, scanning\n");
+	}
+
+	return ext4_linear_lookup(ext4, dir, name, namelen, ino);
+}
+
+/*
+ * Short targets are stored directly in i_block. As in Linux, a link is fast
+ * when it owns no blocks, not counting an extended attribute block.
+ */
+static bool ext4_fast_symlink(ext4_t *ext4, const struct ext4_inode *inode)
+{
+	uint32_t acl_hi = inode->i_osd2[2] | (inode->i_osd2[3] << 8);
+	uint32_t ea_blocks = 0;
+
+	if (ext4_inode_size(inode) >= (off_t)EXT4_FAST_SYMLINK_SIZE)
+		return false;
+
+	if (inode->i_file_acl_lo || acl_hi)
+		ea_blocks = ext4->block_size / 512;
+
+	return inode->i_blocks_lo - ea_blocks == 0;
+}
+
+static int ext4_read_link(ext4_t *ext4, const struct ext4_inode *inode, char *buf, size_t len)
+{
+	off_t size = ext4_inode_size(inode);
+	ssize_t err;
+
+	if (size >= (off_t)len)
+		return ERR_TOO_BIG;
+
+	if (ext4_fast_symlink(ext4, inode)) {
+		memcpy(buf, inode->i_block, size);
+	} else {
+		err = ext4_read_inode(ext4, inode, buf, 0, size);
+		if (err < 0)
+			return err;
+	}
+	buf[size] = 0;
+
+	return 0;
+}
+
+static int ext4_walk(ext4_t *ext4, uint32_t dir_ino, const char *path, int links, uint32_t *ino)
+{
+	struct ext4_inode inode;
+	uint32_t cur = dir_ino;
+	int err;
+
+	for (;;) {
+		const char *next;
+		size_t len;
+
+		while (*path == '/')
+			path++;
+		if (*path == 0)
+			break;
+
+		next = strchr(path, '/');
+		len = next ? (size_t)(next - path) : strlen(path);
+		if (len > EXT4_NAME_LEN)
+			return ERR_BAD_PATH;
+
+		err = ext4_load_inode(ext4, cur, &inode);
+		if (err < 0)
+			return err;
+		if (!S_ISDIR(inode.i_mode))
+			return ERR_NOT_DIR;
+
+		uint32_t found;
+		err = ext4_dir_lookup(ext4, &inode, path, len, &found);
+		if (err < 0)
+			return err;
+
+		LTRACEF("'%.*s' -> inode %u\n", (int)len, path, found);
+
+		path += len;
+
+		err = ext4_load_inode(ext4, found, &inode);
+		if (err < 0)
+			return err;
+
+		if (S_ISLNK(inode.i_mode)) {
+			char *target;
+			size_t rest = strlen(path);
+
+			if (++links > EXT4_MAX_SYMLINKS)
+				return ERR_RECURSE_TOO_DEEP;
+
+			/* splice the link target in front of what's left of the path */
+			target = malloc(ext4->block_size + rest + 1);
+			if (!target)
+				return ERR_NO_MEMORY;
+			err = ext4_read_link(ext4, &inode, target, ext4->block_size);
+			if (err >= 0) {
+				strcat(target, path);
+				err = ext4_walk(ext4, target[0] == '/' ? EXT4_ROOT_INO : cur,
+						target, links, &found);
+			}
+			free(target);
+			if (err < 0)
+				return err;
+
+			/* the rest of the path was walked as part of the link */
+			path += rest;
+		}
+
+		cur = found;
+	}
+
+	*ino = cur;
+	return 0;
+}
+
+int ext4_lookup(ext4_t *ext4, const char *path, uint32_t *ino)
+{
+	return ext4_walk(ext4, EXT4_ROOT_INO, path, 0, ino);
+}
+
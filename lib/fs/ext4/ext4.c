@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <debug.h>
+#include <err.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lib/fs/ext4.h>
+#include "ext4_priv.h"
+
+#define LOCAL_TRACE 0
+
+static void endian_swap_superblock(struct ext4_super_block *sb)
+{
+	int i;
+
+	LE32SWAP(sb->s_inodes_count);
+	LE32SWAP(sb->s_blocks_count_lo);
+	LE32SWAP(sb->s_first_data_block);
+	LE32SWAP(sb->s_log_block_size);
+	LE32SWAP(sb->s_blocks_per_group);
+	LE32SWAP(sb->s_inodes_per_group);
+	LE16SWAP(sb->s_magic);
+	LE32SWAP(sb->s_rev_level);
+	LE32SWAP(sb->s_first_ino);
+	LE16SWAP(sb->s_inode_size);
+	LE32SWAP(sb->s_feature_compat);
+	LE32SWAP(sb->s_feature_incompat);
+	LE32SWAP(sb->s_feature_ro_compat);
+	for (i = 0; i < 4; i++)
+		LE32SWAP(sb->s_hash_seed[i]);
+	LE16SWAP(sb->s_desc_size);
+	LE32SWAP(sb->s_first_meta_bg);
+	LE32SWAP(sb->s_blocks_count_hi);
+	LE32SWAP(sb->s_flags);
+}
+
+static void endian_swap_inode(struct ext4_inode *inode)
+{
+	LE16SWAP(inode->i_mode);
+	LE32SWAP(inode->i_size_lo);
+	LE16SWAP(inode->i_links_count);
+	LE32SWAP(inode->i_blocks_lo);
+	LE32SWAP(inode->i_flags);
+	LE32SWAP(inode->i_size_high);
+
+	/* i_block is left alone, it's either an extent tree or a list of block numbers and is swapped on use */
+}
+
+off_t ext4_inode_size(const struct ext4_inode *inode)
+{
+	return ((off_t)inode->i_size_high << 32) | inode->i_size_lo;
+}
+
+int ext4_load_inode(ext4_t *ext4, uint32_t ino, struct ext4_inode *inode)
+{
+	uint32_t group, index, block, offset;
+	void *ptr;
+	int err;
+
+	if (ino == 0 || ino > ext4->sb.s_inodes_count)
+		return ERR_NOT_VALID;
+
+	group = (ino - 1) / ext4->sb.s_inodes_per_group;
+	index = (ino - 1) % ext4->sb.s_inodes_per_group;
+
+	block = ext4->inode_table[group] + (index * ext4->inode_size) / ext4->block_size;
+	offset = (index * ext4->inode_size) % ext4->block_size;
+
+	LTRACEF("ino %u, group %u, block %u, offset %u\n", ino, group, block, offset);
+
+	err = bcache_get_block(ext4->cache, &ptr, block);
+	if (err < 0)
+		return ERR_IO;
+
+	memcpy(inode, (uint8_t *)ptr + offset, sizeof(struct ext4_inode));
+	bcache_put_block(ext4->cache, block);
+
+	endian_swap_inode(inode);
+
+	return 0;
+}
+
+/* is there a superblock backup (and so a descriptor table) in this group */
+static bool ext4_group_has_super(ext4_t *ext4, uint32_t group)
+{
+	uint32_t n;
+	uint32_t base;
+
+	if (!(ext4->sb.s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER))
+		return true;
+	if (group <= 1)
+		return true;
+
+	/* sparse groups are powers of 3, 5 and 7 */
+	for (base = 3; base <= 7; base += 2) {
+		for (n = base; n < group; n *= base)
+			;
+		if (n == group)
+			return true;
+	}
+
+	return false;
+}
+
+static uint32_t ext4_group_desc_block(ext4_t *ext4, uint32_t group, uint32_t descs_per_block)
+{
+	uint32_t meta_group = group / descs_per_block;
+	uint32_t first_data_block = ext4->sb.s_first_data_block;
+
+	if (!(ext4->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_META_BG) ||
+	    meta_group < ext4->sb.s_first_meta_bg)
+		return first_data_block + 1 + meta_group;
+
+	/* meta_bg: each meta group's descriptors live in its first group */
+	group = meta_group * descs_per_block;
+	return first_data_block + group * ext4->sb.s_blocks_per_group +
+		(ext4_group_has_super(ext4, group) ? 1 : 0);
+}
+
+static int ext4_load_group_descs(ext4_t *ext4)
+{
+	uint32_t desc_size = EXT4_MIN_DESC_SIZE;
+	uint32_t descs_per_block;
+	uint32_t group;
+	uint32_t block;
+	void *ptr;
+
+	if (ext4->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) {
+		desc_size = ext4->sb.s_desc_size;
+		if (desc_size < EXT4_MIN_DESC_SIZE_64BIT || desc_size > ext4->block_size)
+			return ERR_NOT_VALID;
+	}
+	descs_per_block = ext4->block_size / desc_size;
+
+	ext4->inode_table = malloc(ext4->group_count * sizeof(uint32_t));
+	if (!ext4->inode_table)
+		return ERR_NO_MEMORY;
+
+	for (group = 0; group < ext4->group_count; group++) {
+		const struct ext4_group_desc *gd;
+
+		block = ext4_group_desc_block(ext4, group, descs_per_block);
+		if (bcache_get_block(ext4->cache, &ptr, block) < 0)
+			return ERR_IO;
+
+		gd = (const struct ext4_group_desc *)((uint8_t *)ptr + (group % descs_per_block) * desc_size);
+		ext4->inode_table[group] = LE32(gd->bg_inode_table_lo);
+		if (desc_size >= EXT4_MIN_DESC_SIZE_64BIT && gd->bg_inode_table_hi != 0) {
+			bcache_put_block(ext4->cache, block);
+			return ERR_TOO_BIG;
+		}
+
+		bcache_put_block(ext4->cache, block);
+
+		LTRACEF("group %u: inode table at %u\n", group, ext4->inode_table[group]);
+	}
+
+	return 0;
+}
+
+int ext4_mount(bdev_t *dev, fscookie *cookie)
+{
+	int err;
+	uint32_t unsupported;
+
+	LTRACEF("dev %p\n", dev);
+
+	ext4_t *ext4 = malloc(sizeof(ext4_t));
+	if (!ext4)
+		return ERR_NO_MEMORY;
+	memset(ext4, 0, sizeof(ext4_t));
+
+	err = bio_read(dev, &ext4->sb, EXT4_SUPERBLOCK_OFFSET, sizeof(struct ext4_super_block));
+	if (err < (int)sizeof(struct ext4_super_block)) {
+		err = ERR_IO;
+		goto err;
+	}
+
+	endian_swap_superblock(&ext4->sb);
+
+	/* see if the superblock is good */
+	if (ext4->sb.s_magic != EXT4_SUPER_MAGIC) {
+		err = ERR_NOT_VALID;
+		goto err;
+	}
+
+	unsupported = ext4->sb.s_feature_incompat & ~EXT4_FEATURE_INCOMPAT_SUPP;
+	if (ext4->sb.s_rev_level != EXT4_GOOD_OLD_REV && unsupported) {
+		dprintf(INFO, "ext4: unsupported incompatible features 0x%x\n", unsupported);
+		err = ERR_NOT_SUPPORTED;
+		goto err;
+	}
+	if (ext4->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_RECOVER)
+		dprintf(INFO, "ext4: journal needs recovery, reading possibly stale data\n");
+
+	if ((ext4->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) && ext4->sb.s_blocks_count_hi) {
+		err = ERR_TOO_BIG;
+		goto err;
+	}
+
+	if (ext4->sb.s_log_block_size > 6 || ext4->sb.s_blocks_per_group == 0 ||
+	    ext4->sb.s_inodes_per_group == 0) {
+		err = ERR_NOT_VALID;
+		goto err;
+	}
+
+	ext4->dev = dev;
+	ext4->log_block_size = EXT4_MIN_BLOCK_LOG_SIZE + ext4->sb.s_log_block_size;
+	ext4->block_size = 1U << ext4->log_block_size;
+	if (ext4->sb.s_rev_level == EXT4_GOOD_OLD_REV)
+		ext4->inode_size = EXT4_GOOD_OLD_INODE_SIZE;
+	else
+		ext4->inode_size = ext4->sb.s_inode_size;
+	if (ext4->inode_size < EXT4_GOOD_OLD_INODE_SIZE || ext4->inode_size > ext4->block_size) {
+		err = ERR_NOT_VALID;
+		goto err;
+	}
+
+	ext4->group_count = (ext4->sb.s_blocks_count_lo - ext4->sb.s_first_data_block +
+			ext4->sb.s_blocks_per_group - 1) / ext4->sb.s_blocks_per_group;
+
+	memcpy(ext4->hash_seed, ext4->sb.s_hash_seed, sizeof(ext4->hash_seed));
+	ext4->hash_unsigned = (ext4->sb.s_flags & EXT4_FLAGS_UNSIGNED_HASH) ? 1 : 0;
+
+	LTRACEF("block size %u, groups %u, inode size %u, features 0x%x/0x%x/0x%x\n",
+		ext4->block_size, ext4->group_count, ext4->inode_size,
+		ext4->sb.s_feature_compat, ext4->sb.s_feature_incompat, ext4->sb.s_feature_ro_compat);
+
+	/* metadata goes through a small cache, file data is read around it */
+	ext4->cache = bcache_create(dev, ext4->block_size, EXT4_CACHE_BLOCKS);
+	if (!ext4->cache) {
+		err = ERR_NO_MEMORY;
+		goto err;
+	}
+
+	err = ext4_load_group_descs(ext4);
+	if (err < 0)
+		goto err;
+
+	*cookie = (fscookie)ext4;
+
+	return 0;
+
+err:
+	LTRACEF("exiting with err code %d\n", err);
+
+	if (ext4->cache)
+		bcache_destroy(ext4->cache);
+	free(ext4->inode_table);
+	free(ext4);
+	return err;
+}
+
+int ext4_unmount(fscookie cookie)
+{
+	ext4_t *ext4 = (ext4_t *)cookie;
+
+	bcache_destroy(ext4->cache);
+	free(ext4->inode_table);
+	free(ext4);
+
+	return 0;
+}
+
+int ext4_open_file(fscookie cookie, const char *path, filecookie *fcookie)
+{
+	ext4_t *ext4 = (ext4_t *)cookie;
+	ext4_file_t *file;
+	uint32_t ino;
+	int err;
+
+	LTRACEF("path '%s'\n", path);
+
+	err = ext4_lookup(ext4, path, &ino);
+	if (err < 0)
+		return err;
+
+	file = malloc(sizeof(ext4_file_t));
+	if (!file)
+		return ERR_NO_MEMORY;
+
+	file->ext4 = ext4;
+	file->ino = ino;
+
+	err = ext4_load_inode(ext4, ino, &file->inode);
+	if (err < 0) {
+		free(file);
+		return err;
+	}
+
+	*fcookie = (filecookie)file;
+
+	return 0;
+}
+
+int ext4_read_file(filecookie fcookie, void *buf, off_t offset, size_t len)
+{
+	ext4_file_t *file = (ext4_file_t *)fcookie;
+
+	if (S_ISDIR(file->inode.i_mode))
+		return ERR_NOT_FILE;
+
+	return ext4_read_inode(file->ext4, &file->inode, buf, offset, len);
+}
+
+int ext4_close_file(filecookie fcookie)
+{
+	ext4_file_t *file = (ext4_file_t *)fcookie;
+
+	free(file);
+
+	return 0;
+}
+
+int ext4_stat_file(filecookie fcookie, struct file_stat *stat)
+{
+	ext4_file_t *file = (ext4_file_t *)fcookie;
+
+	stat->size = ext4_inode_size(&file->inode);
+	stat->is_dir = S_ISDIR(file->inode.i_mode);
+
+	return 0;
+}
+
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __EXT4_FS_H
+#define __EXT4_FS_H
+
+#include <sys/types.h>
+#include <compiler.h>
+
+/* on disk layout of the pieces of ext4 we understand */
+
+#define EXT4_SUPER_MAGIC		0xEF53
+#define EXT4_SUPERBLOCK_OFFSET		1024
+#define EXT4_MIN_BLOCK_LOG_SIZE		10
+#define EXT4_ROOT_INO			2
+#define EXT4_GOOD_OLD_REV		0
+#define EXT4_GOOD_OLD_INODE_SIZE	128
+#define EXT4_GOOD_OLD_FIRST_INO		11
+
+/* s_feature_compat */
+#define EXT4_FEATURE_COMPAT_DIR_PREALLOC	0x0001
+#define EXT4_FEATURE_COMPAT_IMAGIC_INODES	0x0002
+#define EXT4_FEATURE_COMPAT_HAS_JOURNAL		0x0004
+#define EXT4_FEATURE_COMPAT_EXT_ATTR		0x0008
+#define EXT4_FEATURE_COMPAT_RESIZE_INODE	0x0010
+#define EXT4_FEATURE_COMPAT_DIR_INDEX		0x0020
+
+/* s_feature_ro_compat, none of these matter when reading */
+#define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
+#define EXT4_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
+#define EXT4_FEATURE_RO_COMPAT_HUGE_FILE	0x0008
+#define EXT4_FEATURE_RO_COMPAT_GDT_CSUM		0x0010
+#define EXT4_FEATURE_RO_COMPAT_DIR_NLINK	0x0020
+#define EXT4_FEATURE_RO_COMPAT_EXTRA_ISIZE	0x0040
+#define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM	0x0400
+
+/* s_feature_incompat */
+#define EXT4_FEATURE_INCOMPAT_COMPRESSION	0x0001
+#define EXT4_FEATURE_INCOMPAT_FILETYPE		0x0002
+#define EXT4_FEATURE_INCOMPAT_RECOVER		0x0004
+#define EXT4_FEATURE_INCOMPAT_JOURNAL_DEV	0x0008
+#define EXT4_FEATURE_INCOMPAT_META_BG		0x0010
+#define EXT4_FEATURE_INCOMPAT_EXTENTS		0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT		0x0080
+#define EXT4_FEATURE_INCOMPAT_MMP		0x0100
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG		0x0200
+#define EXT4_FEATURE_INCOMPAT_EA_INODE		0x0400
+#define EXT4_FEATURE_INCOMPAT_DIRDATA		0x1000
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED		0x2000
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR		0x4000
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA	0x8000
+#define EXT4_FEATURE_INCOMPAT_ENCRYPT		0x10000
+
+#define EXT4_FEATURE_INCOMPAT_SUPP	(EXT4_FEATURE_INCOMPAT_FILETYPE | \
+					 EXT4_FEATURE_INCOMPAT_RECOVER | \
+					 EXT4_FEATURE_INCOMPAT_META_BG | \
+					 EXT4_FEATURE_INCOMPAT_EXTENTS | \
+					 EXT4_FEATURE_INCOMPAT_64BIT | \
+					 EXT4_FEATURE_INCOMPAT_MMP | \
+					 EXT4_FEATURE_INCOMPAT_FLEX_BG | \
+					 EXT4_FEATURE_INCOMPAT_EA_INODE | \
+					 EXT4_FEATURE_INCOMPAT_CSUM_SEED | \
+					 EXT4_FEATURE_INCOMPAT_LARGEDIR)
+
+/* s_flags */
+#define EXT4_FLAGS_UNSIGNED_HASH	0x0002
+
+struct ext4_super_block {
+	uint32_t s_inodes_count;
+	uint32_t s_blocks_count_lo;
+	uint32_t s_r_blocks_count_lo;
+	uint32_t s_free_blocks_count_lo;
+	uint32_t s_free_inodes_count;
+	uint32_t s_first_data_block;
+	uint32_t s_log_block_size;
+	uint32_t s_log_cluster_size;
+	uint32_t s_blocks_per_group;
+	uint32_t s_clusters_per_group;
+	uint32_t s_inodes_per_group;
+	uint32_t s_mtime;
+	uint32_t s_wtime;
+	uint16_t s_mnt_count;
+	uint16_t s_max_mnt_count;
+	uint16_t s_magic;
+	uint16_t s_state;
+	uint16_t s_errors;
+	uint16_t s_minor_rev_level;
+	uint32_t s_lastcheck;
+	uint32_t s_checkinterval;
+	uint32_t s_creator_os;
+	uint32_t s_rev_level;
+	uint16_t s_def_resuid;
+	uint16_t s_def_resgid;
+
+	/* EXT4_DYNAMIC_REV */
+	uint32_t s_first_ino;
+	uint16_t s_inode_size;
+	uint16_t s_block_group_nr;
+	uint32_t s_feature_compat;
+	uint32_t s_feature_incompat;
+	uint32_t s_feature_ro_compat;
+	uint8_t  s_uuid[16];
+	char     s_volume_name[16];
+	char     s_last_mounted[64];
+	uint32_t s_algorithm_usage_bitmap;
+	uint8_t  s_prealloc_blocks;
+	uint8_t  s_prealloc_dir_blocks;
+	uint16_t s_reserved_gdt_blocks;
+	uint8_t  s_journal_uuid[16];
+	uint32_t s_journal_inum;
+	uint32_t s_journal_dev;
+	uint32_t s_last_orphan;
+	uint32_t s_hash_seed[4];
+	uint8_t  s_def_hash_version;
+	uint8_t  s_jnl_backup_type;
+	uint16_t s_desc_size;
+	uint32_t s_default_mount_opts;
+	uint32_t s_first_meta_bg;
+	uint32_t s_mkfs_time;
+	uint32_t s_jnl_blocks[17];
+
+	/* 64bit support */
+	uint32_t s_blocks_count_hi;
+	uint32_t s_r_blocks_count_hi;
+	uint32_t s_free_blocks_count_hi;
+	uint16_t s_min_extra_isize;
+	uint16_t s_want_extra_isize;
+	uint32_t s_flags;
+	uint16_t s_raid_stride;
+	uint16_t s_mmp_interval;
+	uint64_t s_mmp_block;
+	uint32_t s_raid_stripe_width;
+	uint8_t  s_log_groups_per_flex;
+	uint8_t  s_checksum_type;
+	uint16_t s_reserved_pad;
+	uint8_t  s_reserved[648];
+} __PACKED;
+
+#define EXT4_MIN_DESC_SIZE		32
+#define EXT4_MIN_DESC_SIZE_64BIT	64
+
+struct ext4_group_desc {
+	uint32_t bg_block_bitmap_lo;
+	uint32_t bg_inode_bitmap_lo;
+	uint32_t bg_inode_table_lo;
+	uint16_t bg_free_blocks_count_lo;
+	uint16_t bg_free_inodes_count_lo;
+	uint16_t bg_used_dirs_count_lo;
+	uint16_t bg_flags;
+	uint32_t bg_exclude_bitmap_lo;
+	uint16_t bg_block_bitmap_csum_lo;
+	uint16_t bg_inode_bitmap_csum_lo;
+	uint16_t bg_itable_unused_lo;
+	uint16_t bg_checksum;
+
+	/* only present if the descriptor size is >= 64 */
+	uint32_t bg_block_bitmap_hi;
+	uint32_t bg_inode_bitmap_hi;
+	uint32_t bg_inode_table_hi;
+} __PACKED;
+
+#define EXT4_NDIR_BLOCKS	12
+#define EXT4_IND_BLOCK		EXT4_NDIR_BLOCKS
+#define EXT4_DIND_BLOCK		(EXT4_IND_BLOCK + 1)
+#define EXT4_TIND_BLOCK		(EXT4_DIND_BLOCK + 1)
+#define EXT4_N_BLOCKS		(EXT4_TIND_BLOCK + 1)
+
+/* i_flags */
+#define EXT4_INDEX_FL		0x00001000
+#define EXT4_EXTENTS_FL		0x00080000
+#define EXT4_INLINE_DATA_FL	0x10000000
+
+/* i_mode */
+#define S_IFMT		0170000
+#define S_IFLNK		0120000
+#define S_IFREG		0100000
+#define S_IFDIR		0040000
+
+#define S_ISLNK(m)	(((m) & S_IFMT) == S_IFLNK)
+#define S_ISREG(m)	(((m) & S_IFMT) == S_IFREG)
+#define S_ISDIR(m)	(((m) & S_IFMT) == S_IFDIR)
+
+struct ext4_inode {
+	uint16_t i_mode;
+	uint16_t i_uid;
+	uint32_t i_size_lo;
+	uint32_t i_atime;
+	uint32_t i_ctime;
+	uint32_t i_mtime;
+	uint32_t i_dtime;
+	uint16_t i_gid;
+	uint16_t i_links_count;
+	uint32_t i_blocks_lo;
+	uint32_t i_flags;
+	uint32_t i_version;
+	uint32_t i_block[EXT4_N_BLOCKS];
+	uint32_t i_generation;
+	uint32_t i_file_acl_lo;
+	uint32_t i_size_high;
+	uint32_t i_obso_faddr;
+	uint8_t  i_osd2[12];
+} __PACKED;
+
+/* extent tree, rooted in i_block */
+#define EXT4_EXT_MAGIC		0xF30A
+#define EXT4_EXT_INIT_MAX_LEN	(1U << 15)
+#define EXT4_EXT_MAX_DEPTH	5
+
+struct ext4_extent_header {
+	uint16_t eh_magic;
+	uint16_t eh_entries;
+	uint16_t eh_max;
+	uint16_t eh_depth;
+	uint32_t eh_generation;
+} __PACKED;
+
+struct ext4_extent_idx {
+	uint32_t ei_block;
+	uint32_t ei_leaf_lo;
+	uint16_t ei_leaf_hi;
+	uint16_t ei_unused;
+} __PACKED;
+
+struct ext4_extent {
+	uint32_t ee_block;
+	uint16_t ee_len;
+	uint16_t ee_start_hi;
+	uint32_t ee_start_lo;
+} __PACKED;
+
+/* directories */
+#define EXT4_NAME_LEN 255
+
+struct ext4_dir_entry_2 {
+	uint32_t inode;
+	uint16_t rec_len;
+	uint8_t  name_len;
+	uint8_t  file_type;
+	char     name[0];
+} __PACKED;
+
+#define EXT4_FT_UNKNOWN		0
+#define EXT4_FT_REG_FILE	1
+#define EXT4_FT_DIR		2
+#define EXT4_FT_SYMLINK		7
+
+/* hashed (dir_index) directories */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
+struct dx_root_info {
+	uint32_t reserved_zero;
+	uint8_t  hash_version;
+	uint8_t  info_length;
+	uint8_t  indirect_levels;
+	uint8_t  unused_flags;
+} __PACKED;
+
+/* the first entry's hash field holds the limit and count of the node */
+struct dx_countlimit {
+	uint16_t limit;
+	uint16_t count;
+} __PACKED;
+
+struct dx_entry {
+	uint32_t hash;
+	uint32_t block;
+} __PACKED;
+
+#endif
+
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __EXT4_PRIV_H
+#define __EXT4_PRIV_H
+
+#include <lib/bio.h>
+#include <lib/bcache.h>
+#include <lib/fs.h>
+#include "ext4_fs.h"
+
+/* metadata blocks kept in the per mount block cache */
+#define EXT4_CACHE_BLOCKS	32
+
+/* symlinks followed while walking a single path */
+#define EXT4_MAX_SYMLINKS	8
+
+typedef struct {
+	bdev_t *dev;
+	bcache_t cache;
+
+	struct ext4_super_block sb;
+
+	uint32_t block_size;
+	uint32_t log_block_size;
+	uint32_t inode_size;
+	uint32_t group_count;
+
+	/* inode table location for each group, resolved at mount */
+	uint32_t *inode_table;
+
+	/* dir_index hashing */
+	uint32_t hash_seed[4];
+	int hash_unsigned;
+} ext4_t;
+
+typedef struct {
+	ext4_t *ext4;
+	uint32_t ino;
+	struct ext4_inode inode;
+} ext4_file_t;
+
+/* ext4.c */
+int ext4_load_inode(ext4_t *ext4, uint32_t ino, struct ext4_inode *inode);
+off_t ext4_inode_size(const struct ext4_inode *inode);
+
+/* file.c */
+int ext4_map_block(ext4_t *ext4, const struct ext4_inode *inode, uint32_t lblock,
+		uint32_t *pblock, uint32_t *count);
+ssize_t ext4_read_inode(ext4_t *ext4, const struct ext4_inode *inode, void *buf,
+		off_t offset, size_t len);
+
+/* dir.c */
+int ext4_lookup(ext4_t *ext4, const char *path, uint32_t *ino);
+
+/* hash.c */
+uint32_t ext4_dx_hash(const char *name, int len, int version, const uint32_t *seed);
+
+#endif
+
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <debug.h>
+#include <err.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ext4_priv.h"
+
+#define LOCAL_TRACE 0
+
+/* upper bound on a single device transfer when reading file data */
+#define EXT4_MAX_RUN_BLOCKS	1024
+
+/*
+ * find the extent covering lblock. returns the physical block in pblock (0 for
+ * holes and unwritten extents) and the number of logical blocks from lblock
+ * that map contiguously in count.
+ */
+static int ext4_map_extent(ext4_t *ext4, const struct ext4_inode *inode, uint32_t lblock,
+		uint32_t *pblock, uint32_t *count)
+{
+	const struct ext4_extent_header *eh = (const struct ext4_extent_header *)inode->i_block;
+	uint32_t held = 0;
+	bool holding = false;
+	int depth;
+	int err = 0;
+	int lo, hi, mid;
+
+	for (depth = 0; ; depth++) {
+		uint16_t entries = LE16(eh->eh_entries);
+
+		if (LE16(eh->eh_magic) != EXT4_EXT_MAGIC || entries > LE16(eh->eh_max) ||
+		    depth > EXT4_EXT_MAX_DEPTH) {
+			err = ERR_NOT_VALID;
+			goto out;
+		}
+
+		if (LE16(eh->eh_depth) == 0) {
+			const struct ext4_extent *ex = (const struct ext4_extent *)(eh + 1);
+
+			/* last extent starting at or before lblock */
+			lo = 0;
+			hi = entries - 1;
+			while (lo <= hi) {
+				mid = (lo + hi) / 2;
+				if (LE32(ex[mid].ee_block) <= lblock)
+					lo = mid + 1;
+				else
+					hi = mid - 1;
+			}
+
+			if (hi >= 0) {
+				uint32_t start = LE32(ex[hi].ee_block);
+				uint32_t len = LE16(ex[hi].ee_len);
+				bool unwritten = false;
+
+				if (len > EXT4_EXT_INIT_MAX_LEN) {
+					len -= EXT4_EXT_INIT_MAX_LEN;
+					unwritten = true;
+				}
+
+				if (lblock < start + len) {
+					*count = start + len - lblock;
+					if (unwritten)
+						*pblock = 0;
+					else
+						*pblock = LE32(ex[hi].ee_start_lo) + (lblock - start);
+					goto out;
+				}
+			}
+
+			/* in a hole, which runs up to the next extent */
+			*pblock = 0;
+			if (hi + 1 < entries)
+				*count = LE32(ex[hi + 1].ee_block) - lblock;
+			else
+				*count = 0xffffffff - lblock;
+			goto out;
+		} else {
+			const struct ext4_extent_idx *ix = (const struct ext4_extent_idx *)(eh + 1);
+			uint32_t leaf;
+			void *ptr;
+
+			if (entries == 0) {
+				err = ERR_NOT_VALID;
+				goto out;
+			}
+
+			lo = 1;
+			hi = entries - 1;
+			while (lo <= hi) {
+				mid = (lo + hi) / 2;
+				if (LE32(ix[mid].ei_block) <= lblock)
+					lo = mid + 1;
+				else
+					hi = mid - 1;
+			}
+
+			leaf = LE32(ix[lo - 1].ei_leaf_lo);
+			if (LE16(ix[lo - 1].ei_leaf_hi)) {
+				err = ERR_TOO_BIG;
+				goto out;
+			}
+
+			if (bcache_get_block(ext4->cache, &ptr, leaf) < 0) {
+				err = ERR_IO;
+				goto out;
+			}
+			if (holding)
+				bcache_put_block(ext4->cache, held);
+			held = leaf;
+			holding = true;
+
+			eh = (const struct ext4_extent_header *)ptr;
+		}
+	}
+
+out:
+	if (holding)
+		bcache_put_block(ext4->cache, held);
+	return err;
+}
+
+/* old style direct/indirect block map */
+static int ext4_map_indirect(ext4_t *ext4, const struct ext4_inode *inode, uint32_t lblock,
+		uint32_t *pblock, uint32_t *count)
+{
+	uint32_t addr_per_block = ext4->block_size / sizeof(uint32_t);
+	uint32_t addr_bits = ext4->log_block_size - 2;
+	uint32_t offsets[3];
+	uint32_t block;
+	int levels;
+	int i;
+
+	*count = 1;
+
+	if (lblock < EXT4_NDIR_BLOCKS) {
+		*pblock = LE32(inode->i_block[lblock]);
+		return 0;
+	}
+
+	lblock -= EXT4_NDIR_BLOCKS;
+	if (lblock < addr_per_block) {
+		block = LE32(inode->i_block[EXT4_IND_BLOCK]);
+		offsets[0] = lblock;
+		levels = 1;
+	} else if ((lblock -= addr_per_block) < (addr_per_block << addr_bits)) {
+		block = LE32(inode->i_block[EXT4_DIND_BLOCK]);
+		offsets[0] = lblock >> addr_bits;
+		offsets[1] = lblock & (addr_per_block - 1);
+		levels = 2;
+	} else {
+		lblock -= addr_per_block << addr_bits;
+		block = LE32(inode->i_block[EXT4_TIND_BLOCK]);
+		offsets[0] = lblock >> (addr_bits * 2);
+		offsets[1] = (lblock >> addr_bits) & (addr_per_block - 1);
+		offsets[2] = lblock & (addr_per_block - 1);
+		levels = 3;
+	}
+
+	for (i = 0; i < levels && block != 0; i++) {
+		void *ptr;
+
+		if (bcache_get_block(ext4->cache, &ptr, block) < 0)
+			return ERR_IO;
+		uint32_t next = LE32(((const uint32_t *)ptr)[offsets[i]]);
+		bcache_put_block(ext4->cache, block);
+		block = next;
+	}
+
+	*pblock = block;
+	return 0;
+}
+
+int ext4_map_block(ext4_t *ext4, const struct ext4_inode *inode, uint32_t lblock,
+		uint32_t *pblock, uint32_t *count)
+{
+	if (inode->i_flags & EXT4_EXTENTS_FL)
+		return ext4_map_extent(ext4, inode, lblock, pblock, count);
+	else
+		return ext4_map_indirect(ext4, inode, lblock, pblock, count);
+}
+
+ssize_t ext4_read_inode(ext4_t *ext4, const struct ext4_inode *inode, void *_buf,
+		off_t offset, size_t len)
+{
+	uint8_t *buf = (uint8_t *)_buf;
+	off_t size = ext4_inode_size(inode);
+	size_t bytes_read = 0;
+	uint32_t pblock, count;
+	int err;
+
+	LTRACEF("inode %p, buf %p, offset %lld, len %zu\n", inode, buf, offset, len);
+
+	if (offset < 0)
+		return ERR_INVALID_ARGS;
+	if (offset >= size)
+		return 0;
+	if (offset + len > size)
+		len = size - offset;
+
+	while (len > 0) {
+		uint32_t lblock = offset >> ext4->log_block_size;
+		uint32_t block_offset = offset & (ext4->block_size - 1);
+
+		err = ext4_map_block(ext4, inode, lblock, &pblock, &count);
+		if (err < 0)
+			return err;
+
+		if (block_offset != 0 || len < ext4->block_size) {
+			/* partial block, bounce it through the cache */
+			size_t tocopy = MIN(ext4->block_size - block_offset, len);
+
+			if (pblock == 0) {
+				memset(buf, 0, tocopy);
+			} else {
+				void *ptr;
+
+				if (bcache_get_block(ext4->cache, &ptr, pblock) < 0)
+					return ERR_IO;
+				memcpy(buf, (uint8_t *)ptr + block_offset, tocopy);
+				bcache_put_block(ext4->cache, pblock);
+			}
+
+			buf += tocopy;
+			offset += tocopy;
+			len -= tocopy;
+			bytes_read += tocopy;
+			continue;
+		}
+
+		/* whole blocks, merge physically contiguous mappings into one transfer */
+		uint32_t want = MIN(len >> ext4->log_block_size, EXT4_MAX_RUN_BLOCKS);
+		uint32_t run = MIN(count, want);
+
+		while (run < want) {
+			uint32_t next_pblock, next_count;
+
+			err = ext4_map_block(ext4, inode, lblock + run, &next_pblock, &next_count);
+			if (err < 0)
+				return err;
+			if (pblock == 0 ? next_pblock != 0 : next_pblock != pblock + run)
+				break;
+			run += MIN(next_count, want - run);
+		}
+
+		size_t bytes = (size_t)run << ext4->log_block_size;
+
+		LTRACEF("lblock %u -> pblock %u, run %u\n", lblock, pblock, run);
+
+		if (pblock == 0) {
+			memset(buf, 0, bytes);
+		} else {
+			ssize_t ret = bio_read(ext4->dev, buf, (off_t)pblock << ext4->log_block_size, bytes);
+			if (ret < (ssize_t)bytes)
+				return ERR_IO;
+		}
+
+		buf += bytes;
+		offset += bytes;
+		len -= bytes;
+		bytes_read += bytes;
+	}
+
+	return bytes_read;
+}
+
@@ -0,0 +1,11 @@
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULES += \
+	lib/fs \
+	lib/bcache
+
+OBJS += \
+	$(LOCAL_DIR)/ext4.o \
+	$(LOCAL_DIR)/dir.o \
+	$(LOCAL_DIR)/file.o \
+	$(LOCAL_DIR)/hash.o
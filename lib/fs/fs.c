@@ -31,6 +31,9 @@
 #if WITH_LIB_FS_EXT2
 #include <lib/fs/ext2.h>
 #endif
+#if WITH_LIB_FS_EXT4
+#include <lib/fs/ext4.h>
+#endif
 #if WITH_LIB_FS_FAT32
 #include <lib/fs/fat32.h>
 #endif
@@ -78,6 +81,17 @@ static struct fs_type types[] = {
 		.close = ext2_close_file,
 	},
 #endif
+#if WITH_LIB_FS_EXT4
+	{
+		.name = "ext4",
+		.mount = ext4_mount,
+		.unmount = ext4_unmount,
+		.open = ext4_open_file,
+		.stat = ext4_stat_file,
+		.read = ext4_read_file,
+		.close = ext4_close_file,
+	},
+#endif
 #if WITH_LIB_FS_FAT32
 	{
 		.name = "fat32",
@@ -192,7 +206,17 @@ static int mount(const char *path, const char *device, struct fs_type *type)
 
 int fs_mount(const char *path, const char *device)
 {
-	return mount(path, device, &types[0]);
+	size_t i;
+	int err = ERR_NOT_SUPPORTED;
+
+	/* probe each filesystem type in turn */
+	for (i = 0; i < countof(types); i++) {
+		err = mount(path, device, &types[i]);
+		if (err != ERR_NOT_VALID && err != ERR_NOT_SUPPORTED)
+			break;
+	}
+
+	return err;
 }
 
 int fs_mount_type(const char *path, const char *device, const char *name)
@@ -20,11 +20,13 @@
  * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <compiler.h>
 #include <debug.h>
 #include <limits.h>
 #include <stdarg.h>
 #include <sys/types.h>
 #include <printf.h>
+#include <stdlib.h>
 #include <string.h>
 
 void putc(char c)
@@ -91,9 +93,43 @@ int snprintf(char *str, size_t len, const char *fmt, ...)
 #define LEFTFORMATFLAG 0x00000200
 #define LEADZEROFLAG 0x00000400
 
+/* "00" .. "99", so decimal conversion does one divide per two digits */
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* write n backwards ending at end, return the first digit */
+static char *u32_to_string(char *end, uint32_t n)
+{
+	/* 32 bit divides by a constant become multiplies, unlike 64 bit ones */
+	while (n >= 100) {
+		uint32_t pair = (n % 100) * 2;
+
+		n /= 100;
+		*--end = digit_pairs[pair + 1];
+		*--end = digit_pairs[pair];
+	}
+	if (n >= 10) {
+		*--end = digit_pairs[n * 2 + 1];
+		*--end = digit_pairs[n * 2];
+	} else {
+		*--end = n + '0';
+	}
+
+	return end;
+}
+
 static char *longlong_to_string(char *buf, unsigned long long n, int len, uint flag)
 {
-	int pos = len;
+	char *pos = &buf[len];
 	int negative = 0;
 
 	if((flag & SIGNEDFLAG) && (long long)n < 0) {
@@ -101,24 +137,30 @@ static char *longlong_to_string(char *buf, unsigned long long n, int len, uint f
 		n = -n;
 	}
 
-	buf[--pos] = 0;
-	
-	/* only do the math if the number is >= 10 */
-	while(n >= 10) {
-		int digit = n % 10;
-
-		n /= 10;
-
-		buf[--pos] = digit + '0';
+	*--pos = 0;
+
+	/*
+	 * peel off 9 digits at a time with a single 64 bit divide, which is a
+	 * library call on 32 bit cpus, and finish in 32 bits
+	 */
+	while (n > 0xffffffffULL) {
+		unsigned long long q = n / 1000000000;
+		uint32_t r = n - q * 1000000000;
+		char *start = u32_to_string(pos, r);
+
+		while (start > pos - 9)
+			*--start = '0';
+		pos = start;
+		n = q;
 	}
-	buf[--pos] = n + '0';
-	
+	pos = u32_to_string(pos, n);
+
 	if(negative)
-		buf[--pos] = '-';
+		*--pos = '-';
 	else if((flag & SHOWSIGNFLAG))
-		buf[--pos] = '+';
+		*--pos = '+';
 
-	return &buf[pos];
+	return pos;
 }
 
 static char *longlong_to_hexstring(char *buf, unsigned long long u, int len, uint flag)
@@ -127,6 +169,7 @@ static char *longlong_to_hexstring(char *buf, unsigned long long u, int len, uin
 	static const char hextable[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
 	static const char hextable_caps[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
 	const char *table;
+	uint32_t u32;
 
 	if((flag & CAPSFLAG))
 		table = hextable_caps;
@@ -134,47 +177,72 @@ static char *longlong_to_hexstring(char *buf, unsigned long long u, int len, uin
 		table = hextable;
 
 	buf[--pos] = 0;
+	while (u > 0xffffffffULL) {
+		buf[--pos] = table[u & 0xf];
+		u >>= 4;
+	}
+
+	u32 = u;
 	do {
-		unsigned int digit = u % 16;
-		u /= 16;
-	
-		buf[--pos] = table[digit];
-	} while(u != 0);
+		buf[--pos] = table[u32 & 0xf];
+		u32 >>= 4;
+	} while(u32 != 0);
 
 	return &buf[pos];
 }
 
-int vsprintf(char *str, const char *fmt, va_list ap)
+/* emit count copies of c, a block at a time */
+static inline __ALWAYS_INLINE int output_pad(_printf_engine_output_func out, void *state, char c, uint count)
 {
-	return vsnprintf(str, INT_MAX, fmt, ap);
+	static const char spaces[] = "                ";
+	static const char zeros[] = "0000000000000000";
+	const char *pad = (c == '0') ? zeros : spaces;
+
+	while (count > 0) {
+		uint chunk = MIN(count, sizeof(spaces) - 1);
+
+		if (out(pad, chunk, state) < 0)
+			return -1;
+		count -= chunk;
+	}
+
+	return 0;
 }
 
-int vsnprintf(char *str, size_t len, const char *fmt, va_list ap)
+/*
+ * The formatter proper. Always inlined, so vsnprintf gets a copy with its
+ * output function folded in while other users go through the pointer.
+ */
+static inline __ALWAYS_INLINE int printf_engine(_printf_engine_output_func out, void *state, const char *fmt, va_list ap)
 {
 	char c;
-	unsigned char uc;
+	char uc;
 	const char *s;
+	const char *run;
 	unsigned long long n;
 	void *ptr;
 	int flags;
 	unsigned int format_num;
+	size_t string_len;
 	size_t chars_written = 0;
 	char num_buffer[32];
 
-#define OUTPUT_CHAR(c) do { (*str++ = c); chars_written++; if (chars_written + 1 == len) goto done; } while(0)
-#define OUTPUT_CHAR_NOLENCHECK(c) do { (*str++ = c); chars_written++; } while(0)
+#define OUTPUT(str, len) do { size_t __l = (len); if (out((str), __l, state) < 0) goto done; chars_written += __l; } while(0)
+#define OUTPUT_CHAR(c) do { char __c = (c); OUTPUT(&__c, 1); } while(0)
+#define OUTPUT_PAD(c, count) do { uint __n = (count); if (output_pad(out, state, (c), __n) < 0) goto done; chars_written += __n; } while(0)
 
-	for(;;) {	
+	for(;;) {
 		/* handle regular chars that aren't format related */
-		while((c = *fmt++) != 0) {
-			if(c == '%')
-				break; /* we saw a '%', break and start parsing format */
-			OUTPUT_CHAR(c);
-		}
+		run = fmt;
+		while((c = *fmt) != 0 && c != '%')
+			fmt++;
+		if (fmt != run)
+			OUTPUT(run, fmt - run);
 
 		/* make sure we haven't just hit the end of the string */
 		if(c == 0)
 			break;
+		fmt++;
 
 		/* reset the format state */
 		flags = 0;
@@ -185,7 +253,7 @@ next_format:
 		c = *fmt++;
 		if(c == 0)
 			break;
-					
+
 		switch(c) {
 			case '0'...'9':
 				if (c == '0' && format_num == 0)
@@ -207,6 +275,7 @@ next_format:
 				s = va_arg(ap, const char *);
 				if(s == 0)
 					s = "<null>";
+				flags &= ~LEADZEROFLAG;
 				goto _output_string;
 			case '-':
 				flags |= LEFTFORMATFLAG;
@@ -236,26 +305,26 @@ next_format:
 			case 'i':
 			case 'd':
 				n = (flags & LONGLONGFLAG) ? va_arg(ap, long long) :
-					(flags & LONGFLAG) ? va_arg(ap, long) : 
+					(flags & LONGFLAG) ? va_arg(ap, long) :
 					(flags & HALFHALFFLAG) ? (signed char)va_arg(ap, int) :
 					(flags & HALFFLAG) ? (short)va_arg(ap, int) :
 					(flags & SIZETFLAG) ? va_arg(ap, ssize_t) :
 					va_arg(ap, int);
 				flags |= SIGNEDFLAG;
 				s = longlong_to_string(num_buffer, n, sizeof(num_buffer), flags);
-				goto _output_string;
+				goto _output_number;
 			case 'U':
 				flags |= LONGFLAG;
 				/* fallthrough */
 			case 'u':
 				n = (flags & LONGLONGFLAG) ? va_arg(ap, unsigned long long) :
-					(flags & LONGFLAG) ? va_arg(ap, unsigned long) : 
+					(flags & LONGFLAG) ? va_arg(ap, unsigned long) :
 					(flags & HALFHALFFLAG) ? (unsigned char)va_arg(ap, unsigned int) :
 					(flags & HALFFLAG) ? (unsigned short)va_arg(ap, unsigned int) :
 					(flags & SIZETFLAG) ? va_arg(ap, size_t) :
 					va_arg(ap, unsigned int);
 				s = longlong_to_string(num_buffer, n, sizeof(num_buffer), flags);
-				goto _output_string;
+				goto _output_number;
 			case 'p':
 				flags |= LONGFLAG | ALTFLAG;
 				goto hex;
@@ -265,17 +334,15 @@ next_format:
 hex:
 			case 'x':
 				n = (flags & LONGLONGFLAG) ? va_arg(ap, unsigned long long) :
-				    (flags & LONGFLAG) ? va_arg(ap, unsigned long) : 
+				    (flags & LONGFLAG) ? va_arg(ap, unsigned long) :
 					(flags & HALFHALFFLAG) ? (unsigned char)va_arg(ap, unsigned int) :
 					(flags & HALFFLAG) ? (unsigned short)va_arg(ap, unsigned int) :
 					(flags & SIZETFLAG) ? va_arg(ap, size_t) :
 					va_arg(ap, unsigned int);
 				s = longlong_to_hexstring(num_buffer, n, sizeof(num_buffer), flags);
-				if(flags & ALTFLAG) {
-					OUTPUT_CHAR('0');
-					OUTPUT_CHAR((flags & CAPSFLAG) ? 'X': 'x');
-				}
-				goto _output_string;
+				if(flags & ALTFLAG)
+					OUTPUT((flags & CAPSFLAG) ? "0X" : "0x", 2);
+				goto _output_number;
 			case 'n':
 				ptr = va_arg(ap, void *);
 				if(flags & LONGLONGFLAG)
@@ -288,7 +355,7 @@ hex:
 					*(short *)ptr = chars_written;
 				else if(flags & SIZETFLAG)
 					*(size_t *)ptr = chars_written;
-				else 
+				else
 					*(int *)ptr = chars_written;
 				break;
 			default:
@@ -301,41 +368,112 @@ hex:
 		continue;
 
 		/* shared output code */
+_output_number:
+		/* the converters build the digits at the end of num_buffer */
+		string_len = &num_buffer[sizeof(num_buffer) - 1] - s;
+		goto _output_field;
 _output_string:
+		string_len = strlen(s);
+_output_field:
 		if (flags & LEFTFORMATFLAG) {
-			/* left justify the text */
-			uint count = 0;
-			while(*s != 0) {
-				OUTPUT_CHAR(*s++);
-				count++;
-			}
-
-			/* pad to the right (if necessary) */
-			for (; format_num > count; format_num--)
-				OUTPUT_CHAR(' ');
+			/* left justify the text, pad to the right (if necessary) */
+			OUTPUT(s, string_len);
+			if (format_num > string_len)
+				OUTPUT_PAD(' ', format_num - string_len);
 		} else {
 			/* right justify the text (digits) */
-			size_t string_len = strlen(s);
-			char outchar = (flags & LEADZEROFLAG) ? '0' : ' ';
-			for (; format_num > string_len; format_num--)
-				OUTPUT_CHAR(outchar);
+			if (format_num > string_len) {
+				if ((flags & LEADZEROFLAG) && (*s == '-' || *s == '+')) {
+					/* zeros go between the sign and the digits */
+					OUTPUT(s, 1);
+					s++;
+					string_len--;
+					format_num--;
+				}
+				OUTPUT_PAD((flags & LEADZEROFLAG) ? '0' : ' ', format_num - string_len);
+			}
 
 			/* output the string */
-			while(*s != 0)
-				OUTPUT_CHAR(*s++);
+			OUTPUT(s, string_len);
 		}
 		continue;
 	}
 
 done:
-	/* null terminate */
-	OUTPUT_CHAR_NOLENCHECK('\0');
-	chars_written--; /* don't count the null */
-
+#undef OUTPUT
 #undef OUTPUT_CHAR
-#undef OUTPUT_CHAR_NOLENCHECK
+#undef OUTPUT_PAD
 
 	return chars_written;
 }
 
+/**
+ * @brief  Format a string, handing the output to a callback in runs
+ *
+ * Literal text between conversions, each converted field and padding are
+ * each passed to out() in a single call. out() returns a negative value to
+ * stop formatting early.
+ *
+ * @return The number of characters handed to out().
+ */
+int _printf_engine(_printf_engine_output_func out, void *state, const char *fmt, va_list ap)
+{
+	return printf_engine(out, state, fmt, ap);
+}
+
+struct snprintf_state {
+	char *str;
+	size_t len;	/* room left, including the terminating null */
+};
+
+static inline __ALWAYS_INLINE int snprintf_output(const char *str, size_t len, void *_state)
+{
+	struct snprintf_state *state = _state;
+	size_t i;
+
+	if (len >= state->len) {
+		/* fill the buffer and stop, leaving room for the null */
+		memcpy(state->str, str, state->len - 1);
+		state->str += state->len - 1;
+		state->len = 1;
+		return -1;
+	}
+
+	/* most runs are a few characters, not worth a memcpy call */
+	if (len <= 8) {
+		for (i = 0; i < len; i++)
+			state->str[i] = str[i];
+	} else {
+		memcpy(state->str, str, len);
+	}
+	state->str += len;
+	state->len -= len;
+	return len;
+}
+
+int vsprintf(char *str, const char *fmt, va_list ap)
+{
+	return vsnprintf(str, INT_MAX, fmt, ap);
+}
+
+/*
+ * Unlike C99, returns the number of characters actually stored, not
+ * counting the null, so callers can advance through a buffer with it.
+ */
+int vsnprintf(char *str, size_t len, const char *fmt, va_list ap)
+{
+	struct snprintf_state state;
+
+	if (len == 0)
+		return 0;
+
+	state.str = str;
+	state.len = len;
+	printf_engine(&snprintf_output, &state, fmt, ap);
+
+	/* null terminate */
+	*state.str = '\0';
+
+	return state.str - str;
+}
 
@@ -0,0 +1,597 @@
+/*
+ * Copyright (c) 2013 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief  DDR test patterns with bandwidth and error summaries
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <string.h>
+#include <stdlib.h>
+#include <arch/ops.h>
+#include <kernel/thread.h>
+#include <platform.h>
+#include <lib/memtest.h>
+
+#define LOCAL_TRACE 0
+
+/* burst and dma paths work in chunks, so a mismatch is found in one */
+#define BURST_ALIGN	64
+#define CHECK_CHUNK	4096
+
+/* only the first few failing words are printed, the rest are counted */
+#define MAX_PRINTED_ERRORS	8
+
+#define MAX_EXCLUDES	8
+
+struct range {
+	addr_t base;
+	size_t len;
+};
+
+static struct range excludes[MAX_EXCLUDES];
+static uint num_excludes;
+
+static const struct memtest_dma_ops *dma_ops;
+
+static const char *pattern_names[MEMTEST_NUM_PATTERNS] = {
+	"solid", "walking", "address", "movinv", "random",
+};
+
+#if ARM_WITH_NEON
+void memtest_burst_fill(void *dst, size_t len, uint32_t pattern);
+uint32_t memtest_burst_check(const void *src, size_t len, uint32_t pattern);
+#else
+/* unrolled 64 bit accesses where there is no NEON */
+static void memtest_burst_fill(void *dst, size_t len, uint32_t pattern)
+{
+	uint64_t *p = dst;
+	uint64_t v = ((uint64_t)pattern << 32) | pattern;
+
+	for (; len; len -= BURST_ALIGN, p += 8) {
+		p[0] = v; p[1] = v; p[2] = v; p[3] = v;
+		p[4] = v; p[5] = v; p[6] = v; p[7] = v;
+	}
+}
+
+static uint32_t memtest_burst_check(const void *src, size_t len, uint32_t pattern)
+{
+	const uint64_t *p = src;
+	uint64_t v = ((uint64_t)pattern << 32) | pattern;
+	uint64_t diff = 0;
+
+	for (; len; len -= BURST_ALIGN, p += 8) {
+		diff |= (p[0] ^ v) | (p[1] ^ v) | (p[2] ^ v) | (p[3] ^ v);
+		diff |= (p[4] ^ v) | (p[5] ^ v) | (p[6] ^ v) | (p[7] ^ v);
+	}
+
+	return (uint32_t)diff | (uint32_t)(diff >> 32);
+}
+#endif
+
+struct memtest_run {
+	struct memtest_result *res;
+	struct memtest_pattern_result *pr;
+	enum memtest_engine engine;
+};
+
+static void record_error(struct memtest_run *run, volatile uint32_t *addr,
+                         uint32_t expected, uint32_t actual)
+{
+	struct memtest_result *res = run->res;
+
+	if (res->errors == 0) {
+		res->first_error = (addr_t)addr;
+		res->first_expected = expected;
+		res->first_actual = actual;
+	}
+	if (res->errors < MAX_PRINTED_ERRORS)
+		dprintf(INFO, "memtest: %s error at %p: expected 0x%08x, read 0x%08x\n",
+		        run->pr->name, addr, expected, actual);
+
+	res->errors++;
+	res->last_error = (addr_t)addr;
+	res->bad_bits |= expected ^ actual;
+	run->pr->errors++;
+}
+
+/* make sure the next reads come from the dram and not the cache */
+static void flush_range(const struct range *r)
+{
+	arch_clean_invalidate_cache_range(r->base, r->len);
+}
+
+static void check_words(struct memtest_run *run, volatile uint32_t *p, size_t words, uint32_t pattern)
+{
+	size_t i;
+
+	for (i = 0; i < words; i++) {
+		uint32_t v = p[i];
+
+		if (unlikely(v != pattern))
+			record_error(run, &p[i], pattern, v);
+	}
+}
+
+static void fill_solid(struct memtest_run *run, const struct range *r, uint32_t pattern)
+{
+	volatile uint32_t *p = (volatile uint32_t *)r->base;
+	size_t words = r->len / 4;
+	size_t block, off, i;
+
+	switch (run->engine) {
+		case MEMTEST_ENGINE_DMA:
+			if (dma_ops && r->len > CHECK_CHUNK) {
+				/* seed one block with the cpu, then let the dma replicate it */
+				block = CHECK_CHUNK;
+				memtest_burst_fill((void *)r->base, block, pattern);
+				arch_clean_cache_range(r->base, block);
+				for (off = block; off < r->len; off += block) {
+					if (dma_ops->copy(r->base + off, r->base, MIN(block, r->len - off)))
+						break;
+				}
+				if (off >= r->len)
+					return;
+				dprintf(INFO, "memtest: dma fill failed at 0x%lx, finishing with the cpu\n",
+				        r->base + off);
+				memtest_burst_fill((void *)(r->base + off), r->len - off, pattern);
+				return;
+			}
+			/* fallthrough */
+		case MEMTEST_ENGINE_BURST:
+			memtest_burst_fill((void *)r->base, r->len, pattern);
+			return;
+		default:
+			for (i = 0; i < words; i++)
+				p[i] = pattern;
+			return;
+	}
+}
+
+static void check_solid(struct memtest_run *run, const struct range *r, uint32_t pattern)
+{
+	size_t off, len;
+
+	if (run->engine == MEMTEST_ENGINE_CPU) {
+		check_words(run, (volatile uint32_t *)r->base, r->len / 4, pattern);
+		return;
+	}
+
+	/* compare in bursts, and only walk a chunk word by word if it failed */
+	for (off = 0; off < r->len; off += len) {
+		len = MIN(CHECK_CHUNK, r->len - off);
+		if (unlikely(memtest_burst_check((const void *)(r->base + off), len, pattern)))
+			check_words(run, (volatile uint32_t *)(r->base + off), len / 4, pattern);
+	}
+}
+
+static void pattern_solid(struct memtest_run *run, const struct range *r)
+{
+	static const uint32_t solid[] = { 0x00000000, 0xffffffff, 0x55555555, 0xaaaaaaaa };
+	bigtime_t t;
+	uint i;
+
+	for (i = 0; i < countof(solid); i++) {
+		t = current_time_hires();
+		fill_solid(run, r, solid[i]);
+		flush_range(r);
+		run->pr->write_us += current_time_hires() - t;
+		run->pr->write_bytes += r->len;
+
+		t = current_time_hires();
+		check_solid(run, r, solid[i]);
+		run->pr->read_us += current_time_hires() - t;
+		run->pr->read_bytes += r->len;
+	}
+}
+
+/* word i holds 1 << (i % 32), so neighbouring words differ in one bit */
+static void pattern_walking(struct memtest_run *run, const struct range *r)
+{
+	volatile uint32_t *p = (volatile uint32_t *)r->base;
+	size_t words = r->len / 4;
+	uint32_t invert;
+	bigtime_t t;
+	size_t i;
+
+	for (invert = 0; invert <= 1; invert++) {
+		uint32_t mask = invert ? 0xffffffff : 0;
+
+		t = current_time_hires();
+		for (i = 0; i < words; i++)
+			p[i] = (1U << (i & 31)) ^ mask;
+		flush_range(r);
+		run->pr->write_us += current_time_hires() - t;
+		run->pr->write_bytes += r->len;
+
+		t = current_time_hires();
+		for (i = 0; i < words; i++) {
+			uint32_t expected = (1U << (i & 31)) ^ mask;
+			uint32_t v = p[i];
+
+			if (unlikely(v != expected))
+				record_error(run, &p[i], expected, v);
+		}
+		run->pr->read_us += current_time_hires() - t;
+		run->pr->read_bytes += r->len;
+	}
+}
+
+/* catches address lines that alias two locations */
+static void pattern_address(struct memtest_run *run, const struct range *r)
+{
+	volatile uint32_t *p = (volatile uint32_t *)r->base;
+	size_t words = r->len / 4;
+	bigtime_t t;
+	size_t i;
+
+	t = current_time_hires();
+	for (i = 0; i < words; i++)
+		p[i] = (uint32_t)(addr_t)&p[i];
+	flush_range(r);
+	run->pr->write_us += current_time_hires() - t;
+	run->pr->write_bytes += r->len;
+
+	t = current_time_hires();
+	for (i = 0; i < words; i++) {
+		uint32_t v = p[i];
+
+		if (unlikely(v != (uint32_t)(addr_t)&p[i]))
+			record_error(run, &p[i], (uint32_t)(addr_t)&p[i], v);
+	}
+	run->pr->read_us += current_time_hires() - t;
+	run->pr->read_bytes += r->len;
+}
+
+/*
+ * Moving inversions: fill with a pattern, then going up check each word and
+ * write its inverse, then going down check the inverse and restore it.
+ * Catches cells disturbed by writes to their neighbours.
+ */
+static void pattern_movinv(struct memtest_run *run, const struct range *r)
+{
+	volatile uint32_t *p = (volatile uint32_t *)r->base;
+	size_t words = r->len / 4;
+	const uint32_t pattern = 0x55555555;
+	bigtime_t t;
+	size_t i;
+
+	t = current_time_hires();
+	fill_solid(run, r, pattern);
+	flush_range(r);
+	run->pr->write_us += current_time_hires() - t;
+	run->pr->write_bytes += r->len;
+
+	t = current_time_hires();
+	for (i = 0; i < words; i++) {
+		uint32_t v = p[i];
+
+		if (unlikely(v != pattern))
+			record_error(run, &p[i], pattern, v);
+		p[i] = ~pattern;
+	}
+	flush_range(r);
+
+	for (i = words; i-- > 0; ) {
+		uint32_t v = p[i];
+
+		if (unlikely(v != ~pattern))
+			record_error(run, &p[i], ~pattern, v);
+		p[i] = pattern;
+	}
+	flush_range(r);
+
+	check_solid(run, r, pattern);
+	run->pr->read_us += current_time_hires() - t;
+	run->pr->read_bytes += r->len * 5;
+}
+
+static inline uint32_t xorshift32(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static void pattern_random(struct memtest_run *run, const struct range *r, uint32_t seed)
+{
+	volatile uint32_t *p = (volatile uint32_t *)r->base;
+	size_t words = r->len / 4;
+	bigtime_t t;
+	uint32_t x;
+	size_t i;
+
+	/* xorshift never leaves 0 */
+	seed = seed ? seed : 0x2545f491;
+
+	t = current_time_hires();
+	for (i = 0, x = seed; i < words; i++) {
+		x = xorshift32(x);
+		p[i] = x;
+	}
+	flush_range(r);
+	run->pr->write_us += current_time_hires() - t;
+	run->pr->write_bytes += r->len;
+
+	t = current_time_hires();
+	for (i = 0, x = seed; i < words; i++) {
+		uint32_t v = p[i];
+
+		x = xorshift32(x);
+		if (unlikely(v != x))
+			record_error(run, &p[i], x, v);
+	}
+	run->pr->read_us += current_time_hires() - t;
+	run->pr->read_bytes += r->len;
+}
+
+status_t memtest_exclude(addr_t base, size_t len)
+{
+	if (num_excludes == MAX_EXCLUDES)
+		return ERR_NO_MEMORY;
+
+	excludes[num_excludes].base = base;
+	excludes[num_excludes].len = len;
+	num_excludes++;
+
+	return NO_ERROR;
+}
+
+void memtest_set_dma_ops(const struct memtest_dma_ops *ops)
+{
+	dma_ops = ops;
+}
+
+extern int _end_of_ram;
+
+/* LK's image and heap, followed by anything registered */
+static uint get_excludes(struct range *list)
+{
+	uint n = 0;
+	uint i;
+
+#ifdef MEMBASE
+	list[n].base = MEMBASE;
+	list[n].len = (addr_t)&_end_of_ram - MEMBASE;
+	n++;
+#endif
+#if WITH_STATIC_HEAP
+	list[n].base = HEAP_START;
+	list[n].len = HEAP_LEN;
+	n++;
+#endif
+	for (i = 0; i < num_excludes; i++)
+		list[n++] = excludes[i];
+
+	return n;
+}
+
+/*
+ * Split [base, base + len) around the excluded ranges into at most max
+ * pieces, each aligned inwards to BURST_ALIGN.
+ */
+static uint split_region(addr_t base, size_t len, struct range *out, uint max)
+{
+	struct range ex[MAX_EXCLUDES + 2];
+	uint nex = get_excludes(ex);
+	uint n = 0;
+	addr_t pos = base;
+	addr_t end = base + len;
+	addr_t piece_end, a, b;
+	uint i;
+
+	while (pos < end && n < max) {
+		/* step over any exclusion pos lands in, they may overlap */
+		for (i = 0; i < nex; i++) {
+			if (ex[i].base <= pos && pos < ex[i].base + ex[i].len) {
+				pos = ex[i].base + ex[i].len;
+				i = -1;
+			}
+		}
+		if (pos >= end)
+			break;
+
+		/* the piece runs up to the next exclusion */
+		piece_end = end;
+		for (i = 0; i < nex; i++) {
+			if (ex[i].base > pos && ex[i].base < piece_end)
+				piece_end = ex[i].base;
+		}
+
+		a = ROUNDUP(pos, BURST_ALIGN);
+		b = ROUNDDOWN(piece_end, BURST_ALIGN);
+		if (b > a) {
+			out[n].base = a;
+			out[n].len = b - a;
+			n++;
+		}
+		pos = piece_end;
+	}
+
+	return n;
+}
+
+/**
+ * @brief  Test a range of memory
+ *
+ * @param  base  Start of the range
+ * @param  len  Length of the range in bytes
+ * @param  patterns  Mask of MEMTEST_PAT_* to run
+ * @param  engine  How the solid fills are written and compared
+ * @param  seed  Seed for MEMTEST_PAT_RANDOM
+ * @param  res  Filled in with error and bandwidth figures
+ */
+status_t memtest_run(addr_t base, size_t len, uint patterns,
+                     enum memtest_engine engine, uint32_t seed,
+                     struct memtest_result *res)
+{
+	struct range pieces[MAX_EXCLUDES + 3];
+	struct memtest_run run;
+	uint npieces;
+	uint i, j;
+
+	memset(res, 0, sizeof(*res));
+
+	npieces = split_region(base, len, pieces, countof(pieces));
+	for (i = 0; i < npieces; i++)
+		res->tested += pieces[i].len;
+	res->excluded = len - res->tested;
+	if (res->tested == 0)
+		return ERR_INVALID_ARGS;
+
+	if (engine == MEMTEST_ENGINE_DMA && !dma_ops) {
+		dprintf(INFO, "memtest: no dma engine, using bursts\n");
+		engine = MEMTEST_ENGINE_BURST;
+	}
+
+	run.res = res;
+	run.engine = engine;
+
+	for (j = 0; j < MEMTEST_NUM_PATTERNS; j++) {
+		if (!(patterns & (1 << j)))
+			continue;
+
+		run.pr = &res->pattern[res->npatterns++];
+		run.pr->name = pattern_names[j];
+
+		for (i = 0; i < npieces; i++) {
+			LTRACEF("%s on 0x%lx len 0x%zx\n", run.pr->name, pieces[i].base, pieces[i].len);
+
+			switch (1 << j) {
+				case MEMTEST_PAT_SOLID:
+					pattern_solid(&run, &pieces[i]);
+					break;
+				case MEMTEST_PAT_WALKING:
+					pattern_walking(&run, &pieces[i]);
+					break;
+				case MEMTEST_PAT_ADDRESS:
+					pattern_address(&run, &pieces[i]);
+					break;
+				case MEMTEST_PAT_MOVINV:
+					pattern_movinv(&run, &pieces[i]);
+					break;
+				case MEMTEST_PAT_RANDOM:
+					pattern_random(&run, &pieces[i], seed);
+					break;
+			}
+		}
+	}
+
+	return res->errors ? ERR_IO : NO_ERROR;
+}
+
+/* bytes per usec is MB/s */
+static uint mbps(uint64_t bytes, bigtime_t us)
+{
+	return us ? (uint)(bytes / us) : 0;
+}
+
+void memtest_summarize(const struct memtest_result *res, void (*line)(const char *str))
+{
+	char buf[64];
+	uint i;
+
+	snprintf(buf, sizeof(buf), "memtest: %u KB tested, %u KB excluded",
+	         (uint)(res->tested / 1024), (uint)(res->excluded / 1024));
+	line(buf);
+
+	for (i = 0; i < res->npatterns; i++) {
+		const struct memtest_pattern_result *pr = &res->pattern[i];
+
+		snprintf(buf, sizeof(buf), "%-8s wr %5u MB/s rd %5u MB/s err %u",
+		         pr->name, mbps(pr->write_bytes, pr->write_us),
+		         mbps(pr->read_bytes, pr->read_us), pr->errors);
+		line(buf);
+	}
+
+	if (!res->errors) {
+		line("memtest: no errors");
+		return;
+	}
+
+	snprintf(buf, sizeof(buf), "memtest: %u errors, bad bits 0x%08x",
+	         res->errors, res->bad_bits);
+	line(buf);
+	snprintf(buf, sizeof(buf), "first 0x%08lx exp 0x%08x got 0x%08x",
+	         res->first_error, res->first_expected, res->first_actual);
+	line(buf);
+	snprintf(buf, sizeof(buf), "last 0x%08lx", res->last_error);
+	line(buf);
+}
+
+#if WITH_LIB_CONSOLE
+
+#include <lib/console.h>
+
+static int cmd_memtest(int argc, const cmd_args *argv);
+
+STATIC_COMMAND_START
+	{ "memtest", "ddr test with patterns and bandwidth", &cmd_memtest },
+STATIC_COMMAND_END(memtest);
+
+static void print_line(const char *str)
+{
+	printf("%s\n", str);
+}
+
+static int cmd_memtest(int argc, const cmd_args *argv)
+{
+	struct memtest_result res;
+	enum memtest_engine engine = MEMTEST_ENGINE_BURST;
+	uint patterns = MEMTEST_PAT_ALL;
+	uint32_t seed = 0;
+	status_t err;
+
+	if (argc < 3) {
+		printf("not enough arguments\n");
+		printf("%s <base> <len> [pattern mask] [cpu|burst|dma] [seed]\n", argv[0].str);
+		printf("patterns: 1 solid, 2 walking, 4 address, 8 movinv, 0x10 random\n");
+		return -1;
+	}
+
+	if (argc > 3)
+		patterns = argv[3].u;
+	if (argc > 4) {
+		if (!strcmp(argv[4].str, "cpu"))
+			engine = MEMTEST_ENGINE_CPU;
+		else if (!strcmp(argv[4].str, "dma"))
+			engine = MEMTEST_ENGINE_DMA;
+	}
+	if (argc > 5)
+		seed = argv[5].u;
+
+	err = memtest_run(argv[1].u, argv[2].u, patterns, engine, seed, &res);
+	if (err == ERR_INVALID_ARGS) {
+		printf("nothing to test outside LK's own memory\n");
+		return -1;
+	}
+
+	memtest_summarize(&res, print_line);
+
+	return err;
+}
+
+#endif
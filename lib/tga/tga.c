@@ -29,7 +29,9 @@
  */
 
 #include <debug.h>
+#include <err.h>
 #include <compiler.h>
+#include <stdlib.h>
 #include <lib/tga.h>
 
 #define LOCAL_TRACE 0
@@ -66,57 +68,189 @@ static void print_tga_info(const struct tga_header *header)
 
 }
 
-static void decode_2byte(gfx_surface *surface, uint x, uint y, const void *input)
+/* tga pixels are little endian BGR(A), 16 bit ones are 1555 */
+static inline uint32_t tga_to_argb(const uint8_t *in, uint step)
 {
-	const uint8_t *in = (const uint8_t *)input;
+	uint r, g, b;
+
+	switch (step) {
+		case 2:
+			b = (in[0] & 0x1f) << 3;
+			g = (((in[0] >> 5) & 0x7) | ((in[1] & 0x3) << 3)) << 3;
+			r = ((in[1] >> 2) & 0x1f) << 3;
+			return 0xff000000 | r << 16 | g << 8 | b;
+		case 3:
+			return 0xff000000 | in[2] << 16 | in[1] << 8 | in[0];
+		default:
+			if (in[3] == 0)
+				return 0;
+			return (uint32_t)in[3] << 24 | in[2] << 16 | in[1] << 8 | in[0];
+	}
+}
+
+static inline uint16_t argb_to_565(uint32_t in)
+{
+	return ((in >> 3) & 0x1f) | (((in >> 10) & 0x3f) << 5) | (((in >> 19) & 0x1f) << 11);
+}
+
+/*
+ * Span converters, one per source depth and destination pixel size, so the
+ * format is picked once per image rather than once per pixel.
+ */
+typedef void (*tga_span_func)(void *dest, const uint8_t *in, uint count);
 
-//	printf("in 0x%hhx 0x%hhx\n", in[0], in[1]);
-	uint r,g,b;
+static void span_2to16(void *dest, const uint8_t *in, uint count)
+{
+	uint16_t *out = dest;
 
-	b = (in[0] & 0x1f) << 3;
-	g = (((in[0] >> 5) & 0x7) | ((in[1] & 0x3) << 3)) << 3;
-	r = ((in[1] >> 2) & 0x1f) << 3;
+	while (count--) {
+		uint v = in[0] | in[1] << 8;
 
-	gfx_putpixel(surface, x, y, 0xff000000 | r << 16 | g << 8 | b);
+		/* 1555 to 565: widen green, drop alpha */
+		*out++ = ((v & 0x7c00) << 1) | ((v & 0x03e0) << 1) | (v & 0x001f);
+		in += 2;
+	}
 }
 
-static void decode_3byte(gfx_surface *surface, uint x, uint y, const void *input)
+static void span_3to16(void *dest, const uint8_t *in, uint count)
 {
-	const uint8_t *in = (const uint8_t *)input;
+	uint16_t *out = dest;
+
+	while (count--) {
+		*out++ = (in[2] >> 3) << 11 | (in[1] >> 2) << 5 | in[0] >> 3;
+		in += 3;
+	}
+}
 
-//	printf("in 0x%hhx 0x%hhx\n", in[0], in[1]);
+static void span_4to16(void *dest, const uint8_t *in, uint count)
+{
+	uint16_t *out = dest;
 
-	gfx_putpixel(surface, x, y, 0xff000000 | in[2] << 16 | in[1] << 8 | in[0]);
+	while (count--) {
+		*out++ = argb_to_565(tga_to_argb(in, 4));
+		in += 4;
+	}
 }
 
-static void decode_4byte(gfx_surface *surface, uint x, uint y, const void *input)
+static void span_2to32(void *dest, const uint8_t *in, uint count)
 {
-	const uint8_t *in = (const uint8_t *)input;
+	uint32_t *out = dest;
+
+	while (count--) {
+		*out++ = tga_to_argb(in, 2);
+		in += 2;
+	}
+}
 
-//	printf("in 0x%hhx 0x%hhx 0x%hhx 0x%hhx\n", in[0], in[1], in[2], in[3]);
+static void span_3to32(void *dest, const uint8_t *in, uint count)
+{
+	uint32_t *out = dest;
 
-	if (in[3] == 0)
-		gfx_putpixel(surface, x, y, 0);
-	else
-		gfx_putpixel(surface, x, y, in[3] << 24 | in[2] << 16 | in[1] << 8 | in[0]);
+	while (count--) {
+		*out++ = 0xff000000 | in[2] << 16 | in[1] << 8 | in[0];
+		in += 3;
+	}
 }
 
-/**
- * @brief  Decode a tga image
- *
- * @param  ptr  Pointer to tga data in memory
- * @param  len  Length of tga data
- * @param  format  Desired format of returned graphics surface
- *
- * @return Graphics surface or NULL on error.
- *
- * @ingroup graphics
+static void span_4to32(void *dest, const uint8_t *in, uint count)
+{
+	uint32_t *out = dest;
+
+	while (count--) {
+		*out++ = in[3] ? ((uint32_t)in[3] << 24 | in[2] << 16 | in[1] << 8 | in[0]) : 0;
+		in += 4;
+	}
+}
+
+static void fill16(void *dest, uint32_t color, uint count)
+{
+	uint16_t *out = dest;
+	uint16_t c = argb_to_565(color);
+
+	while (count--)
+		*out++ = c;
+}
+
+static void fill32(void *dest, uint32_t color, uint count)
+{
+	uint32_t *out = dest;
+
+	while (count--)
+		*out++ = color;
+}
+
+struct tga_stream {
+	gfx_surface *surface;
+	uint width;		/* image size */
+	uint height;
+	bool top_down;
+	int destx;		/* image origin on the surface */
+	int desty;
+	uint clipx0;		/* visible part of the surface, exclusive end */
+	uint clipx1;
+	uint clipy0;
+	uint clipy1;
+	uint step;		/* source bytes per pixel */
+	tga_span_func span;
+	void (*fill)(void *dest, uint32_t color, uint count);
+};
+
+/*
+ * Work out where image pixels [x, x + count) of image row 'row' land.
+ * Returns the number of visible pixels, and the first visible source pixel
+ * and destination address.
  */
-gfx_surface *tga_decode(const void *ptr, size_t len, gfx_format format)
+static uint clip_span(const struct tga_stream *s, uint row, uint x, uint count,
+                      uint *skip, void **dest)
+{
+	gfx_surface *surface = s->surface;
+	int dy = s->desty + (int)(s->top_down ? row : s->height - 1 - row);
+	int dx0 = s->destx + (int)x;
+	int dx1 = dx0 + (int)count;
+
+	if (dy < (int)s->clipy0 || dy >= (int)s->clipy1)
+		return 0;
+	if (dx0 < (int)s->clipx0)
+		dx0 = s->clipx0;
+	if (dx1 > (int)s->clipx1)
+		dx1 = s->clipx1;
+	if (dx0 >= dx1)
+		return 0;
+
+	*skip = dx0 - (s->destx + (int)x);
+	*dest = (uint8_t *)surface->ptr + ((uint)dy * surface->stride + (uint)dx0) * surface->pixelsize;
+	return dx1 - dx0;
+}
+
+static void emit_raw(const struct tga_stream *s, uint row, uint x, const uint8_t *in, uint count)
+{
+	uint skip;
+	void *dest;
+	uint visible = clip_span(s, row, x, count, &skip, &dest);
+
+	if (visible)
+		s->span(dest, in + skip * s->step, visible);
+}
+
+static void emit_fill(const struct tga_stream *s, uint row, uint x, uint32_t color, uint count)
+{
+	uint skip;
+	void *dest;
+	uint visible = clip_span(s, row, x, count, &skip, &dest);
+
+	if (visible)
+		s->fill(dest, color, visible);
+}
+
+static const struct tga_header *tga_check_header(const void *ptr, size_t len)
 {
 	const struct tga_header *header = (const struct tga_header *)ptr;
 
-	LTRACEF("ptr %p, len %zu\n", ptr, len);
+	if (len < sizeof(struct tga_header) ||
+	    len < sizeof(struct tga_header) + header->idlength) {
+		dprintf(INFO, "tga_decode: truncated header\n");
+		return NULL;
+	}
 
 #if LOCAL_TRACE > 0
 	print_tga_info(header);
@@ -135,96 +269,204 @@ gfx_surface *tga_decode(const void *ptr, size_t len, gfx_format format)
 		dprintf(INFO, "tga_decode: has colormap, can't handle\n");
 		return NULL;
 	}
+	if (header->width == 0 || header->height == 0) {
+		dprintf(INFO, "tga_decode: empty image\n");
+		return NULL;
+	}
+
+	return header;
+}
+
+/**
+ * @brief  Get the size of a tga image
+ *
+ * @param  ptr  Pointer to tga data in memory
+ * @param  len  Length of tga data
+ * @param  width  Returns the image width
+ * @param  height  Returns the image height
+ *
+ * @return NO_ERROR, or ERR_NOT_VALID if the data is not a supported tga image.
+ *
+ * @ingroup graphics
+ */
+status_t tga_get_size(const void *ptr, size_t len, uint *width, uint *height)
+{
+	const struct tga_header *header = tga_check_header(ptr, len);
 
-	const void *imagestart = ((const uint8_t *)ptr + sizeof(struct tga_header) + header->idlength);
+	if (!header)
+		return ERR_NOT_VALID;
 
-	/* create a surface to hold the decoded bits */
-	gfx_surface *surface = gfx_create_surface(NULL, header->width, header->height, header->width, format);
-	DEBUG_ASSERT(surface);
+	*width = header->width;
+	*height = header->height;
+	return NO_ERROR;
+}
 
-	/* copy the bits out */
-	void (*decodefunc)(gfx_surface *, uint x, uint y, const void *) = NULL;
+/**
+ * @brief  Decode a tga image straight into an existing surface
+ *
+ * Pixels are converted to the surface's format as they are decoded, and
+ * RLE repeat runs become fills, so no intermediate surface is needed.
+ * Only the part of the image that falls inside both the surface and the
+ * clip rectangle is written. The caller flushes the surface.
+ *
+ * @param  ptr  Pointer to tga data in memory
+ * @param  len  Length of tga data
+ * @param  surface  Surface to draw into
+ * @param  x  Surface column for the image's left edge, may be negative
+ * @param  y  Surface row for the image's top edge, may be negative
+ * @param  clip  Rectangle of the surface that may be written, or NULL for all of it
+ *
+ * @return NO_ERROR, ERR_NOT_VALID for an unsupported image, or
+ *         ERR_NOT_ENOUGH_BUFFER if the image data is truncated.
+ *
+ * @ingroup graphics
+ */
+status_t tga_decode_to_surface(const void *ptr, size_t len, gfx_surface *surface,
+                               int x, int y, const struct tga_rect *clip)
+{
+	const struct tga_header *header = tga_check_header(ptr, len);
+	const uint8_t *in;
+	const uint8_t *end;
+	struct tga_stream s;
+	uint count;
+	uint total;
+	uint row;
+	uint col;
+
+	LTRACEF("ptr %p, len %zu, surface %p, x %d, y %d\n", ptr, len, surface, x, y);
+
+	if (!header)
+		return ERR_NOT_VALID;
+
+	s.surface = surface;
+	s.width = header->width;
+	s.height = header->height;
+	s.top_down = (header->imagedescriptor & (1 << 5)) != 0;
+	s.destx = x;
+	s.desty = y;
+	s.step = header->bitsperpixel / 8;
+
+	s.clipx0 = 0;
+	s.clipy0 = 0;
+	s.clipx1 = surface->width;
+	s.clipy1 = surface->height;
+	if (clip) {
+		s.clipx0 = MAX(s.clipx0, clip->x);
+		s.clipy0 = MAX(s.clipy0, clip->y);
+		s.clipx1 = MIN(s.clipx1, clip->x + clip->width);
+		s.clipy1 = MIN(s.clipy1, clip->y + clip->height);
+	}
 
-	uint step = 1;
-	if (header->bitsperpixel == 16) {
-		step = 2;
-		decodefunc = decode_2byte;
-	} else if (header->bitsperpixel == 24) {
-		step = 3;
-		decodefunc = decode_3byte;
-	} else if (header->bitsperpixel == 32) {
-		step = 4;
-		decodefunc = decode_4byte;
+	if (surface->pixelsize == 2) {
+		s.span = s.step == 2 ? span_2to16 : s.step == 3 ? span_3to16 : span_4to16;
+		s.fill = fill16;
+	} else {
+		s.span = s.step == 2 ? span_2to32 : s.step == 3 ? span_3to32 : span_4to32;
+		s.fill = fill32;
 	}
 
+	in = (const uint8_t *)ptr + sizeof(struct tga_header) + header->idlength;
+	end = (const uint8_t *)ptr + len;
+	total = s.width * s.height;
+
 	if (header->datatypecode == 2) {
 		/* no RLE */
-		uint pos = 0;
-		uint x, y;
-		uint surfacey;
-
-		for (y = 0; y < header->height; y++) {
+		if ((size_t)(end - in) / s.step < total) {
+			dprintf(INFO, "tga_decode: truncated image data\n");
+			return ERR_NOT_ENOUGH_BUFFER;
+		}
 
-			if ((header->imagedescriptor & (1 << 5)) == 0)
-				surfacey = (surface->height - 1) - y;
-			else
-				surfacey = y;
+		for (row = 0; row < s.height; row++) {
+			emit_raw(&s, row, 0, in, s.width);
+			in += s.width * s.step;
+		}
+		return NO_ERROR;
+	}
 
-			for (x = 0; x < header->width; x++) {
-				decodefunc(surface, x, surfacey, (const uint8_t *)imagestart + pos);
-				pos += step;
-			}
+	/* RLE compression, runs may cross row boundaries */
+	row = 0;
+	col = 0;
+	count = 0;
+	while (count < total) {
+		uint runlen;
+		bool repeat_run;
+		uint32_t color = 0;
+
+		if (in >= end)
+			goto truncated;
+
+		repeat_run = (*in & 0x80) != 0;
+		runlen = (*in & 0x7f) + 1;
+		in++;
+
+		if (runlen > total - count)
+			runlen = total - count;
+
+		if (repeat_run) {
+			if ((size_t)(end - in) < s.step)
+				goto truncated;
+			color = tga_to_argb(in, s.step);
+			in += s.step;
+		} else if ((size_t)(end - in) / s.step < runlen) {
+			goto truncated;
 		}
-	} else if (header->datatypecode == 10) {
-		/* RLE compression */
-		uint pos = 0;
-		uint count = 0;
-		uint x, y;
-
-		x = 0;
-		if ((header->imagedescriptor & (1 << 5)) == 0)
-			y = header->height - 1;
-		else
-			y = 0;
-
-		while (count < (uint)header->height * (uint)header->width) {
-			uint runpos;
-
-			uint8_t run = *((const uint8_t *)imagestart + pos);
-			bool repeat_run = (run & 0x80);
-			uint runlen = (run & 0x7f) + 1;
-
-//			printf("pos 0x%x count %u run 0x%hhx runtype %d runlen %u\n", pos, count, run, run & 0x80, runlen);
-
-			/* consume the run byte */
-			pos++;
-
-			/* start of a run */
-			for (runpos = 0; runpos < runlen; runpos++) {
-				decodefunc(surface, x, y, (const uint8_t *)imagestart + pos);
-				count++;
-
-				x++;
-				if (x == surface->width) {
-					if ((header->imagedescriptor & (1 << 5)) == 0)
-						y--;
-					else
-						y++;
-					x = 0;
-				}
-
-				/* if a run of raw pixels, consume an input pixel */
-				if (!repeat_run)
-					pos += step;
+
+		count += runlen;
+		while (runlen > 0) {
+			uint seg = MIN(runlen, s.width - col);
+
+			if (repeat_run) {
+				emit_fill(&s, row, col, color, seg);
+			} else {
+				emit_raw(&s, row, col, in, seg);
+				in += seg * s.step;
 			}
-			/* if this was a run of repeated pixels, consume the one input pixel we repeated */
-			if (repeat_run)
-				pos += step;
 
+			runlen -= seg;
+			col += seg;
+			if (col == s.width) {
+				col = 0;
+				row++;
+			}
 		}
-//		printf("done with RLE: x %d, y %d, pos %d, count %d\n", x, y, pos, count);
 	}
-	
-	return surface;
+
+	return NO_ERROR;
+
+truncated:
+	dprintf(INFO, "tga_decode: truncated RLE data at pixel %u\n", count);
+	return ERR_NOT_ENOUGH_BUFFER;
 }
 
+/**
+ * @brief  Decode a tga image
+ *
+ * @param  ptr  Pointer to tga data in memory
+ * @param  len  Length of tga data
+ * @param  format  Desired format of returned graphics surface
+ *
+ * @return Graphics surface or NULL on error.
+ *
+ * @ingroup graphics
+ */
+gfx_surface *tga_decode(const void *ptr, size_t len, gfx_format format)
+{
+	gfx_surface *surface;
+	uint width, height;
+
+	LTRACEF("ptr %p, len %zu\n", ptr, len);
+
+	if (tga_get_size(ptr, len, &width, &height) != NO_ERROR)
+		return NULL;
+
+	/* create a surface to hold the decoded bits */
+	surface = gfx_create_surface(NULL, width, height, width, format);
+	DEBUG_ASSERT(surface);
+
+	if (tga_decode_to_surface(ptr, len, surface, 0, 0, NULL) != NO_ERROR) {
+		gfx_surface_destroy(surface);
+		return NULL;
+	}
+
+	return surface;
+}
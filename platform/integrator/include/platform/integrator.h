@@ -53,7 +53,32 @@
 #define PL011_UARTICR (17)
 #define PL011_UARTMACR (18)
 
-#define INT_VECTORS 32 // XXX just made this up
+/* counter/timers, three sp804 style timers 0x100 apart */
+#define INTEGRATOR_TIMER(n) (INTEGRATOR_TIMER_REG_BASE + (n) * 0x100)
+#define TIMER_LOAD    (0x00)
+#define TIMER_VALUE   (0x04)
+#define TIMER_CONTROL (0x08)
+#define TIMER_INTCLR  (0x0c)
+
+#define TIMER_CONTROL_ENABLE   (1<<7)
+#define TIMER_CONTROL_PERIODIC (1<<6)
+#define TIMER_CONTROL_INTEN    (1<<5)
+#define TIMER_CONTROL_32BIT    (1<<1)
+
+/* primary interrupt controller */
+#define INTEGRATOR_PIC_IRQ_STATUS    (INTEGRATOR_INT_REG_BASE + 0x00)
+#define INTEGRATOR_PIC_IRQ_RAWSTAT   (INTEGRATOR_INT_REG_BASE + 0x04)
+#define INTEGRATOR_PIC_IRQ_ENABLESET (INTEGRATOR_INT_REG_BASE + 0x08)
+#define INTEGRATOR_PIC_IRQ_ENABLECLR (INTEGRATOR_INT_REG_BASE + 0x0c)
+
+/* primary interrupt controller sources */
+#define INT_UART0  1
+#define INT_UART1  2
+#define INT_TIMER0 5
+#define INT_TIMER1 6
+#define INT_TIMER2 7
+
+#define INT_VECTORS 32
 
 #endif
 
@@ -22,6 +22,7 @@
  */
 #include <sys/types.h>
 #include <err.h>
+#include <reg.h>
 #include <kernel/thread.h>
 #include <debug.h>
 #include <platform.h>
@@ -30,72 +31,87 @@
 #include <platform/integrator.h>
 #include "platform_p.h"
 
-static time_t system_time = 0;
-
-static time_t tick_interval;
-static uint32_t ticks_per_interval;
 static platform_timer_callback t_callback;
 static void *callback_arg;
 
+/*
+ * counter/timer 1 is clocked at 1MHz. left free running from 0xffffffff it
+ * gives a microsecond count, extended to 64 bits here. a wrap is only
+ * missed if nothing reads the time for over an hour.
+ */
+#define HIRES_TIMER INTEGRATOR_TIMER(1)
+
+/* counter/timer 2, also 1MHz, reloads every tick and raises INT_TIMER2 */
+#define TICK_TIMER INTEGRATOR_TIMER(2)
+
+static bool hires_running;
+static uint32_t hires_last;
+static bigtime_t hires_time;
+
 status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, time_t interval)
 {
-#if 0
 	enter_critical_section();
 
 	t_callback = callback;
 	callback_arg = arg;
-	tick_interval = interval;
-	ticks_per_interval = interval * 32768 / 1000; // interval is in ms
 
-	OS_TIMER_CTRL_REG = 0; // stop it
-	OS_TIMER_TICK_VALUE_REG = ticks_per_interval;
-	OS_TIMER_CTRL_REG = (1<<3) | (1<<2) | (1<<1) | (1<<0);
+	writel(0, TICK_TIMER + TIMER_CONTROL); // stop it
+	writel(interval * 1000, TICK_TIMER + TIMER_LOAD); // interval is in ms
+	writel(1, TICK_TIMER + TIMER_INTCLR);
+	writel(TIMER_CONTROL_ENABLE | TIMER_CONTROL_PERIODIC | TIMER_CONTROL_INTEN |
+	       TIMER_CONTROL_32BIT, TICK_TIMER + TIMER_CONTROL);
+
+	unmask_interrupt(INT_TIMER2);
 
 	exit_critical_section();
-#endif
 
 	return NO_ERROR;
 }
 
 time_t current_time(void)
 {
-#if 0
-	time_t t;
-	uint32_t delta_ticks;
-	uint32_t delta_ticks2;
-	
-retry:
-	delta_ticks = OS_TIMER_TICK_COUNTER_REG;
-	t = system_time;
-	delta_ticks2 = OS_TIMER_TICK_COUNTER_REG;
-	if (delta_ticks2 > delta_ticks)
-		goto retry;
-
-	t += ((ticks_per_interval - delta_ticks2) * tick_interval) / ticks_per_interval;
+	return current_time_hires() / 1000;
+}
 
-	return t;
-#else
-	static time_t time = 0;
-	return time++;
-#endif
+bigtime_t current_time_hires(void)
+{
+	uint32_t now;
+	bigtime_t t;
 
+	enter_critical_section();
+
+	if (!hires_running) {
+		writel(0, HIRES_TIMER + TIMER_CONTROL);
+		writel(0xffffffff, HIRES_TIMER + TIMER_LOAD);
+		writel(TIMER_CONTROL_ENABLE | TIMER_CONTROL_32BIT, HIRES_TIMER + TIMER_CONTROL);
+		hires_last = 0;
+		hires_running = true;
+	}
+
+	/* the timer counts down, flip it to count up */
+	now = ~readl(HIRES_TIMER + TIMER_VALUE);
+	hires_time += now - hires_last;
+	hires_last = now;
+	t = hires_time;
+
+	exit_critical_section();
+
+	return t;
 }
 
 static enum handler_return os_timer_tick(void *arg)
 {
-	system_time += tick_interval;
-//	dprintf("os_timer_tick %d\n", system_time);
+	writel(1, TICK_TIMER + TIMER_INTCLR);
 
-	return t_callback(callback_arg, system_time);
+	if (!t_callback)
+		return INT_NO_RESCHEDULE;
+
+	return t_callback(callback_arg, current_time());
 }
 
 void platform_init_timer(void)
 {
-#if 0
-	OS_TIMER_CTRL_REG = 0; // stop the timer if it's already running
+	writel(0, TICK_TIMER + TIMER_CONTROL); // stop the timer if it's already running
 
-	register_int_handler(IRQ_OS_TIMER, &os_timer_tick, NULL);
-	unmask_interrupt(IRQ_OS_TIMER, NULL);
-#endif
+	register_int_handler(INT_TIMER2, &os_timer_tick, NULL);
 }
-
@@ -38,6 +38,7 @@
 #include <platform/iomap.h>
 #include <smem.h>
 #include <qgic.h>
+#include <uart_dm.h>
 
 static uint32_t ticks_per_sec = 0;
 
@@ -62,11 +63,14 @@ void platform_early_init(void)
 void platform_init(void)
 {
 	dprintf(INFO, "platform_init()\n");
+	uart_dm_tx_async_enable();
 	acpu_clock_init();
 }
 
 void platform_uninit(void)
 {
+	uart_dm_tx_async_disable();
+
 	platform_uninit_timer();
 }
 
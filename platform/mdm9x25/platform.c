@@ -40,6 +40,7 @@
 #include <reg.h>
 #include <board.h>
 #include <boot_stats.h>
+#include <uart_dm.h>
 
 extern struct smem_ram_ptable* target_smem_ram_ptable_init();
 
@@ -103,6 +104,7 @@ void platform_early_init(void)
 void platform_init(void)
 {
 	dprintf(INFO, "platform_init()\n");
+	uart_dm_tx_async_enable();
 }
 
 static uint32_t platform_get_sclk_count(void)
@@ -141,6 +143,8 @@ void bs_set_timestamp(enum bs_entry bs_id)
 
 void platform_uninit(void)
 {
+	uart_dm_tx_async_disable();
+
 	qtimer_uninit();
 	qpic_nand_uninit();
 }
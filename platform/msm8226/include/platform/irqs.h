@@ -48,6 +48,11 @@
 #define USB1_HS_IRQ                            (GIC_SPI_START + 134)
 
 #define SDCC_PWRCTRL_IRQ                       (GIC_SPI_START + 138)
+#define SDCC1_IRQ                              (GIC_SPI_START + 123)
+#define SDCC2_IRQ                              (GIC_SPI_START + 125)
+#define SDCC2_PWRCTRL_IRQ                      (GIC_SPI_START + 221)
+
+#define MDSS_IRQ                               (GIC_SPI_START + 72)
 
 /* Retrofit universal macro names */
 #define INT_USB_HS                             USB1_HS_IRQ
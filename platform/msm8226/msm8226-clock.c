@@ -52,6 +52,8 @@ struct clk_freq_tbl rcg_dummy_freq = F_END;
 static struct clk_ops clk_ops_branch =
 {
 	.enable     = clock_lib2_branch_clk_enable,
+	.enable_no_wait = clock_lib2_branch_clk_enable_no_wait,
+	.is_enabled = clock_lib2_branch_clk_is_enabled,
 	.disable    = clock_lib2_branch_clk_disable,
 	.set_rate   = clock_lib2_branch_set_rate,
 };
@@ -77,6 +79,7 @@ static struct clk_ops clk_ops_cxo =
 static struct clk_ops clk_ops_pll_vote =
 {
 	.enable     = pll_vote_clk_enable,
+	.enable_no_wait = pll_vote_clk_enable_no_wait,
 	.disable    = pll_vote_clk_disable,
 	.auto_off   = pll_vote_clk_disable,
 	.is_enabled = pll_vote_clk_is_enabled,
@@ -85,6 +88,8 @@ static struct clk_ops clk_ops_pll_vote =
 static struct clk_ops clk_ops_vote =
 {
 	.enable     = clock_lib2_vote_clk_enable,
+	.enable_no_wait = clock_lib2_vote_clk_enable_no_wait,
+	.is_enabled = clock_lib2_vote_clk_is_enabled,
 	.disable    = clock_lib2_vote_clk_disable,
 };
 
@@ -36,6 +36,7 @@
 #include <arch/arm/mmu.h>
 #include <smem.h>
 #include <board.h>
+#include <uart_dm.h>
 
 #define MB (1024*1024)
 
@@ -74,10 +75,13 @@ void platform_early_init(void)
 void platform_init(void)
 {
 	dprintf(INFO, "platform_init()\n");
+	uart_dm_tx_async_enable();
 }
 
 void platform_uninit(void)
 {
+	uart_dm_tx_async_disable();
+
 	qtimer_uninit();
 }
 
@@ -96,10 +96,13 @@ void platform_early_init(void)
 void platform_init(void)
 {
 	dprintf(INFO, "platform_init()\n");
+	uart_dm_tx_async_enable();
 }
 
 void platform_uninit(void)
 {
+	uart_dm_tx_async_disable();
+
 #if DISPLAY_SPLASH_SCREEN
 	display_shutdown();
 #endif
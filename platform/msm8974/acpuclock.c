@@ -213,37 +213,23 @@ static void ce_async_reset(uint8_t instance)
 void clock_ce_enable(uint8_t instance)
 {
 	int ret;
-	char clk_name[64];
-
-	snprintf(clk_name, 64, "ce%u_src_clk", instance);
-	ret = clk_get_set_enable(clk_name, 100000000, 1);
+	char src_name[16], core_name[16], ahb_name[16], axi_name[16];
+	struct clk_group ce_clks[] = {
+		{ src_name,  100000000 },
+		{ core_name, 0 },
+		{ ahb_name,  0 },
+		{ axi_name,  0 },
+	};
+
+	snprintf(src_name, sizeof(src_name), "ce%u_src_clk", instance);
+	snprintf(core_name, sizeof(core_name), "ce%u_core_clk", instance);
+	snprintf(ahb_name, sizeof(ahb_name), "ce%u_ahb_clk", instance);
+	snprintf(axi_name, sizeof(axi_name), "ce%u_axi_clk", instance);
+
+	ret = clk_group_enable(ce_clks, countof(ce_clks));
 	if(ret)
 	{
-		dprintf(CRITICAL, "failed to set ce_src_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	snprintf(clk_name, 64, "ce%u_core_clk", instance);
-    ret = clk_get_set_enable(clk_name, 0, 1);
-    if(ret)
-	{
-		dprintf(CRITICAL, "failed to set ce_core_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	snprintf(clk_name, 64, "ce%u_ahb_clk", instance);
-    ret = clk_get_set_enable(clk_name, 0, 1);
-    if(ret)
-	{
-		dprintf(CRITICAL, "failed to set ce_ahb_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	snprintf(clk_name, 64, "ce%u_axi_clk", instance);
-    ret = clk_get_set_enable(clk_name, 0, 1);
-    if(ret)
-	{
-		dprintf(CRITICAL, "failed to set ce_axi_clk ret = %d\n", ret);
+		dprintf(CRITICAL, "failed to enable ce%u clocks ret = %d\n", instance, ret);
 		ASSERT(0);
 	}
 
@@ -354,44 +340,23 @@ void mdp_gdsc_ctrl(uint8_t enable)
 	}
 }
 
+static struct clk_group mdp_clks[] = {
+	{ "mdp_ahb_clk",       0 },
+	{ "mdss_mdp_clk_src",  75000000 },
+	{ "mdss_vsync_clk",    0 },
+	{ "mdss_mdp_clk",      0 },
+	{ "mdss_mdp_lut_clk",  0 },
+};
+
 /* Configure MDP clock */
 void mdp_clock_init(void)
 {
 	int ret;
 
-	/* Set MDP clock to 200MHz */
-	ret = clk_get_set_enable("mdp_ahb_clk", 0, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set mdp_ahb_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	ret = clk_get_set_enable("mdss_mdp_clk_src", 75000000, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set mdp_clk_src ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	ret = clk_get_set_enable("mdss_vsync_clk", 0, 1);
+	ret = clk_group_enable(mdp_clks, countof(mdp_clks));
 	if(ret)
 	{
-		dprintf(CRITICAL, "failed to set mdss vsync clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	ret = clk_get_set_enable("mdss_mdp_clk", 0, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set mdp_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	ret = clk_get_set_enable("mdss_mdp_lut_clk", 0, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set lut_mdp clk ret = %d\n", ret);
+		dprintf(CRITICAL, "failed to enable mdp clocks ret = %d\n", ret);
 		ASSERT(0);
 	}
 }
@@ -408,6 +373,13 @@ void mdp_clock_disable(void)
 
 }
 
+static struct clk_group mmss_clks[] = {
+	{ "mdss_esc0_clk",        0 },
+	{ "mmss_mmssnoc_axi_clk", 100000000 },
+	{ "mmss_s0_axi_clk",      100000000 },
+	{ "mdss_axi_clk",         100000000 },
+};
+
 /* Initialize all clocks needed by Display */
 void mmss_clock_init(uint32_t dsi_pixel0_cfg_rcgr)
 {
@@ -418,35 +390,10 @@ void mmss_clock_init(uint32_t dsi_pixel0_cfg_rcgr)
 	writel(0x1, DSI_BYTE0_CMD_RCGR);
 	writel(0x1, DSI_BYTE0_CBCR);
 
-	/* Configure ESC clock */
-	ret = clk_get_set_enable("mdss_esc0_clk", 0, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set esc0_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	/* Configure MMSSNOC AXI clock */
-	ret = clk_get_set_enable("mmss_mmssnoc_axi_clk", 100000000, 1);
+	ret = clk_group_enable(mmss_clks, countof(mmss_clks));
 	if(ret)
 	{
-		dprintf(CRITICAL, "failed to set mmssnoc_axi_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	/* Configure MMSSNOC AXI clock */
-	ret = clk_get_set_enable("mmss_s0_axi_clk", 100000000, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set mmss_s0_axi_clk ret = %d\n", ret);
-		ASSERT(0);
-	}
-
-	/* Configure AXI clock */
-	ret = clk_get_set_enable("mdss_axi_clk", 100000000, 1);
-	if(ret)
-	{
-		dprintf(CRITICAL, "failed to set mdss_axi_clk ret = %d\n", ret);
+		dprintf(CRITICAL, "failed to enable mmss clocks ret = %d\n", ret);
 		ASSERT(0);
 	}
 
@@ -458,17 +405,5 @@ void mmss_clock_init(uint32_t dsi_pixel0_cfg_rcgr)
 
 void mmss_clock_disable(void)
 {
-
-	/* Disable ESC clock */
-	clk_disable(clk_get("mdss_esc0_clk"));
-
-	/* Disable MDSS AXI clock */
-	clk_disable(clk_get("mdss_axi_clk"));
-
-	/* Disable MMSSNOC S0AXI clock */
-	clk_disable(clk_get("mmss_s0_axi_clk"));
-
-	/* Disable MMSSNOC AXI clock */
-	clk_disable(clk_get("mmss_mmssnoc_axi_clk"));
-
+	clk_group_disable(mmss_clks, countof(mmss_clks));
 }
@@ -67,4 +67,9 @@
                                                ((GIC_SPI_START + 101) + qup_id))
 
 #define SDCC_PWRCTRL_IRQ                       (GIC_SPI_START + 138)
+#define SDCC1_IRQ                              (GIC_SPI_START + 123)
+#define SDCC2_IRQ                              (GIC_SPI_START + 125)
+#define SDCC2_PWRCTRL_IRQ                      (GIC_SPI_START + 221)
+
+#define MDSS_IRQ                               (GIC_SPI_START + 72)
 #endif	/* __IRQS_COPPER_H */
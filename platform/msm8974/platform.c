@@ -37,6 +37,7 @@
 #include <smem.h>
 #include <board.h>
 #include <boot_stats.h>
+#include <uart_dm.h>
 
 #define MB (1024*1024)
 
@@ -80,6 +81,7 @@ void platform_early_init(void)
 void platform_init(void)
 {
 	dprintf(INFO, "platform_init()\n");
+	uart_dm_tx_async_enable();
 }
 
 static uint32_t platform_get_sclk_count(void)
@@ -118,6 +120,8 @@ void bs_set_timestamp(enum bs_entry bs_id)
 
 void platform_uninit(void)
 {
+	uart_dm_tx_async_disable();
+
 #if DISPLAY_SPLASH_SCREEN
 	display_shutdown();
 #endif
@@ -44,6 +44,9 @@
 #include <i2c_qup.h>
 #include <gsbi.h>
 #include <uart_dm.h>
+#if PERIPH_BLK_ADM
+#include <adm.h>
+#endif
 #include <mmu.h>
 #include <arch/arm/mmu.h>
 #include <dev/lcdc.h>
@@ -118,6 +121,10 @@ void platform_early_init(void)
 void platform_init(void)
 {
 	dprintf(INFO, "platform_init()\n");
+	uart_dm_tx_async_enable();
+#if PERIPH_BLK_ADM
+	adm_init();
+#endif
 }
 
 void display_init(void)
@@ -244,6 +251,8 @@ void platform_init_mmu_mappings(void)
 /* Do any platform specific cleanup just before kernel entry */
 void platform_uninit(void)
 {
+	uart_dm_tx_async_disable();
+
 	/* As a effect of enabling caches, display gets shutdown even before
 	 * the splash screen shows up. Until we can speed up the splash screen
 	 * display, add an artificial delay so that current user experience
@@ -32,6 +32,7 @@
 #include <bits.h>
 #include <platform/iomap.h>
 #include <platform/pmic.h>
+#include <dev/ssbi.h>
 
 #define TRUE  1
 #define FALSE 0
@@ -122,22 +123,21 @@ void pm8058_write_one(unsigned data, unsigned address)
 
 int pm8058_get_irq_status(pm_irq_id_type irq, bool * rt_status)
 {
-	unsigned block_index, reg_data, reg_mask;
-	int errFlag;
+	uint8_t block_index, reg_data, reg_mask;
+	struct ssbi_xfer xfers[] = {
+		/* select the irq block */
+		{ .addr = IRQ_BLOCK_SEL_USR_ADDR, .len = 1, .buf = &block_index,
+		  .flags = SSBI_XFER_WRITE },
+		/* read real time status */
+		{ .addr = IRQ_STATUS_RT_USR_ADDR, .len = 1, .buf = &reg_data,
+		  .flags = SSBI_XFER_READ },
+	};
+	struct ssbi_batch b;
 
 	block_index = PM_IRQ_ID_TO_BLOCK_INDEX(irq);
 
-	/* select the irq block */
-	errFlag =
-	    pa1_ssbi2_write_bytes(&block_index, 1, IRQ_BLOCK_SEL_USR_ADDR);
-	if (errFlag) {
-		dprintf(INFO, "Device Timeout");
-		return 1;
-	}
-
-	/* read real time status */
-	errFlag = pa1_ssbi2_read_bytes(&reg_data, 1, IRQ_STATUS_RT_USR_ADDR);
-	if (errFlag) {
+	ssbi_batch_init(&b, SSBI_BUS_PA1, xfers, countof(xfers));
+	if (ssbi_batch_run(&b)) {
 		dprintf(INFO, "Device Timeout");
 		return 1;
 	}
@@ -15,6 +15,10 @@ DEFINES += WITH_CPU_EARLY_INIT=0 WITH_CPU_WARM_BOOT=0 \
 
 DEFINES += QT_8660_KEYPAD_HW_BUG=1
 
+ifeq ($(MMC_BOOT_ADM),1)
+DEFINES += PERIPH_BLK_ADM=1
+endif
+
 INCLUDES += -I$(LOCAL_DIR)/include -I$(LK_TOP_DIR)/platform/msm_shared/include
 
 DEVS += fbcon
@@ -28,65 +28,516 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <debug.h>
+#include <err.h>
 #include <reg.h>
+#include <platform.h>
+#include <arch/ops.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <kernel/dpc.h>
+#if WITH_LIB_MEMTEST
+#include <lib/memtest.h>
+#endif
 
 #include "adm.h"
 #include <platform/adm.h>
 
-/* TODO: This ADM implementation is very specific for use by MMC.
- *       Replace with a generic ADM driver that can also be used
- *       by other peripherals such as usb/uart/nand/display etc.
- */
-
 /* TODO:
  * adm module shouldn't have to include mmc.h.
- * clean this up when generic adm interface is implemented.
+ * clean this up when the mmc wrapper moves to mmc.c.
  */
 #include "mmc.h"
 
-extern void mdelay(unsigned msecs);
 extern void dmb(void);
 
+/*
+ * ADM channel manager.
+ *
+ * Transfers are built in descriptors taken from a small pool, so several
+ * can be outstanding at once. Each channel keeps the transfers it has
+ * handed to the hardware in submission order; the hardware takes new
+ * command pointers while CMD_PTR_RDY is set and reports one result per
+ * command pointer, in order, so a result always belongs to the oldest
+ * active transfer. Results are collected by whoever waits on a transfer and
+ * by a timer while anything is outstanding; callbacks run from a dpc.
+ */
+
 /* limit the max_row_len to fifo size so that
  * the same src and dst row attributes can be used.
  */
 #define MAX_ROW_LEN     MMC_BOOT_MCI_FIFO_SIZE
 #define MAX_ROW_NUM     0xFFFF
 
-/* Structures for use with ADM:
- * Must be aligned on 8 byte boundary.
- */
-static uint32_t adm_cmd_ptr_list[8] __attribute__ ((aligned(8)));
-static uint32_t box_mode_entry[8] __attribute__ ((aligned(8)));
+/* largest single item entry, kept 8 byte aligned */
+#define ADM_MAX_SI_LEN  0xFFF8
+
+#define ADM_SI_WORDS    4
+#define ADM_BOX_WORDS   6
 
-adm_result_t adm_transfer_start(uint32_t adm_chn, uint32_t * cmd_ptr_list);
+/*
+ * A command pointer and the command list it points at.
+ * Must be aligned on 8 byte boundary; a whole cache line here, since the
+ * descriptor is cleaned before every submit.
+ */
+struct adm_desc {
+	uint32_t cmd_ptr[2];
+	struct list_node node;	/* on its channel's stale list after a timeout */
+	uint32_t cmds[ADM_MAX_CMDS * ADM_BOX_WORDS];
+	uint32_t used;		/* words of cmds in use */
+	uint32_t *last;		/* last entry, for the LC bit */
+	bool busy;
+} __ALIGNED(CACHE_LINE);
+
+struct adm_channel {
+	struct list_node pending;	/* waiting for CMD_PTR_RDY */
+	struct list_node active;	/* handed to the hardware, oldest first */
+	uint32_t depth;
+	struct list_node stale;	/* descriptors of timed out transfers, oldest first */
+};
+
+static struct adm_desc adm_pool[ADM_POOL_SIZE];
+static struct adm_channel adm_channels[ADM_MAX_CHANNELS];
+static struct list_node adm_done = LIST_INITIAL_VALUE(adm_done);
+static struct adm_stats adm_stats;
+static uint32_t adm_outstanding;
+
+static timer_t adm_timer;
+static dpc_t adm_dpc;
+static bool adm_ready;
 
 /* CRCI - mmc slot mapping. */
 extern uint8_t sdc_crci_map[5];
 
-/* TODO:
- * This interface is very specific to MMC.
- * We need a generic ADM interface that can be easily
- * used by other modules such as usb/uart/nand.
+#if WITH_LIB_MEMTEST
+static int adm_memtest_copy(addr_t dst, addr_t src, size_t len)
+{
+	return adm_memcpy(dst, src, len) == ADM_RESULT_SUCCESS ? 0 : -1;
+}
+
+static const struct memtest_dma_ops adm_memtest_ops = {
+	.copy = adm_memtest_copy,
+};
+#endif
+
+static enum handler_return adm_timer_func(struct timer *t, time_t now, void *arg);
+static void adm_dpc_func(void *arg);
+
+void adm_init(void)
+{
+	uint32_t i;
+
+	enter_critical_section();
+
+	if (!adm_ready) {
+		for (i = 0; i < ADM_MAX_CHANNELS; i++) {
+			list_initialize(&adm_channels[i].pending);
+			list_initialize(&adm_channels[i].active);
+			list_initialize(&adm_channels[i].stale);
+		}
+		timer_initialize(&adm_timer);
+		dpc_initialize(&adm_dpc, adm_dpc_func, NULL, DPC_LEVEL_NORMAL);
+		adm_ready = true;
+	}
+
+	exit_critical_section();
+
+#if WITH_LIB_MEMTEST
+	memtest_set_dma_ops(&adm_memtest_ops);
+#endif
+}
+
+status_t adm_xfer_init(struct adm_xfer *xfer, uint32_t chn)
+{
+	struct adm_desc *desc = NULL;
+	uint32_t i;
+
+	if (chn >= ADM_MAX_CHANNELS)
+		return ERR_INVALID_ARGS;
+
+	adm_init();
+
+	enter_critical_section();
+	for (i = 0; i < ADM_POOL_SIZE; i++) {
+		if (!adm_pool[i].busy) {
+			desc = &adm_pool[i];
+			desc->busy = true;
+			break;
+		}
+	}
+	exit_critical_section();
+
+	if (!desc)
+		return ERR_NO_MEMORY;
+
+	desc->used = 0;
+	desc->last = NULL;
+	list_clear_node(&desc->node);
+
+	memset(xfer, 0, sizeof(*xfer));
+	list_clear_node(&xfer->node);
+	xfer->chn = chn;
+	xfer->desc = desc;
+	xfer->done = true;
+	event_init(&xfer->event, false, 0);
+
+	return NO_ERROR;
+}
+
+void adm_xfer_release(struct adm_xfer *xfer)
+{
+	if (!xfer->desc)
+		return;
+
+	ASSERT(xfer->done);
+
+	enter_critical_section();
+	xfer->desc->busy = false;
+	exit_critical_section();
+
+	xfer->desc = NULL;
+}
+
+/* Empty a finished transfer's command list so it can be filled again. */
+static void adm_xfer_reset(struct adm_xfer *xfer)
+{
+	xfer->desc->used = 0;
+	xfer->desc->last = NULL;
+	xfer->ncmds = 0;
+	xfer->len = 0;
+}
+
+static uint32_t *adm_xfer_entry(struct adm_xfer *xfer, uint32_t words)
+{
+	struct adm_desc *desc = xfer->desc;
+	uint32_t *entry;
+
+	if (!desc || !xfer->done)
+		return NULL;
+	if (desc->used + words > countof(desc->cmds))
+		return NULL;
+
+	entry = &desc->cmds[desc->used];
+	desc->used += words;
+	desc->last = entry;
+	xfer->ncmds++;
+
+	return entry;
+}
+
+status_t adm_xfer_add(struct adm_xfer *xfer, addr_t src, addr_t dst,
+		      uint32_t len, uint32_t crci)
+{
+	uint32_t *entry;
+	uint32_t chunk;
+
+	while (len) {
+		chunk = MIN(len, ADM_MAX_SI_LEN);
+
+		entry = adm_xfer_entry(xfer, ADM_SI_WORDS);
+		if (!entry)
+			return ERR_NOT_ENOUGH_BUFFER;
+
+		entry[0] = ADM_CMD_LIST_CRCI(crci) | ADM_ADDR_MODE_SI;
+		entry[1] = src;
+		entry[2] = dst;
+		entry[3] = chunk;
+
+		xfer->len += chunk;
+		src += chunk;
+		dst += chunk;
+		len -= chunk;
+	}
+
+	return NO_ERROR;
+}
+
+status_t adm_xfer_add_box(struct adm_xfer *xfer, addr_t src, addr_t dst,
+			  uint16_t row_len, uint16_t rows,
+			  uint16_t src_ofs, uint16_t dst_ofs, uint32_t crci)
+{
+	uint32_t *entry;
+
+	entry = adm_xfer_entry(xfer, ADM_BOX_WORDS);
+	if (!entry)
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	entry[0] = ADM_CMD_LIST_CRCI(crci) | ADM_ADDR_MODE_BOX;
+	entry[1] = src;				/* SRC addr    */
+	entry[2] = dst;				/* DST addr    */
+	entry[3] = (row_len << 16) | row_len;	/* SRC/DST row len */
+	entry[4] = (rows << 16) | rows;		/* SRC/DST row #   */
+	entry[5] = (src_ofs << 16) | dst_ofs;	/* SRC/DST offset  */
+
+	xfer->len += row_len * rows;
+
+	return NO_ERROR;
+}
+
+/* Hand pending transfers to the hardware while it has room. */
+static void adm_kick(uint32_t chn)
+{
+	struct adm_channel *ch = &adm_channels[chn];
+	struct adm_xfer *xfer;
+
+	while (!list_is_empty(&ch->pending)) {
+		if (!(readl(ADM_REG_STATUS(chn, ADM_SD)) & ADM_REG_STATUS__CMD_PTR_RDY___M))
+			break;
+
+		xfer = list_remove_head_type(&ch->pending, struct adm_xfer, node);
+		list_add_tail(&ch->active, &xfer->node);
+		xfer->start = current_time_hires();
+
+		writel(((uint32_t) xfer->desc->cmd_ptr) >> 3,
+		       ADM_REG_CMD_PTR(chn, ADM_SD));
+
+		if (++ch->depth > adm_stats.max_depth)
+			adm_stats.max_depth = ch->depth;
+	}
+}
+
+static void adm_complete(struct adm_xfer *xfer, adm_result_t result)
+{
+	bigtime_t now = current_time_hires();
+
+	xfer->result = result;
+	xfer->done = true;
+
+	/* whoever reaps the last transfer stops the poll, so the next submit
+	 * always finds the timer idle */
+	if (--adm_outstanding == 0)
+		timer_cancel(&adm_timer);
+
+	adm_stats.completed++;
+	adm_stats.busy_us += now - xfer->start;
+	if (result == ADM_RESULT_SUCCESS)
+		adm_stats.bytes += xfer->len;
+	else if (result == ADM_RESULT_TIMEOUT)
+		adm_stats.timeouts++;
+	else
+		adm_stats.errors++;
+
+	event_signal(&xfer->event, false);
+
+	if (xfer->callback) {
+		list_add_tail(&adm_done, &xfer->node);
+		dpc_queue_item(&adm_dpc, DPC_FLAG_NORESCHED);
+	}
+}
+
+/* Collect results on one channel. Called with interrupts off. */
+static void adm_reap(uint32_t chn)
+{
+	struct adm_channel *ch = &adm_channels[chn];
+	struct adm_xfer *xfer;
+	struct adm_desc *desc;
+	uint32_t rslt;
+
+	while (readl(ADM_REG_STATUS(chn, ADM_SD)) & ADM_REG_STATUS__RSLT_VLD___M) {
+		rslt = readl(ADM_REG_RSLT(chn, ADM_SD));
+		if (!(rslt & ADM_REG_RSLT__V___M))
+			continue;
+
+		/* the transfer this belonged to was already given up on; only now
+		 * is the ADM done with its descriptor */
+		desc = list_remove_head_type(&ch->stale, struct adm_desc, node);
+		if (desc) {
+			desc->busy = false;
+			continue;
+		}
+
+		xfer = list_remove_head_type(&ch->active, struct adm_xfer, node);
+		if (!xfer)
+			continue;
+		ch->depth--;
+
+		if ((rslt & ADM_REG_RSLT__ERR___M) || !(rslt & ADM_REG_RSLT__TPD___M))
+			adm_complete(xfer, ADM_RESULT_FAILURE);
+		else
+			adm_complete(xfer, ADM_RESULT_SUCCESS);
+	}
+
+	/* give up on a transfer the hardware has sat on for too long */
+	xfer = list_peek_head_type(&ch->active, struct adm_xfer, node);
+	if (xfer && current_time_hires() - xfer->start > ADM_TIMEOUT_US) {
+		list_delete(&xfer->node);
+		ch->depth--;
+		/* the ADM may still read the command list, so the channel keeps
+		 * the descriptor until the late result turns up */
+		list_add_tail(&ch->stale, &xfer->desc->node);
+		xfer->desc = NULL;
+		adm_complete(xfer, ADM_RESULT_TIMEOUT);
+	}
+
+	adm_kick(chn);
+
+	/* Read out the IRQ register to clear the interrupt.
+	 * Even though we are not using interrupts,
+	 * kernel is not clearing the interupts during its
+	 * ADM initialization, causing it to crash.
+	 */
+	readl(ADM_REG_IRQ(ADM_SD));
+}
+
+static void adm_service(void)
+{
+	uint32_t chn;
+
+	for (chn = 0; chn < ADM_MAX_CHANNELS; chn++) {
+		if (adm_channels[chn].depth || !list_is_empty(&adm_channels[chn].pending))
+			adm_reap(chn);
+	}
+}
+
+/* Collect finished transfers now rather than at the next timer tick. */
+void adm_poll(void)
+{
+	enter_critical_section();
+	adm_service();
+	exit_critical_section();
+}
+
+static enum handler_return adm_timer_func(struct timer *t, time_t now, void *arg)
+{
+	adm_service();
+	return INT_NO_RESCHEDULE;
+}
+
+static void adm_dpc_func(void *arg)
+{
+	struct adm_xfer *xfer;
+
+	for (;;) {
+		enter_critical_section();
+		xfer = list_remove_head_type(&adm_done, struct adm_xfer, node);
+		exit_critical_section();
+		if (!xfer)
+			break;
+
+		xfer->callback(xfer, xfer->arg);
+	}
+}
+
+status_t adm_xfer_submit(struct adm_xfer *xfer, adm_callback_t callback, void *arg)
+{
+	struct adm_desc *desc = xfer->desc;
+
+	if (!desc || !xfer->ncmds || !xfer->done)
+		return ERR_INVALID_ARGS;
+
+	desc->last[0] |= ADM_CMD_LIST_LC;
+	desc->cmd_ptr[0] = ADM_CMD_PTR_LP | ADM_CMD_PTR_CMD_LIST |
+			   (((uint32_t) desc->cmds) >> 3);
+
+	/* the ADM reads the descriptor from memory */
+	arch_clean_cache_range((addr_t) desc, sizeof(*desc));
+	dmb();
+
+	xfer->callback = callback;
+	xfer->arg = arg;
+	xfer->done = false;
+	xfer->result = ADM_RESULT_SUCCESS;
+	event_unsignal(&xfer->event);
+
+	enter_critical_section();
+
+	list_add_tail(&adm_channels[xfer->chn].pending, &xfer->node);
+	adm_stats.submitted++;
+	if (adm_outstanding++ == 0)
+		timer_set_periodic(&adm_timer, 1, adm_timer_func, NULL);
+	adm_kick(xfer->chn);
+
+	exit_critical_section();
+
+	return NO_ERROR;
+}
+
+adm_result_t adm_xfer_wait(struct adm_xfer *xfer)
+{
+	while (!xfer->done) {
+		enter_critical_section();
+		adm_reap(xfer->chn);
+		exit_critical_section();
+	}
+
+	return xfer->result;
+}
+
+adm_result_t adm_memcpy(addr_t dst, addr_t src, uint32_t len)
+{
+	struct adm_xfer xfer;
+	adm_result_t result;
+
+	if (adm_xfer_init(&xfer, ADM_CHN))
+		return ADM_RESULT_FAILURE;
+
+	if (adm_xfer_add(&xfer, src, dst, len, 0)) {
+		adm_xfer_release(&xfer);
+		return ADM_RESULT_FAILURE;
+	}
+
+	arch_clean_cache_range(src, len);
+	arch_clean_invalidate_cache_range(dst, len);
+
+	adm_xfer_submit(&xfer, NULL, NULL);
+	result = adm_xfer_wait(&xfer);
+	adm_xfer_release(&xfer);
+
+	arch_invalidate_cache_range(dst, len);
+
+	return result;
+}
+
+void adm_get_stats(struct adm_stats *stats)
+{
+	enter_critical_section();
+	*stats = adm_stats;
+	exit_critical_section();
+}
+
+void adm_reset_stats(void)
+{
+	enter_critical_section();
+	memset(&adm_stats, 0, sizeof(adm_stats));
+	exit_critical_section();
+}
+
+void adm_dump_stats(void)
+{
+	dprintf(INFO, "ADM: %u submitted, %u completed, %u errors, %u timeouts, "
+		"max depth %u, %llu bytes, %llu us busy\n",
+		adm_stats.submitted, adm_stats.completed, adm_stats.errors,
+		adm_stats.timeouts, adm_stats.max_depth, adm_stats.bytes,
+		adm_stats.busy_us);
+}
+
+/*
+ * Move an MMC block through the slot's FIFO. The rows that used to be
+ * separate blocking transfers are now entries in as few command lists as
+ * possible.
  */
 adm_result_t
 adm_transfer_mmc_data(unsigned char slot,
 		      unsigned char *data_ptr,
-		      unsigned int data_len, unsigned char direction)
+		      unsigned int data_len, adm_dir_t direction)
 {
-	uint32_t num_rows;
+	struct adm_xfer xfer;
 	uint16_t row_len;
 	uint16_t row_offset;
 	uint32_t row_num;
 	uint32_t adm_crci_num;
+	addr_t mem = (addr_t) data_ptr;
 	adm_result_t result = ADM_RESULT_SUCCESS;
+	status_t err;
 
 	/* Make sure slot value is in the range 1..4 */
 	ASSERT((slot >= 1) && (slot <= 4));
 
 	adm_crci_num = sdc_crci_map[slot];
-	row_len = MMC_BOOT_MCI_FIFO_SIZE;
-	num_rows = data_len / MMC_BOOT_MCI_FIFO_SIZE;
+
+	if (adm_xfer_init(&xfer, ADM_CHN))
+		return ADM_RESULT_FAILURE;
 
 	/* While there is data to be transferred */
 	while (data_len) {
@@ -105,112 +556,38 @@ adm_transfer_mmc_data(unsigned char slot,
 			}
 		}
 
-		/* Program ADM registers and initiate data transfer */
-
-		/*  Initialize the Box Mode command entry (single entry) */
-		box_mode_entry[0] = (ADM_CMD_LIST_LC |
-				     (adm_crci_num << 3) | ADM_ADDR_MODE_BOX);
-
-		if (direction == ADM_MMC_READ) {
-			box_mode_entry[1] = MMC_BOOT_MCI_FIFO;	/* SRC addr    */
-			box_mode_entry[2] = (uint32_t) data_ptr;	/* DST addr    */
-			box_mode_entry[3] = ((row_len << 16) |	/* SRC row len */
-					     (row_len << 0));	/* DST row len */
-			box_mode_entry[4] = ((row_num << 16) |	/* SRC row #   */
-					     (row_num << 0));	/* DST row #   */
-			box_mode_entry[5] = ((0 << 16) |	/* SRC offset  */
-					     (row_offset << 0));	/* DST offset  */
-		} else {
-			box_mode_entry[1] = (uint32_t) data_ptr;	/* SRC addr    */
-			box_mode_entry[2] = MMC_BOOT_MCI_FIFO;	/* DST addr    */
-			box_mode_entry[3] = ((row_len << 16) |	/* SRC row len */
-					     (row_len << 0));	/* DST row len */
-			box_mode_entry[4] = ((row_num << 16) |	/* SRC row #   */
-					     (row_num << 0));	/* DST row #   */
-			box_mode_entry[5] = ((row_offset << 16) |	/* SRC offset  */
-					     (0 << 0));	/* DST offset  */
-		}
-
-		/*  Initialize the ADM Command Pointer List (single entry) */
-		adm_cmd_ptr_list[0] = (ADM_CMD_PTR_LP |
-				       ADM_CMD_PTR_CMD_LIST |
-				       (((uint32_t) (&box_mode_entry[0])) >>
-					3));
-
-		/* Start ADM transfer, this is a blocking call. */
-		result = adm_transfer_start(ADM_CHN, adm_cmd_ptr_list);
-
-		if (result != ADM_RESULT_SUCCESS) {
-			break;
+		if (direction == ADM_MMC_READ)
+			err = adm_xfer_add_box(&xfer, MMC_BOOT_MCI_FIFO, mem,
+					       row_len, row_num, 0, row_offset,
+					       adm_crci_num);
+		else
+			err = adm_xfer_add_box(&xfer, mem, MMC_BOOT_MCI_FIFO,
+					       row_len, row_num, row_offset, 0,
+					       adm_crci_num);
+
+		/* command list full: run what is there and start another */
+		if (err) {
+			adm_xfer_submit(&xfer, NULL, NULL);
+			result = adm_xfer_wait(&xfer);
+			if (result != ADM_RESULT_SUCCESS)
+				break;
+			adm_xfer_reset(&xfer);
+			continue;
 		}
 
 		/* Update the data ptr and data len by the amount
 		 * we just transferred.
 		 */
-		data_ptr += (row_len * row_num);
+		mem += (row_len * row_num);
 		data_len -= (row_len * row_num);
 	}
 
-	return result;
-}
-
-/*
- * Start the ADM data transfer and return the result of the transfer.
- * Blocks until transfer is completed.
- */
-adm_result_t adm_transfer_start(uint32_t adm_chn, uint32_t * cmd_ptr_list)
-{
-	uint32_t reg_value;
-	uint32_t timeout = 1;
-	uint32_t delay_count = 100;
-
-	/* Memory barrier to ensure that all ADM command list structure
-	 * writes have completed before starting the ADM transfer.
-	 */
-	dmb();
-
-	/* Start the ADM transfer by writing the command ptr */
-	writel(((uint32_t) cmd_ptr_list) >> 3,
-	       ADM_REG_CMD_PTR(adm_chn, ADM_SD));
-
-	/* Poll the status register to check for transfer complete.
-	 * Bail out if transfer is not finished within 1 sec.
-	 * Note: This time depends on the amount of data being transferred.
-	 * Increase the delay_count if this is not sufficient.
-	 */
-	do {
-		reg_value = readl(ADM_REG_STATUS(adm_chn, ADM_SD));
-		if ((reg_value & ADM_REG_STATUS__RSLT_VLD___M) != 0) {
-			timeout = 0;
-			break;
-		}
-
-		/* 10ms wait */
-		mdelay(10);
-
+	if (result == ADM_RESULT_SUCCESS && xfer.ncmds) {
+		adm_xfer_submit(&xfer, NULL, NULL);
+		result = adm_xfer_wait(&xfer);
 	}
-	while (delay_count--);
 
-	/* Read out the IRQ register to clear the interrupt.
-	 * Even though we are not using interrupts,
-	 * kernel is not clearing the interupts during its
-	 * ADM initialization, causing it to crash.
-	 */
-	reg_value = readl(ADM_REG_IRQ(ADM_SD));
-
-	if (timeout) {
-		return ADM_RESULT_TIMEOUT;
-	} else {
-		/* Get the result from the RSLT FIFO */
-		reg_value = readl(ADM_REG_RSLT(adm_chn, ADM_SD));
-
-		/* Check for any error */
-		if (((reg_value & ADM_REG_RSLT__ERR___M) != 0) ||
-		    ((reg_value & ADM_REG_RSLT__TPD___M) == 0) ||
-		    ((reg_value & ADM_REG_RSLT__V___M) == 0)) {
-			return ADM_RESULT_FAILURE;
-		}
-	}
+	adm_xfer_release(&xfer);
 
-	return ADM_RESULT_SUCCESS;
+	return result;
 }
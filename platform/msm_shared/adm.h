@@ -31,6 +31,8 @@
 #define __PLATFORM_MSM_SHARED_ADM_H
 
 #include <platform/iomap.h>
+#include <list.h>
+#include <kernel/event.h>
 
 /* ADM base address for channel (n) and security_domain (s) */
 #define ADM_BASE_ADDR(n, s) (MSM_ADM_BASE + 4*(n) + ((MSM_ADM_SD_OFFSET)*(s)))
@@ -47,6 +49,7 @@
 #define ADM_REG_RSLT__TPD___M       (1 << 1)
 
 /* Status reg bit masks */
+#define ADM_REG_STATUS__CMD_PTR_RDY___M (1 << 0)
 #define ADM_REG_STATUS__RSLT_VLD___M    (1 << 1)
 
 /* Command Pointer List Entry bit masks */
@@ -60,6 +63,12 @@
 #define ADM_CMD_LIST_TCB        (1 << 19)	/* This channel block       */
 #define ADM_ADDR_MODE_BOX       (3 << 0)	/* Box address mode         */
 #define ADM_ADDR_MODE_SI        (0 << 0)	/* Single item address mode */
+#define ADM_CMD_LIST_CRCI(n)    ((n) << 3)	/* Flow control channel     */
+
+#define ADM_MAX_CHANNELS        16
+#define ADM_MAX_CMDS            8	/* command list entries per transfer */
+#define ADM_POOL_SIZE           16	/* descriptors, shared by all channels */
+#define ADM_TIMEOUT_US          1000000
 
 /* ADM external inteface */
 
@@ -78,6 +87,77 @@ typedef enum {
 	ADM_MMC_WRITE
 } adm_dir_t;
 
+struct adm_desc;
+struct adm_xfer;
+
+typedef void (*adm_callback_t)(struct adm_xfer *xfer, void *arg);
+
+/*
+ * One ADM transfer: a command list of up to ADM_MAX_CMDS single item or box
+ * entries, run in order on one channel. Owned by the caller, who must keep
+ * it valid until it has completed.
+ */
+struct adm_xfer {
+	struct list_node node;
+	uint32_t chn;
+	struct adm_desc *desc;
+	unsigned ncmds;
+	uint32_t len;			/* bytes moved, for stats */
+	bool done;
+	adm_result_t result;
+	adm_callback_t callback;
+	void *arg;
+	event_t event;
+	bigtime_t start;
+};
+
+struct adm_stats {
+	uint32_t submitted;
+	uint32_t completed;
+	uint32_t errors;
+	uint32_t timeouts;
+	uint32_t max_depth;		/* most transfers outstanding on a channel */
+	uint64_t bytes;
+	uint64_t busy_us;		/* submit to completion, summed */
+};
+
+void adm_init(void);
+
+/* Take a descriptor from the pool; ERR_NO_MEMORY when all are in use. */
+status_t adm_xfer_init(struct adm_xfer *xfer, uint32_t chn);
+/*
+ * Give the descriptor back. The transfer must not be outstanding. After a
+ * timeout the descriptor already belongs to the channel, which frees it
+ * once the ADM is done with it, and this does nothing.
+ */
+void adm_xfer_release(struct adm_xfer *xfer);
+
+/* Append a copy of len bytes, split across entries as needed. */
+status_t adm_xfer_add(struct adm_xfer *xfer, addr_t src, addr_t dst,
+		      uint32_t len, uint32_t crci);
+/* Append a box mode entry: rows of row_len bytes, offsets between rows. */
+status_t adm_xfer_add_box(struct adm_xfer *xfer, addr_t src, addr_t dst,
+			  uint16_t row_len, uint16_t rows,
+			  uint16_t src_ofs, uint16_t dst_ofs, uint32_t crci);
+
+/*
+ * Queue the transfer on its channel. Several transfers may be outstanding
+ * per channel; they run in the order submitted. The callback, if any, is
+ * called from a dpc once the transfer has completed.
+ */
+status_t adm_xfer_submit(struct adm_xfer *xfer, adm_callback_t callback, void *arg);
+/* Wait for a submitted transfer, polling the hardware meanwhile. */
+adm_result_t adm_xfer_wait(struct adm_xfer *xfer);
+/* Collect finished transfers now; a timer does it otherwise. */
+void adm_poll(void);
+
+/* Blocking memory to memory copy. */
+adm_result_t adm_memcpy(addr_t dst, addr_t src, uint32_t len);
+
+void adm_get_stats(struct adm_stats *stats);
+void adm_reset_stats(void);
+void adm_dump_stats(void);
+
 adm_result_t adm_transfer_mmc_data(unsigned char slot,
 				   unsigned char *data_ptr,
 				   unsigned int data_len, adm_dir_t dir);
@@ -28,6 +28,7 @@
  */
 
 #include <debug.h>
+#include <reg.h>
 #include <board.h>
 #include <smem.h>
 #include <baseband.h>
@@ -49,13 +50,17 @@ static void platform_detect()
 	unsigned int board_info_len = 0;
 	unsigned ret = 0;
 	unsigned format = 0;
+	unsigned info_size = 0;
+	void *info;
 	uint8_t i;
 
-	ret = smem_read_alloc_entry_offset(SMEM_BOARD_INFO_LOCATION,
-						   &format, sizeof(format), 0);
-	if (ret)
+	/* Only the format word is needed to pick the layout, read it in place */
+	info = smem_get_alloc_entry(SMEM_BOARD_INFO_LOCATION, &info_size);
+	if (!info || info_size < sizeof(format))
 		return;
 
+	format = readl(info);
+
 	if (format == 6)
 	{
 			board_info_len = sizeof(board_info_v6);
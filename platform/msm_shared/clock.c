@@ -34,8 +34,62 @@
 #include <bits.h>
 #include <clock.h>
 #include <string.h>
+#include <platform.h>
+
+/*
+ * Name lookups go through an open addressed hash of indices into the clock
+ * list, built once by clk_init(). Slots hold index + 1 so that 0 is empty.
+ */
+#define CLK_HASH_SIZE	256
+#define CLK_GROUP_MAX	16
 
 static struct clk_list msm_clk_list;
+static uint16_t clk_hash[CLK_HASH_SIZE];
+static bool clk_hash_valid;
+
+/* FNV-1a */
+static uint32_t clk_hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static void clk_hash_build(void)
+{
+	unsigned i;
+	uint32_t slot;
+
+	memset(clk_hash, 0, sizeof(clk_hash));
+	clk_hash_valid = false;
+
+	/* keep the table at most half full, or fall back to the list walk */
+	if (msm_clk_list.num > CLK_HASH_SIZE / 2)
+		return;
+
+	for (i = 0; i < msm_clk_list.num; i++) {
+		slot = clk_hash_name(msm_clk_list.clist[i].con_id) & (CLK_HASH_SIZE - 1);
+		while (clk_hash[slot])
+			slot = (slot + 1) & (CLK_HASH_SIZE - 1);
+		clk_hash[slot] = i + 1;
+	}
+
+	clk_hash_valid = true;
+}
+
+static void clk_stats_record(struct clk *clk, bigtime_t us)
+{
+	clk->stats.enables++;
+	clk->stats.last_us = us;
+	clk->stats.total_us += us;
+	if (us > clk->stats.max_us)
+		clk->stats.max_us = us;
+}
 
 int clk_set_parent(struct clk *clk, struct clk *parent)
 {
@@ -70,8 +124,15 @@ int clk_enable(struct clk *clk)
 		if (ret)
 			goto out;
 
-		if (clk->ops->enable)
+		if (clk->ops->enable) {
+			bigtime_t start = current_time_hires();
+
 			ret = clk->ops->enable(clk);
+			if (ret == ERR_TIMED_OUT)
+				clk->stats.timeouts++;
+			else if (!ret)
+				clk_stats_record(clk, current_time_hires() - start);
+		}
 		if (ret) {
 			clk_disable(parent);
 			goto out;
@@ -124,6 +185,7 @@ void clk_init(struct clk_lookup *clist, unsigned num)
 	{
 		msm_clk_list.clist = (struct clk_lookup *)clist;
 		msm_clk_list.num = num;
+		clk_hash_build();
 	}
 }
 
@@ -138,6 +200,21 @@ struct clk *clk_get (const char * cid)
 		dprintf (CRITICAL, "Alert!! clock list not defined!\n");
 		return NULL;
 	}
+
+	if (clk_hash_valid)
+	{
+		uint32_t slot = clk_hash_name(cid) & (CLK_HASH_SIZE - 1);
+
+		while (clk_hash[slot])
+		{
+			cl = &msm_clk_list.clist[clk_hash[slot] - 1];
+			if (!strcmp(cl->con_id, cid))
+				return cl->clk;
+			slot = (slot + 1) & (CLK_HASH_SIZE - 1);
+		}
+		goto not_found;
+	}
+
 	for(i=0; i < num; i++, cl++)
 	{
 		if(!strcmp(cl->con_id, cid))
@@ -146,6 +223,7 @@ struct clk *clk_get (const char * cid)
 		}
 	}
 
+not_found:
 	dprintf(CRITICAL, "Alert!! Requested clock \"%s\" is not supported!", cid);
 	return NULL;
 }
@@ -189,6 +267,195 @@ get_set_enable_error:
 	return ret;
 }
 
+/*
+ * Start enabling a clock whose refcount is 0. Returns 1 if the clock's halt
+ * status still has to be checked, 0 if it is already up.
+ */
+static int clk_group_start(struct clk *clk, int *ret)
+{
+	struct clk *parent = clk_get_parent(clk);
+
+	*ret = clk_enable(parent);
+	if (*ret)
+		return 0;
+
+	if (clk->ops->enable_no_wait && clk->ops->is_enabled) {
+		*ret = clk->ops->enable_no_wait(clk);
+		if (*ret) {
+			clk_disable(parent);
+			return 0;
+		}
+		return 1;
+	}
+
+	/* no split enable, so this one waits here */
+	if (clk->ops->enable) {
+		bigtime_t start = current_time_hires();
+
+		*ret = clk->ops->enable(clk);
+		if (*ret) {
+			if (*ret == ERR_TIMED_OUT)
+				clk->stats.timeouts++;
+			clk_disable(parent);
+			return 0;
+		}
+		clk_stats_record(clk, current_time_hires() - start);
+	}
+
+	return 0;
+}
+
+int clk_group_enable(const struct clk_group *group, unsigned num)
+{
+	struct clk *clks[CLK_GROUP_MAX];
+	bool pending[CLK_GROUP_MAX];
+	bigtime_t started[CLK_GROUP_MAX];
+	unsigned enabled = 0;
+	unsigned waiting = 0;
+	bigtime_t now;
+	bool late;
+	unsigned i;
+	int ret = NO_ERROR;
+
+	if (num > CLK_GROUP_MAX)
+		return ERR_INVALID_ARGS;
+
+	/*
+	 * Set each clock's rate and program its enable in list order, as
+	 * clk_get_set_enable() would; only the halt polling is left for later.
+	 */
+	for (i = 0; i < num; i++) {
+		clks[i] = clk_get(group[i].id);
+		if (!clks[i]) {
+			ret = ERR_NOT_VALID;
+			goto err_disable;
+		}
+
+		if (group[i].rate) {
+			ret = clk_set_rate(clks[i], group[i].rate);
+			if (ret) {
+				dprintf(CRITICAL, "Clock %s set rate failed.\n", group[i].id);
+				goto err_disable;
+			}
+		}
+
+		pending[i] = false;
+		if (clks[i]->count == 0) {
+			started[i] = current_time_hires();
+			pending[i] = clk_group_start(clks[i], &ret);
+			if (ret) {
+				dprintf(CRITICAL, "Clock %s enable failed.\n", group[i].id);
+				goto err_disable;
+			}
+			waiting += pending[i];
+		}
+		clks[i]->count++;
+		enabled++;
+	}
+
+	/* then wait for the whole set to leave halt */
+	while (waiting) {
+		now = current_time_hires();
+		late = false;
+		for (i = 0; i < num; i++) {
+			if (!pending[i])
+				continue;
+			if (clks[i]->ops->is_enabled(clks[i])) {
+				clk_stats_record(clks[i], now - started[i]);
+				pending[i] = false;
+				waiting--;
+			} else if (now - started[i] > CLK_HALT_TIMEOUT_US) {
+				late = true;
+			}
+		}
+
+		if (late) {
+			for (i = 0; i < num; i++) {
+				if (pending[i]) {
+					dprintf(CRITICAL, "Clock %s stuck in halt.\n", group[i].id);
+					clks[i]->stats.timeouts++;
+				}
+			}
+			ret = ERR_TIMED_OUT;
+			goto err_disable;
+		}
+	}
+
+	goto out;
+
+err_disable:
+	for (i = 0; i < enabled; i++)
+		clk_disable(clks[i]);
+out:
+	return ret;
+}
+
+void clk_group_disable(const struct clk_group *group, unsigned num)
+{
+	unsigned i;
+
+	/* in reverse, so the interface clocks listed first go last */
+	for (i = num; i-- > 0; )
+		clk_disable(clk_get(group[i].id));
+}
+
+void clk_reset_stats(void)
+{
+	struct clk_lookup *cl = msm_clk_list.clist;
+	unsigned i;
+
+	for (i = 0; i < msm_clk_list.num; i++, cl++)
+		memset(&cl->clk->stats, 0, sizeof(cl->clk->stats));
+}
+
+void clk_dump_stats(void)
+{
+	struct clk_lookup *cl = msm_clk_list.clist;
+	struct clk_stats *st;
+	unsigned enables = 0, timeouts = 0, total_us = 0;
+	unsigned i;
+
+	dprintf(INFO, "clock                       enables  last   max  avg  timeouts\n");
+	for (i = 0; i < msm_clk_list.num; i++, cl++) {
+		st = &cl->clk->stats;
+		if (!st->enables && !st->timeouts)
+			continue;
+		dprintf(INFO, "%-26s %8u %5u %5u %4u %9u\n", cl->con_id,
+			st->enables, st->last_us, st->max_us,
+			st->enables ? st->total_us / st->enables : 0, st->timeouts);
+		enables += st->enables;
+		timeouts += st->timeouts;
+		total_us += st->total_us;
+	}
+
+	dprintf(INFO, "clocks: %u enables, %u us waiting for halt, %u timeouts\n",
+		enables, total_us, timeouts);
+}
+
+#if WITH_LIB_CONSOLE
+
+#include <lib/console.h>
+
+static int cmd_clkstats(int argc, const cmd_args *argv);
+
+STATIC_COMMAND_START
+	{ "clkstats", "clock enable counts and halt wait times [reset]", &cmd_clkstats },
+STATIC_COMMAND_END(clkstats);
+
+static int cmd_clkstats(int argc, const cmd_args *argv)
+{
+	if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+		clk_reset_stats();
+		return 0;
+	}
+
+	clk_dump_stats();
+
+	return 0;
+}
+
+#endif
+
 #ifdef DEBUG_CLOCK
 struct clk_list *clk_get_list()
 {
@@ -31,7 +31,24 @@
 #include <clock.h>
 #include <clock_pll.h>
 #include <clock_lib2.h>
+#include <debug.h>
+#include <platform.h>
 
+/*
+ * Poll @reg until (value & mask) == val, for at most CLK_HALT_TIMEOUT_US.
+ * Returns 0, or ERR_TIMED_OUT.
+ */
+static int clock_lib2_poll(uint32_t *reg, uint32_t mask, uint32_t val)
+{
+	bigtime_t deadline = current_time_hires() + CLK_HALT_TIMEOUT_US;
+
+	do {
+		if ((readl(reg) & mask) == val)
+			return 0;
+	} while (current_time_hires() < deadline);
+
+	return (readl(reg) & mask) == val ? 0 : ERR_TIMED_OUT;
+}
 
 /*=============== CXO clock ops =============*/
 int cxo_clk_enable(struct clk *clk)
@@ -49,10 +66,9 @@ void cxo_clk_disable(struct clk *clk)
 
 /*=============== Branch clock ops =============*/
 
-/* Branch clock enable */
-int clock_lib2_branch_clk_enable(struct clk *clk)
+/* Branch clock enable, without waiting for the clock to leave halt */
+int clock_lib2_branch_clk_enable_no_wait(struct clk *clk)
 {
-	int rc = 0;
 	uint32_t cbcr_val;
 	struct branch_clk *bclk = to_branch_clk(clk);
 
@@ -60,8 +76,29 @@ int clock_lib2_branch_clk_enable(struct clk *clk)
 	cbcr_val |= CBCR_BRANCH_ENABLE_BIT;
 	writel(cbcr_val, bclk->cbcr_reg);
 
+	return 0;
+}
+
+/* Branch clock halt status */
+int clock_lib2_branch_clk_is_enabled(struct clk *clk)
+{
+	struct branch_clk *bclk = to_branch_clk(clk);
+
+	return !(readl(bclk->cbcr_reg) & CBCR_BRANCH_OFF_BIT);
+}
+
+/* Branch clock enable */
+int clock_lib2_branch_clk_enable(struct clk *clk)
+{
+	int rc;
+	struct branch_clk *bclk = to_branch_clk(clk);
+
+	clock_lib2_branch_clk_enable_no_wait(clk);
+
 	/* wait until status shows it is enabled */
-	while(readl(bclk->cbcr_reg) & CBCR_BRANCH_OFF_BIT);
+	rc = clock_lib2_poll(bclk->cbcr_reg, CBCR_BRANCH_OFF_BIT, 0);
+	if (rc)
+		dprintf(CRITICAL, "%s: clock stuck off\n", clk->dbg_name);
 
 	return rc;
 }
@@ -77,7 +114,8 @@ void clock_lib2_branch_clk_disable(struct clk *clk)
 	writel(cbcr_val, bclk->cbcr_reg);
 
 	/* wait until status shows it is disabled */
-	while(!(readl(bclk->cbcr_reg) & CBCR_BRANCH_OFF_BIT));
+	if (clock_lib2_poll(bclk->cbcr_reg, CBCR_BRANCH_OFF_BIT, CBCR_BRANCH_OFF_BIT))
+		dprintf(CRITICAL, "%s: clock stuck on\n", clk->dbg_name);
 }
 
 /* Branch clock set rate */
@@ -151,7 +189,8 @@ static void clock_lib2_rcg_update_config(struct rcg_clk *rclk)
 	writel(cmd, rclk->cmd_reg);
 
 	/* Wait for frequency to be updated. */
-	while(readl(rclk->cmd_reg) & CMD_UPDATE_MASK);
+	if (clock_lib2_poll(rclk->cmd_reg, CMD_UPDATE_MASK, 0))
+		dprintf(CRITICAL, "%s: config update timed out\n", rclk->c.dbg_name);
 }
 
 /* root set rate for clocks with half integer and MND divider */
@@ -194,22 +233,43 @@ void clock_lib2_rcg_set_rate_hid(struct rcg_clk *rclk, struct clk_freq_tbl *freq
 
 /*=============== Vote clock ops =============*/
 
-/* Vote clock enable */
-int clock_lib2_vote_clk_enable(struct clk *c)
+/* Vote clock enable, without waiting for the clock to leave halt */
+int clock_lib2_vote_clk_enable_no_wait(struct clk *c)
 {
 	uint32_t vote_regval;
-	uint32_t val;
 	struct vote_clk *vclk = to_local_vote_clk(c);
 
 	vote_regval = readl(vclk->vote_reg);
 	vote_regval |= vclk->en_mask;
 	writel_relaxed(vote_regval, vclk->vote_reg);
-	do {
-		val = readl(vclk->cbcr_reg);
-		val &= BRANCH_CHECK_MASK;
-	}
+
+	return 0;
+}
+
+/* Vote clock halt status */
+int clock_lib2_vote_clk_is_enabled(struct clk *c)
+{
+	struct vote_clk *vclk = to_local_vote_clk(c);
+	uint32_t val = readl(vclk->cbcr_reg) & BRANCH_CHECK_MASK;
+
+	return (val == BRANCH_ON_VAL) || (val == BRANCH_NOC_FSM_ON_VAL);
+}
+
+/* Vote clock enable */
+int clock_lib2_vote_clk_enable(struct clk *c)
+{
+	bigtime_t deadline;
+
+	clock_lib2_vote_clk_enable_no_wait(c);
+
 	/*  wait until status shows it is enabled */
-	while((val != BRANCH_ON_VAL) && (val != BRANCH_NOC_FSM_ON_VAL));
+	deadline = current_time_hires() + CLK_HALT_TIMEOUT_US;
+	while (!clock_lib2_vote_clk_is_enabled(c)) {
+		if (current_time_hires() > deadline) {
+			dprintf(CRITICAL, "%s: clock stuck off\n", c->dbg_name);
+			return ERR_TIMED_OUT;
+		}
+	}
 
 	return 0;
 }
@@ -222,8 +282,9 @@ void clock_lib2_vote_clk_disable(struct clk *c)
 
 	vote_regval = readl(vclk->vote_reg);
 	vote_regval &= ~vclk->en_mask;
-    writel_relaxed(vote_regval, vclk->vote_reg);
+	writel_relaxed(vote_regval, vclk->vote_reg);
 
-    /* wait until status shows it is disabled */
-	while(!(readl(vclk->cbcr_reg) & CBCR_BRANCH_OFF_BIT));
+	/* wait until status shows it is disabled */
+	if (clock_lib2_poll(vclk->cbcr_reg, CBCR_BRANCH_OFF_BIT, CBCR_BRANCH_OFF_BIT))
+		dprintf(CRITICAL, "%s: clock stuck on\n", c->dbg_name);
 }
@@ -35,11 +35,12 @@
 #include <platform/timer.h>
 #include <clock.h>
 #include <clock_pll.h>
+#include <platform.h>
 
 /*
  * pll_vote_clk functions
  */
-int pll_vote_clk_enable(struct clk *clk)
+int pll_vote_clk_enable_no_wait(struct clk *clk)
 {
 	uint32_t ena;
 	struct pll_vote_clk *pll = to_pll_vote_clk(clk);
@@ -48,8 +49,23 @@ int pll_vote_clk_enable(struct clk *clk)
 	ena |= pll->en_mask;
 	writel_relaxed(ena, pll->en_reg);
 
+	return 0;
+}
+
+int pll_vote_clk_enable(struct clk *clk)
+{
+	bigtime_t deadline;
+
+	pll_vote_clk_enable_no_wait(clk);
+
 	/* Wait until PLL is enabled */
-	while ((readl_relaxed(pll->status_reg) & pll->status_mask) == 0);
+	deadline = current_time_hires() + CLK_HALT_TIMEOUT_US;
+	while (!pll_vote_clk_is_enabled(clk)) {
+		if (current_time_hires() > deadline) {
+			dprintf(CRITICAL, "%s: pll failed to lock\n", clk->dbg_name);
+			return ERR_TIMED_OUT;
+		}
+	}
 
 	return 0;
 }
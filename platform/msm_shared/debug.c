@@ -52,7 +52,8 @@ static void write_dcc(char c)
 		timeout--;
 	}
 }
-void _dputc(char c)
+/* every console but the uart, which takes whole runs */
+static void dputc_unbuffered(char c)
 {
 #if WITH_DEBUG_DCC
 	if (c == '\n') {
@@ -60,9 +61,6 @@ void _dputc(char c)
 	}
 	write_dcc(c) ;
 #endif
-#if WITH_DEBUG_UART
-	uart_putc(0, c);
-#endif
 #if WITH_DEBUG_FBCON && WITH_DEV_FBCON
 	fbcon_putc(c);
 #endif
@@ -71,6 +69,25 @@ void _dputc(char c)
 #endif
 }
 
+void _dputc(char c)
+{
+	dputc_unbuffered(c);
+#if WITH_DEBUG_UART
+	uart_putc(0, c);
+#endif
+}
+
+void _dwrite(const char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		dputc_unbuffered(str[i]);
+#if WITH_DEBUG_UART
+	uart_write(0, str, len);
+#endif
+}
+
 int dgetc(char *c, bool wait)
 {
 	int n;
@@ -92,5 +109,8 @@ int dgetc(char *c, bool wait)
 void platform_halt(void)
 {
 	dprintf(INFO, "HALT: spinning forever...\n");
+#if WITH_DEBUG_UART
+	uart_flush_tx(0);
+#endif
 	for (;;) ;
 }
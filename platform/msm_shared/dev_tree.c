@@ -195,11 +195,13 @@ int dev_tree_add_mem_info(void *fdt, uint32_t offset, uint32_t addr, uint32_t si
 }
 
 /* Top level function that updates the device tree. */
-int update_device_tree(void *fdt, const char *cmdline,
+int update_device_tree(void *fdt, dt_cmdline_fill fill, void *arg,
 					   void *ramdisk, uint32_t ramdisk_size)
 {
 	int ret = 0;
 	uint32_t offset;
+	void *bootargs;
+	int len;
 
 	/* Check the device tree header */
 	ret = fdt_check_header(fdt);
@@ -243,13 +245,6 @@ int update_device_tree(void *fdt, const char *cmdline,
 	}
 
 	offset = ret;
-	/* Adding the cmdline to the chosen node */
-	ret = fdt_setprop_string(fdt, offset, (const char*)"bootargs", (const void*)cmdline);
-	if (ret)
-	{
-		dprintf(CRITICAL, "ERROR: Cannot update chosen node [bootargs]\n");
-		return ret;
-	}
 
 	/* Adding the initrd-start to the chosen node */
 	ret = fdt_setprop_u32(fdt, offset, "linux,initrd-start", (uint32_t)ramdisk);
@@ -267,6 +262,29 @@ int update_device_tree(void *fdt, const char *cmdline,
 		return ret;
 	}
 
+	/*
+	 * Adding the cmdline to the chosen node: reserve the space left in
+	 * the blob, less a property header and its name, have the command
+	 * line built right there, then trim the property to fit.
+	 */
+	len = fdt_totalsize(fdt) - fdt_off_dt_strings(fdt) - fdt_size_dt_strings(fdt);
+	len = (len - sizeof(struct fdt_property) - sizeof("bootargs")) & ~3;
+	if (len <= 0)
+	{
+		dprintf(CRITICAL, "ERROR: No space for chosen node [bootargs]\n");
+		return -FDT_ERR_NOSPACE;
+	}
+
+	ret = fdt_setprop_placeholder(fdt, offset, "bootargs", len, &bootargs);
+	if (!ret)
+		ret = fdt_setprop_placeholder(fdt, offset, "bootargs",
+					      fill(bootargs, len, arg), &bootargs);
+	if (ret)
+	{
+		dprintf(CRITICAL, "ERROR: Cannot update chosen node [bootargs]\n");
+		return ret;
+	}
+
 	fdt_pack(fdt);
 
 	return ret;
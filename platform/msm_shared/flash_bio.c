@@ -0,0 +1,157 @@
+/* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <string.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <arch/defines.h>
+#include <dev/flash.h>
+#include <lib/ptable.h>
+#include <lib/bio.h>
+#include <storage_bio.h>
+
+#if WITH_LIB_BIO
+
+#define FLASH_BIO_BLOCK_SIZE	512
+
+/*
+ * Each nand partition is its own device rather than a subdevice of the
+ * whole chip: flash_read() skips bad blocks relative to the partition
+ * start, so partition offsets do not map linearly onto the chip.
+ */
+typedef struct flash_bdev {
+	bdev_t dev;
+	struct ptentry *ptn;
+} flash_bdev_t;
+
+/* page sized bounce for partial pages and unaligned buffers */
+static uint8_t *flash_bio_page;
+
+static ssize_t flash_bio_read_block(struct bdev *_dev, void *_buf, bnum_t block, uint count)
+{
+	flash_bdev_t *dev = (flash_bdev_t *)_dev;
+	unsigned page_size = flash_page_size();
+	uint8_t *buf = _buf;
+	unsigned offset = block * dev->dev.block_size;
+	unsigned len = count * dev->dev.block_size;
+	unsigned page_off;
+	unsigned chunk;
+
+	while (len > 0) {
+		page_off = offset & (page_size - 1);
+
+		if (page_off == 0 && len >= page_size && IS_CACHE_LINE_ALIGNED(buf)) {
+			/* as many whole pages as possible straight into the caller's buffer */
+			chunk = len & ~(page_size - 1);
+			if (flash_read(dev->ptn, offset, buf, chunk))
+				return ERR_IO;
+		} else {
+			chunk = MIN(len, page_size - page_off);
+			if (flash_read(dev->ptn, offset - page_off, flash_bio_page, page_size))
+				return ERR_IO;
+			memcpy(buf, flash_bio_page + page_off, chunk);
+		}
+
+		offset += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return count * dev->dev.block_size;
+}
+
+static ssize_t flash_bio_write_block(struct bdev *dev, const void *buf, bnum_t block, uint count)
+{
+	/* flash_write() only rewrites whole images from the start of the partition */
+	return ERR_NOT_SUPPORTED;
+}
+
+static ssize_t flash_bio_erase(struct bdev *_dev, off_t offset, size_t len)
+{
+	flash_bdev_t *dev = (flash_bdev_t *)_dev;
+
+	if (offset != 0 || (off_t)len != dev->dev.size)
+		return ERR_NOT_SUPPORTED;
+
+	if (flash_erase(dev->ptn))
+		return ERR_IO;
+
+	return len;
+}
+
+int flash_bio_publish(struct ptable *ptable)
+{
+	struct flash_info *info = flash_get_info();
+	struct ptentry *ptn;
+	flash_bdev_t *dev;
+	bdev_t *existing;
+	int count = 0;
+	int i;
+
+	if (!info || !info->block_size || flash_page_size() < FLASH_BIO_BLOCK_SIZE)
+		return ERR_NOT_READY;
+
+	if (!flash_bio_page) {
+		flash_bio_page = memalign(CACHE_LINE, ROUNDUP(flash_page_size(), CACHE_LINE));
+		if (!flash_bio_page)
+			return ERR_NO_MEMORY;
+	}
+
+	for (i = 0; i < ptable_size(ptable); i++) {
+		ptn = ptable_get(ptable, i);
+		if (!ptn || !ptn->name[0] || !ptn->length)
+			continue;
+
+		existing = bio_open(ptn->name);
+		if (existing) {
+			bio_close(existing);
+			continue;
+		}
+
+		dev = malloc(sizeof(flash_bdev_t));
+		if (!dev)
+			return ERR_NO_MEMORY;
+
+		bio_initialize_bdev(&dev->dev, ptn->name, FLASH_BIO_BLOCK_SIZE,
+				((uint64_t)ptn->length * info->block_size) / FLASH_BIO_BLOCK_SIZE);
+		dev->ptn = ptn;
+		dev->dev.read_block = flash_bio_read_block;
+		dev->dev.write_block = flash_bio_write_block;
+		dev->dev.erase = flash_bio_erase;
+
+		bio_register_device(&dev->dev);
+		count++;
+	}
+
+	dprintf(SPEW, "Published %d nand partitions\n", count);
+	return count;
+}
+
+#endif
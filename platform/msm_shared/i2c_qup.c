@@ -35,7 +35,10 @@
 #include <arch/arm.h>
 #include <reg.h>
 #include <kernel/thread.h>
+#include <kernel/event.h>
 #include <dev/gpio.h>
+#include <err.h>
+#include <platform.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -50,6 +53,8 @@
 
 static struct qup_i2c_dev *dev_addr = NULL;
 
+#define QUP_STATE_TIMEOUT_US	1000
+
 /* QUP Registers */
 enum {
 	QUP_CONFIG = 0x0,
@@ -195,44 +200,46 @@ static irqreturn_t qup_i2c_interrupt(void)
 
  intr_done:
 	dev->err = err;
+	dev->stats.irqs++;
+	/* Wake up qup_i2c_wait_done */
+	event_signal(&dev->xfer_done, false);
 	return IRQ_HANDLED;
 }
 
-static int qup_i2c_poll_writeready(struct qup_i2c_dev *dev)
+/*
+ * Wait for the QUP to raise its interrupt for the FIFO or block we just
+ * handed it, instead of spinning on the state registers. bytes is the
+ * amount in flight, used to size the timeout.
+ */
+static int qup_i2c_wait_done(struct qup_i2c_dev *dev, int bytes)
 {
-	unsigned retries = 0;
+	/* 9 bit times per byte plus start/stop, with some slack */
+	time_t timeout = (bytes + 2) * 9 * dev->one_bit_t / 1000 + 2;
 
-	while (retries != 2000) {
-		unsigned status = readl(dev->qup_base + QUP_I2C_STATUS);
-
-		if (!(status & I2C_STATUS_WR_BUFFER_FULL)) {
-			if (!(status & I2C_STATUS_BUS_ACTIVE))
-				return 0;
-			else	/* 1-bit delay before we check for bus busy */
-				udelay(dev->one_bit_t);
-		}
-		if (retries++ == 1000)
-			udelay(100);
+	if (event_wait_timeout(&dev->xfer_done, timeout) != NO_ERROR) {
+		dev->stats.timeouts++;
+		qup_print_status(dev);
+		return -ETIMEDOUT;
 	}
-	qup_print_status(dev);
-	return -ETIMEDOUT;
+
+	return 0;
 }
 
 static int qup_i2c_poll_state(struct qup_i2c_dev *dev, unsigned state)
 {
-	unsigned retries = 0;
+	/* State changes take a few core clocks, don't back off */
+	bigtime_t deadline = current_time_hires() + QUP_STATE_TIMEOUT_US;
 
-	dprintf(INFO, "Polling Status for state:0x%x\n", state);
+	dprintf(SPEW, "Polling Status for state:0x%x\n", state);
 
-	while (retries != 2000) {
+	do {
 		unsigned status = readl(dev->qup_base + QUP_STATE);
 
 		if ((status & (QUP_STATE_VALID | state)) ==
 		    (QUP_STATE_VALID | state))
 			return 0;
-		else if (retries++ == 1000)
-			udelay(100);
-	}
+	} while (current_time_hires() < deadline);
+
 	return -ETIMEDOUT;
 }
 
@@ -452,59 +459,18 @@ int qup_i2c_xfer(struct qup_i2c_dev *dev, struct i2c_msg msgs[], int num)
 	int ret;
 	int rem = num;
 	int err;
+	int i;
+	struct i2c_msg *first = msgs;
+	bigtime_t start;
+	bigtime_t elapsed;
 
 	if (dev->suspended) {
 		return -EIO;
 	}
 
-	/* Set the GSBIn_QUP_APPS_CLK to 24MHz, then below figure out what speed to
-	   run I2C_MASTER_CORE at. */
-#if !PERIPH_BLK_BLSP
-	if (dev->clk_state == 0) {
-		if (dev->clk_ctl == 0) {
-			clock_config_i2c(dev->gsbi_number, dev->src_clk_freq);
-		}
-	}
-#endif
-
-	/* Initialize QUP registers during first transfer */
-	if (dev->clk_ctl == 0) {
-		int fs_div;
-		int hs_div;
-		unsigned fifo_reg;
-#if !PERIPH_BLK_BLSP
-		/* Configure the GSBI Protocol Code for i2c */
-		writel((GSBI_PROTOCOL_CODE_I2C <<
-			GSBI_CTRL_REG_PROTOCOL_CODE_S),
-		       GSBI_CTRL_REG(dev->gsbi_base));
-#endif
-
-		fs_div = ((dev->src_clk_freq / dev->clk_freq) / 2) - 3;
-		hs_div = 3;
-		dev->clk_ctl = ((hs_div & 0x7) << 8) | (fs_div & 0xff);
-		fifo_reg = readl(dev->qup_base + QUP_IO_MODE);
-		if (fifo_reg & 0x3)
-			dev->out_blk_sz = (fifo_reg & 0x3) * 16;
-		else
-			dev->out_blk_sz = 16;
-		if (fifo_reg & 0x60)
-			dev->in_blk_sz = ((fifo_reg & 0x60) >> 5) * 16;
-		else
-			dev->in_blk_sz = 16;
-		/*
-		 * The block/fifo size w.r.t. 'actual data' is 1/2 due to 'tag'
-		 * associated with each byte written/received
-		 */
-		dev->out_blk_sz /= 2;
-		dev->in_blk_sz /= 2;
-		dev->out_fifo_sz =
-		    dev->out_blk_sz * (2 << ((fifo_reg & 0x1C) >> 2));
-		dev->in_fifo_sz =
-		    dev->in_blk_sz * (2 << ((fifo_reg & 0x380) >> 7));
-		dprintf(INFO, "QUP IN:bl:%d, ff:%d, OUT:bl:%d, ff:%d\n",
-			dev->in_blk_sz, dev->in_fifo_sz, dev->out_blk_sz,
-			dev->out_fifo_sz);
-	}
+	start = current_time_hires();
+	dev->stats.xfers++;
+	dev->stats.msgs += num;
 
 	unmask_interrupt(dev->qup_irq);
 	writel(1, dev->qup_base + QUP_SW_RESET);
@@ -608,14 +574,23 @@ int qup_i2c_xfer(struct qup_i2c_dev *dev, struct i2c_msg msgs[], int num)
 						filled = TRUE;
 				}
 			}
+			event_unsignal(&dev->xfer_done);
 			err = qup_update_state(dev, QUP_RUN_STATE);
 			if (err < 0) {
 				ret = err;
 				goto out_err;
 			}
-			dprintf(INFO, "idx:%d, rem:%d, num:%d, mode:%d\n",
+			dprintf(SPEW, "idx:%d, rem:%d, num:%d, mode:%d\n",
 				idx, rem, num, dev->mode);
 
+			err = qup_i2c_wait_done(dev, (dev->msg->flags & I2C_M_RD) ?
+						dev->cnt : (idx >> 1));
+			if (err < 0) {
+				dprintf(INFO, "QUP timed out waiting for the irq\n");
+				ret = err;
+				goto out_err;
+			}
+
 			qup_print_status(dev);
 			if (dev->err) {
 				if (dev->err & QUP_I2C_NACK_FLAG) {
@@ -665,24 +640,77 @@ int qup_i2c_xfer(struct qup_i2c_dev *dev, struct i2c_msg msgs[], int num)
 				dev->msg = msgs;
 			}
 		}
-		/* Wait for I2C bus to be idle */
-		ret = qup_i2c_poll_writeready(dev);
-		if (ret) {
-			dprintf(INFO, "Error waiting for write ready\n");
-			goto out_err;
-		}
 	}
 
 	ret = num;
+	for (i = 0; i < num; i++)
+		dev->stats.bytes += first[i].len;
  out_err:
 	dev->msg = NULL;
 	dev->pos = 0;
 	dev->err = 0;
 	dev->cnt = 0;
 	mask_interrupt(dev->qup_irq);
+
+	if (ret < 0)
+		dev->stats.errors++;
+	elapsed = current_time_hires() - start;
+	dev->stats.total_us += elapsed;
+	if (elapsed > dev->stats.max_us)
+		dev->stats.max_us = elapsed;
+
 	return ret;
 }
 
+/*
+ * Work out the clock divider and the FIFO/block geometry once, up front,
+ * rather than on the first transfer.
+ */
+static void qup_i2c_hw_init(struct qup_i2c_dev *dev)
+{
+	int fs_div;
+	int hs_div;
+	unsigned fifo_reg;
+
+	/* Set the GSBIn_QUP_APPS_CLK to 24MHz, then below figure out what speed to
+	   run I2C_MASTER_CORE at. */
+#if !PERIPH_BLK_BLSP
+	if (dev->clk_state == 0)
+		clock_config_i2c(dev->gsbi_number, dev->src_clk_freq);
+
+	/* The write in qup_i2c_init() can be lost while the GSBI clock is
+	 * off, so configure the GSBI Protocol Code for i2c again now. */
+	writel((GSBI_PROTOCOL_CODE_I2C <<
+		GSBI_CTRL_REG_PROTOCOL_CODE_S), GSBI_CTRL_REG(dev->gsbi_base));
+#endif
+
+	fs_div = ((dev->src_clk_freq / dev->clk_freq) / 2) - 3;
+	hs_div = 3;
+	dev->clk_ctl = ((hs_div & 0x7) << 8) | (fs_div & 0xff);
+	fifo_reg = readl(dev->qup_base + QUP_IO_MODE);
+	if (fifo_reg & 0x3)
+		dev->out_blk_sz = (fifo_reg & 0x3) * 16;
+	else
+		dev->out_blk_sz = 16;
+	if (fifo_reg & 0x60)
+		dev->in_blk_sz = ((fifo_reg & 0x60) >> 5) * 16;
+	else
+		dev->in_blk_sz = 16;
+	/*
+	 * The block/fifo size w.r.t. 'actual data' is 1/2 due to 'tag'
+	 * associated with each byte written/received
+	 */
+	dev->out_blk_sz /= 2;
+	dev->in_blk_sz /= 2;
+	dev->out_fifo_sz =
+	    dev->out_blk_sz * (2 << ((fifo_reg & 0x1C) >> 2));
+	dev->in_fifo_sz =
+	    dev->in_blk_sz * (2 << ((fifo_reg & 0x380) >> 7));
+	dprintf(INFO, "QUP IN:bl:%d, ff:%d, OUT:bl:%d, ff:%d\n",
+		dev->in_blk_sz, dev->in_fifo_sz, dev->out_blk_sz,
+		dev->out_fifo_sz);
+}
+
 void qup_i2c_sec_init(struct qup_i2c_dev *dev, uint32_t clk_freq,
 					  uint32_t src_clk_freq)
 {
@@ -693,7 +721,10 @@ void qup_i2c_sec_init(struct qup_i2c_dev *dev, uint32_t clk_freq,
 	dev->num_irqs = 1;
 
 	dev->one_bit_t = USEC_PER_SEC / dev->clk_freq;
-	dev->clk_ctl = 0;
+
+	qup_i2c_hw_init(dev);
+
+	event_init(&dev->xfer_done, false, EVENT_FLAG_AUTOUNSIGNAL);
 
 	/* Register the GSBIn QUP IRQ */
 	register_int_handler(dev->qup_irq, (int_handler) qup_i2c_interrupt, 0);
@@ -772,11 +803,43 @@ struct qup_i2c_dev *qup_blsp_i2c_init(uint8_t blsp_id, uint8_t qup_id,
 	return dev;
 }
 
+/*
+ * Write wlen bytes (typically a register address) then read rlen bytes
+ * back from the same slave, with a repeated START in between, as one
+ * transaction.
+ */
+int qup_i2c_write_read(struct qup_i2c_dev *dev, uint8_t addr,
+		       uint8_t *wbuf, int wlen, uint8_t *rbuf, int rlen)
+{
+	struct i2c_msg msgs[] = {
+		{addr, I2C_M_WR, wlen, wbuf},
+		{addr, I2C_M_RD, rlen, rbuf},
+	};
+	int ret;
+
+	ret = qup_i2c_xfer(dev, msgs, 2);
+
+	return (ret == 2) ? 0 : (ret < 0 ? ret : -EIO);
+}
+
+void qup_i2c_get_stats(struct qup_i2c_dev *dev, struct qup_i2c_stats *stats)
+{
+	*stats = dev->stats;
+}
+
+void qup_i2c_reset_stats(struct qup_i2c_dev *dev)
+{
+	memset(&dev->stats, 0, sizeof(dev->stats));
+}
+
 int qup_i2c_deinit(struct qup_i2c_dev *dev)
 {
 	/* Disable the qup_irq */
 	mask_interrupt(dev->qup_irq);
+	event_destroy(&dev->xfer_done);
 	/* Free the memory used for dev */
+	if (dev == dev_addr)
+		dev_addr = NULL;
 	free(dev);
 	return 0;
 }
@@ -62,12 +62,27 @@ struct clk_ops {
 	int (*set_parent)(struct clk *clk, struct clk *parent);
 	struct clk *(*get_parent)(struct clk *clk);
 	bool (*is_local)(struct clk *clk);
+	/*
+	 * Program the enable and return without waiting for the clock to
+	 * come out of halt; clk_group_enable() polls is_enabled for that.
+	 */
+	int (*enable_no_wait)(struct clk *clk);
+};
+
+/* Enable latency in us, kept by clk_enable() and clk_group_enable(). */
+struct clk_stats {
+	uint32_t enables;
+	uint32_t last_us;
+	uint32_t max_us;
+	uint32_t total_us;
+	uint32_t timeouts;
 };
 
 /**
  * struct clk
  * @count: enable refcount
  * @lock: protects clk_enable()/clk_disable() path and @count
+ * @stats: enable latency statistics
  */
 struct clk {
 	uint32_t flags;
@@ -75,8 +90,12 @@ struct clk {
 	struct clk_ops *ops;
 	const char *dbg_name;
 	unsigned count;
+	struct clk_stats stats;
 };
 
+/* Longest a clock may take to leave halt before enable gives up. */
+#define CLK_HALT_TIMEOUT_US	500
+
 /**
  * clk_get - lookup and obtain a reference to a clock producer.
  * @dev: device for clock "consumer"
@@ -165,6 +184,48 @@ struct clk *clk_get_parent(struct clk *clk);
  */
 int clk_get_set_enable(char *id, unsigned long rate, bool enable);
 
+/**
+ * struct clk_group - one clock of a set enabled by clk_group_enable()
+ * @id: clock identifier
+ * @rate: rate to set before enabling, or 0 to leave it alone
+ */
+struct clk_group {
+	const char *id;
+	unsigned long rate;
+};
+
+/**
+ * clk_group_enable - set the rates of and enable a set of clocks.
+ * @group: clocks to enable
+ * @num: number of entries in @group
+ *
+ * Each clock has its rate set and its enable programmed in list order, as
+ * with clk_get_set_enable(), but the halt status of the whole set is only
+ * verified afterwards, so the clocks come up in parallel. If
+ * any clock fails or does not leave halt within CLK_HALT_TIMEOUT_US, the
+ * clocks enabled by this call are disabled again.
+ *
+ * Returns success (0) or negative errno.
+ */
+int clk_group_enable(const struct clk_group *group, unsigned num);
+
+/**
+ * clk_group_disable - disable a set of clocks enabled by clk_group_enable().
+ * @group: clocks to disable
+ * @num: number of entries in @group
+ */
+void clk_group_disable(const struct clk_group *group, unsigned num);
+
+/**
+ * clk_dump_stats - print the enable latency of every clock that was enabled.
+ */
+void clk_dump_stats(void);
+
+/**
+ * clk_reset_stats - clear the enable latency of every clock.
+ */
+void clk_reset_stats(void);
+
 struct clk_lookup {
 	const char		*con_id;
 	struct clk		*clk;
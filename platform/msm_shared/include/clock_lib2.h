@@ -189,10 +189,14 @@ void cxo_clk_disable(struct clk *clk);
 
 /* Branch clock functions */
 int  clock_lib2_branch_clk_enable(struct clk *clk);
+int  clock_lib2_branch_clk_enable_no_wait(struct clk *clk);
+int  clock_lib2_branch_clk_is_enabled(struct clk *clk);
 void clock_lib2_branch_clk_disable(struct clk *clk);
 int  clock_lib2_branch_set_rate(struct clk *c, unsigned rate);
 
 /* Vote clock functions*/
 int clock_lib2_vote_clk_enable(struct clk *c);
+int clock_lib2_vote_clk_enable_no_wait(struct clk *c);
+int clock_lib2_vote_clk_is_enabled(struct clk *c);
 void clock_lib2_vote_clk_disable(struct clk *c);
 #endif
@@ -91,6 +91,7 @@ static inline struct pll_clk *to_pll_clk(struct clk *clk)
 }
 
 int pll_vote_clk_enable(struct clk *clk);
+int pll_vote_clk_enable_no_wait(struct clk *clk);
 void pll_vote_clk_disable(struct clk *clk);
 unsigned pll_vote_clk_get_rate(struct clk *clk);
 struct clk *pll_vote_clk_get_parent(struct clk *clk);
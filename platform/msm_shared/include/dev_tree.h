@@ -65,7 +65,11 @@ enum dt_err_codes
 };
 
 struct dt_entry * dev_tree_get_entry_ptr(struct dt_table *);
-int update_device_tree(void *, const char *, void *, unsigned);
+/* Writes the kernel command line into buf, returns the bytes used with the nul */
+typedef unsigned (*dt_cmdline_fill)(char *buf, unsigned size, void *arg);
+
+int update_device_tree(void *fdt, dt_cmdline_fill fill, void *arg,
+					   void *ramdisk, unsigned ramdisk_size);
 int dev_tree_add_mem_info(void *fdt, uint32_t offset, uint32_t size, uint32_t addr);
 void *dev_tree_appended(void *kernel, void *tags, uint32_t kernel_size);
 #endif
@@ -30,6 +30,7 @@
 #define  __I2C_QUP__
 
 #include <stdint.h>
+#include <kernel/event.h>
 
 /**
  * struct i2c_msg - an I2C transaction segment beginning with START
@@ -82,6 +83,18 @@ struct i2c_msg {
 	unsigned char *buf;	/* pointer to msg data */
 };
 
+/* Per controller transfer accounting */
+struct qup_i2c_stats {
+	uint32_t xfers;		/* qup_i2c_xfer calls */
+	uint32_t msgs;
+	uint32_t bytes;		/* payload bytes of successful transfers */
+	uint32_t errors;
+	uint32_t irqs;
+	uint32_t timeouts;	/* waits that timed out without an irq */
+	uint64_t total_us;	/* wall time spent in qup_i2c_xfer */
+	uint64_t max_us;	/* slowest single transfer */
+};
+
 struct qup_i2c_dev {
 	unsigned int gsbi_base;
 	unsigned int qup_base;
@@ -104,6 +117,8 @@ struct qup_i2c_dev {
 	int wr_sz;
 	int suspended;
 	int clk_state;
+	event_t xfer_done;
+	struct qup_i2c_stats stats;
 };
 
 /* Function Definitions */
@@ -113,6 +128,10 @@ struct qup_i2c_dev *qup_blsp_i2c_init(uint8_t blsp_id, uint8_t qup_id,
 				      uint32_t clk_freq, uint32_t src_clk_freq);
 int qup_i2c_deinit(struct qup_i2c_dev *dev);
 int qup_i2c_xfer(struct qup_i2c_dev *dev, struct i2c_msg msgs[], int num);
+int qup_i2c_write_read(struct qup_i2c_dev *dev, uint8_t addr,
+		       uint8_t *wbuf, int wlen, uint8_t *rbuf, int rlen);
+void qup_i2c_get_stats(struct qup_i2c_dev *dev, struct qup_i2c_stats *stats);
+void qup_i2c_reset_stats(struct qup_i2c_dev *dev);
 
 struct device {
 	struct device *parent;
@@ -641,9 +641,11 @@ struct mdss_dsi_phy_ctrl {
 	char laneCfg[45];
 };
 
+/* wait: ms to wait after the command, 0 for the usual short gap */
 struct mipi_dsi_cmd {
 	int size;
 	char *payload;
+	int wait;
 };
 
 struct mipi_dsi_panel_config {
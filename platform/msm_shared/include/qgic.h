@@ -56,11 +56,50 @@
 #define GIC_DIST_CONFIG             GIC_DIST_REG(0xc00)
 #define GIC_DIST_SOFTINT            GIC_DIST_REG(0xf00)
 
+#define GIC_SPURIOUS_IRQ            1023
+
+/*
+ * Priorities by source class, lower is more urgent. When several
+ * interrupts are pending the most urgent one is acknowledged first.
+ */
+#define QGIC_PRIO_TIMER             0x60
+#define QGIC_PRIO_USB               0x70
+#define QGIC_PRIO_SDHCI             0x80
+#define QGIC_PRIO_DISPLAY           0x90
+#define QGIC_PRIO_DEFAULT           0xa0
+
+/* Interrupts serviced per exception entry before returning */
+#define QGIC_MAX_DRAIN              32
+
+/* Handler time buckets, in cycles: <256, <1K, <4K, ... , >=1M */
+#define QGIC_HIST_BUCKETS           8
+
 struct ihandler {
 	int_handler func;
 	void *arg;
 };
 
+struct qgic_irq_stats {
+	uint32_t count;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
+	uint32_t hist[QGIC_HIST_BUCKETS];
+};
+
+struct qgic_stats {
+	uint32_t entries;		/* exception entries */
+	uint32_t serviced;		/* interrupts handled */
+	uint32_t max_drained;		/* most handled in one entry */
+	uint32_t spurious;		/* entries with nothing pending */
+	uint32_t unhandled;		/* no handler registered, masked */
+};
+
 void qgic_init(void);
+void qgic_set_priority(unsigned int vector, uint8_t prio);
+
+void qgic_get_stats(struct qgic_stats *stats);
+void qgic_get_irq_stats(unsigned int vector, struct qgic_irq_stats *stats);
+void qgic_reset_stats(void);
+void qgic_dump_stats(void);
 
 #endif
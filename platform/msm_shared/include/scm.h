@@ -231,6 +231,62 @@ struct scm_response {
 	uint32_t is_complete;
 };
 
+/* Size of the static area batches are built in; bigger ones are allocated */
+#define SCM_CMD_AREA_SIZE           1024
+
+#define SCM_BATCH_MAX_CMDS          8
+#define SCM_BATCH_MAX_RANGES        4
+
+/* Latency histogram: bucket i counts calls taking less than 2^i us, the
+ * last bucket everything slower. */
+#define SCM_LAT_BUCKETS             16
+
+struct scm_batch_cmd {
+	uint32_t svc_id;
+	uint32_t cmd_id;
+	const void *cmd_buf;
+	size_t cmd_len;
+	void *resp_buf;
+	size_t resp_len;
+};
+
+/* Buffer TZ accesses directly, in whole cache lines */
+struct scm_batch_range {
+	addr_t start;
+	addr_t end;
+};
+
+struct scm_batch {
+	unsigned int num_cmds;
+	unsigned int num_ranges;
+	unsigned int completed;
+	struct scm_batch_cmd cmds[SCM_BATCH_MAX_CMDS];
+	struct scm_batch_range ranges[SCM_BATCH_MAX_RANGES];
+};
+
+struct scm_stats {
+	uint32_t calls;
+	uint32_t batches;
+	uint32_t cache_passes;
+	uint32_t errors;
+	uint64_t total_us;
+	uint32_t lat_hist[SCM_LAT_BUCKETS];
+};
 
+typedef uint32_t (*scm_monitor_t)(uint32_t cmd_addr);
+
+int scm_call(uint32_t svc_id, uint32_t cmd_id, const void *cmd_buf,
+	     size_t cmd_len, void *resp_buf, size_t resp_len);
+void scm_batch_init(struct scm_batch *batch);
+int scm_batch_add(struct scm_batch *batch, uint32_t svc_id, uint32_t cmd_id,
+		  const void *cmd_buf, size_t cmd_len, void *resp_buf,
+		  size_t resp_len);
+int scm_batch_add_range(struct scm_batch *batch, void *buf, size_t len);
+int scm_batch_submit(struct scm_batch *batch);
+void scm_set_monitor(scm_monitor_t monitor);
+uint32_t scm_stub_monitor(uint32_t cmd_addr);
+void scm_get_stats(struct scm_stats *stats);
+void scm_reset_stats(void);
+void scm_dump_stats(void);
 
 #endif
@@ -68,6 +68,9 @@
 #define PMIC_ARB_CHNLn_RDATA(x,n)            (SPMI_BASE + 0xF818 + \
 	(x) * 0x80 + (n) * 4)
 
+/* Most bytes a single extended register read/write can carry */
+#define PMIC_ARB_MAX_BURST                   8
+
 /* PIC Registers */
 #define SPMI_PIC_OWNERm_ACC_STATUSn(m, n)    (SPMI_PIC_BASE + 32 * (m) + 4 * (n))
 #define SPMI_PIC_ACC_ENABLEn(n)              (SPMI_PIC_BASE + 0x200 + 4 * (n))
@@ -129,6 +132,17 @@ struct pmic_arb_param{
 	uint8_t size;
 };
 
+/* Per boot SPMI bus accounting */
+struct spmi_stats{
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t posted;
+	uint32_t bytes_read;
+	uint32_t bytes_written;
+	uint32_t errors;
+	uint64_t wait_us;
+};
+
 typedef void (*spmi_callback)();
 
 void spmi_init(uint32_t, uint32_t);
@@ -136,5 +150,12 @@ unsigned int pmic_arb_write_cmd(struct pmic_arb_cmd *cmd,
 	struct pmic_arb_param *param);
 unsigned int pmic_arb_read_cmd(struct pmic_arb_cmd *cmd,
 	struct pmic_arb_param *param);
+unsigned int pmic_arb_write_cmd_posted(struct pmic_arb_cmd *cmd,
+	struct pmic_arb_param *param);
+unsigned int pmic_arb_sync();
+
+void spmi_get_stats(struct spmi_stats *stats);
+void spmi_reset_stats();
+void spmi_dump_stats();
 
 #endif
@@ -263,7 +263,37 @@ enum MSM_BOOT_UART_DM_BITS_PER_CHAR {
 #define MSM_BOOT_UART_DM_E_MALLOC_FAIL       4
 #define MSM_BOOT_UART_DM_E_RX_NOT_READY      5
 
+/* TX ring buffer, per port. Size must be a power of 2. */
+#ifndef UART_DM_TX_RING_SIZE
+#define UART_DM_TX_RING_SIZE                 2048
+#endif
+
+/* Max chars announced through NO_CHARS_FOR_TX in one transfer */
+#define UART_DM_TX_MAX_XFER                  256
+
+/* Period of the ring drain timer, once async TX is enabled */
+#define UART_DM_TX_DRAIN_MS                  10
+
+/* With async TX enabled, drop chars instead of waiting for ring space */
+#ifndef UART_DM_TX_DROP_WHEN_FULL
+#define UART_DM_TX_DROP_WHEN_FULL            0
+#endif
+
+struct uart_dm_tx_stats {
+	uint32_t queued;        /* chars accepted into the TX rings */
+	uint32_t sent;          /* chars written to the TX FIFOs */
+	uint32_t dropped;       /* chars dropped because a ring was full */
+	uint32_t blocked;       /* uart_putc() calls that waited for ring space */
+	uint64_t blocked_us;    /* total time spent waiting for ring space */
+	uint32_t max_level;     /* highest ring fill level seen */
+};
+
 void uart_dm_init(uint8_t id,
 				  uint32_t gsbi_base,
 				  uint32_t uart_dm_base);
+void uart_dm_tx_async_enable(void);
+void uart_dm_tx_async_disable(void);
+void uart_dm_tx_get_stats(struct uart_dm_tx_stats *stats);
+void uart_dm_tx_reset_stats(void);
+void uart_dm_tx_dump_stats(void);
 #endif				/* __UART_DM_H__ */
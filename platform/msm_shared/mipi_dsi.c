@@ -40,6 +40,7 @@
 #include <platform/timer.h>
 #include <err.h>
 #include <msm_panel.h>
+#include <platform.h>
 
 extern void mdp_disable(void);
 extern int mipi_dsi_cmd_config(struct fbcon_config mipi_fb_cfg,
@@ -110,29 +111,40 @@ struct mipi_dsi_panel_config *get_panel_info(void)
 	return NULL;
 }
 
+#define DSI_CMD_DMA_DONE	0x00000001
+#define DSI_CMD_DMA_TIMEOUT_US	10000
+
+/* gap after a command that does not ask for a wait of its own */
+#define DSI_CMD_GAP_US		80
+
+/* Wait for the command DMA done status, and acknowledge it */
+static int dsi_cmd_dma_wait_done(void)
+{
+	bigtime_t deadline;
+
+	deadline = current_time_hires() + DSI_CMD_DMA_TIMEOUT_US;
+	while (!(readl(DSI_INT_CTRL) & DSI_CMD_DMA_DONE)) {
+		if (current_time_hires() > deadline) {
+			dprintf(CRITICAL, "Panel CMD: command mode dma timed out\n");
+			return FAIL;
+		}
+	}
+
+	writel((readl(DSI_INT_CTRL) | 0x01000001), DSI_INT_CTRL);
+	return 0;
+}
+
 int dsi_cmd_dma_trigger_for_panel()
 {
-	unsigned long ReadValue;
-	unsigned long count = 0;
-	int status = 0;
+	int status;
 
 	writel(0x03030303, DSI_INT_CTRL);
 	writel(0x1, DSI_CMD_MODE_DMA_SW_TRIGGER);
 	dsb();
-	ReadValue = readl(DSI_INT_CTRL) & 0x00000001;
-	while (ReadValue != 0x00000001) {
-		ReadValue = readl(DSI_INT_CTRL) & 0x00000001;
-		count++;
-		if (count > 0xffff) {
-			status = FAIL;
-			dprintf(CRITICAL,
-				"Panel CMD: command mode dma test failed\n");
-			return status;
-		}
-	}
 
-	writel((readl(DSI_INT_CTRL) | 0x01000001), DSI_INT_CTRL);
-	dprintf(SPEW, "Panel CMD: command mode dma tested successfully\n");
+	status = dsi_cmd_dma_wait_done();
+	if (!status)
+		dprintf(SPEW, "Panel CMD: command mode dma tested successfully\n");
 	return status;
 }
 
@@ -158,7 +170,10 @@ int mipi_dsi_cmds_tx(struct mipi_dsi_cmd *cmds, int count)
 		writel(cm->size, DSI_DMA_CMD_LENGTH);	// reg 0x48 for this build
 		dsb();
 		ret += dsi_cmd_dma_trigger_for_panel();
-		udelay(80);
+		if (cm->wait)
+			mdelay(cm->wait);
+		else
+			udelay(DSI_CMD_GAP_US);
 		cm++;
 	}
 	return ret;
@@ -297,10 +312,17 @@ int mipi_dsi_panel_initialize(struct mipi_dsi_panel_config *pinfo)
 	       | PACK_TYPE1 << 24 | VC1 << 22 | DT1 << 16 | WC1,
 	       DSI_COMMAND_MODE_DMA_CTRL);
 
-	if (pinfo->panel_cmds)
+	if (pinfo->panel_cmds) {
+		bigtime_t start = current_time_hires();
+
 		status = mipi_dsi_cmds_tx(pinfo->panel_cmds,
 					  pinfo->num_of_panel_cmds);
 
+		dprintf(INFO, "Panel CMD: %d init commands in %u us\n",
+			pinfo->num_of_panel_cmds,
+			(uint32_t)(current_time_hires() - start));
+	}
+
 	return status;
 }
 
@@ -0,0 +1,141 @@
+/* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <string.h>
+#include <stdlib.h>
+#include <arch/defines.h>
+#include <lib/bio.h>
+#include <mmc.h>
+#include <storage_bio.h>
+
+#if WITH_LIB_BIO
+
+#define MMC_BIO_BLOCK_SIZE	512
+#define MMC_BIO_BOUNCE_SIZE	(16 * 1024)
+
+/* used when a caller's buffer isn't safe to hand to the controller's dma */
+BUF_DMA_ALIGN(mmc_bio_bounce, MMC_BIO_BOUNCE_SIZE);
+
+static bdev_t mmc_bdev;
+
+static ssize_t mmc_bio_read_block(struct bdev *dev, void *_buf, bnum_t block, uint count)
+{
+	uint8_t *buf = _buf;
+	uint64_t addr = (uint64_t)block * dev->block_size;
+	size_t len = count * dev->block_size;
+	size_t chunk;
+
+	if (IS_CACHE_LINE_ALIGNED(buf)) {
+		if (mmc_read(addr, (void *)buf, len))
+			return ERR_IO;
+		return len;
+	}
+
+	while (len > 0) {
+		chunk = MIN(len, MMC_BIO_BOUNCE_SIZE);
+		if (mmc_read(addr, (void *)mmc_bio_bounce, chunk))
+			return ERR_IO;
+		memcpy(buf, mmc_bio_bounce, chunk);
+
+		addr += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return count * dev->block_size;
+}
+
+static ssize_t mmc_bio_write_block(struct bdev *dev, const void *_buf, bnum_t block, uint count)
+{
+	const uint8_t *buf = _buf;
+	uint64_t addr = (uint64_t)block * dev->block_size;
+	size_t len = count * dev->block_size;
+	size_t chunk;
+
+	if (IS_CACHE_LINE_ALIGNED(buf)) {
+		if (mmc_write(addr, len, (void *)buf))
+			return ERR_IO;
+		return len;
+	}
+
+	while (len > 0) {
+		chunk = MIN(len, MMC_BIO_BOUNCE_SIZE);
+		memcpy(mmc_bio_bounce, buf, chunk);
+		if (mmc_write(addr, chunk, (void *)mmc_bio_bounce))
+			return ERR_IO;
+
+		addr += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return count * dev->block_size;
+}
+
+static ssize_t mmc_bio_erase(struct bdev *dev, off_t offset, size_t len)
+{
+	if ((offset % dev->block_size) || (len % dev->block_size))
+		return ERR_INVALID_ARGS;
+
+	if (mmc_erase_card(offset, len))
+		return ERR_IO;
+
+	return len;
+}
+
+int mmc_bio_register(void)
+{
+	uint64_t capacity = mmc_get_device_capacity();
+	bdev_t *dev;
+
+	/* already done, e.g. after a partition table rewrite */
+	dev = bio_open(MMC_BDEV_NAME);
+	if (dev) {
+		bio_close(dev);
+		return 0;
+	}
+
+	if (capacity == 0)
+		return ERR_NOT_READY;
+
+	bio_initialize_bdev(&mmc_bdev, MMC_BDEV_NAME, MMC_BIO_BLOCK_SIZE,
+			capacity / MMC_BIO_BLOCK_SIZE);
+	mmc_bdev.read_block = mmc_bio_read_block;
+	mmc_bdev.write_block = mmc_bio_write_block;
+	mmc_bdev.erase = mmc_bio_erase;
+
+	/* the device is static, hold a ref so it is never freed */
+	bio_register_device(&mmc_bdev);
+	bio_open(MMC_BDEV_NAME);
+
+	return 0;
+}
+
+#endif
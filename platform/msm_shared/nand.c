@@ -33,6 +33,9 @@
 #include <dev/flash.h>
 #include <lib/ptable.h>
 #include <nand.h>
+#if WITH_LIB_BIO
+#include <storage_bio.h>
+#endif
 
 #include "dmov.h"
 
@@ -3359,6 +3362,9 @@ void flash_set_ptable(struct ptable *new_ptable)
 {
 	ASSERT(flash_ptable == NULL && new_ptable != NULL);
 	flash_ptable = new_ptable;
+#if WITH_LIB_BIO
+	flash_bio_publish(flash_ptable);
+#endif
 }
 
 struct flash_info *flash_get_info(void)
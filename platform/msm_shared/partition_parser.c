@@ -30,6 +30,10 @@
 #include <string.h>
 #include "mmc.h"
 #include "partition_parser.h"
+#if WITH_LIB_BIO
+#include <lib/bio.h>
+#include "storage_bio.h"
+#endif
 
 static uint32_t mmc_boot_read_gpt();
 static uint32_t mmc_boot_read_mbr();
@@ -81,9 +85,66 @@ unsigned int partition_read_table()
 			return 1;
 		}
 	}
+
+#if WITH_LIB_BIO
+	partition_publish_bio();
+#endif
 	return 0;
 }
 
+#if WITH_LIB_BIO
+/* names of the subdevices we have published, so a rewritten table can replace them */
+static char bio_published[NUM_PARTITIONS][MAX_GPT_NAME_SIZE];
+
+int partition_publish_bio()
+{
+	unsigned i;
+	int count = 0;
+	bdev_t *dev;
+	const char *name;
+
+	if (mmc_bio_register())
+		return -1;
+
+	for (i = 0; i < NUM_PARTITIONS; i++) {
+		if (!bio_published[i][0])
+			continue;
+
+		dev = bio_open(bio_published[i]);
+		if (dev) {
+			bio_unregister_device(dev);
+			bio_close(dev);
+		}
+		bio_published[i][0] = 0;
+	}
+
+	for (i = 0; i < partition_count; i++) {
+		name = (const char *)partition_entries[i].name;
+		if (!name[0] || !partition_entries[i].size)
+			continue;
+
+		/* the first of several same named mbr entries wins, as with partition_get_index */
+		dev = bio_open(name);
+		if (dev) {
+			bio_close(dev);
+			continue;
+		}
+
+		if (bio_publish_subdevice(MMC_BDEV_NAME, name, partition_entries[i].first_lba,
+					  partition_entries[i].size) < 0) {
+			dprintf(CRITICAL, "Failed to publish partition %s\n", name);
+			continue;
+		}
+
+		strlcpy(bio_published[i], name, MAX_GPT_NAME_SIZE);
+		count++;
+	}
+
+	dprintf(SPEW, "Published %d partitions on %s\n", count, MMC_BDEV_NAME);
+	return count;
+}
+#endif
+
 /*
  * Read MBR from MMC card and fill partition table.
  */
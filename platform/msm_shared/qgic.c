@@ -33,13 +33,54 @@
 
 #include <reg.h>
 #include <debug.h>
+#include <string.h>
 #include <arch/arm.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
 #include <platform/irqs.h>
 #include <qgic.h>
 
 static struct ihandler handler[NR_IRQS];
 
+static struct qgic_stats qgic_stats;
+static struct qgic_irq_stats irq_stats[NR_IRQS];
+static uint32_t qgic_num_irq;
+
+/* Raise the sources a boot waits on above the rest. */
+static void qgic_class_priorities(void)
+{
+#ifdef INT_DEBUG_TIMER_EXP
+	qgic_set_priority(INT_DEBUG_TIMER_EXP, QGIC_PRIO_TIMER);
+#endif
+#ifdef INT_QTMR_NON_SECURE_PHY_TIMER_EXP
+	qgic_set_priority(INT_QTMR_NON_SECURE_PHY_TIMER_EXP, QGIC_PRIO_TIMER);
+#endif
+#ifdef INT_QTMR_FRM_0_PHYSICAL_TIMER_EXP
+	qgic_set_priority(INT_QTMR_FRM_0_PHYSICAL_TIMER_EXP, QGIC_PRIO_TIMER);
+#endif
+#ifdef INT_USB_HS
+	qgic_set_priority(INT_USB_HS, QGIC_PRIO_USB);
+#endif
+#ifdef USB1_HS_BAM_IRQ
+	qgic_set_priority(USB1_HS_BAM_IRQ, QGIC_PRIO_USB);
+#endif
+#ifdef SDCC1_IRQ
+	qgic_set_priority(SDCC1_IRQ, QGIC_PRIO_SDHCI);
+#endif
+#ifdef SDCC_PWRCTRL_IRQ
+	qgic_set_priority(SDCC_PWRCTRL_IRQ, QGIC_PRIO_SDHCI);
+#endif
+#ifdef SDCC2_IRQ
+	qgic_set_priority(SDCC2_IRQ, QGIC_PRIO_SDHCI);
+#endif
+#ifdef SDCC2_PWRCTRL_IRQ
+	qgic_set_priority(SDCC2_PWRCTRL_IRQ, QGIC_PRIO_SDHCI);
+#endif
+#ifdef MDSS_IRQ
+	qgic_set_priority(MDSS_IRQ, QGIC_PRIO_DISPLAY);
+#endif
+}
+
 /* Intialize distributor */
 static void qgic_dist_init(void)
 {
@@ -58,6 +99,7 @@ static void qgic_dist_init(void)
 	 */
 	num_irq = readl(GIC_DIST_CTR) & 0x1f;
 	num_irq = (num_irq + 1) * 32;
+	qgic_num_irq = num_irq;
 
 	/* Set each interrupt line to use N-N software model
 	 * and edge sensitive, active high
@@ -71,15 +113,12 @@ static void qgic_dist_init(void)
 	for (i = 32; i < num_irq; i += 4)
 		writel(cpumask, GIC_DIST_TARGET + i * 4 / 4);
 
-	/* Set priority of all interrupts */
-
-	/*
-	 * In bootloader we dont care about priority so
-	 * setting up equal priorities for all
-	 */
+	/* Set priority of all interrupts, then raise the urgent classes */
 	for (i = 0; i < num_irq; i += 4)
 		writel(0xa0a0a0a0, GIC_DIST_PRI + i * 4 / 4);
 
+	qgic_class_priorities();
+
 	/* Disabling interrupts */
 	for (i = 0; i < num_irq; i += 32)
 		writel(0xffffffff, GIC_DIST_ENABLE_CLEAR + i * 4 / 32);
@@ -104,18 +143,91 @@ void qgic_init(void)
 	qgic_cpu_init();
 }
 
-/* IRQ handler */
+/* Set the priority of one interrupt, lower is more urgent */
+void qgic_set_priority(unsigned int vector, uint8_t prio)
+{
+	uint32_t reg = GIC_DIST_PRI + (vector & ~3);
+	uint32_t shift = (vector & 3) * 8;
+	uint32_t val;
+
+	if (vector >= qgic_num_irq)
+		return;
+
+	enter_critical_section();
+	val = readl(reg);
+	val &= ~(0xff << shift);
+	val |= prio << shift;
+	writel(val, reg);
+	exit_critical_section();
+}
+
+static void qgic_account(unsigned int num, uint32_t cycles)
+{
+	struct qgic_irq_stats *st = &irq_stats[num];
+	uint32_t bucket = 0;
+	uint32_t c = cycles >> 8;
+
+	while (c && bucket < QGIC_HIST_BUCKETS - 1) {
+		c >>= 2;
+		bucket++;
+	}
+
+	st->count++;
+	st->total_cycles += cycles;
+	if (cycles > st->max_cycles)
+		st->max_cycles = cycles;
+	st->hist[bucket]++;
+}
+
+/*
+ * IRQ handler. Keeps acknowledging until nothing is pending, so a burst
+ * costs one exception entry; the GIC hands out the most urgent first.
+ */
 enum handler_return gic_platform_irq(struct arm_iframe *frame)
 {
+	uint32_t iar;
 	uint32_t num;
-	enum handler_return ret;
+	uint32_t start;
+	uint32_t drained = 0;
+	enum handler_return ret = INT_NO_RESCHEDULE;
 
-	num = readl(GIC_CPU_INTACK);
-	if (num > NR_IRQS)
-		return 0;
+	qgic_stats.entries++;
+
+	while (drained < QGIC_MAX_DRAIN) {
+		iar = readl(GIC_CPU_INTACK);
+		num = iar & 0x3ff;
+
+		if (num == GIC_SPURIOUS_IRQ)
+			break;
 
-	ret = handler[num].func(handler[num].arg);
-	writel(num, GIC_CPU_EOI);
+		if (num >= NR_IRQS) {
+			writel(iar, GIC_CPU_EOI);
+			break;
+		}
+
+		drained++;
+
+		if (!handler[num].func) {
+			writel(1 << (num & 31),
+			       GIC_DIST_ENABLE_CLEAR + (num / 32) * 4);
+			writel(iar, GIC_CPU_EOI);
+			qgic_stats.unhandled++;
+			continue;
+		}
+
+		start = arch_cycle_count();
+		if (handler[num].func(handler[num].arg) == INT_RESCHEDULE)
+			ret = INT_RESCHEDULE;
+		qgic_account(num, arch_cycle_count() - start);
+
+		writel(iar, GIC_CPU_EOI);
+	}
+
+	if (!drained)
+		qgic_stats.spurious++;
+	qgic_stats.serviced += drained;
+	if (drained > qgic_stats.max_drained)
+		qgic_stats.max_drained = drained;
 
 	return ret;
 }
@@ -158,3 +270,74 @@ void gic_register_int_handler(unsigned int vector, int_handler func, void *arg)
 	handler[vector].arg = arg;
 	exit_critical_section();
 }
+
+void qgic_get_stats(struct qgic_stats *stats)
+{
+	enter_critical_section();
+	*stats = qgic_stats;
+	exit_critical_section();
+}
+
+void qgic_get_irq_stats(unsigned int vector, struct qgic_irq_stats *stats)
+{
+	ASSERT(vector < NR_IRQS);
+
+	enter_critical_section();
+	*stats = irq_stats[vector];
+	exit_critical_section();
+}
+
+void qgic_reset_stats(void)
+{
+	enter_critical_section();
+	memset(&qgic_stats, 0, sizeof(qgic_stats));
+	memset(irq_stats, 0, sizeof(irq_stats));
+	exit_critical_section();
+}
+
+void qgic_dump_stats(void)
+{
+	struct qgic_irq_stats st;
+	unsigned int i, b;
+
+	dprintf(INFO, "qgic: %u entries, %u serviced, max %u per entry, "
+		"%u spurious, %u unhandled\n",
+		qgic_stats.entries, qgic_stats.serviced, qgic_stats.max_drained,
+		qgic_stats.spurious, qgic_stats.unhandled);
+
+	for (i = 0; i < NR_IRQS; i++) {
+		qgic_get_irq_stats(i, &st);
+		if (!st.count)
+			continue;
+
+		dprintf(INFO, "irq %3u: %u, avg %llu max %u cycles, hist",
+			i, st.count, st.total_cycles / st.count, st.max_cycles);
+		for (b = 0; b < QGIC_HIST_BUCKETS; b++)
+			dprintf(INFO, " %u", st.hist[b]);
+		dprintf(INFO, "\n");
+	}
+}
+
+#if WITH_LIB_CONSOLE
+
+#include <lib/console.h>
+
+static int cmd_qgic(int argc, const cmd_args *argv);
+
+STATIC_COMMAND_START
+	{ "qgic", "interrupt counts and handler cycle histograms [reset]", &cmd_qgic },
+STATIC_COMMAND_END(qgic);
+
+static int cmd_qgic(int argc, const cmd_args *argv)
+{
+	if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+		qgic_reset_stats();
+		return 0;
+	}
+
+	qgic_dump_stats();
+
+	return 0;
+}
+
+#endif
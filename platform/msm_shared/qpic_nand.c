@@ -30,6 +30,9 @@
 #include <bam.h>
 #include <dev/flash.h>
 #include <lib/ptable.h>
+#if WITH_LIB_BIO
+#include <storage_bio.h>
+#endif
 #include <debug.h>
 #include <string.h>
 #include <malloc.h>
@@ -1328,6 +1331,9 @@ flash_set_ptable(struct ptable *new_ptable)
 {
 	ASSERT(flash_ptable == NULL && new_ptable != NULL);
 	flash_ptable = new_ptable;
+#if WITH_LIB_BIO
+	flash_bio_publish(flash_ptable);
+#endif
 }
 
 /* Note: No support for raw reads. */
@@ -107,10 +107,14 @@ void udelay(unsigned usecs)
 	delay(ticks);
 }
 
-/* Return current time in micro seconds */
+/* Return current time in micro seconds, from the free running counter so
+ * it advances with interrupts off and resolves below the tick.
+ */
 bigtime_t current_time_hires(void)
 {
-	return qtimer_current_time() * 1000000ULL;
+	uint32_t freq = ticks_per_sec ? ticks_per_sec : qtimer_get_frequency();
+
+	return (qtimer_get_phy_timer_cnt() * 1000000ULL) / freq;
 }
 
 void qtimer_init()
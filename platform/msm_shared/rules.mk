@@ -13,7 +13,8 @@ OBJS += \
 	$(LOCAL_DIR)/hsusb.o \
 	$(LOCAL_DIR)/jtag_hook.o \
 	$(LOCAL_DIR)/jtag.o \
-	$(LOCAL_DIR)/partition_parser.o
+	$(LOCAL_DIR)/partition_parser.o \
+	$(LOCAL_DIR)/mmc_bio.o
 
 ifeq ($(ENABLE_SDHCI_SUPPORT),1)
 OBJS += \
@@ -42,6 +43,9 @@ ifeq ($(PLATFORM),msm8x60)
 			$(LOCAL_DIR)/interrupts.o \
 			$(LOCAL_DIR)/timer.o \
 			$(LOCAL_DIR)/nand.o
+ifeq ($(MMC_BOOT_ADM),1)
+	OBJS += $(LOCAL_DIR)/adm.o
+endif
 endif
 
 ifeq ($(PLATFORM),msm8960)
@@ -201,3 +205,7 @@ ifeq ($(PLATFORM),mdm9x25)
 			$(LOCAL_DIR)/clock_pll.o \
 			$(LOCAL_DIR)/clock_lib2.o
 endif
+
+ifneq ($(filter %nand.o,$(OBJS)),)
+	OBJS += $(LOCAL_DIR)/flash_bio.o
+endif
@@ -29,7 +29,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
+#include <debug.h>
+#include <platform.h>
 #include <arch/ops.h>
+#include <kernel/thread.h>
 #include "scm.h"
 
 #pragma GCC optimize ("O0")
@@ -41,42 +44,6 @@
 #  define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
 #endif
 
-/**
- * alloc_scm_command() - Allocate an SCM command
- * @cmd_size: size of the command buffer
- * @resp_size: size of the response buffer
- *
- * Allocate an SCM command, including enough room for the command
- * and response headers as well as the command and response buffers.
- *
- * Returns a valid &scm_command on success or %NULL if the allocation fails.
- */
-static struct scm_command *alloc_scm_command(size_t cmd_size, size_t resp_size)
-{
-	struct scm_command *cmd;
-	size_t len = sizeof(*cmd) + sizeof(struct scm_response) + cmd_size +
-	    resp_size;
-
-	cmd = memalign(CACHE_LINE, ROUNDUP(len, CACHE_LINE));
-	if (cmd) {
-		cmd->len = len;
-		cmd->buf_offset = offsetof(struct scm_command, buf);
-		cmd->resp_hdr_offset = cmd->buf_offset + cmd_size;
-	}
-	return cmd;
-}
-
-/**
- * free_scm_command() - Free an SCM command
- * @cmd: command to free
- *
- * Free an SCM command.
- */
-static inline void free_scm_command(struct scm_command *cmd)
-{
-	free(cmd);
-}
-
 /**
  * scm_command_to_response() - Get a pointer to a scm_response
  * @cmd: command
@@ -121,6 +88,278 @@ static uint32_t smc(uint32_t cmd_addr)
 	return r0;
 }
 
+static scm_monitor_t scm_monitor = smc;
+static struct scm_stats scm_stats;
+
+/* Commands of a batch are laid out back to back, each on its own cache
+ * line, so a single cache pass covers all of them. Batches that fit are
+ * built here rather than in a fresh allocation; one batch at a time owns
+ * it, claimed and released inside a critical section.
+ */
+static uint8_t scm_cmd_area[SCM_CMD_AREA_SIZE] __ALIGNED(CACHE_LINE);
+static bool scm_cmd_area_busy;
+
+/**
+ * scm_set_monitor() - Route SCM commands to a different secure monitor
+ * @monitor: function called with the address of each command, or %NULL
+ *           to go back to the real SMC
+ *
+ * Lets the SCM layer run without TrustZone, e.g. against
+ * scm_stub_monitor() in an emulator or a test.
+ */
+void scm_set_monitor(scm_monitor_t monitor)
+{
+	scm_monitor = monitor ? monitor : smc;
+}
+
+/**
+ * scm_stub_monitor() - Secure monitor that completes every command
+ * @cmd_addr: address of the command
+ *
+ * Marks the response complete with a zeroed response buffer and reports
+ * success. Nothing is executed.
+ */
+uint32_t scm_stub_monitor(uint32_t cmd_addr)
+{
+	struct scm_command *cmd = (struct scm_command *) cmd_addr;
+	struct scm_response *rsp = scm_command_to_response(cmd);
+
+	rsp->len = cmd->len - cmd->resp_hdr_offset;
+	rsp->buf_offset = sizeof(*rsp);
+	memset(scm_get_response_buffer(rsp), 0, rsp->len - rsp->buf_offset);
+	rsp->is_complete = 1;
+
+	/* TZ works on main memory */
+	arch_clean_invalidate_cache_range((addr_t) cmd, cmd->len);
+
+	return 0;
+}
+
+void scm_batch_init(struct scm_batch *batch)
+{
+	memset(batch, 0, sizeof(*batch));
+}
+
+/**
+ * scm_batch_add() - Queue an SCM command
+ * @batch: batch to add to
+ * @svc_id, @cmd_id, @cmd_buf, @cmd_len, @resp_buf, @resp_len: as for scm_call()
+ *
+ * The command buffer is copied when the batch is submitted, the response
+ * is copied to @resp_buf once the command completes.
+ */
+int scm_batch_add(struct scm_batch *batch, uint32_t svc_id, uint32_t cmd_id,
+		  const void *cmd_buf, size_t cmd_len, void *resp_buf,
+		  size_t resp_len)
+{
+	struct scm_batch_cmd *c;
+
+	if (batch->num_cmds >= SCM_BATCH_MAX_CMDS)
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	c = &batch->cmds[batch->num_cmds++];
+	c->svc_id = svc_id;
+	c->cmd_id = cmd_id;
+	c->cmd_buf = cmd_buf;
+	c->cmd_len = cmd_len;
+	c->resp_buf = resp_buf;
+	c->resp_len = resp_len;
+
+	return 0;
+}
+
+/**
+ * scm_batch_add_range() - Add a buffer TZ reads or writes directly
+ * @batch: batch to add to
+ * @buf: start of the buffer
+ * @len: length of the buffer
+ *
+ * The buffer is cleaned once before the first command and invalidated
+ * once after the last one. Ranges that share cache lines
+ * with one already in the batch are merged into it.
+ */
+int scm_batch_add_range(struct scm_batch *batch, void *buf, size_t len)
+{
+	addr_t start = ROUNDDOWN((addr_t) buf, CACHE_LINE);
+	addr_t end = ROUNDUP((addr_t) buf + len, CACHE_LINE);
+	struct scm_batch_range *r;
+	unsigned int i;
+
+	if (!len)
+		return 0;
+
+	for (i = 0; i < batch->num_ranges; i++) {
+		r = &batch->ranges[i];
+		if (start <= r->end && end >= r->start) {
+			r->start = MIN(r->start, start);
+			r->end = MAX(r->end, end);
+			return 0;
+		}
+	}
+
+	if (batch->num_ranges >= SCM_BATCH_MAX_RANGES)
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	r = &batch->ranges[batch->num_ranges++];
+	r->start = start;
+	r->end = end;
+
+	return 0;
+}
+
+/* Lays out the batch in @area, or only sizes it if @area is NULL */
+static size_t scm_batch_layout(const struct scm_batch *batch, uint8_t *area)
+{
+	const struct scm_batch_cmd *c;
+	struct scm_command *cmd;
+	struct scm_response *rsp;
+	size_t off = 0, len;
+	unsigned int i;
+
+	for (i = 0; i < batch->num_cmds; i++) {
+		c = &batch->cmds[i];
+		len = sizeof(*cmd) + sizeof(*rsp) + c->cmd_len + c->resp_len;
+
+		if (area) {
+			cmd = (struct scm_command *) (area + off);
+			cmd->len = len;
+			cmd->buf_offset = offsetof(struct scm_command, buf);
+			cmd->resp_hdr_offset = cmd->buf_offset + c->cmd_len;
+			cmd->id = (c->svc_id << 10) | c->cmd_id;
+			if (c->cmd_buf)
+				memcpy(scm_get_command_buffer(cmd), c->cmd_buf,
+				       c->cmd_len);
+
+			rsp = scm_command_to_response(cmd);
+			rsp->is_complete = 0;
+		}
+
+		off += ROUNDUP(len, CACHE_LINE);
+	}
+
+	return off;
+}
+
+static void scm_stats_record(bigtime_t us)
+{
+	unsigned int bucket = 0;
+
+	while (bucket < SCM_LAT_BUCKETS - 1 && us >= (1ULL << bucket))
+		bucket++;
+
+	scm_stats.calls++;
+	scm_stats.total_us += us;
+	scm_stats.lat_hist[bucket]++;
+}
+
+/**
+ * scm_batch_submit() - Send the commands of a batch
+ * @batch: batch to send
+ *
+ * Commands are sent to the secure monitor one after the other, in the
+ * order they were added; the legacy SCM interface takes one command per
+ * SMC. Cache maintenance for the command area and the batch's ranges is
+ * done once for the whole batch. Stops at the first failing command;
+ * @batch->completed says how many commands ran.
+ */
+int scm_batch_submit(struct scm_batch *batch)
+{
+	struct scm_batch_cmd *c;
+	struct scm_command *cmd;
+	struct scm_response *rsp;
+	uint8_t *area;
+	size_t size, off;
+	bigtime_t start;
+	unsigned int i;
+	int ret = 0;
+
+	batch->completed = 0;
+	if (!batch->num_cmds)
+		return 0;
+
+	size = scm_batch_layout(batch, NULL);
+	area = NULL;
+	enter_critical_section();
+	if (!scm_cmd_area_busy && size <= sizeof(scm_cmd_area)) {
+		area = scm_cmd_area;
+		scm_cmd_area_busy = true;
+	}
+	exit_critical_section();
+
+	if (!area) {
+		area = memalign(CACHE_LINE, size);
+		if (!area)
+			return ERR_NO_MEMORY;
+	}
+
+	scm_batch_layout(batch, area);
+
+	/* Flush commands and shared buffers to main memory for TZ */
+	arch_clean_invalidate_cache_range((addr_t) area, size);
+	for (i = 0; i < batch->num_ranges; i++)
+		arch_clean_invalidate_cache_range(batch->ranges[i].start,
+			batch->ranges[i].end - batch->ranges[i].start);
+	scm_stats.cache_passes++;
+	scm_stats.batches++;
+
+	for (i = 0, off = 0; i < batch->num_cmds; i++) {
+		c = &batch->cmds[i];
+		cmd = (struct scm_command *) (area + off);
+		off += ROUNDUP(cmd->len, CACHE_LINE);
+
+		start = current_time_hires();
+		ret = scm_monitor((uint32_t) cmd);
+
+		if (!ret && c->resp_len) {
+			rsp = scm_command_to_response(cmd);
+			do
+			{
+				/* Need to invalidate before each check since TZ will update
+				 * the response complete flag in main memory.
+				 */
+				arch_invalidate_cache_range((addr_t) rsp, sizeof(*rsp));
+			} while (!rsp->is_complete);
+		}
+		scm_stats_record(current_time_hires() - start);
+
+		if (ret) {
+			scm_stats.errors++;
+			break;
+		}
+		batch->completed++;
+	}
+
+	/* Invalidate any cached response data and whatever TZ wrote to
+	 * the shared buffers. A clean here would write stale lines back
+	 * over TZ's results.
+	 */
+	arch_invalidate_cache_range((addr_t) area, size);
+	for (i = 0; i < batch->num_ranges; i++)
+		arch_invalidate_cache_range(batch->ranges[i].start,
+			batch->ranges[i].end - batch->ranges[i].start);
+
+	for (i = 0, off = 0; i < batch->completed; i++) {
+		c = &batch->cmds[i];
+		cmd = (struct scm_command *) (area + off);
+		off += ROUNDUP(cmd->len, CACHE_LINE);
+
+		if (c->resp_len && c->resp_buf) {
+			rsp = scm_command_to_response(cmd);
+			memcpy(c->resp_buf, scm_get_response_buffer(rsp),
+			       c->resp_len);
+		}
+	}
+
+	if (area == scm_cmd_area) {
+		enter_critical_section();
+		scm_cmd_area_busy = false;
+		exit_critical_section();
+	} else
+		free(area);
+
+	return ret;
+}
+
 /**
  * scm_call() - Send an SCM command
  * @svc_id: service identifier
@@ -136,49 +375,44 @@ int
 scm_call(uint32_t svc_id, uint32_t cmd_id, const void *cmd_buf,
 	 size_t cmd_len, void *resp_buf, size_t resp_len)
 {
-	int ret;
-	struct scm_command *cmd;
-	struct scm_response *rsp;
-	uint8_t *resp_ptr;
-
-	cmd = alloc_scm_command(cmd_len, resp_len);
-	if (!cmd)
-		return ERR_NO_MEMORY;
-
-	cmd->id = (svc_id << 10) | cmd_id;
-	if (cmd_buf)
-		memcpy(scm_get_command_buffer(cmd), cmd_buf, cmd_len);
-
-	/* Flush command to main memory for TZ */
-	arch_clean_invalidate_cache_range((addr_t) cmd, cmd->len);
+	struct scm_batch batch;
 
-	ret = smc((uint32_t) cmd);
-	if (ret)
-		goto out;
+	scm_batch_init(&batch);
+	scm_batch_add(&batch, svc_id, cmd_id, cmd_buf, cmd_len,
+		      resp_buf, resp_len);
 
-	if (resp_len) {
-		rsp = scm_command_to_response(cmd);
+	return scm_batch_submit(&batch);
+}
 
-		do
-		{
-			/* Need to invalidate before each check since TZ will update
-			 * the response complete flag in main memory.
-			 */
-			arch_invalidate_cache_range((addr_t) rsp, sizeof(*rsp));
-		} while (!rsp->is_complete);
+void scm_get_stats(struct scm_stats *stats)
+{
+	*stats = scm_stats;
+}
 
+void scm_reset_stats(void)
+{
+	memset(&scm_stats, 0, sizeof(scm_stats));
+}
 
-		resp_ptr = scm_get_response_buffer(rsp);
+void scm_dump_stats(void)
+{
+	unsigned int i;
 
-		/* Invalidate any cached response data */
-		arch_invalidate_cache_range((addr_t) resp_ptr, resp_len);
+	dprintf(INFO, "SCM: %u calls in %u batches (%u cache passes), "
+		"%u errors, %llu us in TZ\n",
+		scm_stats.calls, scm_stats.batches, scm_stats.cache_passes,
+		scm_stats.errors, scm_stats.total_us);
 
-		if (resp_buf)
-			memcpy(resp_buf, resp_ptr, resp_len);
+	for (i = 0; i < SCM_LAT_BUCKETS; i++) {
+		if (!scm_stats.lat_hist[i])
+			continue;
+		if (i == SCM_LAT_BUCKETS - 1)
+			dprintf(INFO, "SCM:  >= %u us: %u\n", 1U << (i - 1),
+				scm_stats.lat_hist[i]);
+		else
+			dprintf(INFO, "SCM:   < %u us: %u\n", 1U << i,
+				scm_stats.lat_hist[i]);
 	}
- out:
-	free_scm_command(cmd);
-	return ret;
 }
 
 int restore_secure_cfg(uint32_t id)
@@ -202,69 +436,64 @@ int restore_secure_cfg(uint32_t id)
 
 }
 
-/* SCM Encrypt Command */
-int encrypt_scm(uint32_t ** img_ptr, uint32_t * img_len_ptr)
+/*
+ * Runs an SSD encrypt or decrypt command on an image in place.
+ * Image data is operated upon by TZ, which accesses only the main memory,
+ * and TZ updates the values at img_ptr and img_len_ptr. All of them are
+ * flushed along with the command and invalidated once it is done.
+ */
+static int ssd_img_scm(uint32_t cmd_id, uint32_t ** img_ptr, uint32_t * img_len_ptr)
 {
-	int ret;
+	struct scm_batch batch;
+	uint32_t *orig_ptr = *img_ptr;
+	uint32_t orig_len = *img_len_ptr;
 	img_req cmd;
+	int ret;
 
 	cmd.img_ptr     = (uint32*) img_ptr;
 	cmd.img_len_ptr = img_len_ptr;
 
-	/* Image data is operated upon by TZ, which accesses only the main memory.
-	 * It must be flushed/invalidated before and after TZ call.
-	 */
-	arch_clean_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
+	scm_batch_init(&batch);
+	scm_batch_add(&batch, SCM_SVC_SSD, cmd_id, &cmd, sizeof(cmd), NULL, 0);
+	scm_batch_add_range(&batch, *img_ptr, *img_len_ptr);
+	scm_batch_add_range(&batch, img_ptr, sizeof(*img_ptr));
+	scm_batch_add_range(&batch, img_len_ptr, sizeof(*img_len_ptr));
 
-	ret = scm_call(SCM_SVC_SSD, SSD_ENCRYPT_ID, &cmd, sizeof(cmd), NULL, 0);
-
-	/* Values at img_ptr and img_len_ptr are updated by TZ. Must be invalidated
-	 * before we use them.
-	 */
-	arch_clean_invalidate_cache_range((addr_t) img_ptr, sizeof(img_ptr));
-	arch_clean_invalidate_cache_range((addr_t) img_len_ptr, sizeof(img_len_ptr));
+	ret = scm_batch_submit(&batch);
 
-	/* Invalidate the updated image data */
-	arch_clean_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
+	/* Invalidate the updated image data if TZ moved it */
+	if (*img_ptr != orig_ptr || *img_len_ptr > orig_len)
+		arch_clean_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
 
 	return ret;
 }
 
+/* SCM Encrypt Command */
+int encrypt_scm(uint32_t ** img_ptr, uint32_t * img_len_ptr)
+{
+	return ssd_img_scm(SSD_ENCRYPT_ID, img_ptr, img_len_ptr);
+}
+
 /* SCM Decrypt Command */
 int decrypt_scm(uint32_t ** img_ptr, uint32_t * img_len_ptr)
 {
-	int ret;
-	img_req cmd;
-
-	cmd.img_ptr     = (uint32*) img_ptr;
-	cmd.img_len_ptr = img_len_ptr;
-
-	/* Image data is operated upon by TZ, which accesses only the main memory.
-	 * It must be flushed/invalidated before and after TZ call.
-	 */
-	arch_clean_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
-
-	ret = scm_call(SCM_SVC_SSD, SSD_DECRYPT_ID, &cmd, sizeof(cmd), NULL, 0);
-
-	/* Values at img_ptr and img_len_ptr are updated by TZ. Must be invalidated
-	 * before we use them.
-	 */
-	arch_clean_invalidate_cache_range((addr_t) img_ptr, sizeof(img_ptr));
-	arch_clean_invalidate_cache_range((addr_t) img_len_ptr, sizeof(img_len_ptr));
-
-	/* Invalidate the updated image data */
-	arch_clean_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
-
-	return ret;
+	return ssd_img_scm(SSD_DECRYPT_ID, img_ptr, img_len_ptr);
 }
 
 
+/*
+ * Asks TZ to parse the SSD metadata at the start of the image. Each round
+ * goes through a batch, which flushes only the metadata the round newly
+ * exposes to TZ; a round depends on the previous one's status, so the
+ * rounds cannot share a submission.
+ */
 static int ssd_image_is_encrypted(uint32_t ** img_ptr, uint32_t * img_len_ptr, uint32 * ctx_id)
 {
 	int              ret     = 0;
 	ssd_parse_md_req parse_req;
 	ssd_parse_md_rsp parse_rsp;
-	int              prev_len = 0;
+	uint32           prev_len = 0;
+	struct scm_batch batch;
 
 	/* Populate meta-data ptr. Here md_len is the meta-data length.
 	 * The Code below follows a growing length approach. First send
@@ -276,16 +505,20 @@ static int ssd_image_is_encrypted(uint32_t ** img_ptr, uint32_t * img_len_ptr, u
 	parse_req.md     = (uint32*)*img_ptr;
 	parse_req.md_len = ((*img_len_ptr) >= SSD_HEADER_MIN_SIZE) ? SSD_HEADER_MIN_SIZE : (*img_len_ptr);
 
-	arch_clean_invalidate_cache_range((addr_t) *img_ptr, parse_req.md_len);
-
 	do
 	{
-		ret = scm_call(SCM_SVC_SSD,
-				SSD_PARSE_MD_ID,
-				&parse_req,
-				sizeof(parse_req),
-				&parse_rsp,
-				sizeof(parse_rsp));
+		scm_batch_init(&batch);
+		scm_batch_add(&batch,
+			      SCM_SVC_SSD,
+			      SSD_PARSE_MD_ID,
+			      &parse_req,
+			      sizeof(parse_req),
+			      &parse_rsp,
+			      sizeof(parse_rsp));
+		scm_batch_add_range(&batch, (uint8_t *) parse_req.md + prev_len,
+				    parse_req.md_len - prev_len);
+
+		ret = scm_batch_submit(&batch);
 
 		if(!ret && (parse_rsp.status == SSD_PMD_PARSING_INCOMPLETE))
 		{
@@ -293,9 +526,6 @@ static int ssd_image_is_encrypted(uint32_t ** img_ptr, uint32_t * img_len_ptr, u
 
 			parse_req.md_len *= MULTIPLICATION_FACTOR;
 
-			arch_clean_invalidate_cache_range((addr_t) *(img_ptr + prev_len),
-		                                         (parse_req.md_len - prev_len) );
-
 			continue;
 		}
 		else
@@ -329,16 +559,10 @@ int decrypt_scm_v2(uint32_t ** img_ptr, uint32_t * img_len_ptr)
 	uint32                   ctx_id = 0;
 	ssd_decrypt_img_frag_req decrypt_req;
 	ssd_decrypt_img_frag_rsp decrypt_rsp;
+	struct scm_batch         batch;
 
 	if(ssd_image_is_encrypted(img_ptr,img_len_ptr,&ctx_id))
 	{
-
-		/* Image data is operated upon by TZ, which accesses only the main memory.
-		 * It must be flushed/invalidated before and after TZ call.
-		 */
-
-		arch_clean_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
-
 		/*decrypt the image here*/
 
 		decrypt_req.md_ctx_id = ctx_id;
@@ -346,25 +570,27 @@ int decrypt_scm_v2(uint32_t ** img_ptr, uint32_t * img_len_ptr)
 		decrypt_req.frag_len  = *img_len_ptr;
 		decrypt_req.frag      = *img_ptr;
 
-		ret = scm_call(SCM_SVC_SSD,
-				SSD_DECRYPT_IMG_FRAG_ID,
-				&decrypt_req,
-				sizeof(decrypt_req),
-				&decrypt_rsp,
-				sizeof(decrypt_rsp));
+		/* Image data is operated upon by TZ, which accesses only the main memory.
+		 * It is flushed with the command and invalidated after the TZ call,
+		 * along with the values at img_ptr and img_len_ptr.
+		 */
+		scm_batch_init(&batch);
+		scm_batch_add(&batch,
+			      SCM_SVC_SSD,
+			      SSD_DECRYPT_IMG_FRAG_ID,
+			      &decrypt_req,
+			      sizeof(decrypt_req),
+			      &decrypt_rsp,
+			      sizeof(decrypt_rsp));
+		scm_batch_add_range(&batch, *img_ptr, *img_len_ptr);
+		scm_batch_add_range(&batch, img_ptr, sizeof(*img_ptr));
+		scm_batch_add_range(&batch, img_len_ptr, sizeof(*img_len_ptr));
+
+		ret = scm_batch_submit(&batch);
 
 		if(!ret){
 			ret = decrypt_rsp.status;
 		}
-
-		/* Values at img_ptr and img_len_ptr are updated by TZ. Must be invalidated
-		* before we use them.
-		*/
-		arch_invalidate_cache_range((addr_t) img_ptr, sizeof(img_ptr));
-		arch_invalidate_cache_range((addr_t) img_len_ptr, sizeof(img_len_ptr));
-
-		/* Invalidate the updated image data */
-		arch_invalidate_cache_range((addr_t) *img_ptr, *img_len_ptr);
 	}
 
 	return ret;
@@ -395,18 +621,22 @@ int scm_protect_keystore(uint32_t * img_ptr, uint32_t  img_len)
 	int                      ret=0;
 	ssd_protect_keystore_req protect_req;
 	ssd_protect_keystore_rsp protect_rsp;
+	struct scm_batch         batch;
 
 	protect_req.keystore_ptr = img_ptr;
 	protect_req.keystore_len = img_len;
 
-	arch_clean_invalidate_cache_range((addr_t) img_ptr, img_len);
-
-	ret = scm_call(SCM_SVC_SSD,
-		       SSD_PROTECT_KEYSTORE_ID,
-		       &protect_req,
-		       sizeof(protect_req),
-		       &protect_rsp,
-		       sizeof(protect_rsp));
+	scm_batch_init(&batch);
+	scm_batch_add(&batch,
+		      SCM_SVC_SSD,
+		      SSD_PROTECT_KEYSTORE_ID,
+		      &protect_req,
+		      sizeof(protect_req),
+		      &protect_rsp,
+		      sizeof(protect_rsp));
+	scm_batch_add_range(&batch, img_ptr, img_len);
+
+	ret = scm_batch_submit(&batch);
 	if(!ret)
 	{
 		if(protect_rsp.status == TZBSP_SSD_PKS_SUCCESS)
@@ -35,33 +35,87 @@
 
 static struct smem *smem = (void *)(MSM_SHARED_BASE);
 
-/* buf MUST be 4byte aligned, and len MUST be a multiple of 8. */
-unsigned smem_read_alloc_entry(smem_mem_type_t type, void *buf, int len)
-{
-	struct smem_alloc_info *ainfo;
-	unsigned *dest = buf;
-	unsigned src;
+/* Validated descriptors of the allocation table entries looked up so far.
+ * An entry is cached once it is seen allocated; entries that aren't
+ * allocated yet are read again on the next lookup, another processor may
+ * still allocate them.
+ */
+struct smem_index_entry {
+	unsigned offset;
 	unsigned size;
+};
 
-	if (((len & 0x3) != 0) || (((unsigned)buf & 0x3) != 0))
-		return 1;
+static struct smem_index_entry smem_index[SMEM_MAX_SIZE];
+static unsigned smem_index_valid[(SMEM_MAX_SIZE + 31) / 32];
+static unsigned smem_heap_end;
+
+static struct smem_index_entry *smem_lookup(smem_mem_type_t type)
+{
+	struct smem_alloc_info *ainfo;
+	struct smem_index_entry *entry;
+	unsigned offset, size;
 
 	if (type < SMEM_FIRST_VALID_TYPE || type > SMEM_LAST_VALID_TYPE)
-		return 1;
+		return NULL;
+
+	entry = &smem_index[type];
+	if (smem_index_valid[type / 32] & (1U << (type % 32)))
+		return entry;
 
 	/* TODO: Use smem spinlocks */
 	ainfo = &smem->alloc_info[type];
-	if (readl(&ainfo->allocated) == 0)
+	if (readl((addr_t) &ainfo->allocated) == 0)
+		return NULL;
+
+	offset = readl((addr_t) &ainfo->offset);
+	size = readl((addr_t) &ainfo->size);
+
+	/* Everything allocated lies below the heap's free offset. Other
+	 * processors keep allocating, so a stale end is refreshed before
+	 * an entry is rejected.
+	 */
+	if (offset + size > smem_heap_end &&
+	    readl((addr_t) &smem->heap_info.initialized) == 1)
+		smem_heap_end = readl((addr_t) &smem->heap_info.free_offset);
+
+	if ((offset + size < offset) ||
+	    (smem_heap_end && offset + size > smem_heap_end)) {
+		dprintf(CRITICAL, "smem: bad entry %d: offset 0x%x size 0x%x\n",
+			type, offset, size);
+		return NULL;
+	}
+
+	entry->offset = offset;
+	entry->size = size;
+	smem_index_valid[type / 32] |= 1U << (type % 32);
+
+	return entry;
+}
+
+static void smem_copy(void *buf, addr_t src, int len)
+{
+	unsigned *dest = buf;
+
+	for (; len > 0; src += 4, len -= 4)
+		*(dest++) = readl(src);
+}
+
+/* buf MUST be 4byte aligned, and len MUST be a multiple of 8. */
+unsigned smem_read_alloc_entry(smem_mem_type_t type, void *buf, int len)
+{
+	struct smem_index_entry *entry;
+
+	if (((len & 0x3) != 0) || (((unsigned)buf & 0x3) != 0))
 		return 1;
 
-	size = readl(&ainfo->size);
+	entry = smem_lookup(type);
+	if (!entry)
+		return 1;
 
-	if (size != (unsigned)((len + 7) & ~0x00000007))
+	if (entry->size != (unsigned)((len + 7) & ~0x00000007))
 		return 1;
 
-	src = MSM_SHARED_BASE + readl(&ainfo->offset);
-	for (; len > 0; src += 4, len -= 4)
-		*(dest++) = readl(src);
+	smem_copy(buf, (addr_t) smem + entry->offset, len);
 
 	return 0;
 }
@@ -70,24 +124,38 @@ unsigned
 smem_read_alloc_entry_offset(smem_mem_type_t type, void *buf, int len,
 			     int offset)
 {
-	struct smem_alloc_info *ainfo;
-	unsigned *dest = buf;
-	unsigned src;
-	unsigned size = len;
+	struct smem_index_entry *entry;
 
 	if (((len & 0x3) != 0) || (((unsigned)buf & 0x3) != 0))
 		return 1;
 
-	if (type < SMEM_FIRST_VALID_TYPE || type > SMEM_LAST_VALID_TYPE)
+	entry = smem_lookup(type);
+	if (!entry)
 		return 1;
 
-	ainfo = &smem->alloc_info[type];
-	if (readl(&ainfo->allocated) == 0)
+	if (offset < 0 || (unsigned)(offset + len) > entry->size)
 		return 1;
 
-	src = MSM_SHARED_BASE + readl(&ainfo->offset) + offset;
-	for (; size > 0; src += 4, size -= 4)
-		*(dest++) = readl(src);
+	smem_copy(buf, (addr_t) smem + entry->offset + offset, len);
 
 	return 0;
 }
+
+/* Returns a pointer to an allocated item in shared memory and its size,
+ * without copying it. The item stays uncached device memory: use this for
+ * items that are only read, and read them a naturally aligned word at a
+ * time.
+ */
+void *smem_get_alloc_entry(smem_mem_type_t type, unsigned *size)
+{
+	struct smem_index_entry *entry;
+
+	entry = smem_lookup(type);
+	if (!entry)
+		return NULL;
+
+	if (size)
+		*size = entry->size;
+
+	return (void *)((addr_t) smem + entry->offset);
+}
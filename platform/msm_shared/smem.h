@@ -466,6 +466,7 @@ struct smem_ptable {
 } __attribute__ ((__packed__));
 
 unsigned smem_read_alloc_entry_offset(smem_mem_type_t type, void *buf, int len, int offset);
+void *smem_get_alloc_entry(smem_mem_type_t type, unsigned *size);
 int smem_ram_ptable_init(struct smem_ram_ptable *smem_ram_ptable);
 
 #endif				/* __PLATFORM_MSM_SHARED_SMEM_H */
@@ -28,7 +28,9 @@
 
 #include <debug.h>
 #include <reg.h>
+#include <string.h>
 #include <spmi.h>
+#include <platform.h>
 #include <platform/iomap.h>
 #include <platform/irqs.h>
 #include <platform/interrupts.h>
@@ -38,6 +40,13 @@ static uint32_t pmic_arb_owner_id;
 static uint8_t pmic_irq_perph_id;
 static spmi_callback callback;
 
+/* a posted write is still in flight on our channel */
+static uint8_t pmic_arb_pending;
+/* first error seen on a posted write since the last pmic_arb_sync() */
+static uint32_t pmic_arb_posted_error;
+
+static struct spmi_stats spmi_stats;
+
 /* Function to initialize SPMI controller.
  * chnl_num : Channel number to be used by this EE.
  */
@@ -68,39 +77,86 @@ static void write_wdata_from_array(uint8_t *array,
 	writel(val, PMIC_ARB_CHNLn_WDATA(pmic_arb_chnl_num, reg_num));
 }
 
+static uint32_t pmic_arb_cmd_word(struct pmic_arb_cmd *cmd)
+{
+	uint32_t val = 0;
 
-/* Initiate a write cmd by writing to cmd register.
- * Commands are written according to cmd parameters
- * cmd->opcode   : SPMI opcode for the command
- * cmd->priority : Priority of the command
- *                 High priority : 1
- *                 Low Priority : 0
- * cmd->address  : SPMI Peripheral Address.
- * cmd->offset   : Offset Address for the command.
- * cmd->bytecnt  : Number of bytes to be written.
- *
- * param is the parameter to the command
- * param->buffer : Value to be written
- * param->size   : Size of the buffer.
- *
- * return value : 0 if success, the error bit set on error
+	val |= ((uint32_t)(cmd->opcode) << PMIC_ARB_CMD_OPCODE_SHIFT);
+	val |= ((uint32_t)(cmd->priority) << PMIC_ARB_CMD_PRIORITY_SHIFT);
+	val |= ((uint32_t)(cmd->slave_id) << PMIC_ARB_CMD_SLAVE_ID_SHIFT);
+	val |= ((uint32_t)(cmd->address) << PMIC_ARB_CMD_ADDR_SHIFT);
+	val |= ((uint32_t)(cmd->offset) << PMIC_ARB_CMD_ADDR_OFFSET_SHIFT);
+	val |= ((uint32_t)(cmd->byte_cnt));
+
+	return val;
+}
+
+/* Spin until the command on our channel completes.
+ * return value : 0 if success, the error bits otherwise
  */
-unsigned int pmic_arb_write_cmd(struct pmic_arb_cmd *cmd,
-                                struct pmic_arb_param *param)
+static uint32_t pmic_arb_wait_done()
+{
+	bigtime_t start = current_time_hires();
+	uint32_t val;
+
+	/* Wait till CMD DONE status */
+	while (!(val = readl(PMIC_ARB_CHNLn_STATUS(pmic_arb_chnl_num))));
+
+	spmi_stats.wait_us += current_time_hires() - start;
+
+	/* Check for errors */
+	return val ^ (1 << PMIC_ARB_CMD_DONE);
+}
+
+/* Wait for the posted write in flight, if any, and remember its error. */
+static void pmic_arb_drain()
 {
-	uint32_t bytes_written = 0;
 	uint32_t error;
-	uint32_t val = 0;
 
-	/* Disable IRQ mode for the current channel*/
-	writel(0x0, PMIC_ARB_CHNLn_CONFIG(pmic_arb_chnl_num));
+	if (!pmic_arb_pending)
+		return;
 
-	/* Write parameters for the cmd */
-	if (cmd == NULL)
+	pmic_arb_pending = 0;
+
+	error = pmic_arb_wait_done();
+	if (error)
 	{
-		dprintf(CRITICAL,"PMIC arbiter error, no command provided\n");
-		return 1;
+		spmi_stats.errors++;
+		dprintf(CRITICAL, "SPMI posted write failure: error = %u\n", error);
+		if (!pmic_arb_posted_error)
+			pmic_arb_posted_error = error;
 	}
+}
+
+/* Wait for all posted writes to complete.
+ * return value : 0 if every posted write since the last sync succeeded,
+ *                the error bits of the first failing one otherwise
+ */
+unsigned int pmic_arb_sync()
+{
+	uint32_t error;
+
+	pmic_arb_drain();
+
+	error = pmic_arb_posted_error;
+	pmic_arb_posted_error = 0;
+
+	return error;
+}
+
+/* Load WDATA and kick off a write, without waiting for it to finish. */
+static void pmic_arb_issue_write(struct pmic_arb_cmd *cmd,
+                                 struct pmic_arb_param *param)
+{
+	uint8_t bytes_written = 0;
+
+	/* The channel only holds one command, drain the posted one first.
+	 * Its error, if any, is kept for the next pmic_arb_sync().
+	 */
+	pmic_arb_drain();
+
+	/* Disable IRQ mode for the current channel*/
+	writel(0x0, PMIC_ARB_CHNLn_CONFIG(pmic_arb_chnl_num));
 
 	/* Write the data bytes according to the param->size
 	 * Can write upto 8 bytes.
@@ -123,23 +179,52 @@ unsigned int pmic_arb_write_cmd(struct pmic_arb_cmd *cmd,
 	cmd->opcode = SPMI_CMD_EXT_REG_WRTIE_LONG;
 
 	/* Write the command */
-	val = 0;
-	val |= ((uint32_t)(cmd->opcode) << PMIC_ARB_CMD_OPCODE_SHIFT);
-	val |= ((uint32_t)(cmd->priority) << PMIC_ARB_CMD_PRIORITY_SHIFT);
-	val |= ((uint32_t)(cmd->slave_id) << PMIC_ARB_CMD_SLAVE_ID_SHIFT);
-	val |= ((uint32_t)(cmd->address) << PMIC_ARB_CMD_ADDR_SHIFT);
-	val |= ((uint32_t)(cmd->offset) << PMIC_ARB_CMD_ADDR_OFFSET_SHIFT);
-	val |= ((uint32_t)(cmd->byte_cnt));
+	writel(pmic_arb_cmd_word(cmd), PMIC_ARB_CHNLn_CMD0(pmic_arb_chnl_num));
 
-	writel(val, PMIC_ARB_CHNLn_CMD0(pmic_arb_chnl_num));
+	spmi_stats.writes++;
+	spmi_stats.bytes_written += param->size;
+}
 
-	/* Wait till CMD DONE status */
-	while (!(val = readl(PMIC_ARB_CHNLn_STATUS(pmic_arb_chnl_num))));
+/* Initiate a write cmd by writing to cmd register.
+ * Commands are written according to cmd parameters
+ * cmd->opcode   : SPMI opcode for the command
+ * cmd->priority : Priority of the command
+ *                 High priority : 1
+ *                 Low Priority : 0
+ * cmd->address  : SPMI Peripheral Address.
+ * cmd->offset   : Offset Address for the command.
+ * cmd->bytecnt  : Number of bytes to be written.
+ *
+ * param is the parameter to the command
+ * param->buffer : Value to be written
+ * param->size   : Size of the buffer, 1 to PMIC_ARB_MAX_BURST bytes.
+ *
+ * return value : 0 if success, the error bit set on error
+ */
+unsigned int pmic_arb_write_cmd(struct pmic_arb_cmd *cmd,
+                                struct pmic_arb_param *param)
+{
+	uint32_t error;
 
-	/* Check for errors */
-	error = val ^ (1 << PMIC_ARB_CMD_DONE);
+	/* Write parameters for the cmd */
+	if (cmd == NULL)
+	{
+		dprintf(CRITICAL,"PMIC arbiter error, no command provided\n");
+		return 1;
+	}
+
+	if (!param->size || param->size > PMIC_ARB_MAX_BURST)
+	{
+		dprintf(CRITICAL, "PMIC arbiter error, invalid size %u\n", param->size);
+		return 1;
+	}
+
+	pmic_arb_issue_write(cmd, param);
+
+	error = pmic_arb_wait_done();
 	if (error)
 	{
+		spmi_stats.errors++;
 		dprintf(CRITICAL, "SPMI write command failure: \
 			cmd_id = %u, error = %u\n", cmd->opcode, error);
 		return error;
@@ -148,6 +233,34 @@ unsigned int pmic_arb_write_cmd(struct pmic_arb_cmd *cmd,
 		return 0;
 }
 
+/* Same as pmic_arb_write_cmd(), but returns as soon as the command is
+ * issued so the caller can prepare the next one while the bus is busy.
+ * The next command on the channel waits for this one; errors are
+ * reported by pmic_arb_sync(), which must be called before relying on
+ * the write having landed.
+ */
+unsigned int pmic_arb_write_cmd_posted(struct pmic_arb_cmd *cmd,
+                                       struct pmic_arb_param *param)
+{
+	if (cmd == NULL)
+	{
+		dprintf(CRITICAL,"PMIC arbiter error, no command provided\n");
+		return 1;
+	}
+
+	if (!param->size || param->size > PMIC_ARB_MAX_BURST)
+	{
+		dprintf(CRITICAL, "PMIC arbiter error, invalid size %u\n", param->size);
+		return 1;
+	}
+
+	pmic_arb_issue_write(cmd, param);
+	pmic_arb_pending = 1;
+	spmi_stats.posted++;
+
+	return 0;
+}
+
 static void read_rdata_into_array(uint8_t *array,
                                   uint8_t reg_num,
                                   uint8_t array_size,
@@ -180,18 +293,25 @@ static void read_rdata_into_array(uint8_t *array,
  *
  * param is the buffer to the save command data.
  * param->buffer : Buffer to store the bytes returned.
- * param->size   : Size of the buffer.
+ * param->size   : Size of the buffer, 1 to PMIC_ARB_MAX_BURST bytes.
  *
  * return value : 0 if success, the error bit set on error
  */
 unsigned int pmic_arb_read_cmd(struct pmic_arb_cmd *cmd,
                                struct pmic_arb_param *param)
 {
-	uint32_t val = 0;
 	uint32_t error;
-	uint32_t addr;
 	uint8_t bytes_read = 0;
 
+	if (!param->size || param->size > PMIC_ARB_MAX_BURST)
+	{
+		dprintf(CRITICAL, "PMIC arbiter error, invalid size %u\n", param->size);
+		return 1;
+	}
+
+	/* Reads must observe any write still in flight */
+	pmic_arb_drain();
+
 	/* Disable IRQ mode for the current channel*/
 	writel(0x0, PMIC_ARB_CHNLn_CONFIG(pmic_arb_chnl_num));
 
@@ -202,23 +322,14 @@ unsigned int pmic_arb_read_cmd(struct pmic_arb_cmd *cmd,
 	/* Fill in the Write cmd opcode. */
 	cmd->opcode = SPMI_CMD_EXT_REG_READ_LONG;
 
-	val |= ((uint32_t)(cmd->opcode) << PMIC_ARB_CMD_OPCODE_SHIFT);
-	val |= ((uint32_t)(cmd->priority) << PMIC_ARB_CMD_PRIORITY_SHIFT);
-	val |= ((uint32_t)(cmd->slave_id) << PMIC_ARB_CMD_SLAVE_ID_SHIFT);
-	val |= ((uint32_t)(cmd->address) << PMIC_ARB_CMD_ADDR_SHIFT);
-	val |= ((uint32_t)(cmd->offset) << PMIC_ARB_CMD_ADDR_OFFSET_SHIFT);
-	val |= ((uint32_t)(cmd->byte_cnt));
+	writel(pmic_arb_cmd_word(cmd), PMIC_ARB_CHNLn_CMD0(pmic_arb_chnl_num));
 
-	writel(val, PMIC_ARB_CHNLn_CMD0(pmic_arb_chnl_num));
-
-	/* Wait till CMD DONE status */
-	while (!(val = readl(PMIC_ARB_CHNLn_STATUS(pmic_arb_chnl_num))));
-
-	/* Check for errors */
-	error = val ^ (1 << PMIC_ARB_CMD_DONE);
+	spmi_stats.reads++;
 
+	error = pmic_arb_wait_done();
 	if (error)
 	{
+		spmi_stats.errors++;
 		dprintf(CRITICAL, "SPMI read command failure: \
 			cmd_id = %u, error = %u\n", cmd->opcode, error);
 		return error;
@@ -234,16 +345,30 @@ unsigned int pmic_arb_read_cmd(struct pmic_arb_cmd *cmd,
 
 	}
 
-	if (bytes_read < param->size)
-	{
-		/* Read the RDATA2 */
-		read_rdata_into_array(param->buffer, 2, param->size , &bytes_read);
-
-	}
+	spmi_stats.bytes_read += param->size;
 
 	return 0;
 }
 
+void spmi_get_stats(struct spmi_stats *stats)
+{
+	*stats = spmi_stats;
+}
+
+void spmi_reset_stats()
+{
+	memset(&spmi_stats, 0, sizeof(spmi_stats));
+}
+
+void spmi_dump_stats()
+{
+	dprintf(INFO, "SPMI: %u reads (%u bytes), %u writes (%u bytes, %u posted), "
+		"%u errors, %llu us waiting\n",
+		spmi_stats.reads, spmi_stats.bytes_read,
+		spmi_stats.writes, spmi_stats.bytes_written, spmi_stats.posted,
+		spmi_stats.errors, spmi_stats.wait_us);
+}
+
 
 /* Funtion to determine if the peripheral that caused the interrupt
  * is of interest.
@@ -313,5 +438,8 @@ void spmi_enable_periph_interrupts(uint8_t periph_id)
 
 void spmi_uninit()
 {
+	pmic_arb_sync();
+	spmi_dump_stats();
+
 	mask_interrupt(EE0_KRAIT_HLOS_SPMI_PERIPH_IRQ);
 }
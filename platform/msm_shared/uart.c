@@ -194,6 +194,19 @@ int uart_putc(int port, char c)
 	_uart_putc(0, c);
 }
 
+int uart_write(int port, const char *buf, size_t len)
+{
+	while (len--)
+		uart_putc(port, *buf++);
+
+	return 0;
+}
+
+/* TX is synchronous, nothing is ever left queued. */
+void uart_flush_tx(int port)
+{
+}
+
 int uart_getc(int port, bool wait)
 {
 	if (!uart_ready)
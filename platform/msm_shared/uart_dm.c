@@ -38,6 +38,11 @@
 #include <platform/gpio.h>
 #include <uart_dm.h>
 #include <gsbi.h>
+#include <string.h>
+#include <platform.h>
+#include <dev/uart.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
 
 #ifndef NULL
 #define NULL        0
@@ -51,58 +56,20 @@ static int uart_init_flag = 0;
  * This is a basic implementation of UART_DM protocol. More focus has been
  * given on simplicity than efficiency. Few of the things to be noted are:
  * - RX path may not be suitable for multi-threaded scenaraio because of the
- *   use of static variables. TX path shouldn't have any problem though. If
- *   multi-threaded support is required, a simple data-structure can
- *   be maintained for each thread.
- * - Right now we are using polling method than interrupt based.
+ *   use of static variables.
+ * - RX is polled. TX goes through a per port ring buffer which is drained
+ *   into the TX FIFO by uart_putc() and, once uart_dm_tx_async_enable() has
+ *   been called, by a periodic kernel timer. Until then, and while draining
+ *   for panic/reboot/kernel entry, TX is fully synchronous.
  * - We are using legacy UART protocol without Data Mover.
  * - Not all interrupts and error events are handled.
  * - While waiting Watchdog hasn't been taken into consideration.
  */
 
-#define NON_PRINTABLE_ASCII_CHAR      128
-
-static uint8_t pack_chars_into_words(uint8_t *buffer, uint8_t cnt, uint32_t *word)
-{
-	uint8_t num_chars_writtten = 0;
-
-	*word = 0;
-
-	 for(int j=0; j < cnt; j++)
-	 {
-		 if (buffer[num_chars_writtten] == '\n')
-		 {
-			/* replace '\n' by the NON_PRINTABLE_ASCII_CHAR and print '\r'.
-			 * While printing the NON_PRINTABLE_ASCII_CHAR, we will print '\n'.
-			 * Thus successfully replacing '\n' by '\r' '\n'.
-			 */
-			*word |= ('\r' & 0xff) << (j * 8);
-			buffer[num_chars_writtten] = NON_PRINTABLE_ASCII_CHAR;
-		 }
-		 else
-		 {
-			if (buffer[num_chars_writtten] == NON_PRINTABLE_ASCII_CHAR)
-			{
-				buffer[num_chars_writtten] = '\n';
-			}
-
-			 *word |= (buffer[num_chars_writtten] & 0xff) << (j * 8);
-
-			 num_chars_writtten++;
-		 }
-	 }
-
-	 return num_chars_writtten;
-}
-
 /* Static Function Prototype Declarations */
-static unsigned int msm_boot_uart_calculate_num_chars_to_write(char *data_in,
-							       uint32_t *num_of_chars);
 static unsigned int msm_boot_uart_dm_init(uint32_t base);
 static unsigned int msm_boot_uart_dm_read(uint32_t base,
 	unsigned int *data, int wait);
-static unsigned int msm_boot_uart_dm_write(uint32_t base, char *data,
-	unsigned int num_of_chars);
 static unsigned int msm_boot_uart_dm_init_rx_transfer(uint32_t base);
 static unsigned int msm_boot_uart_dm_reset(uint32_t base);
 
@@ -110,34 +77,25 @@ static unsigned int msm_boot_uart_dm_reset(uint32_t base);
  */
 static uint32_t port_lookup[4];
 
-/* Extern functions */
-void udelay(unsigned usecs);
-
-/*
- * Helper function to keep track of Line Feed char "\n" with
- * Carriage Return "\r\n".
+/* TX ring, one per port. head and tail are free running; the difference
+ * is the number of queued chars. xfer_left counts the chars that were
+ * announced through NO_CHARS_FOR_TX but haven't been written to the FIFO
+ * yet; those are always the oldest chars in the ring.
  */
-static unsigned int
-msm_boot_uart_calculate_num_chars_to_write(char *data_in,
-				 uint32_t *num_of_chars)
-{
-	int i = 0, j = 0;
-
-	if ((data_in == NULL) || (*num_of_chars < 0)) {
-		return MSM_BOOT_UART_DM_E_INVAL;
-	}
-
-	for (i = 0, j = 0; i < *num_of_chars; i++, j++) {
-		if (data_in[i] == '\n') {
-			j++;
-		}
-
-	}
-
-	*num_of_chars = j;
+struct uart_dm_tx_ring {
+	char buf[UART_DM_TX_RING_SIZE];
+	unsigned int head;
+	unsigned int tail;
+	unsigned int xfer_left;
+};
+
+static struct uart_dm_tx_ring tx_ring[ARRAY_SIZE(port_lookup)];
+static struct uart_dm_tx_stats tx_stats;
+static timer_t tx_drain_timer;
+static int tx_async = 0;
 
-	return MSM_BOOT_UART_DM_E_SUCCESS;
-}
+/* Extern functions */
+void udelay(unsigned usecs);
 
 /*
  * Reset the UART
@@ -307,68 +265,119 @@ msm_boot_uart_dm_read(uint32_t base, unsigned int *data, int wait)
 
 /*
  * UART transmit operation
+ * Moves queued chars from the TX ring of a port into its TX FIFO. If wait
+ * is zero only what the FIFO can take right now is written; otherwise
+ * this spins until the ring is empty. Callers hold the critical section.
  */
-static unsigned int
-msm_boot_uart_dm_write(uint32_t base, char *data, unsigned int num_of_chars)
+static void msm_boot_uart_dm_tx_pump(int port, int wait)
 {
-	unsigned int tx_word_count = 0;
-	unsigned int tx_char_left = 0, tx_char = 0;
-	unsigned int tx_word = 0;
-	int i = 0;
-	char *tx_data = NULL;
-	uint8_t num_chars_written;
-
-	if ((data == NULL) || (num_of_chars <= 0)) {
-		return MSM_BOOT_UART_DM_E_INVAL;
-	}
+	struct uart_dm_tx_ring *ring = &tx_ring[port];
+	uint32_t base = port_lookup[port];
+	unsigned int n, i;
+	uint32_t word;
+
+	while (ring->xfer_left || ring->head != ring->tail) {
+		if (!ring->xfer_left) {
+			/* Write to NO_CHARS_FOR_TX register number of characters
+			 * to be transmitted. However, before writing TX_FIFO must
+			 * be empty as indicated by TX_READY interrupt in IMR register
+			 */
+			if (!(readl(MSM_BOOT_UART_DM_SR(base)) & MSM_BOOT_UART_DM_SR_TXEMT) &&
+			    !(readl(MSM_BOOT_UART_DM_ISR(base)) & MSM_BOOT_UART_DM_TX_READY)) {
+				if (!wait)
+					return;
+				udelay(1);
+				continue;
+			}
 
-	msm_boot_uart_calculate_num_chars_to_write(data, &num_of_chars);
+			n = ring->head - ring->tail;
+			if (n > UART_DM_TX_MAX_XFER)
+				n = UART_DM_TX_MAX_XFER;
 
-	tx_data = data;
+			writel(n, MSM_BOOT_UART_DM_NO_CHARS_FOR_TX(base));
 
-	/* Write to NO_CHARS_FOR_TX register number of characters
-	 * to be transmitted. However, before writing TX_FIFO must
-	 * be empty as indicated by TX_READY interrupt in IMR register
-	 */
+			/* Clear TX_READY interrupt */
+			writel(MSM_BOOT_UART_DM_GCMD_RES_TX_RDY_INT, MSM_BOOT_UART_DM_CR(base));
 
-	/* Check if transmit FIFO is empty.
-	 * If not we'll wait for TX_READY interrupt. */
-	if (!(readl(MSM_BOOT_UART_DM_SR(base)) & MSM_BOOT_UART_DM_SR_TXEMT)) {
-		while (!(readl(MSM_BOOT_UART_DM_ISR(base)) & MSM_BOOT_UART_DM_TX_READY)) {
+			ring->xfer_left = n;
+		}
+
+		/* Wait till TX FIFO has space */
+		if (!(readl(MSM_BOOT_UART_DM_SR(base)) & MSM_BOOT_UART_DM_SR_TXRDY)) {
+			if (!wait)
+				return;
 			udelay(1);
-			/* Kick watchdog? */
+			continue;
 		}
+
+		/* We use four-character word FIFO. Only the last word of a
+		 * transfer may be partially filled. */
+		n = (ring->xfer_left < 4) ? ring->xfer_left : 4;
+		word = 0;
+		for (i = 0; i < n; i++)
+			word |= (uint8_t) ring->buf[(ring->tail + i) &
+				(UART_DM_TX_RING_SIZE - 1)] << (i * 8);
+
+		writel(word, MSM_BOOT_UART_DM_TF(base, 0));
+
+		ring->tail += n;
+		ring->xfer_left -= n;
+		tx_stats.sent += n;
 	}
+}
 
-	/* We are here. FIFO is ready to be written. */
-	/* Write number of characters to be written */
-	writel(num_of_chars, MSM_BOOT_UART_DM_NO_CHARS_FOR_TX(base));
+/*
+ * Queue one char, expanding '\n' to "\r\n". Waits for ring space unless
+ * UART_DM_TX_DROP_WHEN_FULL is set and the drain timer is running, in
+ * which case the char is dropped. Callers hold the critical section.
+ */
+static int msm_boot_uart_dm_tx_queue(int port, char c)
+{
+	struct uart_dm_tx_ring *ring = &tx_ring[port];
+	unsigned int need = (c == '\n') ? 2 : 1;
+	unsigned int level;
+	bigtime_t start;
+
+	if (UART_DM_TX_RING_SIZE - (ring->head - ring->tail) < need) {
+		if (UART_DM_TX_DROP_WHEN_FULL && tx_async) {
+			tx_stats.dropped += need;
+			return -1;
+		}
 
-	/* Clear TX_READY interrupt */
-	writel(MSM_BOOT_UART_DM_GCMD_RES_TX_RDY_INT, MSM_BOOT_UART_DM_CR(base));
+		start = current_time_hires();
+		tx_stats.blocked++;
+		do {
+			/* Let interrupts (and the drain timer) in while we wait */
+			exit_critical_section();
+			enter_critical_section();
+			msm_boot_uart_dm_tx_pump(port, 0);
+		} while (UART_DM_TX_RING_SIZE - (ring->head - ring->tail) < need);
+		tx_stats.blocked_us += current_time_hires() - start;
+	}
 
-	/* We use four-character word FIFO. So we need to divide data into
-	 * four characters and write in UART_DM_TF register */
-	tx_word_count = (num_of_chars % 4) ? ((num_of_chars / 4) + 1) :
-	    (num_of_chars / 4);
-	tx_char_left = num_of_chars;
+	if (c == '\n')
+		ring->buf[ring->head++ & (UART_DM_TX_RING_SIZE - 1)] = '\r';
+	ring->buf[ring->head++ & (UART_DM_TX_RING_SIZE - 1)] = c;
+	tx_stats.queued += need;
 
-	for (i = 0; i < (int)tx_word_count; i++) {
-		tx_char = (tx_char_left < 4) ? tx_char_left : 4;
-		num_chars_written = pack_chars_into_words(tx_data, tx_char, &tx_word);
+	level = ring->head - ring->tail;
+	if (level > tx_stats.max_level)
+		tx_stats.max_level = level;
 
-		/* Wait till TX FIFO has space */
-		while (!(readl(MSM_BOOT_UART_DM_SR(base)) & MSM_BOOT_UART_DM_SR_TXRDY)) {
-			udelay(1);
-		}
+	return 0;
+}
+
+static enum handler_return
+uart_dm_tx_drain(struct timer *timer, time_t now, void *arg)
+{
+	unsigned int port;
 
-		/* TX FIFO has space. Write the chars */
-		writel(tx_word, MSM_BOOT_UART_DM_TF(base, 0));
-		tx_char_left = num_of_chars - (i + 1) * 4;
-		tx_data = tx_data + num_chars_written;
+	for (port = 0; port < ARRAY_SIZE(port_lookup); port++) {
+		if (port_lookup[port])
+			msm_boot_uart_dm_tx_pump(port, 0);
 	}
 
-	return MSM_BOOT_UART_DM_E_SUCCESS;
+	return INT_NO_RESCHEDULE;
 }
 
 /* Defining functions that's exposed to outside world and in coformance to
@@ -408,31 +417,138 @@ void uart_dm_init(uint8_t id, uint32_t gsbi_base, uint32_t uart_dm_base)
 	/* Intialize UART_DM */
 	msm_boot_uart_dm_init(uart_dm_base);
 
-	msm_boot_uart_dm_write(uart_dm_base, data, 44);
-
 	ASSERT(port < ARRAY_SIZE(port_lookup));
-	port_lookup[port++] = uart_dm_base;
+	port_lookup[port] = uart_dm_base;
+
+	enter_critical_section();
+	for (; *data; data++)
+		msm_boot_uart_dm_tx_queue(port, *data);
+	msm_boot_uart_dm_tx_pump(port, 1);
+	exit_critical_section();
+
+	port++;
 
 	/* Set UART init flag */
 	uart_init_flag = 1;
 }
 
+/* Start draining the TX rings from a periodic timer. From here on
+ * uart_putc() only writes what the TX FIFO can take without waiting.
+ * Needs the kernel timers, so call this from platform_init() or later.
+ */
+void uart_dm_tx_async_enable(void)
+{
+	if (!uart_init_flag || tx_async)
+		return;
+
+	timer_initialize(&tx_drain_timer);
+	timer_set_periodic(&tx_drain_timer, UART_DM_TX_DRAIN_MS,
+			   uart_dm_tx_drain, NULL);
+	tx_async = 1;
+}
+
+/* Stop the drain timer and push out everything that is still queued.
+ * Used before the kernel timers go away, e.g. on kernel entry.
+ */
+void uart_dm_tx_async_disable(void)
+{
+	unsigned int port;
+
+	if (!tx_async)
+		return;
+
+	enter_critical_section();
+	timer_cancel(&tx_drain_timer);
+	tx_async = 0;
+	exit_critical_section();
+
+	uart_dm_tx_dump_stats();
+
+	for (port = 0; port < ARRAY_SIZE(port_lookup); port++) {
+		if (port_lookup[port])
+			uart_flush_tx(port);
+	}
+}
+
 /* UART_DM uses four character word FIFO where as UART core
- * uses a character FIFO. so it's really inefficient to try
- * to write single character. But that's how dprintf has been
- * implemented.
+ * uses a character FIFO. Chars are queued in the TX ring and
+ * packed into words when they are moved into the FIFO.
  */
 int uart_putc(int port, char c)
 {
-	uint32_t uart_base = port_lookup[port];
+	int ret;
 
 	/* Don't do anything if UART is not initialized */
 	if (!uart_init_flag)
 		return -1;
 
-	msm_boot_uart_dm_write(uart_base, &c, 1);
+	enter_critical_section();
+	ret = msm_boot_uart_dm_tx_queue(port, c);
+	msm_boot_uart_dm_tx_pump(port, !tx_async);
+	exit_critical_section();
 
-	return 0;
+	return ret;
+}
+
+/* Queue a run of chars under one critical section and pump the FIFO once
+ * for all of them. Returns -1 if any char was dropped.
+ */
+int uart_write(int port, const char *buf, size_t len)
+{
+	int ret = 0;
+
+	/* Don't do anything if UART is not initialized */
+	if (!uart_init_flag)
+		return -1;
+
+	enter_critical_section();
+	while (len--) {
+		if (msm_boot_uart_dm_tx_queue(port, *buf++))
+			ret = -1;
+	}
+	msm_boot_uart_dm_tx_pump(port, !tx_async);
+	exit_critical_section();
+
+	return ret;
+}
+
+/* Synchronously drain the TX ring of a port. Safe to call with interrupts
+ * disabled; used on panic, reboot and before jumping to the kernel.
+ */
+void uart_flush_tx(int port)
+{
+	if (!uart_init_flag)
+		return;
+
+	enter_critical_section();
+	msm_boot_uart_dm_tx_pump(port, 1);
+	exit_critical_section();
+}
+
+void uart_dm_tx_get_stats(struct uart_dm_tx_stats *stats)
+{
+	enter_critical_section();
+	*stats = tx_stats;
+	exit_critical_section();
+}
+
+void uart_dm_tx_reset_stats(void)
+{
+	enter_critical_section();
+	memset(&tx_stats, 0, sizeof(tx_stats));
+	exit_critical_section();
+}
+
+void uart_dm_tx_dump_stats(void)
+{
+	struct uart_dm_tx_stats stats;
+
+	uart_dm_tx_get_stats(&stats);
+
+	dprintf(SPEW, "UART_DM: %u chars queued, %u sent, %u dropped, "
+		"%u blocked (%llu us), max ring level %u\n",
+		stats.queued, stats.sent, stats.dropped,
+		stats.blocked, stats.blocked_us, stats.max_level);
 }
 
 /* UART_DM uses four character word FIFO whereas uart_getc
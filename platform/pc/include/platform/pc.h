@@ -54,8 +54,13 @@
 #define INT_GP_FAULT		0x0d
 #define INT_PAGE_FAULT		0x0e
 
-/* APIC vectors */
+/*
+ * APIC vectors, 0x22 is free since the pic cascade never raises it. The
+ * spurious vector shares 0x27 with pic irq 7, which the pic also uses for
+ * its own spurious interrupts; platform_irq() tells them apart.
+ */
 #define INT_APIC_TIMER		0x22
+#define INT_APIC_SPURIOUS	0x27
 
 #define INT_SYSCALL			0x30
 
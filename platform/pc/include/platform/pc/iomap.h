@@ -26,6 +26,33 @@
 /* i8253/i8254 programmable interval timer registers */
 #define I8253_CONTROL_REG	0x43
 #define I8253_DATA_REG		0x40
+#define I8253_CH2_DATA_REG	0x42
+
+/* system control port B: pit channel 2 gate and output */
+#define SYSCTL_PORT_B		0x61
+#define SYSCTL_PIT2_GATE	0x01
+#define SYSCTL_SPEAKER		0x02
+#define SYSCTL_PIT2_OUT		0x20
+
+/* local apic, at the address in IA32_APIC_BASE */
+#define IA32_APIC_BASE_MSR	0x1b
+#define APIC_BASE_ENABLE	(1 << 11)
+#define APIC_BASE_ADDR_MASK	0xfffff000
+
+#define LAPIC_EOI		0x0b0
+#define LAPIC_SVR		0x0f0
+#define LAPIC_LVT_TIMER		0x320
+#define LAPIC_LVT_LINT0		0x350
+#define LAPIC_LVT_LINT1		0x360
+#define LAPIC_TIMER_INIT	0x380
+#define LAPIC_TIMER_CUR		0x390
+#define LAPIC_TIMER_DIV		0x3e0
+
+#define LAPIC_SVR_ENABLE	(1 << 8)
+#define LAPIC_LVT_MASKED	(1 << 16)
+#define LAPIC_LVT_EXTINT	(7 << 8)
+#define LAPIC_LVT_NMI		(4 << 8)
+#define LAPIC_TIMER_DIV_16	0x3
 
 /* i8042 keyboard controller registers */
 #define I8042_COMMAND_REG	0x64
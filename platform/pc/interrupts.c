@@ -40,6 +40,7 @@ void x86_unhandled_exception(struct x86_iframe *frame);
 
 #define ICW1 0x11
 #define ICW4 0x01
+#define OCW3_READ_ISR 0x0b
 
 struct int_handler_struct {
 	int_handler handler;
@@ -135,9 +136,25 @@ static void enable(unsigned int vector, bool enable)
 	}
 }
 
+/*
+ * INT_APIC_SPURIOUS arrives on the pic1 irq 7 vector. Only a real irq 7
+ * has its bit set in the pic's in-service register; anything else is an
+ * APIC or pic spurious interrupt, which must not be acknowledged.
+ */
+static bool is_spurious(unsigned int vector)
+{
+	if (vector != INT_APIC_SPURIOUS)
+		return false;
+
+	outp(PIC1, OCW3_READ_ISR);
+	return !(inp(PIC1) & (1 << (INT_APIC_SPURIOUS - PIC1_BASE)));
+}
+
 void issueEOI(unsigned int vector)
 {
-	if (vector >= PIC1_BASE && vector <= PIC1_BASE + 7) {
+	if (vector == INT_APIC_TIMER) {
+		platform_apic_eoi();
+	} else if (vector >= PIC1_BASE && vector <= PIC1_BASE + 7) {
 		outp(PIC1, 0x20);
 	} else if (vector >= PIC2_BASE && vector <= PIC2_BASE + 7) {
 		outp(PIC2, 0x20);
@@ -227,6 +244,8 @@ enum handler_return platform_irq(struct x86_iframe *frame)
 			break;
 		
 		default:
+			if (is_spurious(vector))
+				return INT_NO_RESCHEDULE;
 			if (int_handler_table[vector].handler)
 				ret = int_handler_table[vector].handler(int_handler_table[vector].arg);
 	}
@@ -6,6 +6,9 @@ CPU := generic
 MODULES += \
 	lib/cbuf
 
+DEFINES += \
+	PLATFORM_HAS_DYNAMIC_TIMER=1
+
 INCLUDES += \
 	-I$(LOCAL_DIR)/include
 
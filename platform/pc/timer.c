@@ -24,6 +24,7 @@
 #include <err.h>
 #include <reg.h>
 #include <debug.h>
+#include <string.h>
 #include <kernel/thread.h>
 #include <platform.h>
 #include <platform/interrupts.h>
@@ -33,134 +34,353 @@
 #include "platform_p.h"
 #include <arch/x86.h>
 
+/*
+ * Tickless timer: the TSC is the clock source for current_time() and
+ * current_time_hires(), and the local APIC timer in one shot mode raises an
+ * interrupt only when the kernel's next timer is due. Without a local APIC,
+ * PIT channel 0 in one shot mode (mode 0) stands in, good for up to ~55ms
+ * per shot; longer delays just take several shots.
+ */
+
 static platform_timer_callback t_callback;
 static void *callback_arg;
 
-static uint64_t next_trigger_time;
-static uint64_t next_trigger_delta;
+static enum {
+	PC_TIMER_NONE,
+	PC_TIMER_APIC,
+	PC_TIMER_PIT,
+} timer_hw;
+
+static uint64_t tsc_base;
+static uint64_t tsc_hz;
+static uint64_t tsc_per_ms;
+static uint64_t tsc_to_us;	/* 32.32 fixed point usecs per tsc tick */
+static uint64_t tsc_to_ms;	/* 22.42 fixed point msecs per tsc tick */
 
-static uint64_t timer_delta_time;
-static uint64_t timer_current_time;
+static addr_t apic_base;
+static uint32_t apic_per_ms;	/* apic timer counts per msec, after the divider */
+static uint64_t max_shot_tsc;	/* longest delay the hardware can count */
 
-static uint16_t divisor;
+static uint64_t next_trigger_tsc;	/* 0 when stopped */
+static time_t periodic_interval;
+
+static struct {
+	uint32_t ints;		/* timer interrupts taken */
+	uint32_t callbacks;	/* of which were due and called back */
+	uint32_t rearms;	/* of which were short of the deadline and rearmed */
+	uint32_t programs;	/* one shot requests from the kernel */
+	uint32_t stops;
+} pc_timer_stats;
+static time_t pc_timer_stats_since;	/* current_time() at the last reset */
 
 #define INTERNAL_FREQ 1193182ULL
-#define INTERNAL_FREQ_3X 3579546ULL
+#define CALIBRATE_MS 50
 
-status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, time_t interval)
+static inline uint64_t read_tsc(void)
+{
+	uint64_t tsc;
+
+	rdtscll(tsc);
+	return tsc;
+}
+
+/* multiply a tsc delta by a fixed point factor without overflowing */
+static inline uint64_t tsc_scale(uint64_t delta, uint64_t mult, uint shift)
+{
+	uint64_t hi = delta >> 32;
+	uint64_t lo = delta & 0xffffffff;
+
+	/* shift is 32 or more */
+	return ((hi * mult) >> (shift - 32)) + ((lo * mult) >> shift);
+}
+
+time_t current_time(void)
+{
+	if (!tsc_hz)
+		return 0;
+
+	return (time_t)tsc_scale(read_tsc() - tsc_base, tsc_to_ms, 42);
+}
+
+bigtime_t current_time_hires(void)
+{
+	if (!tsc_hz)
+		return 0;
+
+	return tsc_scale(read_tsc() - tsc_base, tsc_to_us, 32);
+}
+
+static inline uint32_t apic_read(uint32_t reg)
+{
+	return readl(apic_base + reg);
+}
+
+static inline void apic_write(uint32_t reg, uint32_t val)
+{
+	writel(val, apic_base + reg);
+}
+
+void platform_apic_eoi(void)
+{
+	apic_write(LAPIC_EOI, 0);
+}
+
+/* program the hardware to interrupt at (or, if out of range, before) when */
+static void program_timer(uint64_t when)
+{
+	uint64_t now = read_tsc();
+	uint64_t delta = (when > now) ? when - now : 0;
+	uint64_t count;
+
+	if (delta > max_shot_tsc)
+		delta = max_shot_tsc;
+
+	if (timer_hw == PC_TIMER_APIC) {
+		count = (delta * apic_per_ms) / tsc_per_ms;
+		if (count == 0)
+			count = 1;
+
+		apic_write(LAPIC_LVT_TIMER, INT_APIC_TIMER);
+		apic_write(LAPIC_TIMER_INIT, count);
+	} else {
+		count = (delta * INTERNAL_FREQ) / tsc_hz;
+		if (count == 0)
+			count = 1;
+
+		/* timer 0, mode 0 (interrupt on terminal count), LSB then MSB */
+		outp(I8253_CONTROL_REG, 0x30);
+		outp(I8253_DATA_REG, count & 0xff);
+		outp(I8253_DATA_REG, count >> 8);
+	}
+}
+
+static void stop_timer(void)
+{
+	next_trigger_tsc = 0;
+
+	if (timer_hw == PC_TIMER_APIC) {
+		apic_write(LAPIC_TIMER_INIT, 0);
+	} else {
+		/* a new control word holds the counter until a count is loaded */
+		outp(I8253_CONTROL_REG, 0x30);
+	}
+}
+
+status_t platform_set_oneshot_timer(platform_timer_callback callback, void *arg, time_t interval)
 {
 	enter_critical_section();
 
 	t_callback = callback;
 	callback_arg = arg;
-	
-	next_trigger_delta = (uint64_t) interval << 32;
-	next_trigger_time = timer_current_time + next_trigger_delta;
+	periodic_interval = 0;
+
+	next_trigger_tsc = read_tsc() + interval * tsc_per_ms;
+	pc_timer_stats.programs++;
+	program_timer(next_trigger_tsc);
 
 	exit_critical_section();
 
 	return NO_ERROR;
 }
 
-time_t current_time(void)
+status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, time_t interval)
 {
-	time_t time;
-	
 	enter_critical_section();
-	time = (time_t) (timer_current_time >> 32);
+
+	t_callback = callback;
+	callback_arg = arg;
+	periodic_interval = interval;
+
+	next_trigger_tsc = read_tsc() + interval * tsc_per_ms;
+	program_timer(next_trigger_tsc);
+
 	exit_critical_section();
-	
-	return time;
+
+	return NO_ERROR;
 }
 
-bigtime_t current_time_hires(void)
+void platform_stop_timer(void)
 {
-	bigtime_t time;
-	
 	enter_critical_section();
-	time = (bigtime_t) ((timer_current_time >> 22) * 1000) >> 10;
+
+	pc_timer_stats.stops++;
+	stop_timer();
+
 	exit_critical_section();
-	
-	return time;
 }
+
 static enum handler_return os_timer_tick(void *arg)
 {
-	uint64_t delta;
-	
-	timer_current_time += timer_delta_time;
-	
-	time_t time = current_time();
-	//bigtime_t btime = current_time_hires();
-	//printf_xy(71, 0, WHITE, "%08u", (uint32_t) time);
-	//printf_xy(63, 1, WHITE, "%016llu", (uint64_t) btime);
-	
-	if (t_callback && timer_current_time >= next_trigger_time) {
-		delta = timer_current_time - next_trigger_time;
-		next_trigger_time = timer_current_time + next_trigger_delta - delta;
-		
-		return t_callback(callback_arg, time);
-	} else {
+	platform_timer_callback callback;
+
+	pc_timer_stats.ints++;
+
+	if (!next_trigger_tsc || !t_callback)
 		return INT_NO_RESCHEDULE;
+
+	/* a delay longer than the hardware can count fires early, go again */
+	if (read_tsc() < next_trigger_tsc) {
+		pc_timer_stats.rearms++;
+		program_timer(next_trigger_tsc);
+		return INT_NO_RESCHEDULE;
+	}
+
+	callback = t_callback;
+	if (periodic_interval) {
+		next_trigger_tsc += periodic_interval * tsc_per_ms;
+		program_timer(next_trigger_tsc);
+	} else {
+		next_trigger_tsc = 0;
 	}
+
+	pc_timer_stats.callbacks++;
+
+	/* the callback may program the next shot */
+	return callback(callback_arg, current_time());
 }
 
-static void set_pit_frequency(uint32_t frequency)
+/* busy wait for ms on pit channel 2, which is free and has no irq */
+static void pit2_start(uint ms)
 {
-	uint32_t count, remainder;
-	
-	/* figure out the correct divisor for the desired frequency */
-	if (frequency <= 18) {
-		count = 0xffff;
-	} else if (frequency >= INTERNAL_FREQ) {
-		count = 1;
-	} else {
-		count = INTERNAL_FREQ_3X / frequency;
-		remainder = INTERNAL_FREQ_3X % frequency;
-		
-		if (remainder >= INTERNAL_FREQ_3X / 2) {
-			count += 1;
-		}
-		
-		count /= 3;
-		remainder = count % 3;
-		
-		if (remainder >= 1) {
-			count += 1;
-		}
+	uint32_t latch = (INTERNAL_FREQ * ms) / 1000;
+
+	outp(SYSCTL_PORT_B, (inp(SYSCTL_PORT_B) & ~SYSCTL_SPEAKER) | SYSCTL_PIT2_GATE);
+
+	/* timer 2, mode 0, LSB then MSB */
+	outp(I8253_CONTROL_REG, 0xb0);
+	outp(I8253_CH2_DATA_REG, latch & 0xff);
+	outp(I8253_CH2_DATA_REG, latch >> 8);
+}
+
+static void pit2_wait(void)
+{
+	while (!(inp(SYSCTL_PORT_B) & SYSCTL_PIT2_OUT))
+		;
+}
+
+static bool apic_init(void)
+{
+	uint32_t a, b, c, d;
+	uint64_t base;
+	uint32_t elapsed;
+
+	x86_cpuid(1, &a, &b, &c, &d);
+	if (!(d & X86_CPUID1_EDX_APIC) || !(d & X86_CPUID1_EDX_MSR))
+		return false;
+
+	base = read_msr(IA32_APIC_BASE_MSR);
+	if (!(base & APIC_BASE_ENABLE)) {
+		base |= APIC_BASE_ENABLE;
+		write_msr(IA32_APIC_BASE_MSR, base);
 	}
-		
-	divisor = count & 0xffff;
-	
-	/*
-	 * funky math that i don't feel like explaining. essentially 32.32 fixed
-	 * point representation of the configured timer delta.
-	 */
-	timer_delta_time = (3685982306ULL * count) >> 10;
-	
-	//dprintf(DEBUG, "set_pit_frequency: dt=%016llx\n", timer_delta_time);
-	//dprintf(DEBUG, "set_pit_frequency: divisor=%04x\n", divisor);
-	
+	apic_base = base & APIC_BASE_ADDR_MASK;
+
 	/*
-	 * setup the Programmable Interval Timer
-	 * timer 0, mode 2, binary counter, LSB followed by MSB
+	 * software enable, and keep the 8259s wired through LINT0 (virtual
+	 * wire mode) for the keyboard and the other legacy irqs
 	 */
-	outp(I8253_CONTROL_REG, 0x34);
-	outp(I8253_DATA_REG, divisor & 0xff); // LSB
-	outp(I8253_DATA_REG, divisor >> 8); // MSB
+	apic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | INT_APIC_SPURIOUS);
+	apic_write(LAPIC_LVT_LINT0, LAPIC_LVT_EXTINT);
+	apic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+
+	/* measure the apic timer rate against the pit */
+	apic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+	apic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | INT_APIC_TIMER);
+
+	pit2_start(CALIBRATE_MS);
+	apic_write(LAPIC_TIMER_INIT, 0xffffffff);
+	pit2_wait();
+	elapsed = 0xffffffff - apic_read(LAPIC_TIMER_CUR);
+	apic_write(LAPIC_TIMER_INIT, 0);
+
+	apic_per_ms = elapsed / CALIBRATE_MS;
+	if (apic_per_ms == 0)
+		return false;
+
+	return true;
+}
+
+static void tsc_init(void)
+{
+	uint32_t a, b, c, d;
+	uint64_t start;
+
+	x86_cpuid(1, &a, &b, &c, &d);
+	if (!(d & X86_CPUID1_EDX_TSC))
+		panic("pc timer: cpu has no TSC\n");
+
+	pit2_start(CALIBRATE_MS);
+	start = read_tsc();
+	pit2_wait();
+	tsc_hz = (read_tsc() - start) * (1000 / CALIBRATE_MS);
+
+	tsc_per_ms = tsc_hz / 1000;
+	tsc_to_us = (1000000ULL << 32) / tsc_hz;
+	tsc_to_ms = (1000ULL << 42) / tsc_hz;
+	tsc_base = read_tsc();
 }
 
 void platform_init_timer(void)
 {
-	timer_current_time = 0;
-	
-	set_pit_frequency(1000); // ~1ms granularity
+	tsc_init();
 
-	register_int_handler(INT_PIT, &os_timer_tick, NULL);
-	unmask_interrupt(INT_PIT);
+	if (apic_init()) {
+		timer_hw = PC_TIMER_APIC;
+		max_shot_tsc = (0xffffffffULL * tsc_per_ms) / apic_per_ms;
+		register_int_handler(INT_APIC_TIMER, &os_timer_tick, NULL);
+	} else {
+		timer_hw = PC_TIMER_PIT;
+		max_shot_tsc = (0xffffULL * tsc_hz) / INTERNAL_FREQ;
+		stop_timer();
+		register_int_handler(INT_PIT, &os_timer_tick, NULL);
+		unmask_interrupt(INT_PIT);
+	}
+
+	dprintf(INFO, "timer: tsc %u kHz, %s one shot timer (%u counts/ms)\n",
+	        (uint)(tsc_hz / 1000), timer_hw == PC_TIMER_APIC ? "apic" : "pit",
+	        timer_hw == PC_TIMER_APIC ? apic_per_ms : (uint)(INTERNAL_FREQ / 1000));
 }
 
 void platform_halt_timers(void)
 {
-	mask_interrupt(INT_PIT);
+	if (timer_hw == PC_TIMER_APIC)
+		apic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | INT_APIC_TIMER);
+	else
+		mask_interrupt(INT_PIT);
+}
+
+#if WITH_LIB_CONSOLE
+
+#include <lib/console.h>
+
+static int cmd_pctimer(int argc, const cmd_args *argv);
+
+STATIC_COMMAND_START
+	{ "pctimer", "pc timer interrupt counters [reset]", &cmd_pctimer },
+STATIC_COMMAND_END(pctimer);
+
+static int cmd_pctimer(int argc, const cmd_args *argv)
+{
+	time_t now = current_time();
+	time_t span = now - pc_timer_stats_since;
+
+	if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+		enter_critical_section();
+		memset(&pc_timer_stats, 0, sizeof(pc_timer_stats));
+		pc_timer_stats_since = now;
+		exit_critical_section();
+		return 0;
+	}
+
+	printf("%s one shot timer, tsc %u kHz, uptime %lu ms, counting for %lu ms\n",
+	       timer_hw == PC_TIMER_APIC ? "apic" : "pit", (uint)(tsc_hz / 1000), now, span);
+	printf("interrupts %u (%u/s), callbacks %u, rearms %u\n",
+	       pc_timer_stats.ints,
+	       span ? (uint)((uint64_t)pc_timer_stats.ints * 1000 / span) : 0,
+	       pc_timer_stats.callbacks, pc_timer_stats.rearms);
+	printf("programs %u, stops %u\n", pc_timer_stats.programs, pc_timer_stats.stops);
+
+	return 0;
 }
 
+#endif
@@ -8,7 +8,7 @@ MODULES += \
 	lib/partition \
 	lib/bcache \
 	lib/fs \
-	lib/fs/ext2 \
+	lib/fs/ext4 \
 	lib/gfx \
 	lib/gfxconsole \
 	lib/text \
@@ -0,0 +1,16 @@
+# top level project rules for the msm8660_surf-test project
+#
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+TARGET := msm8660_surf
+
+MODULES += \
+	app/tests \
+	app/shell
+
+DEBUG := 1
+
+# run the mmc through the ADM, so the ADM driver and its tests are built
+MMC_BOOT_ADM := 1
+
+DEFINES += WITH_DEBUG_UART=1
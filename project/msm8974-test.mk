@@ -0,0 +1,26 @@
+# top level project rules for the msm8974-test project
+#
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+TARGET := msm8974
+
+MODULES += \
+	lib/bio \
+	lib/memtest \
+	lib/bootparam \
+	app/tests \
+	app/shell
+
+DEBUG := 1
+EMMC_BOOT := 1
+
+DEFINES += WITH_DEBUG_UART=1
+DEFINES += DEVICE_TREE=1
+DEFINES += CRYPTO_BAM=1
+
+#Disable thumb mode
+ENABLE_THUMB := false
+
+ifeq ($(EMMC_BOOT),1)
+DEFINES += _EMMC_BOOT=1
+endif
@@ -6,6 +6,9 @@ TARGET := msm8974
 
 MODULES += app/aboot
 
+# publish the emmc and its partitions as bio devices
+MODULES += lib/bio
+
 DEBUG := 1
 EMMC_BOOT := 1
 ENABLE_SDHCI_SUPPORT := 0
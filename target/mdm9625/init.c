@@ -39,6 +39,7 @@
 #include <pm8x41.h>
 #include <reg.h>
 #include <platform/timer.h>
+#include <uart_dm.h>
 
 extern void smem_ptable_init(void);
 extern void smem_add_modem_partitions(struct ptable *flash_ptable);
@@ -145,6 +146,9 @@ void reboot_device(unsigned reboot_reason)
 {
 	uint32_t version = board_soc_version();
 
+	/* Push out any console output still queued for the UART */
+	uart_dm_tx_async_disable();
+
 	/* Write the reboot reason */
 	if(version >= 0x20000)
 		writel(reboot_reason, RESTART_REASON_ADDR_V2);
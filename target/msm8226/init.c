@@ -251,6 +251,9 @@ unsigned check_reboot_mode(void)
 
 void reboot_device(unsigned reboot_reason)
 {
+	/* Push out any console output still queued for the UART */
+	uart_dm_tx_async_disable();
+
 	writel(reboot_reason, RESTART_REASON_ADDR);
 
 	/* Configure PMIC for warm reset */
@@ -15,13 +15,14 @@ RAMDISK_ADDR     := BASE_ADDR+0x01000000
 SCRATCH_ADDR     := 0x48000000
 
 KEYS_USE_GPIO_KEYPAD := 1
+MMC_BOOT_ADM ?= 0
 
 DEFINES += DISPLAY_SPLASH_SCREEN=1
 DEFINES += DISPLAY_TYPE_LCDC=1
 DEFINES += DISPLAY_TYPE_MIPI=0
 DEFINES += DISPLAY_MIPI_PANEL_NOVATEK_BLUE=0
 DEFINES += DISPLAY_MIPI_PANEL_TOSHIBA=0
-DEFINES += MMC_BOOT_ADM=0
+DEFINES += MMC_BOOT_ADM=$(MMC_BOOT_ADM)
 DEFINES += DISPLAY_TYPE_HDMI=0
 DEFINES += ASYNC_RESET_CE=1
 
@@ -205,6 +205,9 @@ static unsigned target_check_power_on_reason(void)
 
 void reboot_device(unsigned reboot_reason)
 {
+	/* Push out any console output still queued for the UART */
+	uart_dm_tx_async_disable();
+
 	writel(reboot_reason, RESTART_REASON_ADDR);
 
 	/* Actually reset the chip */
@@ -449,6 +449,9 @@ void reboot_device(unsigned reboot_reason)
 {
 	uint32_t soc_ver = 0;
 
+	/* Push out any console output still queued for the UART */
+	uart_dm_tx_async_disable();
+
 	soc_ver = board_soc_version();
 
 	/* Write the reboot reason */
@@ -18,6 +18,9 @@ DEFINES += DISPLAY_SPLASH_SCREEN=1
 DEFINES += DISPLAY_TYPE_MIPI=1
 DEFINES += DISPLAY_TYPE_DSI6G=1
 
+# the i2c bus app/tests talks to, BLSP2 QUP4 on gpio 83/84
+DEFINES += I2C_TEST_BLSP_ID=2 I2C_TEST_QUP_ID=4
+
 MODULES += \
 	dev/keys \
 	dev/pmic/pm8x41 \